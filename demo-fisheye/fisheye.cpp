@@ -6,10 +6,16 @@
 #include "GLFW/glfw3.h"
 #include "imgui.h"
 #include "imgui_impl.h"
+#include "headless.h"
+#include "envmap.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <exception>
+#include <future>
+#include <thread>
 #include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -87,8 +93,10 @@ struct CameraManager {
 struct IblManager {
     std::vector<const char *> files;
     int id;
+    bool cubemap;
+    int cubemapSize; // 0: a quarter of the width of the envmap
 } g_ibl = {
-    {PATH_TO_ASSET_DIRECTORY "./topanga.hdr"}, 0
+    {PATH_TO_ASSET_DIRECTORY "./topanga.hdr"}, 0, true, 0
 };
 
 // -----------------------------------------------------------------------------
@@ -106,6 +114,15 @@ struct AppManager {
     struct {
         int on, frame, capture;
     } recorder;
+    struct {
+        bool on;
+        int backend;
+    } headless;
+    struct {
+        bool on;
+        float timeout;      // max wait for events (s)
+        int frames;         // frames to draw before idling
+    } idle;
     int frame, frameLimit;
 } g_app = {
     /*dir*/     {
@@ -118,6 +135,8 @@ struct AppManager {
                    2.2f, 2.0f
                 },
     /*record*/  {false, 0, 0},
+    /*headless*/{false, HEADLESS_BACKEND_EGL},
+    /*idle*/    {true, 0.5f, 0},
     /*frame*/   0, -1
 };
 
@@ -148,6 +167,7 @@ enum {
     UNIFORM_BACKGROUND_CLEAR_COLOR,
     UNIFORM_BACKGROUND_ENVMAP_SAMPLER,
     UNIFORM_BACKGROUND_FOVY,
+    UNIFORM_BACKGROUND_RESOLUTION,
 
     UNIFORM_COUNT
 };
@@ -273,6 +293,9 @@ void configureBackgroundProgram()
     glProgramUniform1f(g_gl.programs[PROGRAM_BACKGROUND],
                        g_gl.uniforms[UNIFORM_BACKGROUND_FOVY],
                        radians(g_camera.fovy));
+    glProgramUniform2f(g_gl.programs[PROGRAM_BACKGROUND],
+                       g_gl.uniforms[UNIFORM_BACKGROUND_RESOLUTION],
+                       g_framebuffer.w, g_framebuffer.h);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -335,6 +358,8 @@ bool loadBackgroundProgram()
     LOG("Loading {Background-Program}\n");
     if (g_camera.fisheye)
         djgp_push_string(djp, "#define FLAG_FISHEYE 1\n");
+    if (g_ibl.cubemap)
+        djgp_push_string(djp, "#define FLAG_CUBEMAP 1\n");
     djgp_push_string(djp, "#define BUFFER_BINDING_TRANSFORMS %i\n", STREAM_TRANSFORM);
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "background.glsl"));
     if (!djgp_to_gl(djp, 430, false, true, program)) {
@@ -351,6 +376,8 @@ bool loadBackgroundProgram()
         glGetUniformLocation(g_gl.programs[PROGRAM_BACKGROUND], "u_EnvmapSampler");
     g_gl.uniforms[UNIFORM_BACKGROUND_FOVY] =
         glGetUniformLocation(g_gl.programs[PROGRAM_BACKGROUND], "u_Fovy");
+    g_gl.uniforms[UNIFORM_BACKGROUND_RESOLUTION] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_BACKGROUND], "u_Resolution");
 
     configureBackgroundProgram();
 
@@ -489,41 +516,139 @@ bool loadBackFramebufferTexture()
 }
 
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Envmap Assets
+ *
+ * This is the CPU side of the envmap texture: it decodes the HDR image and,
+ * in cubemap mode, converts it to a cubemap with a full mip chain on all
+ * cores (see envmap.h); the cubemap is cached next to the HDR file, in a
+ * file named after the face size. It makes no GL calls, so that init() runs
+ * it on a worker thread while the programs compile.
+ */
+struct EnvmapAssets {
+    djg_texture *hdr;           // equirectangular mode
+    EnvmapCubemap *cubemap;     // cubemap mode
+    int cubemapSize;
+};
+
+static void releaseEnvmapAssets(EnvmapAssets *assets)
+{
+    if (assets->hdr)
+        djgt_release(assets->hdr);
+    if (assets->cubemap)
+        envmapReleaseCubemap(assets->cubemap);
+    *assets = EnvmapAssets();
+}
+
+static bool loadEnvmapAssets(EnvmapAssets *assets)
+{
+    const char *path = g_ibl.files[g_ibl.id];
+
+    *assets = EnvmapAssets();
+    LOG("Loading {Envmap}\n");
+    if (g_ibl.cubemap) {
+        int threadCnt = (int)std::thread::hardware_concurrency();
+        char cachePath[1024];
+        int w, h, c, size;
+
+        stbi_set_flip_vertically_on_load(1);
+        float *texels = stbi_loadf(path, &w, &h, &c, 3);
+        if (!texels)
+            return false;
+
+        size = g_ibl.cubemapSize > 0 ? g_ibl.cubemapSize : std::max(1, w / 4);
+        snprintf(cachePath, sizeof(cachePath), "%s.%i.cube", path, size);
+        assets->cubemap =
+            envmapCreateCubemap(texels, w, h, size, threadCnt, cachePath);
+        assets->cubemapSize = size;
+        stbi_image_free(texels);
+    } else {
+        assets->hdr = djgt_create(0);
+        djgt_push_image_hdr(assets->hdr, path, 1);
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Envmap Cubemap Texture
+ *
+ * The cubemap lets the background shader fetch the envmap without the atan
+ * and acos of the equirectangular mapping.
+ */
+static bool loadEnvmapCubeTexture(const EnvmapCubemap *cm, int size)
+{
+    GLuint *glt = &g_gl.textures[TEXTURE_ENVMAP];
+    int levelCnt = envmapCubemapLevelCount(cm);
+
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ENVMAP);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, *glt);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, levelCnt, GL_RGB9_E5, size, size);
+    for (int k = 0; k < levelCnt; ++k)
+    for (int face = 0; face < 6; ++face) {
+        int s;
+        const float *data = envmapCubemapFace(cm, k, face, &s);
+
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, k,
+                        0, 0, s, s, GL_RGB, GL_FLOAT, data);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    glActiveTexture(GL_TEXTURE0);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load the Envmap Texture
  *
- * This loads an RGB9_E5 texture used as a environment map.
+ * This loads an RGB9_E5 texture used as a environment map, either as is or
+ * as a cubemap, from the envmap assets.
  */
-bool loadEnvmapTexture()
+static bool loadEnvmapTexture(const EnvmapAssets &assets)
 {
-    LOG("Loading {Envmap-Texture}\n");
-    if (!g_ibl.files.empty()) {
-        int id = g_ibl.id;
-        const char *path = g_ibl.files[id];
+    GLuint *glt = &g_gl.textures[TEXTURE_ENVMAP];
 
-        if (glIsTexture(g_gl.textures[TEXTURE_ENVMAP]))
-            glDeleteTextures(1, &g_gl.textures[TEXTURE_ENVMAP]);
-        glGenTextures(1, &g_gl.textures[TEXTURE_ENVMAP]);
+    if (glIsTexture(*glt))
+        glDeleteTextures(1, glt);
+    glGenTextures(1, glt);
 
-        djg_texture *djgt = djgt_create(0);
-        GLuint *glt = &g_gl.textures[TEXTURE_ENVMAP];
+    if (assets.cubemap)
+        return loadEnvmapCubeTexture(assets.cubemap, assets.cubemapSize);
 
-        glActiveTexture(GL_TEXTURE0 + TEXTURE_ENVMAP);
-        djgt_push_image_hdr(djgt, path, 1);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ENVMAP);
+    if (!djgt_to_gl(assets.hdr, GL_TEXTURE_2D, GL_RGB9_E5, 1, 1, glt)) {
+        LOG("=> Failure <=\n");
 
-        if (!djgt_to_gl(djgt, GL_TEXTURE_2D, GL_RGB9_E5, 1, 1, glt)) {
+        return false;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+bool loadEnvmapTexture()
+{
+    LOG("Loading {Envmap-Texture}\n");
+    if (!g_ibl.files.empty()) {
+        EnvmapAssets assets;
+
+        if (!loadEnvmapAssets(&assets)) {
             LOG("=> Failure <=\n");
-            djgt_release(djgt);
 
             return false;
         }
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glActiveTexture(GL_TEXTURE0);
+        bool v = loadEnvmapTexture(assets);
+        releaseEnvmapAssets(&assets);
 
-        djgt_release(djgt);
+        return v;
     }
     return (glGetError() == GL_NO_ERROR);
 }
@@ -531,6 +656,9 @@ bool loadEnvmapTexture()
 // -----------------------------------------------------------------------------
 /**
  * Load All Textures
+ *
+ * The envmap texture is not part of it: init() loads its assets on a worker
+ * thread and uploads them last.
  */
 bool loadTextures()
 {
@@ -538,7 +666,6 @@ bool loadTextures()
 
     if (v) v&= loadSceneFramebufferTexture();
     if (v) v&= loadBackFramebufferTexture();
-    if (v) v&= loadEnvmapTexture();
 
     return v;
 }
@@ -758,11 +885,51 @@ bool loadFramebuffers()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Startup Timings
+ *
+ * The clock starts with main(); init() logs the duration of each of its
+ * phases, and render() the time to the first frame.
+ */
+static double startupClock()
+{
+    static const std::chrono::steady_clock::time_point epoch =
+        std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> dt =
+        std::chrono::steady_clock::now() - epoch;
+
+    return dt.count();
+}
+
+static double logStartupPhase(const char *name, double t0)
+{
+    double t1 = startupClock();
+
+    LOG("Note: {%s} loaded in %.1f ms\n", name, t1 - t0);
+
+    return t1;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Initialize the Demo
+ *
+ * The envmap is decoded (and converted to a cubemap) on a worker thread
+ * (see loadEnvmapAssets) while the main thread creates the GL objects and
+ * compiles the programs; its texture is uploaded last.
+ */
 void init()
 {
+    EnvmapAssets envmapAssets = EnvmapAssets(); // outlives its worker
+    std::future<bool> envmap;
+    double t = startupClock();
     bool v = true;
     int i;
 
+    if (!g_ibl.files.empty())
+        envmap = std::async(std::launch::async, &loadEnvmapAssets, &envmapAssets);
+
     for (i = 0; i < CLOCK_COUNT; ++i) {
         if (g_gl.clocks[i])
             djgc_release(g_gl.clocks[i]);
@@ -770,10 +937,29 @@ void init()
     }
 
     if (v) v&= loadTextures();
+    t = logStartupPhase("Textures", t);
     if (v) v&= loadBuffers();
+    t = logStartupPhase("Buffers", t);
     if (v) v&= loadFramebuffers();
+    t = logStartupPhase("Framebuffers", t);
     if (v) v&= loadVertexArrays();
+    t = logStartupPhase("VertexArrays", t);
     if (v) v&= loadPrograms();
+    t = logStartupPhase("Programs", t);
+
+    // the worker is joined even if a step failed
+    if (envmap.valid()) {
+        bool decoded = envmap.get();
+
+        LOG("Loading {Envmap-Texture}\n");
+        if (!decoded) {
+            LOG("=> Failure <=\n");
+            v = false;
+        }
+        if (v) v&= loadEnvmapTexture(envmapAssets);
+        releaseEnvmapAssets(&envmapAssets);
+        t = logStartupPhase("Envmap", t);
+    }
 
     if (!v) throw std::exception();
 }
@@ -807,6 +993,18 @@ void release()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Check whether the Scene has Reached its Sampling Rate
+ *
+ * The background is deterministic, so every pass draws the same image and
+ * the scene is complete after the first one.
+ */
+bool isSceneComplete()
+{
+    return g_framebuffer.pass > 0;
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Render the Scene
@@ -982,6 +1180,11 @@ void renderViewer(double cpuDt, double gpuDt)
                 loadBackgroundProgram();
                 g_framebuffer.flags.reset = true;
             }
+            if (ImGui::Checkbox("Cubemap", &g_ibl.cubemap)) {
+                loadEnvmapTexture();
+                loadBackgroundProgram();
+                g_framebuffer.flags.reset = true;
+            }
         }
         ImGui::End();
 
@@ -1040,9 +1243,51 @@ void render()
     djgc_stop(g_gl.clocks[CLOCK_SPF]);
     djgc_ticks(g_gl.clocks[CLOCK_SPF], &cpuDt, &gpuDt);
     renderViewer(cpuDt, gpuDt);
-    renderBack();
+    if (!g_app.headless.on) // there is no window to blit to
+        renderBack();
+    if (g_app.frame == 0) {
+        LOG("Note: time to first frame %.1f ms\n", startupClock());
+    }
     ++g_app.frame;
 }
+
+// -----------------------------------------------------------------------------
+/**
+ * Save the Composited Framebuffer
+ *
+ * Writes the back framebuffer to a PNG file in the output directory.
+ */
+void saveBackFramebuffer(const char *name)
+{
+    char path[1024];
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_BACK]);
+    strcat2(path, g_app.dir.output, name);
+    LOG("Note: saving %s.png\n", path);
+    djgt_save_glcolorbuffer_png(GL_COLOR_ATTACHMENT0, GL_RGBA, path);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Idle Scheduling
+ *
+ * Once the scene is complete, the main loop stops drawing and waits for
+ * events, and the window keeps showing the last frame. Input events wake
+ * the viewer for a few frames so that the HUD can respond to them.
+ */
+#define IDLE_WAKE_FRAMES 3
+void wakeViewer()
+{
+    g_app.idle.frames = IDLE_WAKE_FRAMES;
+}
+
+bool isViewerIdle()
+{
+    return g_app.idle.on && g_app.idle.frames == 0
+        && !g_framebuffer.flags.reset && isSceneComplete()
+        && !g_app.recorder.on;
+}
 ////////////////////////////////////////////////////////////////////////////////
 
 // -----------------------------------------------------------------------------
@@ -1052,6 +1297,7 @@ keyboardCallback(
     int key, int scancode, int action, int mods
 ) {
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureKeyboard)
         return;
 
@@ -1073,6 +1319,7 @@ keyboardCallback(
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 }
@@ -1084,6 +1331,7 @@ void mouseMotionCallback(GLFWwindow* window, double x, double y)
            dy = y - y0;
 
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 
@@ -1112,6 +1360,7 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
     ImGuiIO& io = ImGui::GetIO();
     ImGui_ImplGlfw_ScrollCallback(window, xoffset, yoffset);
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 
@@ -1120,16 +1369,84 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
     g_framebuffer.flags.reset = true;
 }
 
+// the window content was damaged, or its focus changed: redraw
+void windowRefreshCallback(GLFWwindow* window)
+{
+    wakeViewer();
+}
+
+void windowFocusCallback(GLFWwindow* window, int focused)
+{
+    wakeViewer();
+}
+
 void usage(const char *app)
 {
     printf("%s -- OpenGL Merl Renderer\n", app);
     printf("usage: %s --merl merl1 merl2 ... --envmap env1 env2 ... "
-           "--npf-data path_to_uber_texture_data --shader-dir path_to_shaders\n", app);
+           "--npf-data path_to_uber_texture_data --shader-dir path_to_shaders "
+           "[--cubemap-size n --no-cubemap] [--no-idle] "
+           "[--headless egl|osmesa --output-dir dir --frame-limit n]\n", app);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Render without a Window
+ *
+ * Runs the same init()/render() code in an offscreen context until the
+ * image is complete (or the frame limit is reached), and saves the
+ * composited framebuffer to the output directory.
+ */
+int mainHeadless()
+{
+    g_app.viewer.hud = false;
+    if (!headlessInit(g_app.headless.backend,
+                      VIEWER_DEFAULT_WIDTH, VIEWER_DEFAULT_HEIGHT)) {
+        LOG("=> Failure <=\n");
+        return -1;
+    }
+
+    // Load OpenGL functions
+    LOG("Loading {OpenGL}\n");
+    if (!gladLoadGLLoader((GLADloadproc)headlessGetProcAddress)) {
+        LOG("gladLoadGLLoader failed\n");
+        headlessShutdown();
+        return -1;
+    }
+
+    LOG("-- Begin -- Demo (headless)\n");
+    try {
+        init();
+        do {
+            render();
+        } while (g_app.frameLimit < 0
+            ? !isSceneComplete()
+            : g_app.frame < g_app.frameLimit);
+        saveBackFramebuffer("headless");
+
+        release();
+        headlessShutdown();
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        headlessShutdown();
+        LOG("(!) Demo Killed (!)\n");
+
+        return EXIT_FAILURE;
+    } catch (...) {
+        headlessShutdown();
+        LOG("(!) Demo Killed (!)\n");
+
+        return EXIT_FAILURE;
+    }
+    LOG("-- End -- Demo\n");
+
+    return 0;
 }
 
 // -----------------------------------------------------------------------------
 int main(int argc, const char **argv)
 {
+    startupClock(); // starts the clock
     for (int i = 1; i < argc; ++i) {
         if (!strcmp("--envmap", argv[i])) {
             g_ibl.files.resize(0);
@@ -1140,9 +1457,35 @@ int main(int argc, const char **argv)
         } else if (!strcmp("--shader-dir", argv[i])) {
             g_app.dir.shader = argv[++i];
             LOG("Note: shader dir set to %s\n", g_app.dir.shader);
+        } else if (!strcmp("--cubemap-size", argv[i]) && i + 1 < argc) {
+            g_ibl.cubemapSize = atoi(argv[++i]);
+            LOG("Note: cubemap size set to %i\n", g_ibl.cubemapSize);
+        } else if (!strcmp("--no-cubemap", argv[i])) {
+            g_ibl.cubemap = false;
+            LOG("Note: cubemap disabled\n");
+        } else if (!strcmp("--no-idle", argv[i])) {
+            g_app.idle.on = false;
+            LOG("Note: idle mode disabled\n");
+        } else if (!strcmp("--output-dir", argv[i]) && i + 1 < argc) {
+            g_app.dir.output = argv[++i];
+            LOG("Note: output directory set to %s\n", g_app.dir.output);
+        } else if (!strcmp("--frame-limit", argv[i]) && i + 1 < argc) {
+            g_app.frameLimit = atoi(argv[++i]);
+            LOG("Note: frame limit set to %i\n", g_app.frameLimit);
+        } else if (!strcmp("--headless", argv[i]) && i + 1 < argc) {
+            g_app.headless.backend = headlessParseBackend(argv[++i]);
+            g_app.headless.on = true;
+            if (g_app.headless.backend < 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            LOG("Note: headless rendering with %s\n", argv[i]);
         }
     }
 
+    if (g_app.headless.on)
+        return mainHeadless();
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -1166,6 +1509,8 @@ int main(int argc, const char **argv)
     glfwSetCursorPosCallback(window, &mouseMotionCallback);
     glfwSetMouseButtonCallback(window, &mouseButtonCallback);
     glfwSetScrollCallback(window, &mouseScrollCallback);
+    glfwSetWindowRefreshCallback(window, &windowRefreshCallback);
+    glfwSetWindowFocusCallback(window, &windowFocusCallback);
 
     // Load OpenGL functions
     LOG("Loading {OpenGL}\n");
@@ -1183,7 +1528,16 @@ int main(int argc, const char **argv)
         init();
 
         while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
+            // wait for events instead of redrawing the same frame
+            if (isViewerIdle()) {
+                glfwWaitEventsTimeout(g_app.idle.timeout);
+                if (isViewerIdle())
+                    continue;
+            } else {
+                glfwPollEvents();
+            }
+            if (g_app.idle.frames > 0)
+                --g_app.idle.frames;
 
             glClearColor(0.8, 0.8, 0.8, 1.0);
             glClear(GL_COLOR_BUFFER_BIT);
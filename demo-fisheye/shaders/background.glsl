@@ -3,7 +3,12 @@
 // --------------------------------------------------
 uniform vec3 u_ClearColor;
 uniform float u_Fovy;
+uniform vec2 u_Resolution;
+#if FLAG_CUBEMAP
+uniform samplerCube u_EnvmapSampler;
+#else
 uniform sampler2D u_EnvmapSampler;
+#endif
 
 struct Transform {
 	mat4 modelView;
@@ -19,10 +24,14 @@ uniform Transforms {
 
 vec3 evalEnvmap(vec3 dir)
 {
+#if FLAG_CUBEMAP
+	return texture(u_EnvmapSampler, dir).rgb;
+#else
 	float pi = 3.14159265359;
 	float u1 = atan(dir.x, dir.y) / pi * 0.5 + 0.5;
 	float u2 = 1.0 - acos(dir.z) / pi;
 	return texture(u_EnvmapSampler, vec2(u1, u2)).rgb;
+#endif
 }
 
 vec3 inv(vec3 x)
@@ -60,10 +69,10 @@ layout(location = 0) in vec3 i_TexCoord;
 layout(location = 0) out vec4 o_FragColor;
 
 void main() {
-    vec2 texCoord = gl_FragCoord.xy / vec2(1680, 1050);
+    vec2 texCoord = gl_FragCoord.xy / u_Resolution;
     //texCoord = floor(texCoord * 256.0f) / 256.0f;
     texCoord = 2.0 * texCoord - 1.0;
-    texCoord*= tan(u_Fovy / 2.0) * vec2(1680.0/1050.0, 1.0);
+    texCoord*= tan(u_Fovy / 2.0) * vec2(u_Resolution.x / u_Resolution.y, 1.0);
 
     vec3 w;
 #if FLAG_FISHEYE
@@ -4,12 +4,25 @@
 #include "imgui.h"
 #include "imgui_impl.h"
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <exception>
 
 #define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
 
+// -----------------------------------------------------------------------------
+// milliseconds since the first call (made at the start of main)
+static double startupClock()
+{
+	static const std::chrono::steady_clock::time_point epoch =
+		std::chrono::steady_clock::now();
+	std::chrono::duration<double, std::milli> dt =
+		std::chrono::steady_clock::now() - epoch;
+
+	return dt.count();
+}
+
 // -----------------------------------------------------------------------------
 void renderGui()
 {
@@ -88,6 +101,7 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 // -----------------------------------------------------------------------------
 int main(int argc, char **argv)
 {
+	startupClock(); // starts the clock
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -120,7 +134,7 @@ int main(int argc, char **argv)
 		ImGui_ImplGlfwGL3_Init(window, false);
 		ImGui::StyleColorsDark();
 
-		while (!glfwWindowShouldClose(window)) {
+		for (int frame = 0; !glfwWindowShouldClose(window); ++frame) {
 			glfwPollEvents();
 
 			glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
@@ -128,6 +142,9 @@ int main(int argc, char **argv)
 			ImGui_ImplGlfwGL3_NewFrame();
 			renderGui();
 			ImGui_ImplGlfwGL3_RenderDrawData(ImGui::GetDrawData());
+			if (frame == 0) {
+				LOG("Note: time to first frame %.1f ms\n", startupClock());
+			}
 			glfwSwapBuffers(window);
 		}
 
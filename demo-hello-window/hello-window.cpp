@@ -3,11 +3,14 @@
 #include "GLFW/glfw3.h"
 #include "imgui.h"
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 
 int main(int argc, char **argv)
 {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -28,10 +31,16 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
-	while (!glfwWindowShouldClose(window))
+	for (int frame = 0; !glfwWindowShouldClose(window); ++frame)
 	{
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
+		if (frame == 0)
+		{
+			std::chrono::duration<double, std::milli> dt =
+				std::chrono::steady_clock::now() - start;
+			printf("Note: time to first frame %.1f ms\n", dt.count());
+		}
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
@@ -6,9 +6,12 @@
 #include "GLFW/glfw3.h"
 #include "imgui.h"
 #include "imgui_impl.h"
+#include "headless.h"
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -127,6 +130,10 @@ struct AppManager {
     struct {
         int on, frame, capture;
     } recorder;
+    struct {
+        bool on;
+        int backend;
+    } headless;
     int frame, frameLimit;
 } g_app = {
     /*dir*/     {
@@ -139,6 +146,7 @@ struct AppManager {
                    2.2f, 0.4f
                 },
     /*record*/  {false, 0, 0},
+    /*headless*/{false, HEADLESS_BACKEND_EGL},
     /*frame*/   0, -1
 };
 
@@ -884,8 +892,36 @@ bool loadFramebuffers()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Startup Timings
+ *
+ * The clock starts with main(); init() logs the duration of each of its
+ * phases, and render() the time to the first frame.
+ */
+static double startupClock()
+{
+    static const std::chrono::steady_clock::time_point epoch =
+        std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> dt =
+        std::chrono::steady_clock::now() - epoch;
+
+    return dt.count();
+}
+
+static double logStartupPhase(const char *name, double t0)
+{
+    double t1 = startupClock();
+
+    LOG("Note: {%s} loaded in %.1f ms\n", name, t1 - t0);
+
+    return t1;
+}
+
+// -----------------------------------------------------------------------------
 void init()
 {
+    double t = startupClock();
     bool v = true;
     int i;
 
@@ -896,10 +932,15 @@ void init()
     }
 
     if (v) v&= loadTextures();
+    t = logStartupPhase("Textures", t);
     if (v) v&= loadBuffers();
+    t = logStartupPhase("Buffers", t);
     if (v) v&= loadFramebuffers();
+    t = logStartupPhase("Framebuffers", t);
     if (v) v&= loadVertexArrays();
+    t = logStartupPhase("VertexArrays", t);
     if (v) v&= loadPrograms();
+    t = logStartupPhase("Programs", t);
 
     if (!v) throw std::exception();
 }
@@ -1244,10 +1285,31 @@ void render()
     djgc_stop(g_gl.clocks[CLOCK_SPF]);
     djgc_ticks(g_gl.clocks[CLOCK_SPF], &cpuDt, &gpuDt);
     renderGui(cpuDt, gpuDt);
-    renderBack();
+    if (!g_app.headless.on) // there is no window to blit to
+        renderBack();
+    if (g_app.frame == 0) {
+        LOG("Note: time to first frame %.1f ms\n", startupClock());
+    }
     ++g_app.frame;
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Save the Composited Framebuffer
+ *
+ * Writes the back framebuffer to a PNG file in the output directory.
+ */
+void saveBackFramebuffer(const char *name)
+{
+    char path[1024];
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_BACK]);
+    strcat2(path, g_app.dir.output, name);
+    LOG("Note: saving %s.png\n", path);
+    djgt_save_glcolorbuffer_png(GL_COLOR_ATTACHMENT0, GL_RGBA, path);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -1326,12 +1388,93 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 void usage(const char *app)
 {
     printf("%s -- OpenGL Terrain Renderer\n", app);
-    printf("usage: %s --shader-dir path_to_shader_dir\n", app);
+    printf("usage: %s --shader-dir path_to_shader_dir"
+           " [--headless egl|osmesa --output-dir dir --frame-limit n]\n", app);
+}
+
+// the subdivision is refined incrementally, one step per frame
+#define HEADLESS_FRAME_COUNT 64
+
+// -----------------------------------------------------------------------------
+/**
+ * Render without a Window
+ *
+ * Runs the same init()/render() code in an offscreen context for
+ * HEADLESS_FRAME_COUNT frames (or up to the frame limit), and saves the
+ * composited framebuffer to the output directory.
+ */
+int mainHeadless()
+{
+    g_app.viewer.hud = false;
+    if (!headlessInit(g_app.headless.backend,
+                      VIEWER_DEFAULT_WIDTH, VIEWER_DEFAULT_HEIGHT)) {
+        LOG("=> Failure <=\n");
+        return -1;
+    }
+
+    // Load OpenGL functions
+    LOG("Loading {OpenGL}\n");
+    if (!gladLoadGLLoader((GLADloadproc)headlessGetProcAddress)) {
+        LOG("gladLoadGLLoader failed\n");
+        headlessShutdown();
+        return -1;
+    }
+    log_debug_output();
+
+    LOG("-- Begin -- Demo (headless)\n");
+    try {
+        init();
+        do {
+            render();
+        } while (g_app.frame < (g_app.frameLimit < 0
+            ? HEADLESS_FRAME_COUNT
+            : g_app.frameLimit));
+        saveBackFramebuffer("headless");
+
+        release();
+        headlessShutdown();
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        headlessShutdown();
+        LOG("(!) Demo Killed (!)\n");
+
+        return EXIT_FAILURE;
+    } catch (...) {
+        headlessShutdown();
+        LOG("(!) Demo Killed (!)\n");
+
+        return EXIT_FAILURE;
+    }
+    LOG("-- End -- Demo\n");
+
+    return 0;
 }
 
 // -----------------------------------------------------------------------------
 int main(int argc, char **argv)
 {
+    startupClock(); // starts the clock
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--output-dir", argv[i]) && i + 1 < argc) {
+            g_app.dir.output = argv[++i];
+            LOG("Note: output directory set to %s\n", g_app.dir.output);
+        } else if (!strcmp("--frame-limit", argv[i]) && i + 1 < argc) {
+            g_app.frameLimit = atoi(argv[++i]);
+            LOG("Note: frame limit set to %i\n", g_app.frameLimit);
+        } else if (!strcmp("--headless", argv[i]) && i + 1 < argc) {
+            g_app.headless.backend = headlessParseBackend(argv[++i]);
+            g_app.headless.on = true;
+            if (g_app.headless.backend < 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            LOG("Note: headless rendering with %s\n", argv[i]);
+        }
+    }
+
+    if (g_app.headless.on)
+        return mainHeadless();
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -6,11 +6,16 @@
 #include "GLFW/glfw3.h"
 #include "imgui.h"
 #include "imgui_impl.h"
+#include "headless.h"
+#include "profiler.h"
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <algorithm>
+#include <chrono>
+#include <future>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -123,6 +128,15 @@ struct AppManager {
     struct {
         int on, frame, capture;
     } recorder;
+    struct {
+        bool on;
+        int backend;
+    } headless;
+    struct {
+        bool on;
+        float timeout;      // max wait for events (s)
+        int frames;         // frames to draw before idling
+    } idle;
     int frame, frameLimit;
 } g_app = {
     /*dir*/     {
@@ -135,6 +149,8 @@ struct AppManager {
                    2.2f, 0.4f
                 },
     /*record*/  {false, 0, 0},
+    /*headless*/{false, HEADLESS_BACKEND_EGL},
+    /*idle*/    {true, 0.5f, 0},
     /*frame*/   0, -1
 };
 
@@ -787,18 +803,29 @@ bool loadBackFramebufferTexture()
 
 // -----------------------------------------------------------------------------
 /**
- * Load the Slope Texture Map
+ * Load the Dmap Assets
  *
- * This loads an RG32F texture used as a slope map
+ * This is the CPU side of the displacement and slope textures: it decodes
+ * the 16-bit PNG and computes the slopes from central differences. It makes
+ * no GL calls, so that init() runs it on a worker thread while the programs
+ * compile.
  */
-void loadSmapTexture(const djg_texture *dmap)
+struct DmapAssets {
+    djg_texture *dmap;
+    std::vector<float> smap;    // RG, see loadSmapTexture
+};
+
+static void loadDmapAssets(DmapAssets *assets)
 {
-    int w = dmap->next->x;
-    int h = dmap->next->y;
-    const uint16_t *texels = (const uint16_t *)dmap->next->texels;
-    int mipcnt = djgt__mipcnt(w, h, 1);
-    std::vector<float> smap(w * h * 2);
+    LOG("Loading {Dmap}\n");
+    assets->dmap = djgt_create(1);
+    djgt_push_image_u16(assets->dmap, g_terrain.dmap.pathToFile.c_str(), 1);
 
+    int w = assets->dmap->next->x;
+    int h = assets->dmap->next->y;
+    const uint16_t *texels = (const uint16_t *)assets->dmap->next->texels;
+
+    assets->smap.resize(w * h * 2);
     for (int j = 0; j < h; ++j)
         for (int i = 0; i < w; ++i) {
             int i1 = std::max(0, i - 1);
@@ -816,9 +843,22 @@ void loadSmapTexture(const djg_texture *dmap)
             float slope_x = (float)w * 0.5f * (z_r - z_l);
             float slope_y = (float)h * 0.5f * (z_t - z_b);
 
-            smap[2 * (i + w * j)] = slope_x;
-            smap[1 + 2 * (i + w * j)] = slope_y;
+            assets->smap[2 * (i + w * j)] = slope_x;
+            assets->smap[1 + 2 * (i + w * j)] = slope_y;
         }
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Slope Texture Map
+ *
+ * This loads an RG32F texture used as a slope map
+ */
+void loadSmapTexture(const DmapAssets &assets)
+{
+    int w = assets.dmap->next->x;
+    int h = assets.dmap->next->y;
+    int mipcnt = djgt__mipcnt(w, h, 1);
 
     if (glIsTexture(g_gl.textures[TEXTURE_SMAP]))
         glDeleteTextures(1, &g_gl.textures[TEXTURE_SMAP]);
@@ -827,7 +867,7 @@ void loadSmapTexture(const djg_texture *dmap)
     glActiveTexture(GL_TEXTURE0 + TEXTURE_SMAP);
     glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_SMAP]);
     glTexStorage2D(GL_TEXTURE_2D, mipcnt, GL_RG32F, w, h);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RG, GL_FLOAT, &smap[0]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RG, GL_FLOAT, &assets.smap[0]);
     glGenerateMipmap(GL_TEXTURE_2D);
     glTexParameteri(GL_TEXTURE_2D,
         GL_TEXTURE_MIN_FILTER,
@@ -844,39 +884,32 @@ void loadSmapTexture(const djg_texture *dmap)
 /**
  * Load the Displacement Texture
  *
- * This loads an R16 texture used as a displacement map
+ * This loads an R16 texture used as a displacement map, and the slope map
+ * that goes with it
  */
-bool loadDmapTexture()
+bool loadDmapTexture(const DmapAssets &assets)
 {
-    if (!g_terrain.dmap.pathToFile.empty()) {
-        djg_texture *djgt = djgt_create(1);
-        GLuint *glt = &g_gl.textures[TEXTURE_DMAP];
-
-        LOG("Loading {Dmap-Texture}\n");
-        djgt_push_image_u16(djgt, g_terrain.dmap.pathToFile.c_str(), 1);
+    GLuint *glt = &g_gl.textures[TEXTURE_DMAP];
 
-        // load smap from dmap
-        loadSmapTexture(djgt);
+    LOG("Loading {Dmap-Texture}\n");
+    loadSmapTexture(assets);
 
-        glActiveTexture(GL_TEXTURE0 + TEXTURE_DMAP);
-        if (!djgt_to_gl(djgt, GL_TEXTURE_2D, GL_R16, 1, 1, glt)) {
-            LOG("=> Failure <=\n");
-            djgt_release(djgt);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_DMAP);
+    if (!djgt_to_gl(assets.dmap, GL_TEXTURE_2D, GL_R16, 1, 1, glt)) {
+        LOG("=> Failure <=\n");
 
-            return false;
-        }
-        glTexParameteri(GL_TEXTURE_2D,
-            GL_TEXTURE_MIN_FILTER,
-            GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D,
-            GL_TEXTURE_WRAP_S,
-            GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D,
-            GL_TEXTURE_WRAP_T,
-            GL_CLAMP_TO_EDGE);
-        glActiveTexture(GL_TEXTURE0);
-        djgt_release(djgt);
+        return false;
     }
+    glTexParameteri(GL_TEXTURE_2D,
+        GL_TEXTURE_MIN_FILTER,
+        GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,
+        GL_TEXTURE_WRAP_S,
+        GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D,
+        GL_TEXTURE_WRAP_T,
+        GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
 
     return (glGetError() == GL_NO_ERROR);
 }
@@ -884,6 +917,9 @@ bool loadDmapTexture()
 // -----------------------------------------------------------------------------
 /**
  * Load All Textures
+ *
+ * The displacement and slope textures are not part of it: init() loads
+ * their assets on a worker thread and uploads them last.
  */
 bool loadTextures()
 {
@@ -891,7 +927,6 @@ bool loadTextures()
 
     if (v) v &= loadSceneFramebufferTexture();
     if (v) v &= loadBackFramebufferTexture();
-    if (v) v &= loadDmapTexture();
 
     return v;
 }
@@ -1380,22 +1415,77 @@ bool loadFramebuffers()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Startup Timings
+ *
+ * The clock starts with main(); init() logs the duration of each of its
+ * phases, and render() the time to the first frame.
+ */
+static double startupClock()
+{
+    static const std::chrono::steady_clock::time_point epoch =
+        std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> dt =
+        std::chrono::steady_clock::now() - epoch;
+
+    return dt.count();
+}
+
+static double logStartupPhase(const char *name, double t0)
+{
+    double t1 = startupClock();
+
+    LOG("Note: {%s} loaded in %.1f ms\n", name, t1 - t0);
+
+    return t1;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Initialize the Demo
+ *
+ * The displacement map is decoded on a worker thread (see loadDmapAssets)
+ * while the main thread creates the GL objects and compiles the programs;
+ * its textures are uploaded last.
+ */
 void init()
 {
+    DmapAssets dmapAssets = {NULL, std::vector<float>()}; // outlives its worker
+    std::future<void> dmap;
+    double t = startupClock();
     bool v = true;
     int i;
 
+    if (!g_terrain.dmap.pathToFile.empty())
+        dmap = std::async(std::launch::async, &loadDmapAssets, &dmapAssets);
+
     for (i = 0; i < CLOCK_COUNT; ++i) {
         if (g_gl.clocks[i])
             djgc_release(g_gl.clocks[i]);
         g_gl.clocks[i] = djgc_create();
     }
+    profilerInit(); // optional: the demo runs without it
 
     if (v) v &= loadTextures();
+    t = logStartupPhase("Textures", t);
     if (v) v &= loadBuffers();
+    t = logStartupPhase("Buffers", t);
     if (v) v &= loadFramebuffers();
+    t = logStartupPhase("Framebuffers", t);
     if (v) v &= loadVertexArrays();
+    t = logStartupPhase("VertexArrays", t);
     if (v) v &= loadPrograms();
+    t = logStartupPhase("Programs", t);
+
+    // the worker is joined even if a step failed
+    if (dmap.valid()) {
+        dmap.get();
+        if (v) v &= loadDmapTexture(dmapAssets);
+        if (dmapAssets.dmap)
+            djgt_release(dmapAssets.dmap);
+        t = logStartupPhase("Dmap", t);
+    }
 
     if (!v) throw std::exception();
 }
@@ -1407,6 +1497,7 @@ void release()
     for (i = 0; i < CLOCK_COUNT; ++i)
         if (g_gl.clocks[i])
             djgc_release(g_gl.clocks[i]);
+    profilerShutdown();
     for (i = 0; i < STREAM_COUNT; ++i)
         if (g_gl.streams[i])
             djgb_release(g_gl.streams[i]);
@@ -1573,13 +1664,17 @@ void renderSceneTs() {
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_gl.buffers[BUFFER_DRAW_INDIRECT]);
     glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
     glUseProgram(g_gl.programs[PROGRAM_TERRAIN]);
+    profilerPush("LoD+Terrain");
     glDrawArraysIndirect(GL_PATCHES, 0);
+    profilerPop();
 
     // prepare next batch
+    profilerPush("Indirect");
     callUpdateIndirectProgram(PROGRAM_UPDATE_INDIRECT_DRAW,
                               g_gl.buffers[BUFFER_ATOMIC_COUNTER],
                               0, 0, 0,
                               g_gl.buffers[BUFFER_DRAW_INDIRECT]);
+    profilerPop();
 
     g_terrain.pingPong = 1 - g_terrain.pingPong;
     offset = nextOffset;
@@ -1629,13 +1724,17 @@ void renderSceneGs() {
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_gl.buffers[BUFFER_DRAW_INDIRECT]);
     glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
     glUseProgram(g_gl.programs[PROGRAM_TERRAIN]);
+    profilerPush("LoD+Terrain");
     glDrawArraysIndirect(GL_POINTS, 0);
+    profilerPop();
 
     // update indirect draw call
+    profilerPush("Indirect");
     callUpdateIndirectProgram(PROGRAM_UPDATE_INDIRECT_DRAW,
                               g_gl.buffers[BUFFER_ATOMIC_COUNTER],
                               0, 0, 0,
                               g_gl.buffers[BUFFER_DRAW_INDIRECT]);
+    profilerPop();
 
     g_terrain.pingPong = 1 - g_terrain.pingPong;
     offset = nextOffset;
@@ -1700,13 +1799,17 @@ void renderSceneMs() {
 
     // draw terrain
     glUseProgram(g_gl.programs[PROGRAM_TERRAIN]);
+    profilerPush("LoD+Terrain");
     glDrawMeshTasksIndirectNV(0);
+    profilerPop();
 
     // update batch
+    profilerPush("Indirect");
     callUpdateIndirectProgram(PROGRAM_UPDATE_INDIRECT,
                               g_gl.buffers[BUFFER_ATOMIC_COUNTER], 0,
                               g_gl.buffers[BUFFER_ATOMIC_COUNTER], 0,
                               g_gl.buffers[BUFFER_DISPATCH_INDIRECT]);
+    profilerPop();
 
     g_terrain.pingPong = 1 - g_terrain.pingPong;
     offset = nextOffset;
@@ -1776,7 +1879,9 @@ void renderSceneCs() {
     glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER,
                  g_gl.buffers[BUFFER_DISPATCH_INDIRECT]);
     glUseProgram(g_gl.programs[PROGRAM_SUBD_CS_LOD]);
+    profilerPush("LoD+Culling");
     glDispatchComputeIndirect(0);
+    profilerPop();
 
     // render the terrain
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
@@ -1784,15 +1889,19 @@ void renderSceneCs() {
     glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_INSTANCED_GRID]);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER,
                  g_gl.buffers[BUFFER_DRAW_INDIRECT]);
+    profilerPush("Terrain");
     glDrawElementsIndirect(GL_TRIANGLES,
                            GL_UNSIGNED_SHORT,
                            NULL);
+    profilerPop();
 
     // update batch
+    profilerPush("Indirect");
     callUpdateIndirectProgram(PROGRAM_UPDATE_INDIRECT,
                               g_gl.buffers[BUFFER_ATOMIC_COUNTER], 0,
                               g_gl.buffers[BUFFER_DRAW_INDIRECT], sizeof(int),
                               g_gl.buffers[BUFFER_DISPATCH_INDIRECT]);
+    profilerPop();
 
     g_terrain.pingPong = 1 - g_terrain.pingPong;
     offset = nextOffset;
@@ -1877,13 +1986,16 @@ void renderGui(double cpuDt, double gpuDt)
     glClear(GL_COLOR_BUFFER_BIT);
 
     // post process the scene framebuffer
+    profilerPush("Viewer");
     glUseProgram(g_gl.programs[PROGRAM_VIEWER]);
     glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    profilerPop();
 
     // draw HUD
     if (g_app.viewer.hud) {
         // ImGui
+        profilerPush("GUI");
         glUseProgram(0);
         ImGui_ImplGlfwGL3_NewFrame();
         // Viewer Widgets
@@ -1920,6 +2032,32 @@ void renderGui(double cpuDt, double gpuDt)
             }
         }
         ImGui::End();
+        // Profiler Widgets
+        ImGui::SetNextWindowPos(ImVec2(530, 10)/*, ImGuiSetCond_FirstUseEver*/);
+        ImGui::SetNextWindowSize(ImVec2(330, 220)/*, ImGuiSetCond_FirstUseEver*/);
+        ImGui::Begin("Profiler");
+        {
+            const ProfilerEntry *entries = profilerGetEntries();
+
+            ImGui::Text("%-20s %9s %9s", "Scope", "CPU", "GPU");
+            for (int i = 0; i < profilerGetEntryCount(); ++i) {
+                const ProfilerEntry *entry = &entries[i];
+
+                ImGui::Text("%*s%-*s %7.3fms %7.3fms",
+                            2 * entry->depth, "",
+                            20 - 2 * entry->depth, entry->name,
+                            entry->cpu, entry->gpu);
+            }
+            if (profilerIsCapturing()) {
+                ImGui::Text("Capturing...");
+            } else if (ImGui::Button("Save Trace")) {
+                char path[1024];
+
+                strcat2(path, g_app.dir.output, "trace.json");
+                profilerCaptureTrace(path, 64);
+            }
+        }
+        ImGui::End();
 #if 0
         // Framebuffer Widgets
         ImGui::SetNextWindowPos(ImVec2(530, 10)/*, ImGuiSetCond_FirstUseEver*/);
@@ -2042,6 +2180,7 @@ void renderGui(double cpuDt, double gpuDt)
 
         ImGui::Render();
         ImGui_ImplGlfwGL3_RenderDrawData(ImGui::GetDrawData());
+        profilerPop();
     }
 
     // screen recording
@@ -2090,15 +2229,77 @@ void render()
 {
     double cpuDt, gpuDt;
 
+    profilerBeginFrame();
     djgc_start(g_gl.clocks[CLOCK_SPF]);
+    profilerPush("Scene");
     renderScene();
+    profilerPop();
     djgc_stop(g_gl.clocks[CLOCK_SPF]);
     djgc_ticks(g_gl.clocks[CLOCK_SPF], &cpuDt, &gpuDt);
     renderGui(cpuDt, gpuDt);
-    renderBack();
+    if (!g_app.headless.on) { // there is no window to blit to
+        profilerPush("Blit");
+        renderBack();
+        profilerPop();
+    }
+    profilerEndFrame();
+    if (g_app.frame == 0) {
+        LOG("Note: time to first frame %.1f ms\n", startupClock());
+    }
     ++g_app.frame;
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Save the Composited Framebuffer
+ *
+ * Writes the back framebuffer to a PNG file in the output directory.
+ */
+void saveBackFramebuffer(const char *name)
+{
+    char path[1024];
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_BACK]);
+    strcat2(path, g_app.dir.output, name);
+    LOG("Note: saving %s.png\n", path);
+    djgt_save_glcolorbuffer_png(GL_COLOR_ATTACHMENT0, GL_RGBA, path);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Idle Scheduling
+ *
+ * The subdivision is refined by one level per frame, so once the camera has
+ * not moved for IDLE_WAKE_FRAMES frames the terrain has settled: the main
+ * loop then stops drawing and waits for events, and the window keeps showing
+ * the last frame. Input events and camera motion restart the count.
+ */
+#define IDLE_WAKE_FRAMES 64
+void wakeViewer()
+{
+    g_app.idle.frames = IDLE_WAKE_FRAMES;
+}
+
+// wakes the viewer if the camera differs from that of the previous call
+void wakeViewerOnCameraMotion()
+{
+    static CameraManager camera;
+    static bool first = true;
+
+    if (first || memcmp(&camera, &g_camera, sizeof(camera)))
+        wakeViewer();
+    camera = g_camera;
+    first = false;
+}
+
+bool isViewerIdle()
+{
+    return g_app.idle.on && g_app.idle.frames == 0
+        && !g_terrain.flags.reset && !g_terrain.flags.freeze_step
+        && !g_app.recorder.on && !profilerIsCapturing();
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -2109,6 +2310,7 @@ keyboardCallback(
     int key, int, int action, int
 ) {
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureKeyboard)
         return;
 
@@ -2142,6 +2344,7 @@ keyboardCallback(
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 }
@@ -2153,6 +2356,7 @@ void mouseMotionCallback(GLFWwindow* window, double x, double y)
         dy = y - y0;
 
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 
@@ -2180,6 +2384,7 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
     ImGuiIO& io = ImGui::GetIO();
     ImGui_ImplGlfw_ScrollCallback(window, xoffset, yoffset);
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 
@@ -2187,15 +2392,110 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
     g_camera.pos -= axis[0] * yoffset * 5e-2 * norm(g_camera.pos);
 }
 
+// the window content was damaged, or its focus changed: redraw
+void windowRefreshCallback(GLFWwindow* window)
+{
+    wakeViewer();
+}
+
+void windowFocusCallback(GLFWwindow* window, int focused)
+{
+    wakeViewer();
+}
+
 void usage(const char *app)
 {
     printf("%s -- OpenGL Terrain Renderer\n", app);
-    printf("usage: %s --shader-dir path_to_shader_dir\n", app);
+    printf("usage: %s --shader-dir path_to_shader_dir [--no-idle]"
+           " [--headless egl|osmesa --output-dir dir --frame-limit n]\n", app);
+}
+
+// the terrain settles once it has been refined for IDLE_WAKE_FRAMES frames
+#define HEADLESS_FRAME_COUNT IDLE_WAKE_FRAMES
+
+// -----------------------------------------------------------------------------
+/**
+ * Render without a Window
+ *
+ * Runs the same init()/render() code in an offscreen context for
+ * HEADLESS_FRAME_COUNT frames (or up to the frame limit), and saves the
+ * composited framebuffer to the output directory.
+ */
+int mainHeadless()
+{
+    g_app.viewer.hud = false;
+    if (!headlessInit(g_app.headless.backend,
+                      VIEWER_DEFAULT_WIDTH, VIEWER_DEFAULT_HEIGHT)) {
+        LOG("=> Failure <=\n");
+        return -1;
+    }
+
+    // Load OpenGL functions
+    LOG("Loading {OpenGL}\n");
+    if (!gladLoadGLLoader((GLADloadproc)headlessGetProcAddress)) {
+        LOG("gladLoadGLLoader failed\n");
+        headlessShutdown();
+        return -1;
+    }
+    log_debug_output();
+
+    LOG("-- Begin -- Demo (headless)\n");
+    try {
+        init();
+        do {
+            render();
+        } while (g_app.frame < (g_app.frameLimit < 0
+            ? HEADLESS_FRAME_COUNT
+            : g_app.frameLimit));
+        saveBackFramebuffer("headless");
+
+        release();
+        headlessShutdown();
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        headlessShutdown();
+        LOG("(!) Demo Killed (!)\n");
+
+        return EXIT_FAILURE;
+    } catch (...) {
+        headlessShutdown();
+        LOG("(!) Demo Killed (!)\n");
+
+        return EXIT_FAILURE;
+    }
+    LOG("-- End -- Demo\n");
+
+    return 0;
 }
 
 // -----------------------------------------------------------------------------
 int main(int argc, char **argv)
 {
+    startupClock(); // starts the clock
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--no-idle", argv[i])) {
+            g_app.idle.on = false;
+            LOG("Note: idle mode disabled\n");
+        } else if (!strcmp("--output-dir", argv[i]) && i + 1 < argc) {
+            g_app.dir.output = argv[++i];
+            LOG("Note: output directory set to %s\n", g_app.dir.output);
+        } else if (!strcmp("--frame-limit", argv[i]) && i + 1 < argc) {
+            g_app.frameLimit = atoi(argv[++i]);
+            LOG("Note: frame limit set to %i\n", g_app.frameLimit);
+        } else if (!strcmp("--headless", argv[i]) && i + 1 < argc) {
+            g_app.headless.backend = headlessParseBackend(argv[++i]);
+            g_app.headless.on = true;
+            if (g_app.headless.backend < 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            LOG("Note: headless rendering with %s\n", argv[i]);
+        }
+    }
+
+    if (g_app.headless.on)
+        return mainHeadless();
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -2218,6 +2518,8 @@ int main(int argc, char **argv)
     glfwSetCursorPosCallback(window, &mouseMotionCallback);
     glfwSetMouseButtonCallback(window, &mouseButtonCallback);
     glfwSetScrollCallback(window, &mouseScrollCallback);
+    glfwSetWindowRefreshCallback(window, &windowRefreshCallback);
+    glfwSetWindowFocusCallback(window, &windowFocusCallback);
 
     // Load OpenGL functions
     LOG("Loading {OpenGL}\n");
@@ -2242,7 +2544,17 @@ int main(int argc, char **argv)
         LOG("-- End -- Init\n");
 
         while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
+            // wait for events instead of redrawing the same frame
+            if (isViewerIdle()) {
+                glfwWaitEventsTimeout(g_app.idle.timeout);
+                if (isViewerIdle())
+                    continue;
+            } else {
+                glfwPollEvents();
+            }
+            wakeViewerOnCameraMotion();
+            if (g_app.idle.frames > 0)
+                --g_app.idle.frames;
 
             render();
 
@@ -6,10 +6,20 @@
 #include "GLFW/glfw3.h"
 #include "imgui.h"
 #include "imgui_impl.h"
+#include "headless.h"
+#include "recorder.h"
+#include "keyframes.h"
+#include "envmap.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <exception>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -56,11 +66,29 @@ struct FramebufferManager {
     int w, h, aa, pass, samplesPerPass, samplesPerPixel;
     struct {bool progressive, reset;} flags;
     struct {int fixed;} msaa;
+    struct {int type;} sampler;
+    struct {
+        bool enabled, converged;
+        float targetError;  // relative error of the pixels
+        int period;         // passes between convergence tests
+        int minSamples;     // samples before the first test
+        float active, error;// ratio of active pixels and mean error
+    } adaptive;
+    struct {
+        int size;           // tile size in pixels
+        float budget;       // GPU time per frame (ms)
+        int next;           // next tile to render
+        double cost;        // GPU time of a tile-pass (ms)
+        int queryTileCnt;   // tile-passes of the pending timer query
+    } tiles;
     struct {float r, g, b;} clearColor;
 } g_framebuffer = {
     VIEWER_DEFAULT_WIDTH, VIEWER_DEFAULT_HEIGHT, AA_MSAA2, 0, 4, 1024 * 1024,
     {true, true},
     {false},
+    {djb::sampler::SOBOL},
+    {true, false, 0.01f, 8, 16, 1.0f, 0.0f},
+    {128, 8.0f, 0, 0.0, 0},
     {61./255., 119./255., 192./225}
 };
 
@@ -88,11 +116,21 @@ enum {
     SHADING_MC_COS,
     SHADING_MC_GGX,
     SHADING_MC_MIS,
+    SHADING_SPLIT_SUM,
     SHADING_DEBUG
 };
-enum { BRDF_DIFFUSE, BRDF_MERL, BRDF_NPF };
+enum {
+    BRDF_DIFFUSE,
+    BRDF_MERL,
+    BRDF_NPF,
+    BRDF_TAB,
+    BRDF_SGD,
+    BRDF_ABC,
+    BRDF_UTIA
+};
+enum { TABLE_RES_FULL, TABLE_RES_HALF, TABLE_RES_THIRD };
 struct SphereManager {
-    struct {bool showLines;} flags;
+    struct {bool showLines, envmapSampling, envmapSh, envmapCubemap;} flags;
     struct {
         int xTess, yTess;
         int vertexCnt, indexCnt;
@@ -105,17 +143,27 @@ struct SphereManager {
         struct {
             std::vector<const char *> files;
             int id;
+            int ggxLevelCnt, ggxSampleCnt; // prefiltering (split sum)
+            int shOrder;                   // SH irradiance (diffuse)
+            int cubemapSize;               // 0: a quarter of the width
         } envmap;
+        struct {
+            std::vector<const char *> files;
+            int id;
+        } utia;
+        struct {int res; bool half;} table;
         const char *pathToUberData;
         int mode, brdf;
         float ggxAlpha;
     } shading;
 } g_sphere = {
-    {false},
+    {false, true, true, true},
     {32, 64, -1, -1}, // sphere
     {
         {{PATH_TO_ASSET_DIRECTORY "./gold-metallic-paint2.binary"}, 0},
-        {{PATH_TO_ASSET_DIRECTORY "./topanga.hdr"}, 0},
+        {{PATH_TO_ASSET_DIRECTORY "./topanga.hdr"}, 0, 6, 256, 2, 0},
+        {{}, 0},
+        {TABLE_RES_FULL, false},
         PATH_TO_SRC_DIRECTORY "npf.bin",
         SHADING_MC_MIS,
         BRDF_MERL,
@@ -130,6 +178,7 @@ struct AppManager {
     struct {
         const char *shader;
         const char *output;
+        const char *cache;
     } dir;
     struct {
         int w, h;
@@ -137,12 +186,27 @@ struct AppManager {
         float gamma, exposure;
     } viewer;
     struct {
-        int on, frame, capture;
+        int on, frame, capture, format;
     } recorder;
+    struct {
+        bool on;
+        int backend;
+    } headless;
+    struct {
+        Keyframes *keys;
+        int frame, frameCnt;
+        float fps;
+    } sweep;
+    struct {
+        bool on;
+        float timeout;      // max wait for events (s)
+        int frames;         // frames to draw before idling
+    } idle;
     int frame, frameLimit;
 } g_app = {
     /*dir*/     {
                     PATH_TO_SRC_DIRECTORY "./shaders/",
+                    PATH_TO_SRC_DIRECTORY "./",
                     PATH_TO_SRC_DIRECTORY "./"
                 },
     /*viewer*/  {
@@ -150,21 +214,34 @@ struct AppManager {
                    true,
                    2.2f, 2.0f
                 },
-    /*record*/  {false, 0, 0},
+    /*record*/  {false, 0, 0, RECORDER_FORMAT_PNG},
+    /*headless*/{false, HEADLESS_BACKEND_EGL},
+    /*sweep*/   {NULL, -1, 0, 60.0f},
+    /*idle*/    {true, 0.5f, 0},
     /*frame*/   0, -1
 };
 
 // -----------------------------------------------------------------------------
 // OpenGL Manager
 enum { CLOCK_SPF, CLOCK_COUNT };
-enum { FRAMEBUFFER_BACK, FRAMEBUFFER_SCENE, FRAMEBUFFER_COUNT };
+enum { QUERY_TILES, QUERY_COUNT };
+enum { FENCE_CONVERGENCE, FENCE_COUNT };
+enum { FRAMEBUFFER_BACK, FRAMEBUFFER_SCENE, FRAMEBUFFER_CONVERGENCE, FRAMEBUFFER_COUNT };
 enum { VERTEXARRAY_EMPTY, VERTEXARRAY_SPHERE, VERTEXARRAY_COUNT };
-enum { STREAM_SPHERES, STREAM_TRANSFORM, STREAM_RANDOM, STREAM_COUNT };
+enum { STREAM_SPHERES, STREAM_TRANSFORM, STREAM_COUNT };
 enum {
     TEXTURE_BACK,
     TEXTURE_SCENE,
     TEXTURE_Z,
+    TEXTURE_MOMENTS,
+    TEXTURE_CONVERGENCE,
     TEXTURE_ENVMAP,
+    TEXTURE_ENVMAP_MARGINAL,
+    TEXTURE_ENVMAP_CONDITIONAL,
+    TEXTURE_ENVMAP_PDF,
+    TEXTURE_ENVMAP_GGX,
+    TEXTURE_ENVMAP_CUBE,
+    TEXTURE_ALBEDO,
     TEXTURE_NPF,
     TEXTURE_MERL,
     TEXTURE_COUNT
@@ -173,12 +250,16 @@ enum {
     BUFFER_SPHERE_VERTICES,
     BUFFER_SPHERE_INDEXES,
     BUFFER_MERL,
+    BUFFER_ENVMAP_SH,
+    BUFFER_CONVERGENCE,
+    BUFFER_CONVERGENCE_READBACK,
     BUFFER_COUNT
 };
 enum {
     PROGRAM_VIEWER,
     PROGRAM_BACKGROUND,
     PROGRAM_SPHERE,
+    PROGRAM_CONVERGENCE,
     PROGRAM_COUNT
 };
 enum {
@@ -189,13 +270,26 @@ enum {
 
     UNIFORM_BACKGROUND_CLEAR_COLOR,
     UNIFORM_BACKGROUND_ENVMAP_SAMPLER,
+    UNIFORM_BACKGROUND_ENVMAP_CUBE_SAMPLER,
 
     UNIFORM_SPHERE_SAMPLES_PER_PASS,
+    UNIFORM_SPHERE_PASS,
     UNIFORM_SPHERE_NPF_SAMPLER,
     UNIFORM_SPHERE_ENVMAP_SAMPLER,
+    UNIFORM_SPHERE_ENVMAP_CUBE_SAMPLER,
+    UNIFORM_SPHERE_ENVMAP_MARGINAL_SAMPLER,
+    UNIFORM_SPHERE_ENVMAP_CONDITIONAL_SAMPLER,
+    UNIFORM_SPHERE_ENVMAP_PDF_SAMPLER,
+    UNIFORM_SPHERE_ENVMAP_GGX_SAMPLER,
+    UNIFORM_SPHERE_ALBEDO_SAMPLER,
     UNIFORM_SPHERE_MERL_SAMPLER,
     UNIFORM_SPHERE_ALPHA,
     UNIFORM_SPHERE_MERL_ID,
+    UNIFORM_SPHERE_ADAPTIVE,
+    UNIFORM_SPHERE_CONVERGENCE_SAMPLER,
+
+    UNIFORM_CONVERGENCE_MOMENTS_SAMPLER,
+    UNIFORM_CONVERGENCE_TARGET_ERROR,
 
     UNIFORM_COUNT
 };
@@ -206,6 +300,8 @@ struct OpenGLManager {
     GLuint vertexArrays[VERTEXARRAY_COUNT];
     GLuint buffers[BUFFER_COUNT];
     GLint uniforms[UNIFORM_COUNT];
+    GLuint queries[QUERY_COUNT];
+    GLsync fences[FENCE_COUNT];
     djg_buffer *streams[STREAM_COUNT];
     djg_clock *clocks[CLOCK_COUNT];
 } g_gl = {{0}};
@@ -319,6 +415,9 @@ void configureBackgroundProgram()
     glProgramUniform1i(g_gl.programs[PROGRAM_BACKGROUND],
                        g_gl.uniforms[UNIFORM_BACKGROUND_ENVMAP_SAMPLER],
                        TEXTURE_ENVMAP);
+    glProgramUniform1i(g_gl.programs[PROGRAM_BACKGROUND],
+                       g_gl.uniforms[UNIFORM_BACKGROUND_ENVMAP_CUBE_SAMPLER],
+                       TEXTURE_ENVMAP_CUBE);
 }
 
 // -----------------------------------------------------------------------------
@@ -334,6 +433,24 @@ void configureSphereProgram()
     glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
                        g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_SAMPLER],
                        TEXTURE_ENVMAP);
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_CUBE_SAMPLER],
+                       TEXTURE_ENVMAP_CUBE);
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_MARGINAL_SAMPLER],
+                       TEXTURE_ENVMAP_MARGINAL);
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_CONDITIONAL_SAMPLER],
+                       TEXTURE_ENVMAP_CONDITIONAL);
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_PDF_SAMPLER],
+                       TEXTURE_ENVMAP_PDF);
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_GGX_SAMPLER],
+                       TEXTURE_ENVMAP_GGX);
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_ALBEDO_SAMPLER],
+                       TEXTURE_ALBEDO);
     glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
                        g_gl.uniforms[UNIFORM_SPHERE_MERL_SAMPLER],
                        TEXTURE_MERL);
@@ -343,6 +460,24 @@ void configureSphereProgram()
     glProgramUniform1f(g_gl.programs[PROGRAM_SPHERE],
                        g_gl.uniforms[UNIFORM_SPHERE_ALPHA],
                        g_sphere.shading.ggxAlpha);
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_CONVERGENCE_SAMPLER],
+                       TEXTURE_CONVERGENCE);
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_ADAPTIVE],
+                       0);
+}
+
+// -----------------------------------------------------------------------------
+// set convergence program uniforms
+void configureConvergenceProgram()
+{
+    glProgramUniform1i(g_gl.programs[PROGRAM_CONVERGENCE],
+                       g_gl.uniforms[UNIFORM_CONVERGENCE_MOMENTS_SAMPLER],
+                       TEXTURE_MOMENTS);
+    glProgramUniform1f(g_gl.programs[PROGRAM_CONVERGENCE],
+                       g_gl.uniforms[UNIFORM_CONVERGENCE_TARGET_ERROR],
+                       g_framebuffer.adaptive.targetError);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -403,6 +538,8 @@ bool loadBackgroundProgram()
     char buf[1024];
 
     LOG("Loading {Background-Program}\n");
+    if (g_sphere.flags.envmapCubemap)
+        djgp_push_string(djp, "#define ENVMAP_CUBEMAP 1\n");
     djgp_push_string(djp, "#define BUFFER_BINDING_TRANSFORMS %i\n", STREAM_TRANSFORM);
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "background.glsl"));
     if (!djgp_to_gl(djp, 430, false, true, program)) {
@@ -417,6 +554,8 @@ bool loadBackgroundProgram()
         glGetUniformLocation(g_gl.programs[PROGRAM_BACKGROUND], "u_ClearColor");
     g_gl.uniforms[UNIFORM_BACKGROUND_ENVMAP_SAMPLER] =
         glGetUniformLocation(g_gl.programs[PROGRAM_BACKGROUND], "u_EnvmapSampler");
+    g_gl.uniforms[UNIFORM_BACKGROUND_ENVMAP_CUBE_SAMPLER] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_BACKGROUND], "u_EnvmapCubeSampler");
 
     configureBackgroundProgram();
 
@@ -439,8 +578,17 @@ bool loadSphereProgram()
     LOG("Loading {Sphere-Program}\n");
     switch (g_sphere.shading.brdf) {
         case BRDF_MERL:
+        case BRDF_TAB:
+        case BRDF_SGD:
+        case BRDF_ABC:
+        case BRDF_UTIA: {
+            int scale = 1 + g_sphere.shading.table.res;
+
             djgp_push_string(djp, "#define BRDF_MERL 1\n");
-            break;
+            djgp_push_string(djp, "#define MERL_RES_THETA_H %i\n", 90 / scale);
+            djgp_push_string(djp, "#define MERL_RES_THETA_D %i\n", 90 / scale);
+            djgp_push_string(djp, "#define MERL_RES_PHI_D %i\n", 180 / scale);
+        } break;
         case BRDF_NPF:
             djgp_push_string(djp, "#define BRDF_NPF 1\n");
             break;
@@ -461,14 +609,27 @@ bool loadSphereProgram()
         case SHADING_MC_MIS:
             djgp_push_string(djp, "#define SHADE_MC_MIS 1\n");
             break;
+        case SHADING_SPLIT_SUM:
+            djgp_push_string(djp, "#define SHADE_SPLIT_SUM 1\n");
+            break;
     };
-    djgp_push_string(djp, "#define BUFFER_BINDING_RANDOM %i\n", STREAM_RANDOM);
+    if (g_sphere.flags.envmapSampling)
+        djgp_push_string(djp, "#define ENVMAP_SAMPLING 1\n");
+    if (g_sphere.flags.envmapCubemap)
+        djgp_push_string(djp, "#define ENVMAP_CUBEMAP 1\n");
+    if (g_sphere.flags.envmapSh && g_sphere.shading.mode != SHADING_DEBUG) {
+        djgp_push_string(djp, "#define ENVMAP_SH 1\n");
+        djgp_push_string(djp, "#define ENVMAP_SH_ORDER %i\n", g_sphere.shading.envmap.shOrder);
+    }
+    djgp_push_string(djp, "#define SAMPLER_TYPE %i\n", g_framebuffer.sampler.type);
     djgp_push_string(djp, "#define BUFFER_BINDING_TRANSFORMS %i\n", STREAM_TRANSFORM);
     djgp_push_string(djp, "#define BUFFER_BINDING_SPHERES %i\n", STREAM_SPHERES);
+    djgp_push_string(djp, "#define BUFFER_BINDING_ENVMAP_SH %i\n", BUFFER_ENVMAP_SH);
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "ggx.glsl"));
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "npf.glsl"));
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "brdf_merl.glsl"));
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "pivot.glsl"));
+    djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "sampler.glsl"));
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "sphere.glsl"));
 
     if (!djgp_to_gl(djp, 430, false, true, program)) {
@@ -481,14 +642,32 @@ bool loadSphereProgram()
 
     g_gl.uniforms[UNIFORM_SPHERE_SAMPLES_PER_PASS] =
         glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_SamplesPerPass");
+    g_gl.uniforms[UNIFORM_SPHERE_PASS] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_Pass");
     g_gl.uniforms[UNIFORM_SPHERE_NPF_SAMPLER] =
         glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_NpfSampler");
     g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_SAMPLER] =
         glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_EnvmapSampler");
+    g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_CUBE_SAMPLER] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_EnvmapCubeSampler");
+    g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_MARGINAL_SAMPLER] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_EnvmapMarginalSampler");
+    g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_CONDITIONAL_SAMPLER] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_EnvmapConditionalSampler");
+    g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_PDF_SAMPLER] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_EnvmapPdfSampler");
+    g_gl.uniforms[UNIFORM_SPHERE_ENVMAP_GGX_SAMPLER] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_EnvmapGgxSampler");
+    g_gl.uniforms[UNIFORM_SPHERE_ALBEDO_SAMPLER] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_AlbedoSampler");
     g_gl.uniforms[UNIFORM_SPHERE_MERL_SAMPLER] =
         glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_MerlSampler");
     g_gl.uniforms[UNIFORM_SPHERE_ALPHA] =
         glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_Alpha");
+    g_gl.uniforms[UNIFORM_SPHERE_ADAPTIVE] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_Adaptive");
+    g_gl.uniforms[UNIFORM_SPHERE_CONVERGENCE_SAMPLER] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_ConvergenceSampler");
     g_gl.uniforms[UNIFORM_SPHERE_MERL_ID] =
         glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_MerlId");
 
@@ -497,6 +676,42 @@ bool loadSphereProgram()
     return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Convergence Program
+ *
+ * This program estimates the relative error of each pixel of the scene
+ * framebuffer from its luminance moments (see renderConvergence).
+ */
+bool loadConvergenceProgram()
+{
+    djg_program *djp = djgp_create();
+    GLuint *program = &g_gl.programs[PROGRAM_CONVERGENCE];
+    char buf[1024];
+
+    LOG("Loading {Convergence-Program}\n");
+    if (g_framebuffer.aa >= AA_MSAA2 && g_framebuffer.aa <= AA_MSAA16)
+        djgp_push_string(djp, "#define MSAA_FACTOR %i\n", 1 << g_framebuffer.aa);
+    djgp_push_string(djp, "#define BUFFER_BINDING_CONVERGENCE %i\n", BUFFER_CONVERGENCE);
+    djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "convergence.glsl"));
+    if (!djgp_to_gl(djp, 430, false, true, program)) {
+        LOG("=> Failure <=\n");
+        djgp_release(djp);
+
+        return false;
+    }
+    djgp_release(djp);
+
+    g_gl.uniforms[UNIFORM_CONVERGENCE_MOMENTS_SAMPLER] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_CONVERGENCE], "u_MomentsSampler");
+    g_gl.uniforms[UNIFORM_CONVERGENCE_TARGET_ERROR] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_CONVERGENCE], "u_TargetError");
+
+    configureConvergenceProgram();
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load All Programs
@@ -509,6 +724,7 @@ bool loadPrograms()
     v&= loadViewerProgram();
     v&= loadBackgroundProgram();
     v&= loadSphereProgram();
+    v&= loadConvergenceProgram();
 
     return v;
 }
@@ -525,7 +741,9 @@ bool loadPrograms()
  * Depending on the scene framebuffer AA mode, this function load 2 or
  * 3 textures. In FSAA mode, two RGBA16F and one DEPTH24_STENCIL8 textures
  * are created. In other modes, one RGBA16F and one DEPTH24_STENCIL8 textures
- * are created.
+ * are created. An RGBA32F texture with the same layout as the color buffer
+ * holds the luminance moments used for adaptive sampling, and an R8 texture
+ * receives the per-pixel convergence test.
  */
 bool loadSceneFramebufferTexture()
 {
@@ -533,8 +751,14 @@ bool loadSceneFramebufferTexture()
         glDeleteTextures(1, &g_gl.textures[TEXTURE_SCENE]);
     if (glIsTexture(g_gl.textures[TEXTURE_Z]))
         glDeleteTextures(1, &g_gl.textures[TEXTURE_Z]);
+    if (glIsTexture(g_gl.textures[TEXTURE_MOMENTS]))
+        glDeleteTextures(1, &g_gl.textures[TEXTURE_MOMENTS]);
+    if (glIsTexture(g_gl.textures[TEXTURE_CONVERGENCE]))
+        glDeleteTextures(1, &g_gl.textures[TEXTURE_CONVERGENCE]);
     glGenTextures(1, &g_gl.textures[TEXTURE_Z]);
     glGenTextures(1, &g_gl.textures[TEXTURE_SCENE]);
+    glGenTextures(1, &g_gl.textures[TEXTURE_MOMENTS]);
+    glGenTextures(1, &g_gl.textures[TEXTURE_CONVERGENCE]);
 
     switch (g_framebuffer.aa) {
         case AA_NONE:
@@ -559,6 +783,17 @@ bool loadSceneFramebufferTexture()
                            g_framebuffer.h);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            LOG("Loading {Scene-Moments-Framebuffer-Texture}\n");
+            glActiveTexture(GL_TEXTURE0 + TEXTURE_MOMENTS);
+            glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_MOMENTS]);
+            glTexStorage2D(GL_TEXTURE_2D,
+                           1,
+                           GL_RGBA32F,
+                           g_framebuffer.w,
+                           g_framebuffer.h);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             break;
         case AA_MSAA2:
         case AA_MSAA4:
@@ -592,8 +827,26 @@ bool loadSceneFramebufferTexture()
                                       g_framebuffer.w,
                                       g_framebuffer.h,
                                       g_framebuffer.msaa.fixed);
+
+            LOG("Loading {Scene-MSAA-Moments-Framebuffer-Texture}\n");
+            glActiveTexture(GL_TEXTURE0 + TEXTURE_MOMENTS);
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE,
+                          g_gl.textures[TEXTURE_MOMENTS]);
+            glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE,
+                                      samples,
+                                      GL_RGBA32F,
+                                      g_framebuffer.w,
+                                      g_framebuffer.h,
+                                      g_framebuffer.msaa.fixed);
         } break;
     }
+
+    LOG("Loading {Scene-Convergence-Texture}\n");
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_CONVERGENCE);
+    glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_CONVERGENCE]);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, g_framebuffer.w, g_framebuffer.h);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glActiveTexture(GL_TEXTURE0);
 
     return (glGetError() == GL_NO_ERROR);
@@ -630,22 +883,36 @@ bool loadBackFramebufferTexture()
 
 // -----------------------------------------------------------------------------
 /**
- * Load the Pivot Texture
+ * Load the NPF Texture
  *
- * This loads a precomputed table that is used to map a GGX BRDF to a
- * Uniform PTSD parameter.
+ * This loads the uber texture that stores the NPF parameters of each
+ * material in a row of 512 texels. The number of rows is deduced from the
+ * file size, so textures extended with the npf-fit tool load as is.
  */
 bool loadNpfTexture()
 {
     LOG("Loading {NPF-Texture}\n");
     FILE *pf = fopen(g_sphere.shading.pathToUberData, "rb");
+    const long rowBytes = 512 * 3 * sizeof(float);
     std::vector<float> data;
+    long byteCount;
+    int rowCount;
 
     if (!pf)
         return false;
-    data.resize(512 * 256 * 3);
+    fseek(pf, 0, SEEK_END);
+    byteCount = ftell(pf);
+    fseek(pf, 0, SEEK_SET);
+    rowCount = (int)(byteCount / rowBytes);
+    if (rowCount <= 0) {
+        fclose(pf);
+        return false;
+    }
+    data.resize(512 * 3 * rowCount);
     fread(&data[0], sizeof(float), data.size(), pf);
     fclose(pf);
+    LOG("Note: NPF texture holds %i materials\n", rowCount);
+
     if (glIsTexture(g_gl.textures[TEXTURE_NPF]))
         glDeleteTextures(1, &g_gl.textures[TEXTURE_NPF]);
     glGenTextures(1, &g_gl.textures[TEXTURE_NPF]);
@@ -656,8 +923,8 @@ bool loadNpfTexture()
                    1,
                    GL_RGB32F,
                    512,
-                   256);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 512, 256, GL_RGB, GL_FLOAT, &data[0]);
+                   rowCount);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 512, rowCount, GL_RGB, GL_FLOAT, &data[0]);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -668,44 +935,205 @@ bool loadNpfTexture()
     return (glGetError() == GL_NO_ERROR);
 }
 
-static bool loadMerlTexture(void)
+// -----------------------------------------------------------------------------
+// BRDF baked into the MERL texture for the selected BRDF: the diffuse and NPF
+// BRDFs do not read it, and keep the MERL BRDF
+static int getBakedBrdf()
 {
-    if (!g_sphere.shading.merl.files.empty()) {
-        try {
-        LOG("Loading {MERL-BRDF}\n");
+    switch (g_sphere.shading.brdf) {
+        case BRDF_TAB:
+        case BRDF_SGD:
+        case BRDF_ABC:
+        case BRDF_UTIA:
+            return g_sphere.shading.brdf;
+        default:
+            return BRDF_MERL;
+    }
+}
 
-        djb::merl merl(g_sphere.shading.merl.files[g_sphere.shading.merl.id]);
-        djb::tab_r tab(merl, 90);
-        djb::microfacet::args args = djb::tab_r::extract_ggx_args(djb::tab_r(merl, 90));
-        g_sphere.shading.ggxAlpha = args.minv[0][0];
+// -----------------------------------------------------------------------------
+// Instantiate the selected BRDF (NULL for the MERL BRDF itself); the SGD and
+// ABC BRDFs are looked up by the name of the current MERL file
+static djb::brdf *createTabulatedBrdf(const djb::merl &merl, const char *file)
+{
+    std::string name = file;
+    size_t s = name.find_last_of("/\\");
+
+    if (s != std::string::npos) name = name.substr(s + 1);
+    name = name.substr(0, name.find_last_of('.'));
+
+    switch (g_sphere.shading.brdf) {
+        case BRDF_TAB:
+            return new djb::tab_r(merl, 90);
+        case BRDF_SGD:
+            return new djb::sgd(name.c_str());
+        case BRDF_ABC:
+            return new djb::abc(name.c_str());
+        case BRDF_UTIA:
+            if (g_sphere.shading.utia.files.empty())
+                throw djb::exc("djb_error: No UTIA file (see --utia)\n");
+            return new djb::utia(g_sphere.shading.utia.files[g_sphere.shading.utia.id]);
+        default:
+            return NULL;
+    }
+}
 
-        if (glIsTexture(g_gl.textures[TEXTURE_MERL])) {
-            glDeleteBuffers(1, &g_gl.buffers[BUFFER_MERL]);
-            glDeleteTextures(1, &g_gl.textures[TEXTURE_MERL]);
+// -----------------------------------------------------------------------------
+/**
+ * Load the Albedo Texture
+ *
+ * Stores the directional albedo of the BRDF, i.e., the integral of
+ * f_r * cos over the light directions, as a function of cos(theta_o). The
+ * split-sum mode multiplies it with the prefiltered envmap (see sphere.glsl).
+ * The integrals use scrambled Sobol points drawn from a tab_r fit, and are
+ * computed with the MERL assets (see loadMerlAssets).
+ */
+#define ALBEDO_RES 32
+static std::vector<float>
+integrateAlbedo(const djb::brdf &fr, const djb::brdf &sampling)
+{
+    const int sampleCnt = 1024;
+    djb::sampler sampler(djb::sampler::SOBOL, 0);
+    std::vector<float> albedo(3 * ALBEDO_RES);
+
+    for (int i = 0; i < ALBEDO_RES; ++i) {
+        double cosTheta = (i + 0.5) / ALBEDO_RES;
+        djb::vec3 wo(sqrt(1.0 - cosTheta * cosTheta), 0, cosTheta);
+        djb::brdf::value_type sum = fr.zero_value();
+
+        for (int j = 0; j < sampleCnt; ++j) {
+            djb::vec3 wi;
+            djb::float_t pdf;
+
+            sampling.sample(sampler.sample(j), wo, &wi, &pdf);
+            if (pdf > 0 && wi.z > 0)
+                sum+= fr.eval(wo, wi) / pdf;
         }
-        glGenBuffers(1, &g_gl.buffers[BUFFER_MERL]);
-        glGenTextures(1, &g_gl.textures[TEXTURE_MERL]);
-
-        LOG("Loading {MERL-Texture}\n");
-        glActiveTexture(GL_TEXTURE0 + TEXTURE_MERL);
-        glBindTexture(GL_TEXTURE_BUFFER, g_gl.textures[TEXTURE_MERL]);
-        glBindBuffer(GL_TEXTURE_BUFFER, g_gl.buffers[BUFFER_MERL]);
-        std::vector<float> texels;
-        const std::vector<double>& samples = merl.get_samples();
-        texels.reserve(samples.size());
-        texels.resize(0);
-        for (int i = 0; i < (int) samples.size(); ++i)
-            texels.push_back(samples[i]);
+        for (int c = 0; c < 3; ++c)
+            albedo[3 * i + c] = sum[c % sum.size()] / sampleCnt;
+    }
+
+    return albedo;
+}
+
+static void loadAlbedoTexture(const std::vector<float> &albedo)
+{
+    GLuint *glt = &g_gl.textures[TEXTURE_ALBEDO];
+
+    if (glIsTexture(*glt))
+        glDeleteTextures(1, glt);
+    glGenTextures(1, glt);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ALBEDO);
+    glBindTexture(GL_TEXTURE_2D, *glt);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB32F, ALBEDO_RES, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ALBEDO_RES, 1, GL_RGB, GL_FLOAT, &albedo[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
+}
+#undef ALBEDO_RES
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the MERL Assets
+ *
+ * This is the CPU side of the MERL texture: it reads the MERL file, fits
+ * the tab_r BRDF that drives the albedo integrals and the GGX roughness of
+ * the sphere shader, and bakes the selected BRDF into a
+ * (theta_h, theta_d, phi_d) table (see djb::baked). It makes no GL calls,
+ * so that init() runs it on a worker thread while the programs compile.
+ * Errors are thrown.
+ */
+struct MerlAssets {
+    float ggxAlpha;
+    std::vector<float> albedo;          // RGB, see loadAlbedoTexture
+    std::vector<float> texels;          // RGB32F
+    std::vector<uint16_t> texelsHalf;   // RGBA16F
+};
+
+static MerlAssets loadMerlAssets()
+{
+    const char *file = g_sphere.shading.merl.files[g_sphere.shading.merl.id];
+    MerlAssets assets;
+
+    LOG("Loading {MERL-BRDF}\n");
+    djb::merl merl(file);
+    djb::tab_r tabr(merl, 90);
+    djb::microfacet::args args = djb::tab_r::extract_ggx_args(tabr);
+    assets.ggxAlpha = args.minv[0][0];
+
+    LOG("Loading {Baked-BRDF}\n");
+    int scale = 1 + g_sphere.shading.table.res;
+    std::unique_ptr<djb::brdf> brdf(createTabulatedBrdf(merl, file));
+    const djb::brdf &fr = brdf ? *brdf : static_cast<const djb::brdf &>(merl);
+    djb::baked baked(fr, 90 / scale, 90 / scale, 180 / scale);
+
+    if (g_sphere.shading.table.half)
+        assets.texelsHalf = baked.get_texels_half();
+    else
+        assets.texels = baked.get_texels();
+
+    LOG("Loading {Albedo}\n");
+    assets.albedo = integrateAlbedo(fr, tabr);
+
+    return assets;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the MERL Texture
+ *
+ * This uploads the baked BRDF table of the MERL assets to an RGB32F or
+ * RGBA16F texture buffer, so that all tabulated BRDFs are rendered by
+ * brdf_merl.glsl with a single fetch, along with the albedo texture.
+ */
+static bool loadMerlTexture(const MerlAssets &assets)
+{
+    g_sphere.shading.ggxAlpha = assets.ggxAlpha;
+
+    LOG("Loading {Albedo-Texture}\n");
+    loadAlbedoTexture(assets.albedo);
+
+    if (glIsTexture(g_gl.textures[TEXTURE_MERL])) {
+        glDeleteBuffers(1, &g_gl.buffers[BUFFER_MERL]);
+        glDeleteTextures(1, &g_gl.textures[TEXTURE_MERL]);
+    }
+    glGenBuffers(1, &g_gl.buffers[BUFFER_MERL]);
+    glGenTextures(1, &g_gl.textures[TEXTURE_MERL]);
+
+    LOG("Loading {MERL-Texture}\n");
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_MERL);
+    glBindTexture(GL_TEXTURE_BUFFER, g_gl.textures[TEXTURE_MERL]);
+    glBindBuffer(GL_TEXTURE_BUFFER, g_gl.buffers[BUFFER_MERL]);
+    if (!assets.texelsHalf.empty()) {
+        // buffer textures have no RGB16F format
+        glBufferData(GL_TEXTURE_BUFFER,
+                     sizeof(assets.texelsHalf[0]) * assets.texelsHalf.size(),
+                     &assets.texelsHalf[0],
+                     GL_STATIC_DRAW);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA16F, g_gl.buffers[BUFFER_MERL]);
+    } else {
         glBufferData(GL_TEXTURE_BUFFER,
-                     sizeof(texels[0]) * texels.size(),
-                     &texels[0],
+                     sizeof(assets.texels[0]) * assets.texels.size(),
+                     &assets.texels[0],
                      GL_STATIC_DRAW);
-        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, g_gl.buffers[BUFFER_MERL]);
-        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, g_gl.buffers[BUFFER_MERL]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // clean up
+    glActiveTexture(GL_TEXTURE0);
 
-        // clean up
-        glActiveTexture(GL_TEXTURE0);
+    return (glGetError() == GL_NO_ERROR);
+}
 
+static bool loadMerlTexture(void)
+{
+    if (!g_sphere.shading.merl.files.empty()) {
+        try {
+            return loadMerlTexture(loadMerlAssets());
         } catch (std::exception& e) {
             LOG("%s\n", e.what());
             return false;
@@ -717,41 +1145,281 @@ static bool loadMerlTexture(void)
     return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load an Envmap Sampling Table
+ *
+ * The tables are read with texelFetch, so they have a single level and
+ * nearest filtering.
+ */
+static void
+loadEnvmapSamplingTexture(int texture, int w, int h, const float *data)
+{
+    GLuint *glt = &g_gl.textures[texture];
+
+    if (glIsTexture(*glt))
+        glDeleteTextures(1, glt);
+    glGenTextures(1, glt);
+    glActiveTexture(GL_TEXTURE0 + texture);
+    glBindTexture(GL_TEXTURE_2D, *glt);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, w, h);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_FLOAT, data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Envmap Assets
+ *
+ * This is the CPU side of the envmap textures: it decodes the HDR image and
+ * builds its importance sampling tables and its SH coefficients (projected
+ * up to band 4 and convolved with the clamped cosine), plus its cubemap and
+ * its GGX prefiltered levels when they are used. Each of these runs on all
+ * cores (see envmap.h), and the cubemap and the prefiltered levels are
+ * cached. Like loadMerlAssets, it makes no GL calls.
+ */
+struct EnvmapAssets {
+    float *texels;
+    int w, h;
+    EnvmapSampler *sampler;
+    float sh[3 * 25];
+    EnvmapCubemap *cubemap;
+    int cubemapSize;
+    EnvmapPrefiltered *ggx;
+};
+
+static void releaseEnvmapAssets(EnvmapAssets *assets)
+{
+    if (assets->ggx)
+        envmapReleasePrefiltered(assets->ggx);
+    if (assets->cubemap)
+        envmapReleaseCubemap(assets->cubemap);
+    if (assets->sampler)
+        envmapReleaseSampler(assets->sampler);
+    if (assets->texels)
+        stbi_image_free(assets->texels);
+    *assets = EnvmapAssets();
+}
+
+static bool loadEnvmapAssets(EnvmapAssets *assets)
+{
+    const char *path = g_sphere.shading.envmap.files[g_sphere.shading.envmap.id];
+    int threadCnt = (int)std::thread::hardware_concurrency();
+    int c;
+
+    *assets = EnvmapAssets();
+    LOG("Loading {Envmap-HDR}\n");
+    stbi_set_flip_vertically_on_load(1);
+    assets->texels = stbi_loadf(path, &assets->w, &assets->h, &c, 3);
+    if (!assets->texels)
+        return false;
+
+    const float *texels = assets->texels;
+    int w = assets->w, h = assets->h;
+
+    assets->sampler = envmapCreateSampler(texels, w, h, threadCnt);
+    if (!assets->sampler) {
+        releaseEnvmapAssets(assets);
+        return false;
+    }
+
+    LOG("Loading {Envmap-SH}\n");
+    envmapProjectSh(texels, w, h, 4, threadCnt, assets->sh);
+    envmapShConvolveCosine(4, assets->sh);
+
+    if (g_sphere.flags.envmapCubemap) {
+        int size = g_sphere.shading.envmap.cubemapSize;
+        char cachePath[1024];
+
+        LOG("Loading {Envmap-Cube}\n");
+        if (size <= 0)
+            size = std::max(1, w / 4);
+        snprintf(cachePath, sizeof(cachePath), "%s.%i.cube", path, size);
+        assets->cubemap =
+            envmapCreateCubemap(texels, w, h, size, threadCnt, cachePath);
+        assets->cubemapSize = size;
+    }
+
+    if (g_sphere.shading.mode == SHADING_SPLIT_SUM) {
+        LOG("Loading {Envmap-GGX}\n");
+        assets->ggx =
+            envmapCreatePrefiltered(texels, w, h,
+                                    g_sphere.shading.envmap.ggxLevelCnt,
+                                    g_sphere.shading.envmap.ggxSampleCnt,
+                                    threadCnt, g_app.dir.cache);
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the GGX Prefiltered Envmap Texture
+ *
+ * Level k of the mip chain holds the envmap convolved with the GGX lobe of
+ * roughness alpha = (k / (levelCnt - 1))^2 (see envmap.h).
+ */
+static bool loadEnvmapGgxTexture(const EnvmapPrefiltered *ggx, int w, int h)
+{
+    LOG("Loading {Envmap-GGX-Texture}\n");
+    GLuint *glt = &g_gl.textures[TEXTURE_ENVMAP_GGX];
+    int levelCnt = envmapPrefilteredLevelCount(ggx);
+
+    if (glIsTexture(*glt))
+        glDeleteTextures(1, glt);
+    glGenTextures(1, glt);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ENVMAP_GGX);
+    glBindTexture(GL_TEXTURE_2D, *glt);
+    glTexStorage2D(GL_TEXTURE_2D, levelCnt, GL_RGB9_E5, w, h);
+    for (int k = 0; k < levelCnt; ++k) {
+        int lw, lh;
+        const float *data = envmapPrefilteredLevel(ggx, k, &lw, &lh);
+
+        glTexSubImage2D(GL_TEXTURE_2D, k, 0, 0, lw, lh, GL_RGB, GL_FLOAT, data);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCnt - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Envmap Cubemap Texture
+ *
+ * The cubemap has a full mip chain, so that the shaders fetch the envmap
+ * without the atan and acos of the equirectangular mapping.
+ */
+static bool loadEnvmapCubeTexture(const EnvmapCubemap *cm, int size)
+{
+    LOG("Loading {Envmap-Cube-Texture}\n");
+    GLuint *glt = &g_gl.textures[TEXTURE_ENVMAP_CUBE];
+    int levelCnt = envmapCubemapLevelCount(cm);
+
+    if (glIsTexture(*glt))
+        glDeleteTextures(1, glt);
+    glGenTextures(1, glt);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ENVMAP_CUBE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, *glt);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, levelCnt, GL_RGB9_E5, size, size);
+    for (int k = 0; k < levelCnt; ++k)
+    for (int face = 0; face < 6; ++face) {
+        int s;
+        const float *data = envmapCubemapFace(cm, k, face, &s);
+
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, k,
+                        0, 0, s, s, GL_RGB, GL_FLOAT, data);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    glActiveTexture(GL_TEXTURE0);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Envmap SH Buffer
+ *
+ * The SH coefficients are uploaded as the std140 array of vec4 of the
+ * EnvmapSh uniform block of the sphere shader, which evaluates the bands up
+ * to ENVMAP_SH_ORDER, so that changing the order only requires to reload
+ * the program.
+ */
+static bool loadEnvmapShBuffer(const float *coeffs)
+{
+    LOG("Loading {Envmap-SH-Buffer}\n");
+    float data[4 * 25];
+    GLuint *buffer = &g_gl.buffers[BUFFER_ENVMAP_SH];
+
+    for (int k = 0; k < 25; ++k) {
+        data[4 * k    ] = coeffs[3 * k    ];
+        data[4 * k + 1] = coeffs[3 * k + 1];
+        data[4 * k + 2] = coeffs[3 * k + 2];
+        data[4 * k + 3] = 0.0f;
+    }
+
+    if (glIsBuffer(*buffer))
+        glDeleteBuffers(1, buffer);
+    glGenBuffers(1, buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, *buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BUFFER_ENVMAP_SH, *buffer);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load the Envmap Texture
  *
- * This loads an RGB9_E5 texture used as a environment map.
+ * The HDR image of the envmap assets is uploaded with its mipmaps, its
+ * importance sampling tables as R32F textures (see envmap.h), and its SH
+ * coefficients. The cubemap and the GGX prefiltered levels are only
+ * uploaded when they are used.
  */
-bool loadEnvmapTexture()
+static bool loadEnvmapTexture(const EnvmapAssets &assets)
 {
-    LOG("Loading {Envmap-Texture}\n");
-    if (!g_sphere.shading.envmap.files.empty()) {
-        int id = g_sphere.shading.envmap.id;
-        const char *path = g_sphere.shading.envmap.files[id];
+    const EnvmapSampler *sampler = assets.sampler;
+    GLuint *glt = &g_gl.textures[TEXTURE_ENVMAP];
+    int w = assets.w, h = assets.h, levels = 1;
+
+    if (glIsTexture(*glt))
+        glDeleteTextures(1, glt);
+    glGenTextures(1, glt);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ENVMAP);
+    glBindTexture(GL_TEXTURE_2D, *glt);
+    while ((w | h) >> levels) // full mip chain
+        ++levels;
+    glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGB9_E5, w, h);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGB, GL_FLOAT, assets.texels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glActiveTexture(GL_TEXTURE0);
+
+    loadEnvmapSamplingTexture(TEXTURE_ENVMAP_MARGINAL, h + 1, 1,
+                              envmapMarginalCdf(sampler));
+    loadEnvmapSamplingTexture(TEXTURE_ENVMAP_CONDITIONAL, w + 1, h,
+                              envmapConditionalCdf(sampler));
+    loadEnvmapSamplingTexture(TEXTURE_ENVMAP_PDF, w, h,
+                              envmapTexelPdf(sampler));
 
-        if (glIsTexture(g_gl.textures[TEXTURE_ENVMAP]))
-            glDeleteTextures(1, &g_gl.textures[TEXTURE_ENVMAP]);
-        glGenTextures(1, &g_gl.textures[TEXTURE_ENVMAP]);
+    bool v = loadEnvmapShBuffer(assets.sh);
+    if (v && assets.cubemap)
+        v = loadEnvmapCubeTexture(assets.cubemap, assets.cubemapSize);
+    if (v && assets.ggx)
+        v = loadEnvmapGgxTexture(assets.ggx, w, h);
 
-        djg_texture *djgt = djgt_create(0);
-        GLuint *glt = &g_gl.textures[TEXTURE_ENVMAP];
+    return v;
+}
 
-        glActiveTexture(GL_TEXTURE0 + TEXTURE_ENVMAP);
-        djgt_push_image_hdr(djgt, path, 1);
+bool loadEnvmapTexture()
+{
+    LOG("Loading {Envmap-Texture}\n");
+    if (!g_sphere.shading.envmap.files.empty()) {
+        EnvmapAssets assets;
 
-        if (!djgt_to_gl(djgt, GL_TEXTURE_2D, GL_RGB9_E5, 1, 1, glt)) {
+        if (!loadEnvmapAssets(&assets)) {
             LOG("=> Failure <=\n");
-            djgt_release(djgt);
 
             return false;
         }
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glActiveTexture(GL_TEXTURE0);
+        bool v = loadEnvmapTexture(assets);
+        releaseEnvmapAssets(&assets);
+        if (!v) {
+            LOG("=> Failure <=\n");
 
-        djgt_release(djgt);
+            return false;
+        }
     }
     return (glGetError() == GL_NO_ERROR);
 }
@@ -759,6 +1427,9 @@ bool loadEnvmapTexture()
 // -----------------------------------------------------------------------------
 /**
  * Load All Textures
+ *
+ * The envmap and MERL textures are not part of it: init() loads their
+ * assets on worker threads and uploads them last.
  */
 bool loadTextures()
 {
@@ -766,9 +1437,7 @@ bool loadTextures()
 
     if (v) v&= loadSceneFramebufferTexture();
     if (v) v&= loadBackFramebufferTexture();
-    if (v) v&= loadEnvmapTexture();
     if (v) v&= loadNpfTexture();
-    if (v) v&= loadMerlTexture();
 
     return v;
 }
@@ -824,48 +1493,6 @@ bool loadSphereDataBuffers(float dt = 0)
     return (glGetError() == GL_NO_ERROR);
 }
 
-// -----------------------------------------------------------------------------
-/**
- * Load Random Buffer
- *
- * This buffer holds the random samples used by the GLSL Monte Carlo integrator.
- * It should be updated at each frame. The random samples are generated using
- * the Marsaglia pseudo-random generator.
- */
-uint32_t mrand() // Marsaglia random generator
-{
-    static uint32_t m_z = 1, m_w = 2;
-
-    m_z = 36969u * (m_z & 65535u) + (m_z >> 16u);
-    m_w = 18000u * (m_w & 65535u) + (m_w >> 16u);
-
-    return ((m_z << 16u) + m_w);
-}
-
-bool loadRandomBuffer()
-{
-    static bool first = true;
-    float buffer[256];
-    int offset = 0;
-
-    if (first) {
-        g_gl.streams[STREAM_RANDOM] = djgb_create(sizeof(buffer));
-        first = false;
-    }
-
-    for (int i = 0; i < BUFFER_SIZE(buffer); ++i) {
-        buffer[i] = (float)((double)mrand() / (double)0xFFFFFFFFu);
-        assert(buffer[i] <= 1.f && buffer[i] >= 0.f);
-    }
-
-    djgb_to_gl(g_gl.streams[STREAM_RANDOM], (const void *)buffer, &offset);
-    djgb_glbindrange(g_gl.streams[STREAM_RANDOM],
-                     GL_UNIFORM_BUFFER,
-                     STREAM_RANDOM);
-
-    return (glGetError() == GL_NO_ERROR);
-}
-
 // -----------------------------------------------------------------------------
 /**
  * Load Sphere Mesh Buffer
@@ -911,6 +1538,38 @@ bool loadSphereMeshBuffers()
     return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Convergence Buffers
+ *
+ * The convergence program counts the active pixels and sums their errors
+ * in a shader storage buffer, which is copied to a second buffer for the
+ * CPU to read back once a fence has signaled (see renderConvergence).
+ */
+bool loadConvergenceBuffers()
+{
+    LOG("Loading {Convergence-Buffers}\n");
+    GLuint *buffer = &g_gl.buffers[BUFFER_CONVERGENCE];
+    GLuint *readback = &g_gl.buffers[BUFFER_CONVERGENCE_READBACK];
+    GLsizeiptr size = 4 * sizeof(GLuint);
+
+    if (glIsBuffer(*buffer))
+        glDeleteBuffers(1, buffer);
+    if (glIsBuffer(*readback))
+        glDeleteBuffers(1, readback);
+    glGenBuffers(1, buffer);
+    glGenBuffers(1, readback);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_CONVERGENCE, *buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, *readback);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load All Buffers
@@ -921,8 +1580,8 @@ bool loadBuffers()
     bool v = true;
 
     v&= loadSphereDataBuffers();
-    v&= loadRandomBuffer();
     v&= loadSphereMeshBuffers();
+    v&= loadConvergenceBuffers();
 
     return v;
 }
@@ -1041,7 +1700,7 @@ bool loadBackFramebuffer()
  * Load the Scene Framebuffer
  *
  * This framebuffer is used to draw the 3D scene.
- * A single framebuffer is created, holding a color and Z buffer.
+ * A single framebuffer is created, holding a color, a moments and a Z buffer.
  * The scene writes directly to it.
  */
 bool loadSceneFramebuffer()
@@ -1059,6 +1718,11 @@ bool loadSceneFramebuffer()
                                GL_TEXTURE_2D_MULTISAMPLE,
                                g_gl.textures[TEXTURE_SCENE],
                                0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER,
+                               GL_COLOR_ATTACHMENT1,
+                               GL_TEXTURE_2D_MULTISAMPLE,
+                               g_gl.textures[TEXTURE_MOMENTS],
+                               0);
         glFramebufferTexture2D(GL_FRAMEBUFFER,
                                GL_DEPTH_STENCIL_ATTACHMENT,
                                GL_TEXTURE_2D_MULTISAMPLE,
@@ -1070,6 +1734,11 @@ bool loadSceneFramebuffer()
                                GL_TEXTURE_2D,
                                g_gl.textures[TEXTURE_SCENE],
                                0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER,
+                               GL_COLOR_ATTACHMENT1,
+                               GL_TEXTURE_2D,
+                               g_gl.textures[TEXTURE_MOMENTS],
+                               0);
         glFramebufferTexture2D(GL_FRAMEBUFFER,
                                GL_DEPTH_STENCIL_ATTACHMENT,
                                GL_TEXTURE_2D,
@@ -1077,7 +1746,8 @@ bool loadSceneFramebuffer()
                                0);
     }
 
-    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(BUFFER_SIZE(drawBuffers), drawBuffers);
     if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) {
         LOG("=> Failure <=\n");
 
@@ -1091,15 +1761,48 @@ bool loadSceneFramebuffer()
 
 // -----------------------------------------------------------------------------
 /**
- * Load All Framebuffers
+ * Load the Convergence Framebuffer
  *
+ * This framebuffer receives the per-pixel convergence test of the scene
+ * framebuffer (see renderConvergence).
  */
-bool loadFramebuffers()
+bool loadConvergenceFramebuffer()
 {
-    bool v = true;
+    LOG("Loading {Convergence-Framebuffer}\n");
+    if (glIsFramebuffer(g_gl.framebuffers[FRAMEBUFFER_CONVERGENCE]))
+        glDeleteFramebuffers(1, &g_gl.framebuffers[FRAMEBUFFER_CONVERGENCE]);
+
+    glGenFramebuffers(1, &g_gl.framebuffers[FRAMEBUFFER_CONVERGENCE]);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_CONVERGENCE]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D,
+                           g_gl.textures[TEXTURE_CONVERGENCE],
+                           0);
+
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) {
+        LOG("=> Failure <=\n");
+
+        return false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load All Framebuffers
+ *
+ */
+bool loadFramebuffers()
+{
+    bool v = true;
 
     v&= loadBackFramebuffer();
     v&= loadSceneFramebuffer();
+    v&= loadConvergenceFramebuffer();
 
     return v;
 }
@@ -1109,22 +1812,108 @@ bool loadFramebuffers()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Startup Timings
+ *
+ * The clock starts with main(); init() logs the duration of each of its
+ * phases, and render() the time to the first frame.
+ */
+static double startupClock()
+{
+    static const std::chrono::steady_clock::time_point epoch =
+        std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> dt =
+        std::chrono::steady_clock::now() - epoch;
+
+    return dt.count();
+}
+
+static double logStartupPhase(const char *name, double t0)
+{
+    double t1 = startupClock();
+
+    LOG("Note: {%s} loaded in %.1f ms\n", name, t1 - t0);
+
+    return t1;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Initialize the Demo
+ *
+ * The MERL BRDF and the envmap are decoded, fitted and tabulated on worker
+ * threads (see loadMerlAssets and loadEnvmapAssets) while the main thread
+ * creates the GL objects and compiles the programs; their textures are
+ * uploaded last, which is where the main thread waits for the workers.
+ */
 void init()
 {
+    EnvmapAssets envmapAssets = EnvmapAssets(); // outlives its worker
+    std::future<MerlAssets> merl;
+    std::future<bool> envmap;
+    double t = startupClock();
     bool v = true;
     int i;
 
+    if (!g_sphere.shading.merl.files.empty())
+        merl = std::async(std::launch::async, &loadMerlAssets);
+    if (!g_sphere.shading.envmap.files.empty())
+        envmap = std::async(std::launch::async, &loadEnvmapAssets, &envmapAssets);
+
     for (i = 0; i < CLOCK_COUNT; ++i) {
         if (g_gl.clocks[i])
             djgc_release(g_gl.clocks[i]);
         g_gl.clocks[i] = djgc_create();
     }
+    if (glIsQuery(g_gl.queries[0]))
+        glDeleteQueries(QUERY_COUNT, g_gl.queries);
+    glGenQueries(QUERY_COUNT, g_gl.queries);
+    g_framebuffer.tiles.queryTileCnt = 0;
+    for (i = 0; i < FENCE_COUNT; ++i) {
+        if (g_gl.fences[i])
+            glDeleteSync(g_gl.fences[i]);
+        g_gl.fences[i] = 0;
+    }
 
     if (v) v&= loadTextures();
+    t = logStartupPhase("Textures", t);
     if (v) v&= loadBuffers();
+    t = logStartupPhase("Buffers", t);
     if (v) v&= loadFramebuffers();
+    t = logStartupPhase("Framebuffers", t);
     if (v) v&= loadVertexArrays();
+    t = logStartupPhase("VertexArrays", t);
     if (v) v&= loadPrograms();
+    t = logStartupPhase("Programs", t);
+
+    // the workers are joined even if a step failed
+    if (envmap.valid()) {
+        bool decoded = envmap.get();
+
+        LOG("Loading {Envmap-Texture}\n");
+        if (!decoded) {
+            LOG("=> Failure <=\n");
+            v = false;
+        }
+        if (v) v&= loadEnvmapTexture(envmapAssets);
+        releaseEnvmapAssets(&envmapAssets);
+        t = logStartupPhase("Envmap", t);
+    }
+    if (merl.valid()) {
+        try {
+            MerlAssets assets = merl.get();
+
+            if (v) v&= loadMerlTexture(assets);
+        } catch (std::exception& e) {
+            LOG("%s\n", e.what());
+            v = false;
+        } catch (...) {
+            v = false;
+        }
+        t = logStartupPhase("MERL", t);
+    }
+    if (v) configureSphereProgram(); // the GGX roughness comes with the MERL
 
     if (!v) throw std::exception();
 }
@@ -1133,9 +1922,21 @@ void release()
 {
     int i;
 
+    recorderShutdown();
+    if (g_app.sweep.keys) {
+        keyframesRelease(g_app.sweep.keys);
+        g_app.sweep.keys = NULL;
+    }
     for (i = 0; i < CLOCK_COUNT; ++i)
         if (g_gl.clocks[i])
             djgc_release(g_gl.clocks[i]);
+    if (glIsQuery(g_gl.queries[0]))
+        glDeleteQueries(QUERY_COUNT, g_gl.queries);
+    for (i = 0; i < FENCE_COUNT; ++i) {
+        if (g_gl.fences[i])
+            glDeleteSync(g_gl.fences[i]);
+        g_gl.fences[i] = 0;
+    }
     for (i = 0; i < STREAM_COUNT; ++i)
         if (g_gl.streams[i])
             djgb_release(g_gl.streams[i]);
@@ -1163,88 +1964,306 @@ void release()
 
 // -----------------------------------------------------------------------------
 /**
- * Render the Scene
+ * Test the Convergence of the Scene
  *
- * This drawing pass renders the 3D scene to the framebuffer.
+ * This pass estimates the relative error of each pixel from the moments
+ * accumulated in the scene framebuffer. Pixels below the target error are
+ * skipped by the next passes, and progression stops once all pixels have
+ * converged. The count of active pixels and the sum of the errors are
+ * copied to the readback buffer behind a fence, and read a few frames
+ * later without stalling the pipeline (see readConvergence).
  */
-void renderSceneProgressive()
+void renderConvergence()
 {
-    // configure GL state
-    glBindFramebuffer(GL_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_SCENE]);
+    GLsizeiptr size = 4 * sizeof(GLuint);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_CONVERGENCE]);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI,
+                      GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_CONVERGENCE]);
     glViewport(0, 0, g_framebuffer.w, g_framebuffer.h);
-    glDepthFunc(GL_LESS);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    glUseProgram(g_gl.programs[PROGRAM_CONVERGENCE]);
+    glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, g_gl.buffers[BUFFER_CONVERGENCE]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_gl.buffers[BUFFER_CONVERGENCE_READBACK]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    g_gl.fences[FENCE_CONVERGENCE] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
-    if (g_framebuffer.flags.reset) {
-        glClearColor(0, 0, 0, g_framebuffer.samplesPerPass);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        g_framebuffer.pass = 0;
-        g_framebuffer.flags.reset = false;
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_ADAPTIVE],
+                       1);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Read the Result of the last Convergence Test
+ *
+ * Returns false while the copy of the last test has not completed; the
+ * scene keeps progressing in the meantime, on the pixels that test left
+ * active.
+ */
+bool readConvergence()
+{
+    GLsync *fence = &g_gl.fences[FENCE_CONVERGENCE];
+    double pixelCnt = (double)g_framebuffer.w * g_framebuffer.h;
+    GLuint v[4];
+    GLenum status;
+
+    if (!*fence)
+        return true;
+    status = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(*fence);
+    *fence = 0;
+    if (status == GL_WAIT_FAILED) {
+        LOG("djg_error: glClientWaitSync failed\n");
+        return true;
     }
 
+    glBindBuffer(GL_COPY_READ_BUFFER, g_gl.buffers[BUFFER_CONVERGENCE_READBACK]);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(v), v);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    g_framebuffer.adaptive.active = (float)(v[0] / pixelCnt);
+    g_framebuffer.adaptive.error =
+        (float)((v[2] * 4294967296.0 + v[1]) / 65536.0 / pixelCnt);
+    g_framebuffer.adaptive.converged = (v[0] == 0);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// the closed-form shading modes output the same value at each pass
+bool isShadingClosedForm()
+{
+    if (g_sphere.shading.mode == SHADING_DEBUG)
+        return false;
+
+    return g_sphere.shading.mode == SHADING_SPLIT_SUM
+        || (g_sphere.shading.brdf == BRDF_DIFFUSE && g_sphere.flags.envmapSh);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Render the Scene
+ *
+ * These drawing passes render the 3D scene to the framebuffer. Each pass
+ * adds samplesPerPass samples to the pixels it covers; progressive rendering
+ * draws one full-screen pass per frame, and tiled rendering draws as many
+ * tile-passes as fit the frame time budget.
+ */
+bool isSceneComplete()
+{
+    return g_framebuffer.pass * g_framebuffer.samplesPerPass
+        >= g_framebuffer.samplesPerPixel || g_framebuffer.adaptive.converged
+        || (g_framebuffer.pass > 0 && isShadingClosedForm());
+}
+
+void resetScene()
+{
+    glClearColor(0, 0, 0, g_framebuffer.samplesPerPass);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    g_framebuffer.pass = 0;
+    g_framebuffer.tiles.next = 0;
+    g_framebuffer.flags.reset = false;
+    g_framebuffer.adaptive.converged = false;
+    g_framebuffer.adaptive.active = 1.0f;
+    if (g_gl.fences[FENCE_CONVERGENCE]) { // drop the pending test
+        glDeleteSync(g_gl.fences[FENCE_CONVERGENCE]);
+        g_gl.fences[FENCE_CONVERGENCE] = 0;
+    }
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_ADAPTIVE],
+                       0);
+}
+
+void renderScenePass(int pass)
+{
     // enable blending only after the first is complete
     // (otherwise backfaces might be included in the rendering)
-    if (g_framebuffer.pass > 0) {
+    if (pass > 0) {
         glDepthFunc(GL_LEQUAL);
         glEnable(GL_BLEND);
         glBlendFunc(GL_ONE, GL_ONE);
-        loadRandomBuffer();
     } else {
         glDepthFunc(GL_LESS);
         glDisable(GL_BLEND);
     }
+    glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                       g_gl.uniforms[UNIFORM_SPHERE_PASS],
+                       pass);
 
-    // stop progressive drawing once the desired sampling rate has been reached
-    if (g_framebuffer.pass * g_framebuffer.samplesPerPass
-        < g_framebuffer.samplesPerPixel) {
+    // draw planets
+    if (g_sphere.flags.showLines)
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+    glUseProgram(g_gl.programs[PROGRAM_SPHERE]);
+    glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_SPHERE]);
+    glDrawElements(GL_TRIANGLES,
+                   g_sphere.sphere.indexCnt,
+                   GL_UNSIGNED_SHORT,
+                   NULL);
 
-        // draw planets
-        if (g_sphere.flags.showLines)
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    if (g_sphere.flags.showLines)
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    // draw background
+    glUseProgram(g_gl.programs[PROGRAM_BACKGROUND]);
+    glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
-        glUseProgram(g_gl.programs[PROGRAM_SPHERE]);
-        glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_SPHERE]);
-        glDrawElements(GL_TRIANGLES,
-                       g_sphere.sphere.indexCnt,
-                       GL_UNSIGNED_SHORT,
-                       NULL);
+// test convergence periodically, once the previous test has been read
+void testSceneConvergence()
+{
+    if (readConvergence()
+        && g_framebuffer.adaptive.enabled && !g_framebuffer.adaptive.converged
+        && g_framebuffer.pass % g_framebuffer.adaptive.period == 0
+        && g_framebuffer.pass * g_framebuffer.samplesPerPass
+           >= g_framebuffer.adaptive.minSamples) {
+        renderConvergence();
+    }
+}
 
-        if (g_sphere.flags.showLines)
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+void renderSceneProgressive()
+{
+    // configure GL state
+    glBindFramebuffer(GL_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_SCENE]);
+    glViewport(0, 0, g_framebuffer.w, g_framebuffer.h);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
 
-        // draw background
-        glUseProgram(g_gl.programs[PROGRAM_BACKGROUND]);
-        glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    if (g_framebuffer.flags.reset)
+        resetScene();
 
+    // stop progressive drawing once the desired sampling rate has been reached
+    // or all pixels have converged
+    bool draw = !isSceneComplete();
+    if (draw) {
+        renderScenePass(g_framebuffer.pass);
         ++g_framebuffer.pass;
     }
 
     // restore GL state
-    if (g_framebuffer.pass > 0) {
-        glDepthFunc(GL_LESS);
-        glDisable(GL_BLEND);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+
+    if (draw)
+        testSceneConvergence();
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Render the Scene by Tiles
+ *
+ * The scene framebuffer is split into square tiles that are rendered in
+ * scanline order, one pass per tile, so that all tiles hold either pass or
+ * pass + 1 passes. The number of tile-passes drawn per frame is the time
+ * budget divided by the GPU cost of a tile-pass, which is measured with a
+ * timer query and read back asynchronously on the next frames (a frame never
+ * waits for its result). The accumulation state persists across frames.
+ */
+void renderSceneTiled()
+{
+    int tileSize = g_framebuffer.tiles.size;
+    int tileX = (g_framebuffer.w + tileSize - 1) / tileSize;
+    int tileY = (g_framebuffer.h + tileSize - 1) / tileSize;
+    int passBefore = g_framebuffer.pass;
+    int tileCnt = 0, maxTileCnt = 1;
+    GLuint query = g_gl.queries[QUERY_TILES];
+    bool measure = false;
+
+    // configure GL state
+    glBindFramebuffer(GL_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_SCENE]);
+    glViewport(0, 0, g_framebuffer.w, g_framebuffer.h);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    if (g_framebuffer.flags.reset)
+        resetScene();
+
+    // update the cost of a tile-pass from the last measurement
+    if (g_framebuffer.tiles.queryTileCnt > 0) {
+        GLint available = 0;
+
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 ns;
+            double ms;
+
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            ms = ns / 1e6 / g_framebuffer.tiles.queryTileCnt;
+            if (g_framebuffer.tiles.cost > 0.0)
+                g_framebuffer.tiles.cost+= 0.25 * (ms - g_framebuffer.tiles.cost);
+            else
+                g_framebuffer.tiles.cost = ms;
+            g_framebuffer.tiles.queryTileCnt = 0;
+        }
+    }
+    if (g_framebuffer.tiles.cost > 0.0) {
+        maxTileCnt = (int)(g_framebuffer.tiles.budget / g_framebuffer.tiles.cost);
+        if (maxTileCnt < 1) maxTileCnt = 1;
+    }
+
+    // draw tile-passes
+    measure = (g_framebuffer.tiles.queryTileCnt == 0) && !isSceneComplete();
+    if (measure)
+        glBeginQuery(GL_TIME_ELAPSED, query);
+    glEnable(GL_SCISSOR_TEST);
+    while (tileCnt < maxTileCnt && !isSceneComplete()) {
+        int tile = g_framebuffer.tiles.next;
+
+        glScissor((tile % tileX) * tileSize, (tile / tileX) * tileSize,
+                  tileSize, tileSize);
+        renderScenePass(g_framebuffer.pass);
+        ++tileCnt;
+
+        if (++g_framebuffer.tiles.next == tileX * tileY) {
+            g_framebuffer.tiles.next = 0;
+            ++g_framebuffer.pass;
+
+            // convergence is tested on complete passes only
+            if (g_framebuffer.adaptive.enabled
+                && g_framebuffer.pass % g_framebuffer.adaptive.period == 0)
+                break;
+        }
+    }
+    glDisable(GL_SCISSOR_TEST);
+    if (measure) {
+        glEndQuery(GL_TIME_ELAPSED);
+        g_framebuffer.tiles.queryTileCnt = tileCnt;
     }
+
+    // restore GL state
+    glDepthFunc(GL_LESS);
+    glDisable(GL_BLEND);
     glDisable(GL_CULL_FACE);
     glDisable(GL_DEPTH_TEST);
+
+    if (g_framebuffer.pass != passBefore)
+        testSceneConvergence();
 }
 
 void renderScene()
 {
     loadSphereDataBuffers(1.f);
-    if (g_framebuffer.flags.progressive) {
+    if (g_framebuffer.flags.progressive)
         renderSceneProgressive();
-    } else {
-        int passCnt = g_framebuffer.samplesPerPixel
-                    / g_framebuffer.samplesPerPass;
-
-        if (!passCnt) passCnt = 1;
-        for (int i = 0; i < passCnt; ++i) {
-            loadRandomBuffer();
-            renderSceneProgressive();
-        }
-    }
+    else
+        renderSceneTiled();
 }
 
 // -----------------------------------------------------------------------------
@@ -1257,7 +2276,8 @@ void renderScene()
 void imguiSetAa()
 {
     if (!loadSceneFramebufferTexture() || !loadSceneFramebuffer()
-    || !loadViewerProgram()) {
+    || !loadConvergenceFramebuffer() || !loadViewerProgram()
+    || !loadConvergenceProgram()) {
         LOG("=> Framebuffer config failed <=\n");
         throw std::exception();
     }
@@ -1283,7 +2303,7 @@ void renderViewer(double cpuDt, double gpuDt)
         ImGui_ImplGlfwGL3_NewFrame();
         // Viewer Widgets
         ImGui::SetNextWindowPos(ImVec2(270, 10)/*, ImGuiSetCond_FirstUseEver*/);
-        ImGui::SetNextWindowSize(ImVec2(250, 120)/*, ImGuiSetCond_FirstUseEver*/);
+        ImGui::SetNextWindowSize(ImVec2(250, 250)/*, ImGuiSetCond_FirstUseEver*/);
         ImGui::Begin("Framebuffer");
         {
             const char* aaItems[] = {
@@ -1297,7 +2317,37 @@ void renderViewer(double cpuDt, double gpuDt)
                 imguiSetAa();
             if (ImGui::Combo("MSAA", &g_framebuffer.msaa.fixed, "Fixed\0Random\0\0"))
                 imguiSetAa();
-            ImGui::Checkbox("Progressive", &g_framebuffer.flags.progressive);
+            if (ImGui::Combo("Sampler", &g_framebuffer.sampler.type, "Random\0Sobol\0R2\0\0")) {
+                loadSphereProgram();
+                g_framebuffer.flags.reset = true;
+            }
+            if (ImGui::Checkbox("Progressive", &g_framebuffer.flags.progressive))
+                g_framebuffer.flags.reset = true;
+            if (!g_framebuffer.flags.progressive) {
+                const char* tileItems[] = {"32", "64", "128", "256", "512"};
+                int tileId = 0;
+
+                while ((32 << tileId) < g_framebuffer.tiles.size) ++tileId;
+                if (ImGui::Combo("Tile Size", &tileId, tileItems, BUFFER_SIZE(tileItems))) {
+                    g_framebuffer.tiles.size = 32 << tileId;
+                    g_framebuffer.tiles.cost = 0.0;
+                    g_framebuffer.flags.reset = true;
+                }
+                ImGui::SliderFloat("Budget (ms)", &g_framebuffer.tiles.budget, 1.0f, 33.0f);
+                ImGui::Text("Tile-Pass: %.3fms", g_framebuffer.tiles.cost);
+            }
+            if (ImGui::Checkbox("Adaptive", &g_framebuffer.adaptive.enabled))
+                g_framebuffer.flags.reset = true;
+            if (g_framebuffer.adaptive.enabled) {
+                if (ImGui::SliderFloat("Target Error", &g_framebuffer.adaptive.targetError, 0.001f, 0.1f, "%.3f")) {
+                    configureConvergenceProgram();
+                    g_framebuffer.flags.reset = true;
+                }
+                ImGui::Text("Active Pixels: %.2f%%%s",
+                            g_framebuffer.adaptive.active * 100.0f,
+                            g_framebuffer.adaptive.converged ? " (converged)" : "");
+                ImGui::Text("Mean Error: %.4f", g_framebuffer.adaptive.error);
+            }
             if (g_framebuffer.flags.progressive) {
                 ImGui::SameLine();
                 if (ImGui::Button("Reset"))
@@ -1323,8 +2373,14 @@ void renderViewer(double cpuDt, double gpuDt)
                 djgt_save_glcolorbuffer_png(GL_FRONT, GL_RGBA, buf);
                 ++cnt;
             }
-            if (ImGui::Button("Record"))
+            if (ImGui::Button("Record")) {
                 g_app.recorder.on = !g_app.recorder.on;
+                if (!g_app.recorder.on) {
+                    recorderShutdown();
+                    g_app.recorder.frame = 0;
+                    ++g_app.recorder.capture;
+                }
+            }
             if (g_app.recorder.on) {
                 ImGui::SameLine();
                 ImGui::Text("Recording...");
@@ -1357,19 +2413,35 @@ void renderViewer(double cpuDt, double gpuDt)
                 "MC Cos",
                 "MC GGX",
                 "MC MIS",
+                "Split Sum",
                 "Debug"
             };
             const char* brdfModes[] = {
                 "diffuse",
                 "merl",
-                "npf"
+                "npf",
+                "tab",
+                "sgd",
+                "abc",
+                "utia"
+            };
+            const char* tableModes[] = {
+                "90x90x180",
+                "45x45x90",
+                "30x30x60"
             };
             if (ImGui::Combo("Shading", &g_sphere.shading.mode, shadingModes, BUFFER_SIZE(shadingModes))) {
+                if (g_sphere.shading.mode == SHADING_SPLIT_SUM)
+                    loadEnvmapTexture();
                 loadSphereProgram();
                 loadMerlTexture();
                 g_framebuffer.flags.reset = true;
             }
+            int bakedBrdf = getBakedBrdf();
             if (ImGui::Combo("Brdf", &g_sphere.shading.brdf, brdfModes, BUFFER_SIZE(brdfModes))) {
+                // the MERL file is only read again if the table changes
+                if (getBakedBrdf() != bakedBrdf)
+                    loadMerlTexture();
                 loadSphereProgram();
                 g_framebuffer.flags.reset = true;
             }
@@ -1380,6 +2452,13 @@ void renderViewer(double cpuDt, double gpuDt)
                     g_framebuffer.flags.reset = true;
                 }
             }
+            if (!g_sphere.shading.utia.files.empty()) {
+                if (ImGui::Combo("Utia", &g_sphere.shading.utia.id, &g_sphere.shading.utia.files[0], g_sphere.shading.utia.files.size())) {
+                    if (g_sphere.shading.brdf == BRDF_UTIA)
+                        loadMerlTexture();
+                    g_framebuffer.flags.reset = true;
+                }
+            }
             if (!g_sphere.shading.envmap.files.empty()) {
                 if (ImGui::Combo("Envmap", &g_sphere.shading.envmap.id, &g_sphere.shading.envmap.files[0], g_sphere.shading.envmap.files.size())) {
                     loadEnvmapTexture();
@@ -1390,6 +2469,38 @@ void renderViewer(double cpuDt, double gpuDt)
             if (ImGui::CollapsingHeader("Flags", ImGuiTreeNodeFlags_DefaultOpen)) {
                 if (ImGui::Checkbox("Wireframe", &g_sphere.flags.showLines))
                     g_framebuffer.flags.reset = true;
+                if (ImGui::Checkbox("Envmap Sampling", &g_sphere.flags.envmapSampling)) {
+                    loadSphereProgram();
+                    g_framebuffer.flags.reset = true;
+                }
+                if (ImGui::Checkbox("Cubemap", &g_sphere.flags.envmapCubemap)) {
+                    if (g_sphere.flags.envmapCubemap)
+                        loadEnvmapTexture();
+                    loadBackgroundProgram();
+                    loadSphereProgram();
+                    g_framebuffer.flags.reset = true;
+                }
+                if (ImGui::Checkbox("SH Irradiance", &g_sphere.flags.envmapSh)) {
+                    loadSphereProgram();
+                    g_framebuffer.flags.reset = true;
+                }
+                if (g_sphere.flags.envmapSh) {
+                    if (ImGui::SliderInt("SH Order", &g_sphere.shading.envmap.shOrder, 2, 4)) {
+                        loadSphereProgram();
+                        g_framebuffer.flags.reset = true;
+                    }
+                }
+            }
+            if (ImGui::CollapsingHeader("Table", ImGuiTreeNodeFlags_DefaultOpen)) {
+                if (ImGui::Combo("Resolution", &g_sphere.shading.table.res, tableModes, BUFFER_SIZE(tableModes))) {
+                    loadMerlTexture();
+                    loadSphereProgram();
+                    g_framebuffer.flags.reset = true;
+                }
+                if (ImGui::Checkbox("Half Precision", &g_sphere.shading.table.half)) {
+                    loadMerlTexture();
+                    g_framebuffer.flags.reset = true;
+                }
             }
             if (ImGui::CollapsingHeader("Geometry", ImGuiTreeNodeFlags_DefaultOpen)) {
                 if (ImGui::SliderInt("xTess", &g_sphere.sphere.xTess, 0, 128)) {
@@ -1412,14 +2523,18 @@ void renderViewer(double cpuDt, double gpuDt)
 
     // screen recording
     if (g_app.recorder.on) {
-        char name[64], path[1024];
-
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_BACK]);
-        sprintf(name, "capture_%02i_%09i",
-                g_app.recorder.capture,
-                g_app.recorder.frame);
-        strcat2(path, g_app.dir.output, name);
-        djgt_save_glcolorbuffer_bmp(GL_COLOR_ATTACHMENT0, GL_RGB, path);
+        if (!recorderIsRunning()) {
+            char name[64], path[1024];
+
+            sprintf(name, "capture_%02i_", g_app.recorder.capture);
+            strcat2(path, g_app.dir.output, name);
+            if (g_app.recorder.format == RECORDER_FORMAT_Y4M)
+                strcpy(path, "-");
+            if (!recorderInit(g_app.recorder.format,
+                              g_app.viewer.w, g_app.viewer.h, 60, path))
+                g_app.recorder.on = false;
+        }
+        recorderCapture(g_gl.framebuffers[FRAMEBUFFER_BACK]);
         ++g_app.recorder.frame;
     }
 
@@ -1461,9 +2576,129 @@ void render()
     djgc_stop(g_gl.clocks[CLOCK_SPF]);
     djgc_ticks(g_gl.clocks[CLOCK_SPF], &cpuDt, &gpuDt);
     renderViewer(cpuDt, gpuDt);
-    renderBack();
+    if (!g_app.headless.on) // there is no window to blit to
+        renderBack();
+    if (g_app.frame == 0) {
+        LOG("Note: time to first frame %.1f ms\n", startupClock());
+    }
     ++g_app.frame;
 }
+
+// -----------------------------------------------------------------------------
+/**
+ * Idle Scheduling
+ *
+ * Once the scene is complete, the main loop stops drawing and waits for
+ * events, and the window keeps showing the last frame. Input events wake
+ * the viewer for a few frames so that the HUD can respond to them.
+ */
+#define IDLE_WAKE_FRAMES 3
+void wakeViewer()
+{
+    g_app.idle.frames = IDLE_WAKE_FRAMES;
+}
+
+bool isViewerIdle()
+{
+    return g_app.idle.on && g_app.idle.frames == 0
+        && !g_framebuffer.flags.reset && isSceneComplete()
+        && !g_app.recorder.on && !g_app.sweep.keys;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Save the Composited Framebuffer to Disk
+ *
+ */
+void saveBackFramebuffer(const char *name)
+{
+    char path[1024];
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_BACK]);
+    strcat2(path, g_app.dir.output, name);
+    LOG("Note: saving %s.png\n", path);
+    djgt_save_glcolorbuffer_png(GL_COLOR_ATTACHMENT0, GL_RGBA, path);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Set the Parameters of the Sweep at Time t
+ *
+ * Tracks: merl and envmap (indexes) and camera (position, looking at the
+ * origin).
+ */
+void setSweepParameters(double t)
+{
+    const Keyframes *keys = g_app.sweep.keys;
+    float v[3];
+
+    if (keyframesStep(keys, "merl", t, v, 1)) {
+        int id = (int)v[0];
+        int cnt = (int)g_sphere.shading.merl.files.size();
+
+        if (id != g_sphere.shading.merl.id && id >= 0 && id < cnt) {
+            g_sphere.shading.merl.id = id;
+            loadMerlTexture();
+            loadSphereProgram();
+        }
+    }
+    if (keyframesStep(keys, "envmap", t, v, 1)) {
+        int id = (int)v[0];
+        int cnt = (int)g_sphere.shading.envmap.files.size();
+
+        if (id != g_sphere.shading.envmap.id && id >= 0 && id < cnt) {
+            g_sphere.shading.envmap.id = id;
+            loadEnvmapTexture();
+            loadSphereProgram();
+        }
+    }
+    if (keyframesEval(keys, "camera", t, v, 3)) {
+        g_camera.pos = dja::vec3(v[0], v[1], v[2]);
+        g_camera.axis = dja::mat3::lookat(dja::vec3(0.f), g_camera.pos,
+                                          dja::vec3(0, 0, 1));
+    }
+    g_framebuffer.flags.reset = true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Advance the Keyframed Sweep
+ *
+ * Called before each render: records the current sweep frame once it is
+ * complete and sets up the next one. Returns false once the whole sweep has
+ * been recorded (always true when no sweep is loaded).
+ */
+bool updateSweep()
+{
+    if (!g_app.sweep.keys)
+        return true;
+
+    if (g_app.sweep.frame < 0) {
+        char path[1024];
+
+        if (g_app.recorder.format == RECORDER_FORMAT_Y4M)
+            strcpy(path, "-");
+        else
+            strcat2(path, g_app.dir.output, "sweep_");
+        if (!recorderInit(g_app.recorder.format,
+                          g_app.viewer.w, g_app.viewer.h,
+                          (int)g_app.sweep.fps, path))
+            return false;
+    } else if (!isSceneComplete()) {
+        return true;
+    } else {
+        recorderCapture(g_gl.framebuffers[FRAMEBUFFER_BACK]);
+    }
+
+    if (++g_app.sweep.frame == g_app.sweep.frameCnt) {
+        recorderShutdown();
+        return false;
+    }
+    setSweepParameters(g_app.sweep.frame / g_app.sweep.fps);
+
+    return true;
+}
 ////////////////////////////////////////////////////////////////////////////////
 
 // -----------------------------------------------------------------------------
@@ -1473,6 +2708,7 @@ keyboardCallback(
     int key, int scancode, int action, int mods
 ) {
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureKeyboard)
         return;
 
@@ -1494,6 +2730,7 @@ keyboardCallback(
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 }
@@ -1505,6 +2742,7 @@ void mouseMotionCallback(GLFWwindow* window, double x, double y)
            dy = y - y0;
 
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 
@@ -1533,6 +2771,7 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
     ImGuiIO& io = ImGui::GetIO();
     ImGui_ImplGlfw_ScrollCallback(window, xoffset, yoffset);
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 
@@ -1541,16 +2780,96 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
     g_framebuffer.flags.reset = true;
 }
 
+// the window content was damaged, or its focus changed: redraw
+void windowRefreshCallback(GLFWwindow* window)
+{
+    wakeViewer();
+}
+
+void windowFocusCallback(GLFWwindow* window, int focused)
+{
+    wakeViewer();
+}
+
 void usage(const char *app)
 {
     printf("%s -- OpenGL Merl Renderer\n", app);
     printf("usage: %s --merl merl1 merl2 ... --envmap env1 env2 ... "
-           "--npf-data path_to_uber_texture_data --shader-dir path_to_shaders\n", app);
+           "--utia utia1 utia2 ... "
+           "--npf-data path_to_uber_texture_data --shader-dir path_to_shaders "
+           "[--split-sum --ggx-levels n --ggx-samples n --cache-dir path] "
+           "[--sh-order 2|3|4 --no-sh] [--cubemap-size n --no-cubemap] "
+           "[--headless egl|osmesa --output-dir path "
+           "--samples-per-pixel n --frame-limit n] "
+           "[--record --record-format png|y4m] "
+           "[--sweep keyframes.txt --sweep-fps n] [--no-idle]\n", app);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Render without a Window
+ *
+ * Runs the same init()/render() code in an offscreen context until the
+ * image is complete (or the frame limit is reached), and saves the
+ * composited framebuffer to the output directory.
+ */
+int mainHeadless()
+{
+    g_app.viewer.hud = false;
+    if (!headlessInit(g_app.headless.backend,
+                      VIEWER_DEFAULT_WIDTH, VIEWER_DEFAULT_HEIGHT)) {
+        LOG("=> Failure <=\n");
+        return -1;
+    }
+
+    // Load OpenGL functions
+    LOG("Loading {OpenGL}\n");
+    if (!gladLoadGLLoader((GLADloadproc)headlessGetProcAddress)) {
+        LOG("gladLoadGLLoader failed\n");
+        headlessShutdown();
+        return -1;
+    }
+
+    LOG("-- Begin -- Demo (headless)\n");
+    try {
+        init();
+
+        if (g_app.sweep.keys) {
+            while (updateSweep())
+                render();
+        } else {
+            do {
+                render();
+            } while (!isSceneComplete()
+                && (g_app.frameLimit < 0 || g_app.frame < g_app.frameLimit));
+            LOG("Note: %i samples per pixel in %i frames\n",
+                g_framebuffer.pass * g_framebuffer.samplesPerPass, g_app.frame);
+            saveBackFramebuffer("headless");
+        }
+
+        release();
+        headlessShutdown();
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        headlessShutdown();
+        LOG("(!) Demo Killed (!)\n");
+
+        return EXIT_FAILURE;
+    }
+    LOG("-- End -- Demo\n");
+
+    return 0;
 }
 
 // -----------------------------------------------------------------------------
 int main(int argc, const char **argv)
 {
+    startupClock(); // starts the clock
+    // keep stdout for the video stream when recording y4m
+    for (int i = 1; i + 1 < argc; ++i)
+        if (!strcmp("--record-format", argv[i]) && !strcmp("y4m", argv[i + 1]))
+            recorderReserveStdout();
+
     for (int i = 1; i < argc; ++i) {
         if (!strcmp("--merl", argv[i])) {
             int cnt = 0;
@@ -1569,15 +2888,96 @@ int main(int argc, const char **argv)
                 ++i;
             } while ((cnt < argc-i) && strncmp("-", argv[i], 1));
             LOG("Note: number of Envmaps set to %i\n", cnt);
+        } else if (!strcmp("--utia", argv[i])) {
+            int cnt = 0;
+
+            while (i + 1 < argc && strncmp("-", argv[i + 1], 1)) {
+                g_sphere.shading.utia.files.push_back(argv[++i]);
+                ++cnt;
+            }
+            LOG("Note: number of UTIA BRDFs set to %i\n", cnt);
         } else if (!strcmp("--shader-dir", argv[i])) {
             g_app.dir.shader = argv[++i];
             LOG("Note: shader dir set to %s\n", g_app.dir.shader);
         } else if (!strcmp("--npf-data", argv[i])) {
             g_sphere.shading.pathToUberData = argv[++i];
             LOG("Note: NPF data set to %s\n", g_sphere.shading.pathToUberData);
+        } else if (!strcmp("--headless", argv[i]) && i + 1 < argc) {
+            g_app.headless.backend = headlessParseBackend(argv[++i]);
+            g_app.headless.on = true;
+            if (g_app.headless.backend < 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            LOG("Note: headless rendering with %s\n", argv[i]);
+        } else if (!strcmp("--cubemap-size", argv[i]) && i + 1 < argc) {
+            g_sphere.shading.envmap.cubemapSize = atoi(argv[++i]);
+            LOG("Note: cubemap size set to %i\n", g_sphere.shading.envmap.cubemapSize);
+        } else if (!strcmp("--no-cubemap", argv[i])) {
+            g_sphere.flags.envmapCubemap = false;
+            LOG("Note: cubemap disabled\n");
+        } else if (!strcmp("--sh-order", argv[i]) && i + 1 < argc) {
+            g_sphere.shading.envmap.shOrder = std::max(2, std::min(4, atoi(argv[++i])));
+            LOG("Note: SH order set to %i\n", g_sphere.shading.envmap.shOrder);
+        } else if (!strcmp("--no-sh", argv[i])) {
+            g_sphere.flags.envmapSh = false;
+            LOG("Note: SH irradiance disabled\n");
+        } else if (!strcmp("--split-sum", argv[i])) {
+            g_sphere.shading.mode = SHADING_SPLIT_SUM;
+            LOG("Note: split-sum shading\n");
+        } else if (!strcmp("--ggx-levels", argv[i]) && i + 1 < argc) {
+            g_sphere.shading.envmap.ggxLevelCnt = atoi(argv[++i]);
+            LOG("Note: GGX prefiltered levels set to %i\n", g_sphere.shading.envmap.ggxLevelCnt);
+        } else if (!strcmp("--ggx-samples", argv[i]) && i + 1 < argc) {
+            g_sphere.shading.envmap.ggxSampleCnt = atoi(argv[++i]);
+            LOG("Note: GGX prefiltering samples set to %i\n", g_sphere.shading.envmap.ggxSampleCnt);
+        } else if (!strcmp("--cache-dir", argv[i]) && i + 1 < argc) {
+            g_app.dir.cache = argv[++i];
+            LOG("Note: cache dir set to %s\n", g_app.dir.cache);
+        } else if (!strcmp("--output-dir", argv[i]) && i + 1 < argc) {
+            g_app.dir.output = argv[++i];
+            LOG("Note: output dir set to %s\n", g_app.dir.output);
+        } else if (!strcmp("--samples-per-pixel", argv[i]) && i + 1 < argc) {
+            g_framebuffer.samplesPerPixel = atoi(argv[++i]);
+            LOG("Note: samples per pixel set to %i\n", g_framebuffer.samplesPerPixel);
+        } else if (!strcmp("--frame-limit", argv[i]) && i + 1 < argc) {
+            g_app.frameLimit = atoi(argv[++i]);
+            LOG("Note: frame limit set to %i\n", g_app.frameLimit);
+        } else if (!strcmp("--sweep", argv[i]) && i + 1 < argc) {
+            g_app.sweep.keys = keyframesLoad(argv[++i]);
+            if (!g_app.sweep.keys)
+                return EXIT_FAILURE;
+            g_app.viewer.hud = false;
+            LOG("Note: sweep set to %s\n", argv[i]);
+        } else if (!strcmp("--sweep-fps", argv[i]) && i + 1 < argc) {
+            g_app.sweep.fps = atof(argv[++i]);
+            LOG("Note: sweep fps set to %f\n", g_app.sweep.fps);
+        } else if (!strcmp("--no-idle", argv[i])) {
+            g_app.idle.on = false;
+            LOG("Note: idle mode disabled\n");
+        } else if (!strcmp("--record", argv[i])) {
+            g_app.recorder.on = true;
+            LOG("Note: recording enabled\n");
+        } else if (!strcmp("--record-format", argv[i]) && i + 1 < argc) {
+            g_app.recorder.format = recorderParseFormat(argv[++i]);
+            if (g_app.recorder.format < 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            LOG("Note: recording format set to %s\n", argv[i]);
         }
     }
 
+    if (g_app.sweep.keys) {
+        // (the epsilon absorbs the rounding of the key times)
+        g_app.sweep.frameCnt =
+            (int)(keyframesDuration(g_app.sweep.keys) * g_app.sweep.fps + 1e-3) + 1;
+        LOG("Note: sweep has %i frames\n", g_app.sweep.frameCnt);
+    }
+
+    if (g_app.headless.on)
+        return mainHeadless();
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -1601,6 +3001,8 @@ int main(int argc, const char **argv)
     glfwSetCursorPosCallback(window, &mouseMotionCallback);
     glfwSetMouseButtonCallback(window, &mouseButtonCallback);
     glfwSetScrollCallback(window, &mouseScrollCallback);
+    glfwSetWindowRefreshCallback(window, &windowRefreshCallback);
+    glfwSetWindowFocusCallback(window, &windowFocusCallback);
 
     // Load OpenGL functions
     LOG("Loading {OpenGL}\n");
@@ -1617,8 +3019,17 @@ int main(int argc, const char **argv)
         ImGui::StyleColorsDark();
         init();
 
-        while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
+        while (!glfwWindowShouldClose(window) && updateSweep()) {
+            // wait for events instead of redrawing the same frame
+            if (isViewerIdle()) {
+                glfwWaitEventsTimeout(g_app.idle.timeout);
+                if (isViewerIdle())
+                    continue;
+            } else {
+                glfwPollEvents();
+            }
+            if (g_app.idle.frames > 0)
+                --g_app.idle.frames;
 
             glClearColor(0.8, 0.8, 0.8, 1.0);
             glClear(GL_COLOR_BUFFER_BIT);
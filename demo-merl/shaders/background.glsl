@@ -3,6 +3,9 @@
 // --------------------------------------------------
 uniform vec3 u_ClearColor;
 uniform sampler2D u_EnvmapSampler;
+#if ENVMAP_CUBEMAP
+uniform samplerCube u_EnvmapCubeSampler;
+#endif
 
 struct Transform {
 	mat4 modelView;
@@ -18,10 +21,14 @@ uniform Transforms {
 
 vec3 evalEnvmap(vec3 dir)
 {
+#if ENVMAP_CUBEMAP
+	return texture(u_EnvmapCubeSampler, dir).rgb;
+#else
 	float pi = 3.14159265359;
 	float u1 = atan(dir.x, dir.y) / pi * 0.5 + 0.5;
 	float u2 = 1.0 - acos(dir.z) / pi;
 	return texture(u_EnvmapSampler, vec2(u1, u2)).rgb;
+#endif
 }
 
 // --------------------------------------------------
@@ -46,10 +53,12 @@ void main() {
 #ifdef FRAGMENT_SHADER
 layout(location = 0) in vec3 i_TexCoord;
 layout(location = 0) out vec4 o_FragColor;
+layout(location = 1) out vec4 o_Moments;
 
 void main() {
 	vec3 dir = normalize(i_TexCoord);
 	o_FragColor = vec4(evalEnvmap(dir), 1);
+	o_Moments = vec4(0); // the background is noise free
 }
 #endif
 
@@ -43,14 +43,22 @@ implied warranties of merchantability, fitness for a particular purpose and non-
 infringement.
 */
 
+// RGB table of f_r baked with djb::baked (one texel per cell)
 uniform samplerBuffer u_MerlSampler;
 
-const int BRDF_SAMPLING_RES_THETA_H = 90;
-const int BRDF_SAMPLING_RES_THETA_D = 90;
-const int BRDF_SAMPLING_RES_PHI_D   = 360;
-const float RED_SCALE = (1.0/1500.0);
-const float GREEN_SCALE = (1.15/1500.0);
-const float BLUE_SCALE = (1.66/1500.0);
+#ifndef MERL_RES_THETA_H
+#define MERL_RES_THETA_H 90
+#endif
+#ifndef MERL_RES_THETA_D
+#define MERL_RES_THETA_D 90
+#endif
+#ifndef MERL_RES_PHI_D
+#define MERL_RES_PHI_D 180
+#endif
+
+const int BRDF_SAMPLING_RES_THETA_H = MERL_RES_THETA_H;
+const int BRDF_SAMPLING_RES_THETA_D = MERL_RES_THETA_D;
+const int BRDF_SAMPLING_RES_PHI_D   = 2 * MERL_RES_PHI_D;
 #ifndef M_PI
 #define M_PI  3.1415926535897932384626433832795
 #endif
@@ -121,17 +129,7 @@ vec3 BRDF( vec3 toLight, vec3 toViewer, vec3 normal, vec3 tangent, vec3 bitangen
 		theta_half_index(theta_H) * BRDF_SAMPLING_RES_PHI_D / 2 *
 		BRDF_SAMPLING_RES_THETA_D;
 
-	int redIndex = ind;
-	int greenIndex = ind + BRDF_SAMPLING_RES_THETA_H*BRDF_SAMPLING_RES_THETA_D*BRDF_SAMPLING_RES_PHI_D/2;
-	int blueIndex = ind + BRDF_SAMPLING_RES_THETA_H*BRDF_SAMPLING_RES_THETA_D*BRDF_SAMPLING_RES_PHI_D;
-
-#if 1
-	return vec3(
-		texelFetch(u_MerlSampler, redIndex).r * RED_SCALE,
-		texelFetch(u_MerlSampler, greenIndex).r * GREEN_SCALE,
-		texelFetch(u_MerlSampler, blueIndex).r * BLUE_SCALE
-	);
-#endif
+	return texelFetch(u_MerlSampler, ind).rgb;
 }
 
 #undef M_PI
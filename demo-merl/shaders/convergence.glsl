@@ -0,0 +1,85 @@
+uniform float u_TargetError;
+
+// active pixel count and sum of the relative errors, a 64-bit integer holding
+// 16 fractional bits (read back by the CPU, see renderConvergence)
+layout(std430, binding = BUFFER_BINDING_CONVERGENCE)
+buffer Convergence {
+	uint u_ActivePixelCount;
+	uint u_ErrorSumLo;
+	uint u_ErrorSumHi;
+};
+
+#if MSAA_FACTOR
+uniform sampler2DMS u_MomentsSampler;
+#else
+uniform sampler2D   u_MomentsSampler;
+#endif
+
+// -------------------------------------------------------------------------------------------------
+/**
+ * Vertex Shader
+ *
+ * This vertex shader draws a fullscreen quad
+ */
+#ifdef VERTEX_SHADER
+void main(void)
+{
+	vec2 p = vec2(gl_VertexID & 1, gl_VertexID >> 1 & 1);
+	gl_Position = vec4(2.0 * p - 1.0, 0.0, 1.0);
+}
+#endif
+
+// -------------------------------------------------------------------------------------------------
+/**
+ * Fragment Shader
+ *
+ * This fragment shader estimates the relative error of each pixel from the
+ * luminance moments accumulated by the sphere shader, i.e., {sum(Y),
+ * sum(Y^2), 0, sample count}. It outputs 1 if the pixel still needs samples
+ * and 0 otherwise, and accumulates the count of active pixels and the sum
+ * of the errors in the convergence buffer.
+ */
+#ifdef FRAGMENT_SHADER
+layout(location = 0) out float o_Convergence;
+
+float relativeError(vec4 moments)
+{
+	float n = moments.a;
+
+	if (n < 2.0) // background or not enough samples
+		return 0.0;
+
+	float mean = moments.x / n;
+	float var = max(0.0, moments.y / n - mean * mean) * n / (n - 1.0);
+
+	return sqrt(var / n) / (mean + 1e-3);
+}
+
+void main(void)
+{
+	ivec2 P = ivec2(gl_FragCoord.xy);
+	float error = 0.0;
+
+#if MSAA_FACTOR
+	for (int i = 0; i < MSAA_FACTOR; ++i)
+		error = max(error, relativeError(texelFetch(u_MomentsSampler, P, i)));
+#else
+	error = relativeError(texelFetch(u_MomentsSampler, P, 0));
+#endif
+
+	bool isActive = error > u_TargetError;
+
+	if (isActive)
+		atomicAdd(u_ActivePixelCount, 1u);
+
+	if (error > 0.0) {
+		uint e = uint(min(error, 65535.0) * 65536.0);
+
+		if (atomicAdd(u_ErrorSumLo, e) > 0xFFFFFFFFu - e) // carry
+			atomicAdd(u_ErrorSumHi, 1u);
+	}
+
+	o_Convergence = isActive ? 1.0 : 0.0;
+}
+#endif
+
@@ -3,9 +3,9 @@ uniform sampler2D u_NpfSampler;
 const float M_PI = 3.14159265359;
 const float M_PI_2 = 1.57079632679;
 
-// decode the simple HDR format in the PNG
-vec3 uberTextureLookup( vec2 uv ) {
-	vec4 color = texture( u_NpfSampler, uv );
+// fetch texel x of material n (the texture has one row per material)
+vec3 uberTextureLookup( int x, int n ) {
+	vec4 color = texelFetch( u_NpfSampler, ivec2(x, n), 0 );
 	return color.xyz;
 }
 
@@ -43,25 +43,20 @@ vec3 lookupInterpolatedG1(int n, float theta)
     float w1 = 1.0 - w0 ; // 1.0 - (f1 - fb)
     // sample
     vec3 G1 = vec3(0.0);
-    vec2 uv;
-    uv.y = float(n)/256.;
 	if (t1 > 90.0-1.0)
     {
-    	uv.x = (t0+2.+90.)/512.;
-        G1 = uberTextureLookup(uv) * w0 ;
+        G1 = uberTextureLookup(int(t0)+2+90, n) * w0 ;
     }
     else
     {
-    	uv.x = (t0+2.+90.)/512.;
-    	vec3 g0 = uberTextureLookup(uv);
-    	uv.x = (t1+2.+90.)/512.;
-    	vec3 g1 = uberTextureLookup(uv);
+    	vec3 g0 = uberTextureLookup(int(t0)+2+90, n);
+    	vec3 g1 = uberTextureLookup(int(t1)+2+90, n);
         G1 = g0 * w0 + g1 * w1;
     }
     return G1;
 }
 
-// material index goes from 0 to 99
+// material index goes from 0 to the number of rows of the texture minus one
 // each texture row contains: rhoD rhoS D[90] G1[90] F[90]
 vec3 getBRDF(int n, vec3 dirIn, vec3 dirOut, vec3 dirNormal) {
 	if (dirIn.z < 0 || dirOut.z < 0)
@@ -73,28 +68,21 @@ vec3 getBRDF(int n, vec3 dirIn, vec3 dirOut, vec3 dirNormal) {
 	float thetaI = acos(dot(dirIn, dirNormal));
 	float thetaO = acos(dot(dirOut, dirNormal));
 
-	// BRDF texture has a fixed size of 512x256
-	vec2 uv;
-	uv.y = float(n)/256.;
+	// BRDF texture is 512 texels wide
+	vec3 rhoD = uberTextureLookup(0, n);
 
-	uv.x = 0.0/512.;
-	vec3 rhoD = uberTextureLookup(uv);
-
-	uv.x = 1.0/512.;
-	vec3 rhoS = uberTextureLookup(uv);
+	vec3 rhoS = uberTextureLookup(1, n);
 
 	int iD = int(clamp(sqrt(thetaH / M_PI_2
 	             * 90.0 * 90.0), 0.0, 89.0));
-	uv.x = float(iD+2)/512.;
-	vec3 D = uberTextureLookup(uv);
+	vec3 D = uberTextureLookup(iD+2, n);
 
 	vec3 G1I = lookupInterpolatedG1(n, thetaI);
 
 	vec3 G1O = lookupInterpolatedG1(n, thetaO);
 
 	int iF = int(clamp(thetaD / M_PI_2 * 90.0, 0.0, 89.0));
-	uv.x = float(iF+2+90+90)/512.;
-	vec3 F = uberTextureLookup(uv);
+	vec3 F = uberTextureLookup(iF+2+90+90, n);
 
 	vec3 BRDF = (rhoD) + (rhoS) * D * F *
 	            (G1I / cos(thetaI)) * (G1O / cos(thetaO));
@@ -46,6 +46,7 @@ float cap_solidangle(cap c1, cap c2);
 
 // Approximate BRDF shading
 float GGXSphereLightingPivotApprox(sphere s, vec3 wo, vec3 pivot);
+float GGXSphereLightingPivotTable(sphere s, vec3 wo, float alpha, sampler3D pivots);
 
 //
 //
@@ -112,6 +113,27 @@ float GGXSphereLightingPivotApprox(sphere s, vec3 wo, vec3 pivot)
 	return clamp(res, 0.0, 1.0);
 }
 
+// Same as above, with the pivot and its scale fetched from a table fitted
+// offline (see tools/pivot-fit.cpp); the table is parameterized by
+// sqrt(alpha), sqrt(1 - cos(theta_o)) and sqrt(1 - cos of the cap aperture)
+float GGXSphereLightingPivotTable(sphere s, vec3 wo, float alpha, sampler3D pivots)
+{
+	// compute the table coordinates
+	float tmp = clamp(s.r * s.r / dot(s.pos, s.pos), 0.0, 1.0);
+	vec3 u = vec3(sqrt(clamp(alpha, 0.0, 1.0)),
+	              sqrt(clamp(1.0 - wo.z, 0.0, 1.0)),
+	              sqrt(tmp / (1.0 + sqrt(1.0 - tmp))));
+	vec3 res = vec3(textureSize(pivots, 0));
+	vec3 p = texture(pivots, (u * (res - 1.0) + 0.5) / res).rgb;
+
+	// the pivot lies in the plane of incidence
+	float l = length(wo.xy);
+	vec2 dir = l > 0.0 ? wo.xy / l : vec2(1, 0);
+	vec3 pivot = vec3(p.x * dir, p.y);
+
+	return p.z * GGXSphereLightingPivotApprox(s, wo, pivot);
+}
+
 // -----------------------------------------------------------------------------
 // sample warps
 
@@ -0,0 +1,93 @@
+// *****************************************************************************
+/**
+ * Counter-based sample streams
+ *
+ * Sample i of a stream is a pure function of (seed, i): shaders derive the
+ * seed from the pixel coordinates and the index from the pass and sample
+ * numbers, so no random numbers are uploaded between passes. The streams
+ * match djb::sampler bit for bit. This file only uses scalar uint arithmetic
+ * common to GLSL and C++ so that tools/sampler-check.cpp can include it (with
+ * a uint typedef) and verify the sequences on the CPU.
+ */
+#define SAMPLER_RANDOM 0
+#define SAMPLER_SOBOL  1
+#define SAMPLER_R2     2
+
+// integer hash (lowbias32)
+uint sampler_hash(uint x)
+{
+	x^= x >> 16u;
+	x*= 0x7feb352du;
+	x^= x >> 15u;
+	x*= 0x846ca68bu;
+	x^= x >> 16u;
+
+	return x;
+}
+
+uint sampler_reverse(uint x)
+{
+	x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+	x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+	x = ((x >> 4u) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4u);
+	x = ((x >> 8u) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8u);
+
+	return (x >> 16u) | (x << 16u);
+}
+
+// Owen scrambling (hash-based nested uniform scrambling)
+uint sampler_owen(uint x, uint seed)
+{
+	x = sampler_reverse(x);
+	x^= x * 0x3d20adeau;
+	x+= seed;
+	x*= (seed >> 16u) | 1u;
+	x^= x * 0x05526c56u;
+	x^= x * 0x53a22864u;
+
+	return sampler_reverse(x);
+}
+
+// first two dimensions of the Sobol sequence
+uint sampler_sobol(uint i, int dim)
+{
+	uint x = 0u, v = 1u << 31u;
+
+	for (; i != 0u; i>>= 1u) {
+		if ((i & 1u) != 0u)
+			x^= v;
+		v = (dim == 0) ? (v >> 1u) : (v ^ (v >> 1u));
+	}
+
+	return x;
+}
+
+// scrambling key of dimension dim
+uint sampler_key(uint seed, int dim)
+{
+	uint key = sampler_hash(seed ^ 0x9e3779b9u);
+
+	return (dim == 0) ? key : sampler_hash(key);
+}
+
+// 32 random bits for dimension dim (0 or 1) of sample i
+uint sampler_bits(int type, uint seed, uint i, int dim)
+{
+	uint key = sampler_key(seed, dim);
+
+	if (type == SAMPLER_SOBOL)
+		return sampler_owen(sampler_sobol(i, dim), key);
+	if (type == SAMPLER_R2) // fixed-point 1 / g and 1 / g^2, g^3 = g + 1
+		return key + i * ((dim == 0) ? 3242174889u : 2447445414u);
+
+	uint x = sampler_hash(i ^ sampler_key(seed, 0));
+
+	return (dim == 0) ? x : sampler_hash(x ^ key);
+}
+
+// maps 32 bits to [0, 1) (24 bits are kept so that floats never round up)
+float sampler_unit(uint bits)
+{
+	return float(bits >> 8u) * 5.9604644775390625e-8;
+}
+
@@ -5,6 +5,7 @@
  *
  */
 uniform int u_SamplesPerPass;
+uniform int u_Pass;
 
 
 struct Transform {
@@ -19,19 +20,29 @@ uniform Transforms {
 	Transform u_Transform;
 };
 
-layout(std140, binding = BUFFER_BINDING_RANDOM)
-uniform Random {
-	vec4 value[64];
-} u_Random;
+#ifdef FRAGMENT_SHADER
+// sample j of the current pass, drawn from stream s of the pixel (streams
+// have distinct seeds, hence independent scrambles)
+vec2 rand(int j, uint s)
+{
+	uvec2 p = uvec2(gl_FragCoord.xy);
+	uint seed = sampler_hash(p.x ^ sampler_hash(p.y ^ sampler_hash(s)));
+	uint i = uint(u_Pass * u_SamplesPerPass + j);
 
-vec4 rand(int idx) { return u_Random.value[idx]; }
-float hash(vec2 p)
+	return vec2(sampler_unit(sampler_bits(SAMPLER_TYPE, seed, i, 0)),
+	            sampler_unit(sampler_bits(SAMPLER_TYPE, seed, i, 1)));
+}
+
+vec2 rand(int j)
 {
-	float h = dot(p, vec2(127.1, 311.7));
-	return fract(sin(h) * 43758.5453123);
+	return rand(j, 0u);
 }
+#endif
 
 uniform sampler2D u_EnvmapSampler;
+#if ENVMAP_CUBEMAP
+uniform samplerCube u_EnvmapCubeSampler;
+#endif
 uniform float u_Alpha;
 uniform int u_MerlId = 0;
 
@@ -39,11 +50,146 @@ uniform int u_MerlId = 0;
 
 vec3 evalEnvmap(vec3 dir)
 {
+#if ENVMAP_CUBEMAP
+	return textureLod(u_EnvmapCubeSampler, dir, 0.0).rgb;
+#else
 	float u1 = atan(dir.x, dir.y) / M_PI * 0.5 + 0.5;
 	float u2 = 1.0 - acos(dir.z) / M_PI;
 	return textureLod(u_EnvmapSampler, vec2(u1, u2), 0.0).rgb;
+#endif
+}
+
+#if ENVMAP_SAMPLING
+// importance sampling tables of the envmap (see envmap.h)
+uniform sampler2D u_EnvmapMarginalSampler;
+uniform sampler2D u_EnvmapConditionalSampler;
+uniform sampler2D u_EnvmapPdfSampler;
+
+// index i of the interval such that cdf[i] <= u < cdf[i + 1]
+int envmapSearch(sampler2D cdf, int row, int n, float u)
+{
+	int lo = 0, hi = n;
+
+	while (hi - lo > 1) {
+		int mid = (lo + hi) / 2;
+
+		if (texelFetch(cdf, ivec2(mid, row), 0).r <= u)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+// solid angle density of an envmap sample from its texel
+float envmapPdf(ivec2 P, float sinTheta)
+{
+	float pdf = texelFetch(u_EnvmapPdfSampler, P, 0).r;
+
+	return sinTheta > 0.0 ? pdf / (2.0 * M_PI * M_PI * sinTheta) : 0.0;
 }
 
+float envmapPdf(vec3 dir)
+{
+	ivec2 size = textureSize(u_EnvmapPdfSampler, 0);
+	float z = clamp(dir.z, -1.0, 1.0);
+	float u1 = atan(dir.x, dir.y) / M_PI * 0.5 + 0.5;
+	float u2 = 1.0 - acos(z) / M_PI;
+	ivec2 P = clamp(ivec2(vec2(u1, u2) * vec2(size)), ivec2(0), size - 1);
+
+	return envmapPdf(P, sqrt(max(0.0, 1.0 - z * z)));
+}
+
+// draws a world space direction with a density proportional to the
+// luminance of the envmap (row from the marginal CDF, then texel from the
+// conditional CDF of the row, then uniformly within the texel)
+vec3 envmapSample(vec2 u, out float pdf)
+{
+	ivec2 size = textureSize(u_EnvmapPdfSampler, 0);
+	int j = envmapSearch(u_EnvmapMarginalSampler, 0, size.y, u.y);
+	int i = envmapSearch(u_EnvmapConditionalSampler, j, size.x, u.x);
+	float m0 = texelFetch(u_EnvmapMarginalSampler, ivec2(j, 0), 0).r;
+	float m1 = texelFetch(u_EnvmapMarginalSampler, ivec2(j + 1, 0), 0).r;
+	float c0 = texelFetch(u_EnvmapConditionalSampler, ivec2(i, j), 0).r;
+	float c1 = texelFetch(u_EnvmapConditionalSampler, ivec2(i + 1, j), 0).r;
+	vec2 f = min(vec2((u.x - c0) / (c1 - c0), (u.y - m0) / (m1 - m0)),
+	             vec2(0.999999));
+	vec2 uv = (vec2(i, j) + f) / vec2(size);
+	float phi = (uv.x - 0.5) * 2.0 * M_PI;
+	float theta = (1.0 - uv.y) * M_PI;
+	float sinTheta = sin(theta);
+
+	pdf = envmapPdf(ivec2(i, j), sinTheta);
+
+	return vec3(sinTheta * sin(phi), sinTheta * cos(phi), cos(theta));
+}
+#endif
+
+#if ENVMAP_SH
+// SH coefficients of the envmap convolved with the clamped cosine over pi
+// (see envmap.h), RGB in xyz; ENVMAP_SH_ORDER is in [2, 4]
+layout(std140, binding = BUFFER_BINDING_ENVMAP_SH)
+uniform EnvmapSh {
+	vec4 u_EnvmapSh[25];
+};
+
+// radiance reflected by a white Lambertian surface of world space normal n
+vec3 evalEnvmapSh(vec3 n)
+{
+	float x = n.x, y = n.y, z = n.z;
+	float x2 = x * x, y2 = y * y, z2 = z * z;
+	vec3 L = u_EnvmapSh[0].rgb * 0.282095;
+
+	L+= u_EnvmapSh[1].rgb * (0.488603 * y);
+	L+= u_EnvmapSh[2].rgb * (0.488603 * z);
+	L+= u_EnvmapSh[3].rgb * (0.488603 * x);
+
+	L+= u_EnvmapSh[4].rgb * (1.092548 * x * y);
+	L+= u_EnvmapSh[5].rgb * (1.092548 * y * z);
+	L+= u_EnvmapSh[6].rgb * (0.315392 * (3.0 * z2 - 1.0));
+	L+= u_EnvmapSh[7].rgb * (1.092548 * x * z);
+	L+= u_EnvmapSh[8].rgb * (0.546274 * (x2 - y2));
+#if ENVMAP_SH_ORDER >= 3
+	L+= u_EnvmapSh[ 9].rgb * (0.590044 * y * (3.0 * x2 - y2));
+	L+= u_EnvmapSh[10].rgb * (2.890611 * x * y * z);
+	L+= u_EnvmapSh[11].rgb * (0.457046 * y * (5.0 * z2 - 1.0));
+	L+= u_EnvmapSh[12].rgb * (0.373176 * z * (5.0 * z2 - 3.0));
+	L+= u_EnvmapSh[13].rgb * (0.457046 * x * (5.0 * z2 - 1.0));
+	L+= u_EnvmapSh[14].rgb * (1.445306 * z * (x2 - y2));
+	L+= u_EnvmapSh[15].rgb * (0.590044 * x * (x2 - 3.0 * y2));
+#endif
+#if ENVMAP_SH_ORDER >= 4
+	L+= u_EnvmapSh[16].rgb * (2.503343 * x * y * (x2 - y2));
+	L+= u_EnvmapSh[17].rgb * (1.770131 * y * z * (3.0 * x2 - y2));
+	L+= u_EnvmapSh[18].rgb * (0.946175 * x * y * (7.0 * z2 - 1.0));
+	L+= u_EnvmapSh[19].rgb * (0.669047 * y * z * (7.0 * z2 - 3.0));
+	L+= u_EnvmapSh[20].rgb * (0.105786 * (35.0 * z2 * z2 - 30.0 * z2 + 3.0));
+	L+= u_EnvmapSh[21].rgb * (0.669047 * x * z * (7.0 * z2 - 3.0));
+	L+= u_EnvmapSh[22].rgb * (0.473087 * (x2 - y2) * (7.0 * z2 - 1.0));
+	L+= u_EnvmapSh[23].rgb * (1.770131 * x * z * (x2 - 3.0 * y2));
+	L+= u_EnvmapSh[24].rgb * (0.625836 * (x2 * (x2 - 3.0 * y2) - y2 * (3.0 * x2 - y2)));
+#endif
+
+	return max(L, vec3(0));
+}
+#endif
+
+#if SHADE_SPLIT_SUM
+// GGX prefiltered envmap (level k has alpha = (k / (levelCnt - 1))^2) and
+// directional albedo of the BRDF as a function of cos(theta_o)
+uniform sampler2D u_EnvmapGgxSampler;
+uniform sampler2D u_AlbedoSampler;
+
+vec3 evalEnvmapGgx(vec3 dir, float roughness)
+{
+	float lod = roughness * float(textureQueryLevels(u_EnvmapGgxSampler) - 1);
+	float u1 = atan(dir.x, dir.y) / M_PI * 0.5 + 0.5;
+	float u2 = 1.0 - acos(clamp(dir.z, -1.0, 1.0)) / M_PI;
+	return textureLod(u_EnvmapGgxSampler, vec2(u1, u2), lod).rgb;
+}
+#endif
+
 vec3 evalBrdf(vec3 wi, vec3 wo)
 {
 	float c = clamp(wi.z, 0.0, 1.0);
@@ -99,9 +245,29 @@ layout(location = 2) in vec4 i_Tangent1;
 layout(location = 3) in vec4 i_Tangent2;
 layout(location = 4) flat in int i_SphereId;
 layout(location = 0) out vec4 o_FragColor;
+layout(location = 1) out vec4 o_Moments;
+
+uniform int u_Adaptive;
+uniform sampler2D u_ConvergenceSampler;
+
+// luminance of a sample and its square (see convergence.glsl)
+vec2 moments(vec3 L)
+{
+	float y = dot(L, vec3(0.2126, 0.7152, 0.0722));
+
+	return vec2(y, y * y);
+}
 
 void main(void)
 {
+	// skip the pixels that have converged
+	if (u_Adaptive != 0) {
+		ivec2 P = ivec2(gl_FragCoord.xy);
+
+		if (texelFetch(u_ConvergenceSampler, P, 0).r == 0.0)
+			discard;
+	}
+
 	// extract attributes
 	vec3 wx = normalize(i_Tangent1.xyz);
 	vec3 wy = normalize(i_Tangent2.xyz);
@@ -116,19 +282,33 @@ void main(void)
 
 	// initialize emitted and outgoing radiance
 	vec3 Lo = vec3(0);
+	vec2 m = vec2(0);
+
+// -----------------------------------------------------------------------------
+/**
+ * Diffuse Shading with Spherical Harmonics
+ *
+ * The closed form of the envmap convolved with the clamped cosine replaces
+ * the Monte Carlo estimators; each pass outputs the same value.
+ */
+#if (BRDF_DIFFUSE && ENVMAP_SH)
+	vec4 tmp = vec4(transpose(tg) * wn, 0);
+	vec3 wnWorld = normalize( (u_Transform.viewInv * tmp).xyz );
+
+	Lo = evalEnvmapSh(wnWorld);
+	o_FragColor = vec4(Lo * u_SamplesPerPass, u_SamplesPerPass);
 
 // -----------------------------------------------------------------------------
 /**
  * Shading with Importance Sampling
  *
  */
-#if (SHADE_MC_GGX || SHADE_MC_COS)
+#elif (SHADE_MC_GGX || SHADE_MC_COS)
 		// loop over all samples
 	for (int j = 0; j < u_SamplesPerPass; ++j) {
+		vec3 Lj = Lo;
 		// compute a uniform sample
-		float h1 = hash(gl_FragCoord.xy);
-		float h2 = hash(gl_FragCoord.yx);
-		vec2 u2 = mod(vec2(h1, h2) + rand(j).xy, vec2(1.0));
+		vec2 u2 = rand(j);
 #if SHADE_MC_COS
 		vec3 wi = u2_to_cos(u2);
 		float pdf = pdf_cos(wi);
@@ -147,6 +327,7 @@ void main(void)
 
 		if (pdf > 0.0)
 			Lo+= Li * frp / pdf;
+		m+= moments(Lo - Lj);
 	}
 
 	o_FragColor = vec4(Lo, u_SamplesPerPass);
@@ -159,10 +340,9 @@ void main(void)
 #elif SHADE_MC_MIS
 	// loop over all samples
 	for (int j = 0; j < u_SamplesPerPass; ++j) {
+		vec3 Lj = Lo;
 		// compute a uniform sample
-		float h1 = hash(gl_FragCoord.xy);
-		float h2 = hash(gl_FragCoord.yx);
-		vec2 u2 = mod(vec2(h1, h2) + rand(j).xy, vec2(1.0));
+		vec2 u2 = rand(j);
 
 		// importance sample the GGX Approx
 		if (true) {
@@ -178,8 +358,13 @@ void main(void)
 			// raytrace the sphere light
 			if (pdf1 > 0.0) {
 				float pdf2 = pdf_cos(wi);
+#if ENVMAP_SAMPLING
+				float pdf3 = envmapPdf(wiWorld);
+#else
+				float pdf3 = 0.0;
+#endif
 				float misWeight = pdf1 * pdf1;
-				float misNrm = pdf1 * pdf1 + pdf2 * pdf2;
+				float misNrm = pdf1 * pdf1 + pdf2 * pdf2 + pdf3 * pdf3;
 
 				Lo+= Li * frp / pdf1 * misWeight / misNrm;
 			}
@@ -197,16 +382,70 @@ void main(void)
 			if (pdf2 > 0.0) {
 				float pdf1;
 				ggx_evalp(wi, wo, u_Alpha, pdf1);
+#if ENVMAP_SAMPLING
+				float pdf3 = envmapPdf(wiWorld);
+#else
+				float pdf3 = 0.0;
+#endif
 				float misWeight = pdf2 * pdf2;
-				float misNrm = pdf1 * pdf1 + pdf2 * pdf2;
+				float misNrm = pdf1 * pdf1 + pdf2 * pdf2 + pdf3 * pdf3;
 
 				Lo+= Li * frp / pdf2 * misWeight / misNrm;
 			}
 		}
+
+#if ENVMAP_SAMPLING
+		// importance sample the envmap (from a stream of its own, so that
+		// the sample is independent of the previous ones)
+		if (true) {
+			float pdf3;
+			vec3 wiWorld = envmapSample(rand(j, 1u), pdf3);
+			mat3 viewInv = mat3(u_Transform.viewInv);
+			vec3 wi = tg * (transpose(viewInv) * wiWorld);
+
+			if (pdf3 > 0.0 && wi.z > 0.0) {
+				vec3 frp = evalBrdf(wi, wo);
+				vec3 Li = evalEnvmap(wiWorld);
+				float pdf1;
+				ggx_evalp(wi, wo, u_Alpha, pdf1);
+				float pdf2 = pdf_cos(wi);
+				float misWeight = pdf3 * pdf3;
+				float misNrm = pdf1 * pdf1 + pdf2 * pdf2 + pdf3 * pdf3;
+
+				Lo+= Li * frp / pdf3 * misWeight / misNrm;
+			}
+		}
+#endif
+		m+= moments(Lo - Lj);
 	}
 
 	o_FragColor = vec4(Lo, u_SamplesPerPass);
 
+// -----------------------------------------------------------------------------
+/**
+ * Split-Sum Shading
+ *
+ * The prefiltered radiance around the mirror direction, at the roughness
+ * of the GGX fit, times the directional albedo of the BRDF. This is a
+ * noise-free approximation: each pass outputs the same value.
+ */
+#elif SHADE_SPLIT_SUM
+#if BRDF_DIFFUSE
+	// the roughest level around the normal
+	vec3 wr = vec3(0, 0, 1);
+	float roughness = 1.0;
+	vec3 albedo = vec3(1.0);
+#else
+	vec3 wr = vec3(-wo.x, -wo.y, wo.z);
+	float roughness = clamp(sqrt(u_Alpha), 0.0, 1.0);
+	vec3 albedo = texture(u_AlbedoSampler, vec2(wo.z, 0.5)).rgb;
+#endif
+	vec4 tmp = vec4(transpose(tg) * wr, 0);
+	vec3 wrWorld = normalize( (u_Transform.viewInv * tmp).xyz );
+
+	Lo = evalEnvmapGgx(wrWorld, roughness) * albedo;
+	o_FragColor = vec4(Lo * u_SamplesPerPass, u_SamplesPerPass);
+
 	// -----------------------------------------------------------------------------
 /**
  * Debug Shading
@@ -230,6 +469,7 @@ void main(void)
 // -----------------------------------------------------------------------------
 #endif // SHADE
 
+	o_Moments = vec4(m, 0, u_SamplesPerPass);
 }
 #endif // FRAGMENT_SHADER
 
@@ -0,0 +1,1007 @@
+#include "envmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+static const double PI = 3.14159265358979323846;
+
+struct EnvmapSampler {
+    int w, h;
+    std::vector<float> marginalCdf;
+    std::vector<float> conditionalCdf;
+    std::vector<float> texelPdf;
+};
+
+// -----------------------------------------------------------------------------
+// index i of the interval such that cdf[i] <= u < cdf[i + 1]; intervals of
+// zero probability are never returned since cdf[0] = 0 <= u < cdf[n] = 1
+static int search(const float *cdf, int n, float u)
+{
+    int lo = 0, hi = n;
+
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+
+        if (cdf[mid] <= u)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+// normalizes a running sum into a CDF (uniform if the sum is zero)
+static void normalize(float *cdf, const double *sum, int n)
+{
+    cdf[0] = 0.0f;
+    for (int i = 1; i < n; ++i)
+        cdf[i] = sum[n] > 0.0 ? (float)(sum[i] / sum[n]) : (float)i / n;
+    cdf[n] = 1.0f;
+}
+
+// -----------------------------------------------------------------------------
+EnvmapSampler *
+envmapCreateSampler(const float *texels, int w, int h, int threadCnt)
+{
+    EnvmapSampler *s = new EnvmapSampler();
+    std::vector<double> rowSum(h);
+    std::vector<std::thread> threads;
+
+    s->w = w;
+    s->h = h;
+    s->marginalCdf.resize(h + 1);
+    s->conditionalCdf.resize(h * (w + 1));
+    s->texelPdf.resize(w * h);
+
+    // conditional CDFs (one row per thread at a time)
+    threadCnt = std::max(1, std::min(threadCnt, h));
+    for (int t = 0; t < threadCnt; ++t) {
+        threads.push_back(std::thread([=, &rowSum] {
+            std::vector<double> sum(w + 1);
+
+            for (int j = t; j < h; j+= threadCnt) {
+                double sinTheta = sin(PI * (j + 0.5) / h);
+
+                sum[0] = 0.0;
+                for (int i = 0; i < w; ++i) {
+                    const float *rgb = &texels[3 * (j * w + i)];
+                    double y = 0.2126 * rgb[0] + 0.7152 * rgb[1] + 0.0722 * rgb[2];
+                    double f = y > 0.0 ? y * sinTheta : 0.0; // also rejects NaNs
+
+                    s->texelPdf[j * w + i] = (float)f;
+                    sum[i + 1] = sum[i] + f;
+                }
+                normalize(&s->conditionalCdf[j * (w + 1)], &sum[0], w);
+                rowSum[j] = sum[w];
+            }
+        }));
+    }
+    for (int t = 0; t < threadCnt; ++t)
+        threads[t].join();
+
+    // marginal CDF
+    std::vector<double> sum(h + 1);
+    sum[0] = 0.0;
+    for (int j = 0; j < h; ++j)
+        sum[j + 1] = sum[j] + rowSum[j];
+    if (!(sum[h] > 0.0)) {
+        LOG("envmap_error: the envmap has no energy to sample\n");
+        delete s;
+        return NULL;
+    }
+    normalize(&s->marginalCdf[0], &sum[0], h);
+
+    for (int i = 0; i < w * h; ++i)
+        s->texelPdf[i] = (float)(s->texelPdf[i] * ((double)w * h / sum[h]));
+
+    return s;
+}
+
+void envmapReleaseSampler(EnvmapSampler *s)
+{
+    delete s;
+}
+
+int envmapSamplerWidth(const EnvmapSampler *s)
+{
+    return s->w;
+}
+
+int envmapSamplerHeight(const EnvmapSampler *s)
+{
+    return s->h;
+}
+
+const float *envmapMarginalCdf(const EnvmapSampler *s)
+{
+    return &s->marginalCdf[0];
+}
+
+const float *envmapConditionalCdf(const EnvmapSampler *s)
+{
+    return &s->conditionalCdf[0];
+}
+
+const float *envmapTexelPdf(const EnvmapSampler *s)
+{
+    return &s->texelPdf[0];
+}
+
+// -----------------------------------------------------------------------------
+void envmapSample(const EnvmapSampler *s, float u1, float u2,
+                  float dir[3], float *pdf)
+{
+    const float *m = &s->marginalCdf[0];
+    int j = search(m, s->h, u2);
+    const float *c = &s->conditionalCdf[j * (s->w + 1)];
+    int i = search(c, s->w, u1);
+    float fv = (u2 - m[j]) / (m[j + 1] - m[j]);
+    float fu = (u1 - c[i]) / (c[i + 1] - c[i]);
+    double u = (i + std::min(fu, 0.999999f)) / s->w;
+    double v = (j + std::min(fv, 0.999999f)) / s->h;
+    double phi = (u - 0.5) * 2.0 * PI;
+    double theta = (1.0 - v) * PI;
+    double sinTheta = sin(theta);
+
+    dir[0] = (float)(sinTheta * sin(phi));
+    dir[1] = (float)(sinTheta * cos(phi));
+    dir[2] = (float)cos(theta);
+    (*pdf) = sinTheta > 0.0
+           ? (float)(s->texelPdf[j * s->w + i] / (2.0 * PI * PI * sinTheta))
+           : 0.0f;
+}
+
+float envmapPdf(const EnvmapSampler *s, const float dir[3])
+{
+    double z = std::max(-1.0, std::min(1.0, (double)dir[2]));
+    double u = atan2((double)dir[0], (double)dir[1]) / PI * 0.5 + 0.5;
+    double v = 1.0 - acos(z) / PI;
+    double sinTheta = sqrt(1.0 - z * z);
+    int i = std::max(0, std::min(s->w - 1, (int)(u * s->w)));
+    int j = std::max(0, std::min(s->h - 1, (int)(v * s->h)));
+
+    if (sinTheta <= 0.0)
+        return 0.0f;
+
+    return (float)(s->texelPdf[j * s->w + i] / (2.0 * PI * PI * sinTheta));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// GGX Prefiltering
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// bump when the prefiltered data changes so that stale cache files are ignored
+#define ENVMAP_CACHE_VERSION 1
+
+struct EnvmapLevel {
+    int w, h;
+    std::vector<float> texels;
+};
+
+struct EnvmapPrefiltered {
+    std::vector<EnvmapLevel> levels;
+};
+
+// -----------------------------------------------------------------------------
+// box filtered mip chain of the envmap
+static std::vector<EnvmapLevel>
+buildMips(const float *texels, int w, int h, int mipCnt)
+{
+    std::vector<EnvmapLevel> mips(mipCnt);
+
+    mips[0].w = w;
+    mips[0].h = h;
+    mips[0].texels.assign(texels, texels + 3 * w * h);
+    for (int k = 1; k < mipCnt; ++k) {
+        const EnvmapLevel &src = mips[k - 1];
+        EnvmapLevel &dst = mips[k];
+
+        dst.w = std::max(1, src.w / 2);
+        dst.h = std::max(1, src.h / 2);
+        dst.texels.resize(3 * dst.w * dst.h);
+        for (int j = 0; j < dst.h; ++j)
+        for (int i = 0; i < dst.w; ++i)
+        for (int c = 0; c < 3; ++c) {
+            int i0 = std::min(2 * i, src.w - 1), i1 = std::min(2 * i + 1, src.w - 1);
+            int j0 = std::min(2 * j, src.h - 1), j1 = std::min(2 * j + 1, src.h - 1);
+
+            dst.texels[3 * (j * dst.w + i) + c] = 0.25f * (
+                src.texels[3 * (j0 * src.w + i0) + c] +
+                src.texels[3 * (j0 * src.w + i1) + c] +
+                src.texels[3 * (j1 * src.w + i0) + c] +
+                src.texels[3 * (j1 * src.w + i1) + c]);
+        }
+    }
+
+    return mips;
+}
+
+// bilinear lookup, repeated along u and clamped along v
+static void
+fetch(const EnvmapLevel &level, float u, float v, float weight, float *rgb)
+{
+    float x = u * level.w - 0.5f, y = v * level.h - 0.5f;
+    int x0 = (int)floorf(x), y0 = (int)floorf(y);
+    float fx = x - x0, fy = y - y0;
+
+    for (int k = 0; k < 4; ++k) {
+        int i = ((x0 + (k & 1)) % level.w + level.w) % level.w;
+        int j = std::max(0, std::min(level.h - 1, y0 + (k >> 1)));
+        float wk = weight * ((k & 1) ? fx : 1.0f - fx) * ((k >> 1) ? fy : 1.0f - fy);
+        const float *t = &level.texels[3 * (j * level.w + i)];
+
+        rgb[0]+= wk * t[0];
+        rgb[1]+= wk * t[1];
+        rgb[2]+= wk * t[2];
+    }
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Texel Coordinates of Four Directions
+ *
+ * With SSE, atan2 and acos are replaced by polynomial approximations whose
+ * error (below 1e-4 radians) is much smaller than a texel.
+ */
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+
+static inline __m128 sseSelect(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 sseAbs(__m128 x)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+// Abramowitz and Stegun 4.4.45
+static __m128 sseAcos(__m128 x)
+{
+    __m128 a = _mm_min_ps(sseAbs(x), _mm_set1_ps(1.0f));
+    __m128 p = _mm_set1_ps(-0.0187293f);
+
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(0.0742610f));
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(-0.2121144f));
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(1.5707288f));
+    p = _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)));
+
+    return sseSelect(_mm_cmplt_ps(x, _mm_setzero_ps()),
+                     _mm_sub_ps(_mm_set1_ps((float)PI), p), p);
+}
+
+static __m128 sseAtan2(__m128 y, __m128 x)
+{
+    __m128 ax = sseAbs(x), ay = sseAbs(y);
+    __m128 mx = _mm_max_ps(ax, ay), mn = _mm_min_ps(ax, ay);
+    __m128 a = _mm_div_ps(mn, _mm_max_ps(mx, _mm_set1_ps(1e-30f)));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_set1_ps(-0.0464964749f);
+
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.15931422f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.327622764f));
+    r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+    r = sseSelect(_mm_cmpgt_ps(ay, ax),
+                  _mm_sub_ps(_mm_set1_ps(0.5f * (float)PI), r), r);
+    r = sseSelect(_mm_cmplt_ps(x, _mm_setzero_ps()),
+                  _mm_sub_ps(_mm_set1_ps((float)PI), r), r);
+
+    return sseSelect(_mm_cmplt_ps(y, _mm_setzero_ps()),
+                     _mm_sub_ps(_mm_setzero_ps(), r), r);
+}
+
+static void
+dirToUv4(const float *dx, const float *dy, const float *dz, float *u, float *v)
+{
+    const __m128 invPi = _mm_set1_ps((float)(1.0 / PI));
+    __m128 phi = sseAtan2(_mm_loadu_ps(dx), _mm_loadu_ps(dy));
+    __m128 theta = sseAcos(_mm_loadu_ps(dz));
+
+    _mm_storeu_ps(u, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(phi, invPi),
+                                           _mm_set1_ps(0.5f)),
+                                _mm_set1_ps(0.5f)));
+    _mm_storeu_ps(v, _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(theta, invPi)));
+}
+#else
+static void
+dirToUv4(const float *dx, const float *dy, const float *dz, float *u, float *v)
+{
+    for (int k = 0; k < 4; ++k) {
+        float z = std::max(-1.0f, std::min(1.0f, dz[k]));
+
+        u[k] = atan2f(dx[k], dy[k]) / (float)PI * 0.5f + 0.5f;
+        v[k] = 1.0f - acosf(z) / (float)PI;
+    }
+}
+#endif
+
+// -----------------------------------------------------------------------------
+/**
+ * GGX Samples in Tangent Space
+ *
+ * With n = v, the reflected direction of a half vector h drawn from
+ * D(h) (n.h) has the density D(h) / 4. Each sample reads the mip whose
+ * texels cover the solid angle of the sample (with a bias of one level, as
+ * in Karis 2013); samples below the horizon are dropped, and the count is
+ * padded to a multiple of 4 with samples of zero weight.
+ */
+struct GgxSamples {
+    std::vector<float> x, y, z, weight, lod;
+};
+
+static float radicalInverse(uint32_t i)
+{
+    i = (i << 16) | (i >> 16);
+    i = ((i & 0x55555555u) << 1) | ((i & 0xAAAAAAAAu) >> 1);
+    i = ((i & 0x33333333u) << 2) | ((i & 0xCCCCCCCCu) >> 2);
+    i = ((i & 0x0F0F0F0Fu) << 4) | ((i & 0xF0F0F0F0u) >> 4);
+    i = ((i & 0x00FF00FFu) << 8) | ((i & 0xFF00FF00u) >> 8);
+
+    return (float)(i * 2.3283064365386963e-10);
+}
+
+static GgxSamples
+ggxSamples(double alpha, int sampleCnt, int w, int h, int mipCnt)
+{
+    GgxSamples s;
+    double a2 = std::max(alpha * alpha, 1e-8);
+    double texelSolidAngle = 4.0 * PI / ((double)w * h);
+
+    for (int i = 0; i < sampleCnt; ++i) {
+        double u1 = (i + 0.5) / sampleCnt, u2 = radicalInverse(i);
+        double cos2 = (1.0 - u1) / (1.0 + (a2 - 1.0) * u1);
+        double cosH = sqrt(cos2), sinH = sqrt(1.0 - cos2);
+        double phi = 2.0 * PI * u2;
+        double z = 2.0 * cos2 - 1.0;
+
+        if (z <= 0.0)
+            continue;
+        double d = (a2 - 1.0) * cos2 + 1.0;
+        double pdf = a2 / (PI * d * d) / 4.0;
+        double sampleSolidAngle = 1.0 / (sampleCnt * pdf);
+        double lod = 0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0;
+
+        s.x.push_back((float)(2.0 * cosH * sinH * cos(phi)));
+        s.y.push_back((float)(2.0 * cosH * sinH * sin(phi)));
+        s.z.push_back((float)z);
+        s.weight.push_back((float)z);
+        s.lod.push_back((float)std::max(0.0, std::min(mipCnt - 1.0, lod)));
+    }
+    while (s.x.size() % 4) {
+        s.x.push_back(0.0f);
+        s.y.push_back(0.0f);
+        s.z.push_back(1.0f);
+        s.weight.push_back(0.0f);
+        s.lod.push_back(0.0f);
+    }
+
+    return s;
+}
+
+// -----------------------------------------------------------------------------
+// convolves the mips with the GGX samples into a level of size w x h
+static void
+prefilterLevel(const std::vector<EnvmapLevel> &mips, const GgxSamples &s,
+               int w, int h, int threadCnt, float *texels)
+{
+    std::vector<std::thread> threads;
+
+    threadCnt = std::max(1, std::min(threadCnt, h));
+    for (int t = 0; t < threadCnt; ++t) {
+        threads.push_back(std::thread([=, &mips, &s] {
+            for (int j = t; j < h; j+= threadCnt)
+            for (int i = 0; i < w; ++i) {
+                double phi = ((i + 0.5) / w - 0.5) * 2.0 * PI;
+                double theta = (1.0 - (j + 0.5) / h) * PI;
+                float n[3] = {
+                    (float)(sin(theta) * sin(phi)),
+                    (float)(sin(theta) * cos(phi)),
+                    (float)cos(theta)
+                };
+                // orthonormal basis (Duff et al. 2017)
+                float sg = n[2] >= 0.0f ? 1.0f : -1.0f;
+                float a = -1.0f / (sg + n[2]), b = n[0] * n[1] * a;
+                float t1[3] = {1.0f + sg * n[0] * n[0] * a, sg * b, -sg * n[0]};
+                float t2[3] = {b, sg + n[1] * n[1] * a, -n[1]};
+                float rgb[3] = {0.0f, 0.0f, 0.0f}, weightSum = 0.0f;
+
+                for (int k = 0; k < (int)s.x.size(); k+= 4) {
+                    float dx[4], dy[4], dz[4], u[4], v[4];
+
+                    for (int l = 0; l < 4; ++l) {
+                        float x = s.x[k + l], y = s.y[k + l], z = s.z[k + l];
+
+                        dx[l] = t1[0] * x + t2[0] * y + n[0] * z;
+                        dy[l] = t1[1] * x + t2[1] * y + n[1] * z;
+                        dz[l] = t1[2] * x + t2[2] * y + n[2] * z;
+                    }
+                    dirToUv4(dx, dy, dz, u, v);
+                    for (int l = 0; l < 4; ++l) {
+                        float weight = s.weight[k + l], lod = s.lod[k + l];
+                        int m = (int)lod;
+                        float f = lod - m;
+
+                        if (weight == 0.0f)
+                            continue;
+                        fetch(mips[m], u[l], v[l], weight * (1.0f - f), rgb);
+                        if (f > 0.0f)
+                            fetch(mips[m + 1], u[l], v[l], weight * f, rgb);
+                        weightSum+= weight;
+                    }
+                }
+                for (int c = 0; c < 3; ++c)
+                    texels[3 * (j * w + i) + c] = rgb[c] / weightSum;
+            }
+        }));
+    }
+    for (int t = 0; t < threadCnt; ++t)
+        threads[t].join();
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Cache Files
+ *
+ * A header (magic, version, hash, sizes) followed by the RGB floats of the
+ * levels; files whose header does not match are ignored and overwritten.
+ */
+struct CacheHeader {
+    char magic[8];
+    uint64_t hash;
+    uint32_t version, w, h, levelCnt;
+    uint32_t param; // samples per texel (GGX) or face size (cubemap)
+};
+
+// FNV-1a
+static uint64_t hash(const void *data, size_t size, uint64_t h)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    for (size_t i = 0; i < size; ++i)
+        h = (h ^ bytes[i]) * 1099511628211ull;
+
+    return h;
+}
+
+static bool
+readCache(const char *path, const CacheHeader &expected,
+          std::vector<EnvmapLevel> &levels)
+{
+    FILE *pf = fopen(path, "rb");
+    CacheHeader header;
+    bool ok;
+
+    if (!pf)
+        return false;
+    ok = fread(&header, sizeof(header), 1, pf) == 1
+      && !memcmp(&header, &expected, sizeof(header));
+    for (int k = 0; ok && k < (int)levels.size(); ++k) {
+        std::vector<float> &t = levels[k].texels;
+
+        ok = fread(&t[0], sizeof(t[0]), t.size(), pf) == t.size();
+    }
+    fclose(pf);
+
+    return ok;
+}
+
+static bool
+writeCache(const char *path, const CacheHeader &header,
+           const std::vector<EnvmapLevel> &levels)
+{
+    FILE *pf = fopen(path, "wb");
+    bool ok;
+
+    if (!pf) {
+        LOG("envmap_error: failed to create %s\n", path);
+        return false;
+    }
+    ok = fwrite(&header, sizeof(header), 1, pf) == 1;
+    for (int k = 0; ok && k < (int)levels.size(); ++k) {
+        const std::vector<float> &t = levels[k].texels;
+
+        ok = fwrite(&t[0], sizeof(t[0]), t.size(), pf) == t.size();
+    }
+    fclose(pf);
+    if (!ok) {
+        LOG("envmap_error: failed to write %s\n", path);
+        remove(path);
+    }
+
+    return ok;
+}
+
+// joins a directory and a file name, adding a separator if the directory
+// does not end with one
+static std::string
+joinPath(const char *dir, const char *name)
+{
+    std::string path(dir);
+
+    if (!path.empty() && path[path.size() - 1] != '/'
+        && path[path.size() - 1] != '\\')
+        path+= '/';
+
+    return path + name;
+}
+
+// -----------------------------------------------------------------------------
+EnvmapPrefiltered *
+envmapCreatePrefiltered(const float *texels, int w, int h,
+                        int levelCnt, int sampleCnt, int threadCnt,
+                        const char *cacheDir)
+{
+    EnvmapPrefiltered *p = new EnvmapPrefiltered();
+    int mipCnt = 1;
+    CacheHeader header;
+    std::string path;
+
+    while ((w | h) >> mipCnt)
+        ++mipCnt;
+    levelCnt = std::max(1, std::min(levelCnt, mipCnt));
+    p->levels.resize(levelCnt);
+    for (int k = 0; k < levelCnt; ++k) {
+        p->levels[k].w = std::max(1, w >> k);
+        p->levels[k].h = std::max(1, h >> k);
+        p->levels[k].texels.resize(3 * p->levels[k].w * p->levels[k].h);
+    }
+
+    if (cacheDir) {
+        char name[64];
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "ENVGGX", 6);
+        header.version = ENVMAP_CACHE_VERSION;
+        header.w = w;
+        header.h = h;
+        header.levelCnt = levelCnt;
+        header.param = sampleCnt;
+        header.hash = hash(texels, sizeof(float) * 3 * w * h,
+                           14695981039346656037ull);
+        snprintf(name, sizeof(name), "envmap_%016llx_%02i.ggx",
+                 (unsigned long long)header.hash, levelCnt);
+        path = joinPath(cacheDir, name);
+        if (readCache(path.c_str(), header, p->levels)) {
+            LOG("Note: read %s\n", path.c_str());
+            return p;
+        }
+    }
+
+    std::vector<EnvmapLevel> mips = buildMips(texels, w, h, mipCnt);
+    p->levels[0].texels = mips[0].texels; // alpha = 0 is a mirror
+    for (int k = 1; k < levelCnt; ++k) {
+        double roughness = (double)k / (levelCnt - 1);
+        GgxSamples s = ggxSamples(roughness * roughness, sampleCnt, w, h, mipCnt);
+        EnvmapLevel &level = p->levels[k];
+
+        prefilterLevel(mips, s, level.w, level.h, threadCnt, &level.texels[0]);
+    }
+
+    if (cacheDir && writeCache(path.c_str(), header, p->levels)) {
+        LOG("Note: wrote %s\n", path.c_str());
+    }
+
+    return p;
+}
+
+void envmapReleasePrefiltered(EnvmapPrefiltered *p)
+{
+    delete p;
+}
+
+int envmapPrefilteredLevelCount(const EnvmapPrefiltered *p)
+{
+    return (int)p->levels.size();
+}
+
+const float *
+envmapPrefilteredLevel(const EnvmapPrefiltered *p, int level, int *w, int *h)
+{
+    (*w) = p->levels[level].w;
+    (*h) = p->levels[level].h;
+
+    return &p->levels[level].texels[0];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Spherical Harmonics
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#define ENVMAP_SH_MAX_ORDER 4
+
+static int shOrder(int order)
+{
+    return std::max(2, std::min(order, ENVMAP_SH_MAX_ORDER));
+}
+
+// -----------------------------------------------------------------------------
+// real orthonormal SH of bands 0 to order, indexed l (l + 1) + m; these are
+// the polynomials of the sphere shader of demo-merl
+static void shBasis(int order, float x, float y, float z, float *Y)
+{
+    float x2 = x * x, y2 = y * y, z2 = z * z;
+
+    Y[0] = 0.282095f;
+
+    Y[1] = 0.488603f * y;
+    Y[2] = 0.488603f * z;
+    Y[3] = 0.488603f * x;
+
+    Y[4] = 1.092548f * x * y;
+    Y[5] = 1.092548f * y * z;
+    Y[6] = 0.315392f * (3.0f * z2 - 1.0f);
+    Y[7] = 1.092548f * x * z;
+    Y[8] = 0.546274f * (x2 - y2);
+    if (order < 3)
+        return;
+
+    Y[ 9] = 0.590044f * y * (3.0f * x2 - y2);
+    Y[10] = 2.890611f * x * y * z;
+    Y[11] = 0.457046f * y * (5.0f * z2 - 1.0f);
+    Y[12] = 0.373176f * z * (5.0f * z2 - 3.0f);
+    Y[13] = 0.457046f * x * (5.0f * z2 - 1.0f);
+    Y[14] = 1.445306f * z * (x2 - y2);
+    Y[15] = 0.590044f * x * (x2 - 3.0f * y2);
+    if (order < 4)
+        return;
+
+    Y[16] = 2.503343f * x * y * (x2 - y2);
+    Y[17] = 1.770131f * y * z * (3.0f * x2 - y2);
+    Y[18] = 0.946175f * x * y * (7.0f * z2 - 1.0f);
+    Y[19] = 0.669047f * y * z * (7.0f * z2 - 3.0f);
+    Y[20] = 0.105786f * (35.0f * z2 * z2 - 30.0f * z2 + 3.0f);
+    Y[21] = 0.669047f * x * z * (7.0f * z2 - 3.0f);
+    Y[22] = 0.473087f * (x2 - y2) * (7.0f * z2 - 1.0f);
+    Y[23] = 1.770131f * x * z * (x2 - 3.0f * y2);
+    Y[24] = 0.625836f * (x2 * (x2 - 3.0f * y2) - y2 * (3.0f * x2 - y2));
+}
+
+void envmapShBasis(int order, const float dir[3], float *basis)
+{
+    shBasis(shOrder(order), dir[0], dir[1], dir[2], basis);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Projection
+ *
+ * With psi = pi / 2 - phi, so that x = sin(theta) cos(psi) and
+ * y = sin(theta) sin(psi), the basis functions are separable:
+ *   Y_lm = R_lm(theta) cos(m psi)      if m > 0
+ *   Y_lm = R_lm(theta)                 if m = 0
+ *   Y_lm = R_lm(theta) sin(|m| psi)    if m < 0
+ * so each row is first reduced to its Fourier sums of frequency 0 to order
+ * (2 order + 1 products per texel and channel, instead of evaluating the
+ * whole basis), which are then multiplied by R_lm. The R_lm are the basis
+ * functions evaluated where the trigonometric factor is one. Each texel is
+ * weighted by its solid angle, i.e., (2 pi / w) times the difference of the
+ * cosines of its row bounds, which is exact for constant texels. The
+ * threads accumulate interleaved rows in double precision and their sums
+ * are reduced at the end.
+ */
+void
+envmapProjectSh(const float *texels, int w, int h, int order, int threadCnt,
+                float *coeffs)
+{
+    int coeffCnt, freqCnt;
+    std::vector<float> trig;
+    std::vector<std::vector<double> > sums;
+    std::vector<std::thread> threads;
+
+    order = shOrder(order);
+    coeffCnt = (order + 1) * (order + 1);
+    freqCnt = 2 * order + 1;
+
+    // cos(m psi) at index order + m and sin(m psi) at index order - m
+    trig.resize(w * freqCnt);
+    for (int i = 0; i < w; ++i) {
+        double psi = 0.5 * PI - ((i + 0.5) / w - 0.5) * 2.0 * PI;
+
+        for (int m = 0; m <= order; ++m) {
+            trig[i * freqCnt + order + m] = (float)cos(m * psi);
+            trig[i * freqCnt + order - m] = (float)(m > 0 ? sin(m * psi) : 1.0);
+        }
+    }
+
+    threadCnt = std::max(1, std::min(threadCnt, h));
+    sums.resize(threadCnt, std::vector<double>(3 * coeffCnt, 0.0));
+    for (int t = 0; t < threadCnt; ++t) {
+        threads.push_back(std::thread([=, &trig, &sums] {
+            const int maxCoeffCnt = (ENVMAP_SH_MAX_ORDER + 1) * (ENVMAP_SH_MAX_ORDER + 1);
+            float Y[maxCoeffCnt], R[maxCoeffCnt];
+            std::vector<float> fourier(3 * freqCnt);
+            std::vector<double> &sum = sums[t];
+
+            for (int j = t; j < h; j+= threadCnt) {
+                double theta = (1.0 - (j + 0.5) / h) * PI;
+                double solidAngle = 2.0 * PI / w
+                                  * (cos(PI * (1.0 - (j + 1.0) / h))
+                                   - cos(PI * (1.0 - (double)j / h)));
+                float sinTheta = (float)sin(theta), z = (float)cos(theta);
+
+                // Fourier sums of the row
+                std::fill(fourier.begin(), fourier.end(), 0.0f);
+                for (int i = 0; i < w; ++i) {
+                    const float *rgb = &texels[3 * (j * w + i)];
+                    const float *f = &trig[i * freqCnt];
+
+                    for (int m = 0; m < freqCnt; ++m) {
+                        fourier[3 * m    ]+= f[m] * rgb[0];
+                        fourier[3 * m + 1]+= f[m] * rgb[1];
+                        fourier[3 * m + 2]+= f[m] * rgb[2];
+                    }
+                }
+
+                // R_lm: psi = 0 for m >= 0 and psi = pi / (2 |m|) for m < 0
+                shBasis(order, sinTheta, 0.0f, z, R);
+                for (int m = 1; m <= order; ++m) {
+                    double psi = 0.5 * PI / m;
+
+                    shBasis(order, sinTheta * (float)cos(psi),
+                            sinTheta * (float)sin(psi), z, Y);
+                    for (int l = m; l <= order; ++l)
+                        R[l * (l + 1) - m] = Y[l * (l + 1) - m];
+                }
+
+                for (int l = 0; l <= order; ++l)
+                for (int m = -l; m <= l; ++m) {
+                    int k = l * (l + 1) + m;
+                    double r = R[k] * solidAngle;
+
+                    for (int c = 0; c < 3; ++c)
+                        sum[3 * k + c]+= r * fourier[3 * (order + m) + c];
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < threadCnt; ++t)
+        threads[t].join();
+
+    for (int k = 0; k < 3 * coeffCnt; ++k) {
+        double sum = 0.0;
+
+        for (int t = 0; t < threadCnt; ++t)
+            sum+= sums[t][k];
+        coeffs[k] = (float)sum;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// zonal coefficients of the clamped cosine divided by pi (Ramamoorthi and
+// Hanrahan 2001): 1, 2/3, 1/4, 0, -1/24
+void envmapShConvolveCosine(int order, float *coeffs)
+{
+    const float A[] = {1.0f, 2.0f / 3.0f, 0.25f, 0.0f, -1.0f / 24.0f};
+
+    order = shOrder(order);
+    for (int l = 0; l <= order; ++l)
+    for (int m = -l; m <= l; ++m)
+    for (int c = 0; c < 3; ++c)
+        coeffs[3 * (l * (l + 1) + m) + c]*= A[l];
+}
+
+void
+envmapShEval(int order, const float *coeffs, const float dir[3], float rgb[3])
+{
+    float Y[(ENVMAP_SH_MAX_ORDER + 1) * (ENVMAP_SH_MAX_ORDER + 1)];
+
+    order = shOrder(order);
+    shBasis(order, dir[0], dir[1], dir[2], Y);
+    rgb[0] = rgb[1] = rgb[2] = 0.0f;
+    for (int k = 0; k < (order + 1) * (order + 1); ++k)
+    for (int c = 0; c < 3; ++c)
+        rgb[c]+= Y[k] * coeffs[3 * k + c];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Cubemap Conversion
+//
+////////////////////////////////////////////////////////////////////////////////
+
+struct EnvmapCubemap {
+    std::vector<EnvmapLevel> levels; // the six faces, stacked along y
+};
+
+// -----------------------------------------------------------------------------
+// unnormalized direction of the point (a, b) in [-1, 1]^2 of a face, with
+// a = 2 s - 1 and b = 2 t - 1 (OpenGL, Table 8.19 of the 4.5 specification)
+static void cubemapDir(int face, float a, float b, float *dir)
+{
+    switch (face) {
+        case 0: dir[0] =  1.0f; dir[1] =    -b; dir[2] =    -a; break;
+        case 1: dir[0] = -1.0f; dir[1] =    -b; dir[2] =     a; break;
+        case 2: dir[0] =     a; dir[1] =  1.0f; dir[2] =     b; break;
+        case 3: dir[0] =     a; dir[1] = -1.0f; dir[2] =    -b; break;
+        case 4: dir[0] =     a; dir[1] =    -b; dir[2] =  1.0f; break;
+        default:dir[0] =    -a; dir[1] =    -b; dir[2] = -1.0f; break;
+    }
+}
+
+// solid angle of the rectangle [a0, a1] x [b0, b1] of a face, from that of
+// [0, a] x [0, b]
+static double cubemapArea(double a, double b)
+{
+    return atan2(a * b, sqrt(a * a + b * b + 1.0));
+}
+
+static double cubemapSolidAngle(double a0, double b0, double a1, double b1)
+{
+    return cubemapArea(a0, b0) - cubemapArea(a0, b1)
+         - cubemapArea(a1, b0) + cubemapArea(a1, b1);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * First Level
+ *
+ * Each texel averages 2x2 samples weighted by their solid angle; the
+ * samples read the mip of the envmap whose rows match their angular size,
+ * so that the texels near the poles of the envmap, which are squeezed in
+ * the cube faces, are filtered instead of aliased. The rows of the six
+ * faces are split across threads, and the sample directions are mapped
+ * to the envmap four at a time (see dirToUv4).
+ */
+static void
+cubemapLevel0(const std::vector<EnvmapLevel> &mips, int size, int threadCnt,
+              float *texels)
+{
+    std::vector<std::thread> threads;
+    int mipCnt = (int)mips.size(), rowCnt = 6 * size;
+
+    threadCnt = std::max(1, std::min(threadCnt, rowCnt));
+    for (int t = 0; t < threadCnt; ++t) {
+        threads.push_back(std::thread([=, &mips] {
+            for (int r = t; r < rowCnt; r+= threadCnt)
+            for (int i = 0; i < size; ++i) {
+                int face = r / size, j = r % size;
+                float dx[4], dy[4], dz[4], u[4], v[4], weight[4], lod[4];
+                float rgb[3] = {0.0f, 0.0f, 0.0f}, weightSum = 0.0f;
+
+                for (int k = 0; k < 4; ++k) {
+                    float a = 2.0f * (i + 0.25f + 0.5f * (k & 1)) / size - 1.0f;
+                    float b = 2.0f * (j + 0.25f + 0.5f * (k >> 1)) / size - 1.0f;
+                    float d[3], rcp = 1.0f / sqrtf(1.0f + a * a + b * b);
+                    // solid angle of the sample (which spans 1 / size along a
+                    // and b) and its angular size in rows of the envmap
+                    double solidAngle = rcp * rcp * rcp / ((double)size * size);
+                    double rows = sqrt(solidAngle) * mips[0].h / PI;
+
+                    cubemapDir(face, a, b, d);
+                    dx[k] = d[0] * rcp;
+                    dy[k] = d[1] * rcp;
+                    dz[k] = d[2] * rcp;
+                    weight[k] = (float)solidAngle;
+                    lod[k] = (float)std::max(0.0, std::min(log2(rows), mipCnt - 1.0));
+                }
+                dirToUv4(dx, dy, dz, u, v);
+                for (int k = 0; k < 4; ++k) {
+                    int m = (int)lod[k];
+                    float f = lod[k] - m;
+
+                    fetch(mips[m], u[k], v[k], weight[k] * (1.0f - f), rgb);
+                    if (f > 0.0f)
+                        fetch(mips[m + 1], u[k], v[k], weight[k] * f, rgb);
+                    weightSum+= weight[k];
+                }
+                for (int c = 0; c < 3; ++c)
+                    texels[3 * (r * size + i) + c] = rgb[c] / weightSum;
+            }
+        }));
+    }
+    for (int t = 0; t < threadCnt; ++t)
+        threads[t].join();
+}
+
+// -----------------------------------------------------------------------------
+// each texel of a mip averages its (up to) 2x2 children weighted by their
+// solid angle, so that the mean radiance of each face region is preserved
+static void cubemapMip(const EnvmapLevel &src, EnvmapLevel &dst)
+{
+    int srcSize = src.w, dstSize = dst.w;
+
+    for (int face = 0; face < 6; ++face)
+    for (int j = 0; j < dstSize; ++j)
+    for (int i = 0; i < dstSize; ++i) {
+        float rgb[3] = {0.0f, 0.0f, 0.0f};
+        double weightSum = 0.0;
+
+        for (int k = 0; k < 4; ++k) {
+            int ci = std::min(2 * i + (k & 1), srcSize - 1);
+            int cj = std::min(2 * j + (k >> 1), srcSize - 1);
+            double a0 = 2.0 * ci / srcSize - 1.0, a1 = 2.0 * (ci + 1) / srcSize - 1.0;
+            double b0 = 2.0 * cj / srcSize - 1.0, b1 = 2.0 * (cj + 1) / srcSize - 1.0;
+            float weight = (float)cubemapSolidAngle(a0, b0, a1, b1);
+            const float *t = &src.texels[3 * ((face * srcSize + cj) * srcSize + ci)];
+
+            rgb[0]+= weight * t[0];
+            rgb[1]+= weight * t[1];
+            rgb[2]+= weight * t[2];
+            weightSum+= weight;
+        }
+        for (int c = 0; c < 3; ++c)
+            dst.texels[3 * ((face * dstSize + j) * dstSize + i) + c] =
+                (float)(rgb[c] / weightSum);
+    }
+}
+
+// -----------------------------------------------------------------------------
+EnvmapCubemap *
+envmapCreateCubemap(const float *texels, int w, int h, int size, int threadCnt,
+                    const char *cachePath)
+{
+    EnvmapCubemap *cm = new EnvmapCubemap();
+    int levelCnt = 1, mipCnt = 1;
+    CacheHeader header;
+
+    size = std::max(1, size);
+    while (size >> levelCnt)
+        ++levelCnt;
+    cm->levels.resize(levelCnt);
+    for (int k = 0; k < levelCnt; ++k) {
+        cm->levels[k].w = std::max(1, size >> k);
+        cm->levels[k].h = 6 * cm->levels[k].w;
+        cm->levels[k].texels.resize(3 * cm->levels[k].w * cm->levels[k].h);
+    }
+
+    if (cachePath) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "ENVCUBE", 7);
+        header.version = ENVMAP_CACHE_VERSION;
+        header.w = w;
+        header.h = h;
+        header.levelCnt = levelCnt;
+        header.param = size;
+        header.hash = hash(texels, sizeof(float) * 3 * w * h,
+                           14695981039346656037ull);
+        if (readCache(cachePath, header, cm->levels)) {
+            LOG("Note: read %s\n", cachePath);
+            return cm;
+        }
+    }
+
+    while ((w | h) >> mipCnt)
+        ++mipCnt;
+    std::vector<EnvmapLevel> mips = buildMips(texels, w, h, mipCnt);
+    cubemapLevel0(mips, size, threadCnt, &cm->levels[0].texels[0]);
+    for (int k = 1; k < levelCnt; ++k)
+        cubemapMip(cm->levels[k - 1], cm->levels[k]);
+
+    if (cachePath && writeCache(cachePath, header, cm->levels)) {
+        LOG("Note: wrote %s\n", cachePath);
+    }
+
+    return cm;
+}
+
+void envmapReleaseCubemap(EnvmapCubemap *cm)
+{
+    delete cm;
+}
+
+int envmapCubemapLevelCount(const EnvmapCubemap *cm)
+{
+    return (int)cm->levels.size();
+}
+
+const float *
+envmapCubemapFace(const EnvmapCubemap *cm, int level, int face, int *size)
+{
+    const EnvmapLevel &l = cm->levels[level];
+
+    (*size) = l.w;
+
+    return &l.texels[3 * face * l.w * l.w];
+}
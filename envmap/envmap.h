@@ -0,0 +1,120 @@
+// Environment map importance sampling
+//
+// Builds the tables that draw directions with a density proportional to the
+// luminance of an equirectangular HDR envmap: a marginal CDF over its rows
+// and a conditional CDF per row, weighted by sin(theta) so that texels are
+// drawn according to their radiance times their solid angle. The rows are
+// processed in parallel. The tables are laid out as the envmap is uploaded
+// to OpenGL (first row at v = 0, i.e., the nadir), so that the GPU can use
+// them as textures (see the envmap functions of sphere.glsl), with
+//   u = atan(dir.x, dir.y) / (2 pi) + 1/2
+//   v = 1 - acos(dir.z) / pi
+// Samples are uniform within their texel; their density w.r.t. solid angle
+// is pdf(u, v) / (2 pi^2 sin(theta)).
+//
+// Usage:
+//   EnvmapSampler *s = envmapCreateSampler(rgb, w, h, threadCnt);
+//   envmapSample(s, u1, u2, dir, &pdf);
+//   envmapReleaseSampler(s);
+//
+// The library also prefilters envmaps with the GGX lobe for split-sum
+// shading: level k of the result is the radiance convolved with the GGX
+// distribution of roughness alpha = (k / (levelCnt - 1))^2, with the normal,
+// view and reflected directions all equal, i.e.,
+//   L_k(n) = sum L(l) (n.l) / sum (n.l),  l drawn from D(h) (n.h)
+// Level k has the size of mip k of the envmap, so that the levels can be
+// uploaded as a mip chain and looked up with textureLod. The integrals are
+// computed with importance sampling on all cores, reading lower resolution
+// mips for the samples of low density (filtered importance sampling); the
+// sample directions are mapped to texels four at a time with SSE. As this
+// takes seconds for large envmaps, results can be cached on disk.
+//
+// Envmaps can also be projected onto the real spherical harmonics of bands
+// 0 to order, with order in [2, 4], i.e., (order + 1)^2 RGB coefficients;
+// each texel is weighted by its solid angle and the rows are reduced in
+// parallel. Convolved with the clamped cosine, the coefficients
+// give the radiance reflected by a white Lambertian surface of normal n in
+// closed form (Ramamoorthi and Hanrahan 2001):
+//   L(n) = sum_k c_k Y_k(n)
+//
+// Finally, envmaps can be converted to cubemaps, so that shaders fetch them
+// without the atan and acos of the equirectangular mapping. The faces are
+// in the order and orientation of OpenGL (+x, -x, +y, -y, +z, -z), with the
+// directions of the envmap mapping above. Each texel is the solid angle
+// weighted mean of four samples, read from the mip of the envmap that
+// matches their size; the mip chain of the cubemap is built by weighting
+// each texel by its exact solid angle. Conversions take all cores and can
+// be cached on disk.
+
+#ifndef ENVMAP_H
+#define ENVMAP_H
+
+struct EnvmapSampler;
+
+// texels are RGB floats; threadCnt is clamped to [1, height]; returns NULL if
+// the envmap is black
+EnvmapSampler *
+envmapCreateSampler(const float *texels, int width, int height, int threadCnt);
+void envmapReleaseSampler(EnvmapSampler *sampler);
+int envmapSamplerWidth(const EnvmapSampler *sampler);
+int envmapSamplerHeight(const EnvmapSampler *sampler);
+// height + 1 values
+const float *envmapMarginalCdf(const EnvmapSampler *sampler);
+// height rows of width + 1 values
+const float *envmapConditionalCdf(const EnvmapSampler *sampler);
+// width x height densities w.r.t. (u, v)
+const float *envmapTexelPdf(const EnvmapSampler *sampler);
+// draws a unit direction from two uniform numbers in [0, 1)
+void envmapSample(const EnvmapSampler *sampler, float u1, float u2,
+                  float dir[3], float *pdf);
+// density of a unit direction w.r.t. solid angle
+float envmapPdf(const EnvmapSampler *sampler, const float dir[3]);
+
+struct EnvmapPrefiltered;
+
+// prefilters the envmap (RGB floats, first row at the nadir); levelCnt is
+// clamped to the mip count of the envmap; if cacheDir is not NULL, the
+// result is read from or written to a cache file in it, named after a hash
+// of the envmap and the level count
+EnvmapPrefiltered *
+envmapCreatePrefiltered(const float *texels, int width, int height,
+                        int levelCnt, int sampleCnt, int threadCnt,
+                        const char *cacheDir);
+void envmapReleasePrefiltered(EnvmapPrefiltered *prefiltered);
+int envmapPrefilteredLevelCount(const EnvmapPrefiltered *prefiltered);
+// RGB floats of a level, and its size
+const float *
+envmapPrefilteredLevel(const EnvmapPrefiltered *prefiltered, int level,
+                       int *width, int *height);
+
+// projects the envmap (RGB floats, first row at the nadir) onto the SH basis;
+// coeffs holds 3 (order + 1)^2 floats, the RGB values of coefficient
+// l (l + 1) + m being contiguous
+void
+envmapProjectSh(const float *texels, int width, int height, int order,
+                int threadCnt, float *coeffs);
+// scales the coefficients by those of the clamped cosine divided by pi
+void envmapShConvolveCosine(int order, float *coeffs);
+// (order + 1)^2 values of the SH basis at a unit direction
+void envmapShBasis(int order, const float dir[3], float *basis);
+void
+envmapShEval(int order, const float *coeffs, const float dir[3], float rgb[3]);
+
+struct EnvmapCubemap;
+
+// converts the envmap (RGB floats, first row at the nadir) to a cubemap of
+// size x size texels per face with a full mip chain; if cachePath is not
+// NULL, the result is read from or written to this file, which is ignored
+// if it was built from other texels or sizes
+EnvmapCubemap *
+envmapCreateCubemap(const float *texels, int width, int height, int size,
+                    int threadCnt, const char *cachePath);
+void envmapReleaseCubemap(EnvmapCubemap *cubemap);
+int envmapCubemapLevelCount(const EnvmapCubemap *cubemap);
+// RGB floats of a face of a level (rows along t, as uploaded to OpenGL), and
+// its size
+const float *
+envmapCubemapFace(const EnvmapCubemap *cubemap, int level, int face, int *size);
+
+#endif // ENVMAP_H
+
@@ -0,0 +1,213 @@
+#include "headless.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if HEADLESS_EGL
+#   include <EGL/egl.h>
+#   include <EGL/eglext.h>
+#endif
+#if HEADLESS_OSMESA
+#   include <GL/osmesa.h>
+#endif
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+static struct {
+    bool current;
+    int backend;
+#if HEADLESS_EGL
+    EGLDisplay display;
+    EGLContext context;
+#endif
+#if HEADLESS_OSMESA
+    OSMesaContext osmesa;
+    std::vector<unsigned char> buffer;
+#endif
+} g_headless;
+
+int headlessParseBackend(const char *name)
+{
+    if (!strcmp(name, "egl"))
+        return HEADLESS_BACKEND_EGL;
+    if (!strcmp(name, "osmesa"))
+        return HEADLESS_BACKEND_OSMESA;
+
+    return -1;
+}
+
+// -----------------------------------------------------------------------------
+// EGL backend
+#if HEADLESS_EGL
+static bool eglInit()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLConfig config = (EGLConfig)0;
+    EGLint major, minor, configCnt = 0;
+    const EGLint configAttribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    // prefer a display that needs neither a window system nor a GPU
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    if (eglGetPlatformDisplayEXT)
+        display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA,
+                                           EGL_DEFAULT_DISPLAY, NULL);
+#endif
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+            LOG("headless_error: no EGL display\n");
+            return false;
+        }
+    }
+    LOG("Note: EGL %i.%i\n", major, minor);
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        LOG("headless_error: eglBindAPI failed\n");
+        eglTerminate(display);
+        return false;
+    }
+
+    // surfaceless contexts do not need a config (EGL_KHR_no_config_context)
+    eglChooseConfig(display, configAttribs, &config, 1, &configCnt);
+    g_headless.context = eglCreateContext(display,
+                                          configCnt > 0 ? config : (EGLConfig)0,
+                                          EGL_NO_CONTEXT,
+                                          contextAttribs);
+    if (g_headless.context == EGL_NO_CONTEXT) {
+        LOG("headless_error: eglCreateContext failed (0x%x)\n", eglGetError());
+        eglTerminate(display);
+        return false;
+    }
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        g_headless.context)) {
+        LOG("headless_error: eglMakeCurrent failed (0x%x)\n", eglGetError());
+        eglDestroyContext(display, g_headless.context);
+        eglTerminate(display);
+        return false;
+    }
+    g_headless.display = display;
+
+    return true;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// OSMesa backend
+#if HEADLESS_OSMESA
+static bool osmesaInit(int width, int height)
+{
+    const int attribs[] = {
+        OSMESA_FORMAT, OSMESA_RGBA,
+        OSMESA_DEPTH_BITS, 24,
+        OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+        OSMESA_CONTEXT_MAJOR_VERSION, 4,
+        OSMESA_CONTEXT_MINOR_VERSION, 5,
+        0
+    };
+
+    g_headless.osmesa = OSMesaCreateContextAttribs(attribs, NULL);
+    if (!g_headless.osmesa) {
+        LOG("headless_error: OSMesaCreateContextAttribs failed\n");
+        return false;
+    }
+    g_headless.buffer.resize(4 * width * height);
+    if (!OSMesaMakeCurrent(g_headless.osmesa, &g_headless.buffer[0],
+                           GL_UNSIGNED_BYTE, width, height)) {
+        LOG("headless_error: OSMesaMakeCurrent failed\n");
+        OSMesaDestroyContext(g_headless.osmesa);
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+bool headlessInit(int backend, int width, int height)
+{
+    bool v = false;
+
+    LOG("Loading {Headless-Context}\n");
+    switch (backend) {
+        case HEADLESS_BACKEND_EGL:
+#if HEADLESS_EGL
+            v = eglInit();
+#else
+            LOG("headless_error: built without EGL\n");
+#endif
+            break;
+        case HEADLESS_BACKEND_OSMESA:
+#if HEADLESS_OSMESA
+            v = osmesaInit(width, height);
+#else
+            LOG("headless_error: built without OSMesa\n");
+#endif
+            break;
+        default:
+            LOG("headless_error: unknown backend\n");
+            break;
+    }
+    g_headless.current = v;
+    g_headless.backend = backend;
+    (void)width; (void)height;
+
+    return v;
+}
+
+void *headlessGetProcAddress(const char *name)
+{
+    (void)name;
+    if (!g_headless.current)
+        return NULL;
+    switch (g_headless.backend) {
+#if HEADLESS_EGL
+        case HEADLESS_BACKEND_EGL:
+            return (void *)eglGetProcAddress(name);
+#endif
+#if HEADLESS_OSMESA
+        case HEADLESS_BACKEND_OSMESA:
+            return (void *)OSMesaGetProcAddress(name);
+#endif
+        default:
+            return NULL;
+    }
+}
+
+void headlessShutdown()
+{
+    if (!g_headless.current)
+        return;
+    switch (g_headless.backend) {
+#if HEADLESS_EGL
+        case HEADLESS_BACKEND_EGL:
+            eglMakeCurrent(g_headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                           EGL_NO_CONTEXT);
+            eglDestroyContext(g_headless.display, g_headless.context);
+            eglTerminate(g_headless.display);
+            break;
+#endif
+#if HEADLESS_OSMESA
+        case HEADLESS_BACKEND_OSMESA:
+            OSMesaDestroyContext(g_headless.osmesa);
+            g_headless.buffer.clear();
+            break;
+#endif
+        default:
+            break;
+    }
+    g_headless.current = false;
+}
+
@@ -0,0 +1,32 @@
+// Headless OpenGL contexts
+//
+// Creates an OpenGL 4.5 core context without a window, so that the demos can
+// render into their framebuffer objects on machines without a display (e.g.,
+// render farm nodes, or CI runners with Mesa's llvmpipe). Two backends are
+// supported:
+//   - EGL with a surfaceless display (EGL_MESA_platform_surfaceless, falling
+//     back to the default display) and EGL_KHR_surfaceless_context;
+//   - OSMesa (software rendering into a client-side buffer).
+// Each backend is compiled in when its library is found at configure time
+// (HEADLESS_EGL / HEADLESS_OSMESA).
+//
+// Usage:
+//   if (!headlessInit(headlessParseBackend("egl"), w, h)) ...
+//   gladLoadGLLoader((GLADloadproc)headlessGetProcAddress);
+//   ... render into FBOs ...
+//   headlessShutdown();
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+enum { HEADLESS_BACKEND_EGL, HEADLESS_BACKEND_OSMESA };
+
+// returns the backend named "egl" or "osmesa", -1 otherwise
+int headlessParseBackend(const char *name);
+// creates a context and makes it current
+bool headlessInit(int backend, int width, int height);
+void *headlessGetProcAddress(const char *name);
+void headlessShutdown();
+
+#endif // HEADLESS_H
+
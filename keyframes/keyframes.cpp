@@ -0,0 +1,135 @@
+#include "keyframes.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+struct Keyframe {
+    double time;
+    std::vector<float> values;
+
+    bool operator<(const Keyframe &k) const {return time < k.time;}
+};
+
+struct Keyframes {
+    std::map<std::string, std::vector<Keyframe> > tracks;
+    double duration;
+};
+
+Keyframes *keyframesLoad(const char *path)
+{
+    FILE *pf = fopen(path, "r");
+    Keyframes *keys;
+    char line[1024];
+    int lineNumber = 0;
+
+    if (!pf) {
+        LOG("keyframes_error: failed to open %s\n", path);
+        return NULL;
+    }
+
+    LOG("Loading {Keyframes}\n");
+    keys = new Keyframes();
+    keys->duration = 0.0;
+    while (fgets(line, sizeof(line), pf)) {
+        const char *delim = " \t\r\n";
+        char *time, *name, *value;
+        Keyframe key;
+
+        ++lineNumber;
+        time = strtok(line, delim);
+        if (!time || time[0] == '#')
+            continue;
+        name = strtok(NULL, delim);
+        if (!name) {
+            LOG("keyframes_error: %s:%i: missing track name\n", path, lineNumber);
+            fclose(pf);
+            delete keys;
+            return NULL;
+        }
+        key.time = atof(time);
+        while ((value = strtok(NULL, delim)))
+            key.values.push_back((float)atof(value));
+        keys->tracks[name].push_back(key);
+        keys->duration = std::max(keys->duration, key.time);
+    }
+    fclose(pf);
+
+    std::map<std::string, std::vector<Keyframe> >::iterator it;
+    for (it = keys->tracks.begin(); it != keys->tracks.end(); ++it) {
+        std::stable_sort(it->second.begin(), it->second.end());
+        LOG("Note: track '%s' has %i keys\n",
+            it->first.c_str(), (int)it->second.size());
+    }
+
+    return keys;
+}
+
+void keyframesRelease(Keyframes *keys)
+{
+    delete keys;
+}
+
+double keyframesDuration(const Keyframes *keys)
+{
+    return keys->duration;
+}
+
+// -----------------------------------------------------------------------------
+static bool
+eval(const Keyframes *keys, const char *track, double t,
+     float *values, int cnt, bool step)
+{
+    std::map<std::string, std::vector<Keyframe> >::const_iterator it;
+    Keyframe key;
+    int i1;
+
+    it = keys->tracks.find(track);
+    if (it == keys->tracks.end())
+        return false;
+
+    // first key after t
+    const std::vector<Keyframe> &k = it->second;
+    key.time = t;
+    i1 = (int)(std::upper_bound(k.begin(), k.end(), key) - k.begin());
+
+    for (int j = 0; j < cnt; ++j) {
+        if (i1 == 0) {
+            values[j] = j < (int)k[0].values.size() ? k[0].values[j] : 0.0f;
+        } else {
+            const Keyframe &k0 = k[i1 - 1];
+            float v0 = j < (int)k0.values.size() ? k0.values[j] : 0.0f;
+
+            if (step || i1 == (int)k.size()) {
+                values[j] = v0;
+            } else {
+                const Keyframe &k1 = k[i1];
+                float v1 = j < (int)k1.values.size() ? k1.values[j] : 0.0f;
+                double u = (t - k0.time) / (k1.time - k0.time);
+
+                values[j] = v0 + (float)u * (v1 - v0);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool keyframesEval(const Keyframes *keys, const char *track, double t,
+                   float *values, int cnt)
+{
+    return eval(keys, track, t, values, cnt, false);
+}
+
+bool keyframesStep(const Keyframes *keys, const char *track, double t,
+                   float *values, int cnt)
+{
+    return eval(keys, track, t, values, cnt, true);
+}
+
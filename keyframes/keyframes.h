@@ -0,0 +1,38 @@
+// Keyframed parameter tracks
+//
+// Reads a text file of keyframes, one per line:
+//   time track value0 value1 ...
+// e.g.,
+//   # wi sweep with a fixed roughness
+//   0.0 dir    45 255
+//   2.5 dir    75 255
+//   5.0 dir    45 255
+//   0.0 alpha  0.3
+//   0.0 camera 2.5 2.5 2.5
+// Lines starting with '#' are comments. Keys of a track may appear in any
+// order; the track is interpolated linearly between them and clamped
+// outside of them. Discrete parameters (e.g., a BRDF index) use
+// keyframesStep, which holds the value of the previous key.
+//
+// The demos use the tracks to render sweeps in a single process (see their
+// --sweep option), so that the GL context and the loaded data are reused.
+
+#ifndef KEYFRAMES_H
+#define KEYFRAMES_H
+
+struct Keyframes;
+
+// returns NULL on failure
+Keyframes *keyframesLoad(const char *path);
+void keyframesRelease(Keyframes *keys);
+// time of the last key
+double keyframesDuration(const Keyframes *keys);
+// writes the first cnt values of the track at time t; returns false if the
+// track does not exist
+bool keyframesEval(const Keyframes *keys, const char *track, double t,
+                   float *values, int cnt);
+bool keyframesStep(const Keyframes *keys, const char *track, double t,
+                   float *values, int cnt);
+
+#endif // KEYFRAMES_H
+
@@ -28,6 +28,7 @@ by Jonathan Dupuy
 #include <string>
 #include <memory>
 #include <valarray>
+#include <cstdint>
 
 namespace djb {
 
@@ -75,6 +76,11 @@ struct mat3 {
 	private: vec3 r[3];
 };
 
+// *****************************************************************************
+/* Half precision utilities (IEEE 754 binary16, as used by GL_HALF_FLOAT) */
+uint16_t float_to_half(float x);
+float half_to_float(uint16_t x);
+
 // *****************************************************************************
 /* BRDF API */
 class brdf {
@@ -441,6 +447,66 @@ public:
 	const std::vector<double>& get_samples() const {return m_samples;}
 };
 
+// *****************************************************************************
+/* Low-rank MERL BRDF
+ *
+ * Each channel of a MERL table is mapped to log(1 + f_r) and viewed as a
+ * (theta_h) x (theta_d, phi_d) matrix, which is approximated by a truncated
+ * SVD of the given rank. The theta_h factors (scaled by the singular values)
+ * are stored in single precision and the (theta_d, phi_d) factors in half
+ * precision, so a lookup costs one dot product of length rank per channel.
+ */
+class merl_lr : public brdf_rgb {
+	std::vector<float_t> m_u;  // theta_h factors [channel][theta_h][rank]
+	std::vector<uint16_t> m_v; // theta_d, phi_d factors [channel][td, pd][rank]
+	int m_rank;
+public:
+	struct error_report {
+		vec3 rmse;     // RMSE of f_r over the valid cells of the table
+		vec3 rel_rmse; // RMSE normalized by the RMS of the reference
+		vec3 log_rmse; // RMSE of log(1 + f_r)
+	};
+	explicit merl_lr(const merl &merl, int rank = 6);
+	explicit merl_lr(const char *path_to_file);
+	brdf::value_type eval(const vec3 &wi, const vec3 &wo,
+	                      const void *user_param = NULL) const;
+	void save(const char *path_to_file) const;
+	error_report report_error(const merl &ref) const;
+	int get_rank() const {return m_rank;}
+	size_t get_byte_size() const;
+private:
+	float_t eval_cell(int channel, int th, int tdpd) const;
+};
+
+// *****************************************************************************
+/* Baked BRDF
+ *
+ * Tabulates a BRDF over the (theta_h, theta_d, phi_d) parameterization of
+ * MERL (including the square root mapping of theta_h), possibly at a lower
+ * resolution than the 90 x 90 x 180 MERL tables. Cells are evaluated at their
+ * centre and store f_r as interleaved RGB values, so that a GPU lookup takes
+ * a single fetch (see shaders/brdf_merl.glsl in demo-merl); single-channel
+ * BRDFs are broadcast to RGB. Cell (th, td, pd) is stored at index
+ * pd + res_phi_d * (td + res_theta_d * th).
+ */
+class baked : public brdf_rgb {
+	std::vector<float> m_texels;
+	int m_res_theta_h, m_res_theta_d, m_res_phi_d;
+public:
+	explicit baked(const brdf &fr,
+	               int res_theta_h = 90, int res_theta_d = 90,
+	               int res_phi_d = 180, const void *user_args = nullptr);
+	brdf::value_type eval(const vec3 &wi, const vec3 &wo,
+	                      const void *user_param = NULL) const;
+	// RGB32F texels
+	const std::vector<float>& get_texels() const {return m_texels;}
+	// RGBA16F texels (alpha is set to one)
+	std::vector<uint16_t> get_texels_half() const;
+	int get_res_theta_h() const {return m_res_theta_h;}
+	int get_res_theta_d() const {return m_res_theta_d;}
+	int get_res_phi_d() const {return m_res_phi_d;}
+};
+
 // *****************************************************************************
 /* UTIA BRDF */
 class utia : public brdf_rgb {
@@ -514,15 +580,173 @@ class npf : public brdf_rgb {
 	static const char *s_list[100];
 	std::vector<vec3> m_uber_texture;
 	int m_id;
-	mutable bool m_first;
 	vec3 uberTextureLookup(const vec2 &uv) const;
 	vec3 uberTextureLookupInt(int x) const;
 	vec3 lookupInterpolatedG1(int n, float_t theta) const;
+	static int load(const char *uber_texture, std::vector<vec3> *texels);
 public:
+	enum {TEXELS_PER_ROW = 512};
 	explicit npf(const char *uber_texture, const char *name);
+	explicit npf(const char *uber_texture, int id);
 	brdf::value_type eval(const vec3 &wi, const vec3 &wo,
 	                      const void *user_param = NULL) const;
+	// factorize a MERL BRDF into an uber texture row (rhoD rhoS D G1 F)
+	static std::vector<vec3> fit(const merl &merl, int iterations = 32);
+	// write a row into the first free slot of an uber texture (returns its id)
+	static int append(const char *uber_texture, const std::vector<vec3> &row);
+};
+
+// *****************************************************************************
+/* Linearly Transformed Cosines (LTC) table
+ *
+ * Fits the cosine-weighted BRDF f_r * cos(wo) / albedo with a linearly
+ * transformed cosine for each (theta, roughness) bin. Bins are laid out as
+ * x = sqrt(alpha), y = sqrt(1 - cos(theta)) (alpha fastest). The roughness
+ * axis maps to microfacet::args::isotropic(alpha) and is only meaningful for
+ * microfacet BRDFs; use res_alpha = 1 for other BRDFs (e.g., a MERL). Each
+ * bin stores the inverse matrix normalized by its middle element as
+ * {Minv(0,0), Minv(2,0), Minv(0,2), Minv(2,2)} and the directional albedo as
+ * {r, g, b, mean}.
+ */
+class ltc {
+	std::vector<float_t> m_minv;
+	std::vector<float_t> m_albedo;
+	int m_res_theta, m_res_alpha;
+public:
+	ltc(const brdf &fr, int res_theta = 64, int res_alpha = 64,
+	    int sample_cnt = 32);
+	// accessors
+	mat3 get_minv(int theta, int alpha) const;
+	vec3 get_albedo(int theta, int alpha) const;
+	int get_res_theta() const {return m_res_theta;}
+	int get_res_alpha() const {return m_res_alpha;}
+	static float_t get_alpha(int alpha, int res_alpha);
+	static float_t get_cos_theta(int theta, int res_theta);
+	// export two RGBA16F textures (matrices, then albedo) after a
+	// {res_alpha, res_theta} int32 header
+	void save(const char *path) const;
+};
+
+// *****************************************************************************
+/* Pivot table for sphere lights
+ *
+ * Fits the pivot of the spherical cap preserving parameterization (see
+ * pivot.glsl) so that the scaled pivot-transformed uniform distribution
+ * matches the integral of f_r * cos(wo) over spherical caps, for each
+ * (roughness, theta, cap size) bin. The reference integrals are estimated
+ * over caps that overlap directions sampled from the BRDF, with samples of
+ * the cap and of the BRDF, and the pivot distribution as a control variate. Bins
+ * are laid out as x = sqrt(alpha), y = sqrt(1 - cos(theta)) and
+ * z = sqrt(1 - cos(aperture)) (alpha fastest), and store {pivot.x, pivot.z,
+ * scale}, with wi in the xz-plane and wi.x >= 0. Like the LTC table, the
+ * roughness axis maps to microfacet::args::isotropic(alpha).
+ */
+class pivot {
+	std::vector<float_t> m_params; // {pivot.x, pivot.z, scale} per bin
+	std::vector<float_t> m_error;  // relative RMSE of the fit of each bin
+	int m_res_alpha, m_res_theta, m_res_cap;
+public:
+	pivot(const brdf &fr, int res_alpha = 16, int res_theta = 16,
+	      int res_cap = 16, int dir_cnt = 64, int sample_cnt = 16);
+	// accessors
+	vec3 get_params(int alpha, int theta, int cap) const;
+	float_t get_error(int alpha, int theta, int cap) const;
+	int get_res_alpha() const {return m_res_alpha;}
+	int get_res_theta() const {return m_res_theta;}
+	int get_res_cap() const {return m_res_cap;}
+	static float_t get_cap_cos(int cap, int res_cap);
+	// integral of f_r * cos(wo) over the cap, with the float16 parameters
+	// filtered trilinearly as the GGXSphereLightingPivotTable shader does
+	float_t eval(const vec3 &wi, const vec3 &cap_dir, float_t cap_cos,
+	             float_t alpha) const;
+	// Monte Carlo estimate of the integral (n x n samples), using the
+	// distribution of the given pivot as control variate
+	static float_t integrate(const brdf &fr, const vec3 &wi,
+	                         const vec3 &cap_dir, float_t cap_cos,
+	                         const void *user_args = nullptr,
+	                         int sample_cnt = 16,
+	                         const vec3 &cv_pivot = vec3(0));
+	// export an RGB16F 3D texture after a {res_alpha, res_theta, res_cap}
+	// int32 header
+	void save(const char *path) const;
+};
+
+// *****************************************************************************
+/* Evaluation plan
+ *
+ * Precomputes everything that does not depend on the material for a fixed set
+ * of direction pairs: the cosine factor, the MERL cell indexes, the
+ * (theta_h, theta_d, phi_d) coordinates used by baked tables and the UTIA
+ * interpolation indexes and weights. Executing the plan against a MERL,
+ * baked or UTIA BRDF is then a gather loop free of trigonometry; other BRDFs
+ * are evaluated with brdf::eval. Each execution returns f_r * cos(wo) for
+ * all pairs (single-channel BRDFs are broadcast to RGB).
+ */
+class eval_plan {
+	struct utia_lerp {int32_t row[4], col[4]; float_t w_row[4], w_col[4];};
+	std::vector<brdf::io_pair> m_wiwo;
+	std::vector<float_t> m_cos;       // cos(wo), zero below the horizon
+	std::vector<int32_t> m_merl;      // red channel index, -1 if invalid
+	std::vector<vec3> m_hd;           // normalized theta_h, theta_d, phi_d
+	std::vector<utia_lerp> m_utia;
+	int m_targets;
+public:
+	enum {MERL = 1, BAKED = 2, UTIA = 4};
+	explicit eval_plan(const std::vector<brdf::io_pair> &wiwo,
+	                   int targets = MERL | BAKED);
+	int size() const {return (int)m_cos.size();}
+	void execute(const merl &fr, std::vector<vec3> *out) const;
+	void execute(const baked &fr, std::vector<vec3> *out) const;
+	void execute(const utia &fr, std::vector<vec3> *out) const;
+	void execute(const brdf &fr, std::vector<vec3> *out,
+	             const void *user_args = nullptr) const;
+private:
+	void check(int target) const;
+};
+
+// *****************************************************************************
+/* BRDF comparison
+ *
+ * Compares a BRDF against a reference over pairs of directions distributed
+ * with the measure cos(wi) cos(wo) / pi^2. The integrals over wo are estimated
+ * with multiple importance sampling (balance heuristic) over the sampling
+ * routines of both BRDFs and a cosine lobe, using scrambled Sobol points; the
+ * directions wi are Sobol points too. Each metric comes with the standard
+ * error of its estimate over the directions wi. A single-channel BRDF is
+ * compared against each channel of the other one.
+ */
+struct comparison {
+	brdf::value_type rmse, rmse_stderr;         // f_r
+	brdf::value_type log_rmse, log_rmse_stderr; // log(1 + f_r)
+	brdf::value_type albedo_error, albedo_error_stderr; // |A - A_ref| / A_ref
+};
+comparison compare(const brdf &fr, const brdf &ref,
+                   int dir_cnt = 256, int sample_cnt = 256,
+                   const void *fr_args = nullptr,
+                   const void *ref_args = nullptr);
+
+// *****************************************************************************
+/* Low-discrepancy sample streams
+ *
+ * Stateless 2D sample streams for progressive Monte Carlo estimators: sample i
+ * of a stream only depends on i and the seed, so successive passes continue
+ * the sequence where the previous pass stopped. SOBOL is the (0,2)-sequence
+ * with Owen scrambling (nested uniform scrambling, hashed from the seed), R2
+ * is the Kronecker sequence of the plastic number with a random shift, and
+ * RANDOM is hashed white noise for reference. Values lie in [0, 1). The
+ * streams are reproduced bit for bit by the sampler.glsl shader include.
+ */
+class sampler {
+	int m_type;
+	uint32_t m_key_x, m_key_y;
+public:
+	enum {RANDOM, SOBOL, R2};
+	explicit sampler(int type = SOBOL, uint32_t seed = 0);
+	vec2 sample(uint32_t i) const;
+	int get_type() const {return m_type;}
 };
+// L2-star discrepancy of a 2D point set (Warnock's formula, O(n^2))
+double l2_star_discrepancy(const std::vector<vec2> &u);
 
 } // namespace djb
 
@@ -540,6 +764,9 @@ public:
 #include <cstring>      // memcpy
 #include <cstdint>      // uint32_t
 #include <limits>       // inf
+#include <thread>       // std::thread
+#include <atomic>       // std::atomic
+#include <algorithm>    // std::sort
 
 #ifndef DJB_ASSERT
 #	include <cassert>
@@ -613,6 +840,119 @@ exc::exc(const char *fmt, ...)
 	m_str = std::string(buf);
 }
 
+// *****************************************************************************
+// Parallel API
+
+//------------------------------------------------------------------------------
+// Run f(i) for i in [0, cnt) over all available hardware threads. Reductions
+// are kept deterministic by having f(i) write to slot i only and summing the
+// slots in order afterwards.
+template<typename F>
+static void parallel_for(int cnt, const F &f)
+{
+	int thread_cnt = min((int)std::thread::hardware_concurrency(), cnt);
+	std::atomic<int> next(0);
+	std::vector<std::thread> threads;
+	auto worker = [&]() {
+		for (int i = next++; i < cnt; i = next++)
+			f(i);
+	};
+
+	for (int i = 1; i < thread_cnt; ++i)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (int i = 0; i < (int)threads.size(); ++i)
+		threads[i].join();
+}
+
+// *****************************************************************************
+// Sobol API
+
+//------------------------------------------------------------------------------
+// Integer hash (used to derive scrambling keys)
+static uint32_t hash32(uint32_t x)
+{
+	x^= x >> 16;
+	x*= 0x7feb352dU;
+	x^= x >> 15;
+	x*= 0x846ca68bU;
+	x^= x >> 16;
+
+	return x;
+}
+
+//------------------------------------------------------------------------------
+// First two dimensions of the Sobol sequence, scrambled with a random digital
+// shift (the XOR keys)
+static vec2 sobol2(uint32_t i, uint32_t key_x, uint32_t key_y)
+{
+	uint32_t x = 0, y = 0;
+
+	for (uint32_t v1 = 1U << 31, v2 = 1U << 31; i; i>>= 1, v1>>= 1, v2^= v2 >> 1)
+		if (i & 1) {
+			x^= v1;
+			y^= v2;
+		}
+
+	return vec2((x ^ key_x) * (float_t)2.3283064365386963e-10, (y ^ key_y) * (float_t)2.3283064365386963e-10);
+}
+
+// *****************************************************************************
+// Half precision API
+
+uint16_t float_to_half(float x)
+{
+	uint32_t u, r, h;
+	memcpy(&u, &x, sizeof(u));
+	uint32_t sign = (u >> 16) & 0x8000;
+	int32_t e = (int32_t)((u >> 23) & 0xff) - 127 + 15;
+	uint32_t m = u & 0x7fffff;
+
+	if (((u >> 23) & 0xff) == 0xff) // inf or nan
+		return (uint16_t)(sign | 0x7c00 | (m ? 0x200 : 0));
+	if (e >= 31) // overflow
+		return (uint16_t)(sign | 0x7c00);
+	if (e <= 0) { // denormal
+		if (e < -10)
+			return (uint16_t)sign;
+		int shift = 14 - e;
+		m|= 0x800000;
+		h = m >> shift;
+		r = m & ((1u << shift) - 1);
+		if (r > (1u << (shift - 1)) || (r == (1u << (shift - 1)) && (h & 1)))
+			++h;
+		return (uint16_t)(sign | h);
+	}
+	// round to nearest even (a carry correctly bumps the exponent)
+	h = ((uint32_t)e << 10) | (m >> 13);
+	r = m & 0x1fff;
+	if (r > 0x1000 || (r == 0x1000 && (h & 1)))
+		++h;
+
+	return (uint16_t)(sign | h);
+}
+
+float half_to_float(uint16_t x)
+{
+	uint32_t sign = (uint32_t)(x & 0x8000) << 16;
+	uint32_t e = (x >> 10) & 0x1f;
+	uint32_t m = x & 0x3ff;
+	uint32_t u;
+	float f;
+
+	if (e == 0) { // zero or denormal
+		f = std::ldexp((float)m, -24);
+		return sign ? -f : f;
+	} else if (e == 31) { // inf or nan
+		u = sign | 0x7f800000 | (m << 13);
+	} else {
+		u = sign | ((e - 15 + 127) << 23) | (m << 13);
+	}
+	memcpy(&f, &u, sizeof(f));
+
+	return f;
+}
+
 // *****************************************************************************
 // Vector API
 
@@ -715,6 +1055,23 @@ vec3 operator*(const mat3 &m, const vec3 &r)
 	return vec3(dot(m[0], r), dot(m[1], r), dot(m[2], r));
 }
 
+mat3 operator*(const mat3 &a, const mat3 &b)
+{
+	mat3 bt = transpose(b);
+
+	return mat3(bt * a[0], bt * a[1], bt * a[2]);
+}
+
+mat3 inverse(const mat3 &m)
+{
+	vec3 c0 = cross(m[1], m[2]);
+	vec3 c1 = cross(m[2], m[0]);
+	vec3 c2 = cross(m[0], m[1]);
+	float_t d = dot(m[0], c0);
+
+	return transpose(mat3(c0 / d, c1 / d, c2 / d));
+}
+
 //---------------------------------------------------------------------------
 // rotate vector along one axis (Rodrguez formula)
 
@@ -872,10 +1229,10 @@ brdf::eval_batch(
 	return fr;
 }
 
-float_t brdf::pdf(const vec3 &wi, const vec3 &, const void *) const
+float_t brdf::pdf(const vec3 &, const vec3 &wo, const void *) const
 {
-	if (wi.z > 0)
-		return float_t(wi.z / m_pi());
+	if (wo.z > 0)
+		return float_t(wo.z / m_pi());
 	return 0;
 }
 
@@ -2658,6 +3015,25 @@ phi_diff_index(float_t phi_diff)
 // XXX End of
 // Copyright 2005 Mitsubishi Electric Research Laboratories All Rights Reserved.
 
+//------------------------------------------------------------------------------
+// Lookup the table cell of a pair of directions
+// Out: th, td, pd indexes (the red channel index is pd + 180 * (td + 90 * th))
+static void
+merl_cell(const vec3 &wi, const vec3 &wo, int *th, int *td, int *pd)
+{
+	vec3 wh, wd;
+
+	// phi_h is not needed, and the angles are computed without the clamping
+	// of xyz_to_theta_phi so that the first theta_h cells remain reachable
+	brdf::io_to_hd(wi, wo, &wh, &wd);
+	float_t theta_h = acos(clamp(wh.z, (float_t)-1, (float_t)1));
+	float_t theta_d = acos(clamp(wd.z, (float_t)-1, (float_t)1));
+	float_t phi_d = atan2(wd.y, wd.x);
+	(*th) = theta_half_index(theta_h);
+	(*td) = theta_diff_index(theta_d);
+	(*pd) = phi_diff_index(phi_d);
+}
+
 //------------------------------------------------------------------------------
 // MERL Contructor
 merl::merl(const char *path_to_file)
@@ -2687,18 +3063,13 @@ merl::merl(const char *path_to_file)
 brdf::value_type merl::eval(const vec3 &wi, const vec3 &wo, const void *) const
 {
 	if (wi.z > 0 && wo.z > 0) {
-		// convert to half / diff angle coordinates
-		vec3 wh, wd;
-		float_t th, ph, td, pd;
-		io_to_hd(wi, wo, &wh, &wd);
-		xyz_to_theta_phi(wh, &th, &ph);
-		xyz_to_theta_phi(wd, &td, &pd);
-
 		// compute indexes
-		int idx_r = phi_diff_index(pd)
-		          + theta_diff_index(td)
+		int th, td, pd;
+		merl_cell(wi, wo, &th, &td, &pd);
+		int idx_r = pd
+		          + td
 		          * MERL_SAMPLING_RES_PHI_D / 2
-		          + theta_half_index(th)
+		          + th
 		          * MERL_SAMPLING_RES_PHI_D / 2
 		          * MERL_SAMPLING_RES_THETA_D;
 		int idx_g = idx_r + MERL_SAMPLING_RES_THETA_H
@@ -2728,6 +3099,384 @@ brdf::value_type merl::eval(const vec3 &wi, const vec3 &wo, const void *) const
 	return zero_value();
 }
 
+// *****************************************************************************
+// Low-rank MERL API implementation
+
+//------------------------------------------------------------------------------
+// Eigen decomposition of a symmetric matrix with cyclic Jacobi rotations
+// In:  a (n x n, destroyed)
+// Out: eigenvalues in w, eigenvectors in the columns of v (both unsorted)
+static void
+jacobi_eigen(std::vector<double> &a, int n, std::vector<double> &w,
+             std::vector<double> &v)
+{
+	v.assign(n * n, 0.0);
+	w.resize(n);
+	for (int i = 0; i < n; ++i)
+		v[i * n + i] = 1;
+
+	for (int sweep = 0; sweep < 64; ++sweep) {
+		double off = 0, diag = 0;
+
+		for (int i = 0; i < n; ++i) {
+			diag+= sqr(a[i * n + i]);
+			for (int j = i + 1; j < n; ++j)
+				off+= sqr(a[i * n + j]);
+		}
+		if (off <= 1e-24 * diag)
+			break;
+
+		for (int p = 0; p < n; ++p)
+		for (int q = p + 1; q < n; ++q) {
+			double apq = a[p * n + q];
+
+			if (fabs(apq) < 1e-300)
+				continue;
+
+			double theta = (a[q * n + q] - a[p * n + p]) / (2 * apq);
+			double t = sgn(theta) / (fabs(theta) + sqrt(theta * theta + 1));
+			if (theta == 0) t = 1;
+			double c = 1 / sqrt(t * t + 1), s = t * c;
+
+			for (int k = 0; k < n; ++k) {
+				double akp = a[k * n + p], akq = a[k * n + q];
+				a[k * n + p] = c * akp - s * akq;
+				a[k * n + q] = s * akp + c * akq;
+			}
+			for (int k = 0; k < n; ++k) {
+				double apk = a[p * n + k], aqk = a[q * n + k];
+				a[p * n + k] = c * apk - s * aqk;
+				a[q * n + k] = s * apk + c * aqk;
+			}
+			for (int k = 0; k < n; ++k) {
+				double vkp = v[k * n + p], vkq = v[k * n + q];
+				v[k * n + p] = c * vkp - s * vkq;
+				v[k * n + q] = s * vkp + c * vkq;
+			}
+		}
+	}
+
+	for (int i = 0; i < n; ++i)
+		w[i] = a[i * n + i];
+}
+
+//------------------------------------------------------------------------------
+// Ctor: truncated SVD of each log-mapped channel. The SVD is obtained from the
+// eigen decomposition of the small (theta_h x theta_h) Gram matrix A A^T.
+merl_lr::merl_lr(const merl &merl, int rank):
+	m_rank(rank)
+{
+	const int rows = MERL_SAMPLING_RES_THETA_H;
+	const int cols = MERL_SAMPLING_RES_THETA_D * MERL_SAMPLING_RES_PHI_D / 2;
+	const double scale[3] = {MERL_RED_SCALE, MERL_GREEN_SCALE, MERL_BLUE_SCALE};
+	const std::vector<double> &samples = merl.get_samples();
+
+	if (rank < 1 || rank > rows)
+		throw exc("djb_error: Invalid rank %i (expected 1 to %i)\n", rank, rows);
+	if ((int)samples.size() != 3 * rows * cols)
+		throw exc("djb_error: Unexpected MERL table size\n");
+
+	m_u.resize(3 * rows * rank);
+	m_v.resize(3 * cols * rank);
+
+	for (int c = 0; c < 3; ++c) {
+		std::vector<double> a(rows * cols), g(rows * rows), w, v;
+		std::vector<int> order(rows);
+
+		// log-mapped matrix (invalid cells are set to zero)
+		parallel_for(rows, [&](int i) {
+			for (int j = 0; j < cols; ++j) {
+				double fr = samples[c * rows * cols + i * cols + j] * scale[c];
+				a[i * cols + j] = log(1 + max(0.0, fr));
+			}
+		});
+
+		// Gram matrix
+		parallel_for(rows, [&](int i) {
+			for (int j = 0; j <= i; ++j) {
+				double sum = 0;
+				for (int k = 0; k < cols; ++k)
+					sum+= a[i * cols + k] * a[j * cols + k];
+				g[i * rows + j] = g[j * rows + i] = sum;
+			}
+		});
+		jacobi_eigen(g, rows, w, v);
+
+		// sort eigenvalues in decreasing order
+		for (int i = 0; i < rows; ++i)
+			order[i] = i;
+		std::sort(order.begin(), order.end(),
+		          [&](int i, int j) {return w[i] > w[j];});
+
+#ifndef NVERBOSE
+		double total = 0, kept = 0;
+		for (int i = 0; i < rows; ++i) {
+			total+= max(0.0, w[order[i]]);
+			if (i < rank) kept+= max(0.0, w[order[i]]);
+		}
+		DJB_LOG("djb_verbose: MERL channel %i, rank %i keeps %.6f%% of the energy\n",
+		        c, rank, total > 0 ? 100 * kept / total : 100.0);
+#endif
+
+		// factors: U * sigma (theta_h) and V = A^T U / sigma (theta_d, phi_d)
+		for (int k = 0; k < rank; ++k) {
+			int e = order[k];
+			double sigma = sqrt(max(0.0, w[e]));
+
+			for (int i = 0; i < rows; ++i)
+				m_u[(c * rows + i) * rank + k] = v[i * rows + e] * sigma;
+			parallel_for(rows, [&](int i) {
+				// each task handles a contiguous range of columns
+				int j0 = i * cols / rows, j1 = (i + 1) * cols / rows;
+
+				for (int j = j0; j < j1; ++j) {
+					double sum = 0;
+
+					for (int l = 0; l < rows; ++l)
+						sum+= a[l * cols + j] * v[l * rows + e];
+					m_v[(c * cols + j) * rank + k] =
+						float_to_half(sigma > 0 ? (float)(sum / sigma) : 0.f);
+				}
+			});
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Ctor: load compressed data
+// Layout: int32 {rank}, float U[3][90][rank], float16 V[3][90 * 180][rank]
+merl_lr::merl_lr(const char *path_to_file)
+{
+	std::fstream f(path_to_file, std::fstream::in | std::fstream::binary);
+	const int rows = MERL_SAMPLING_RES_THETA_H;
+	const int cols = MERL_SAMPLING_RES_THETA_D * MERL_SAMPLING_RES_PHI_D / 2;
+	int32_t rank;
+	std::vector<float> u;
+
+	if (!f.is_open())
+		throw exc("djb_error: Failed to open %s\n", path_to_file);
+
+	f.read((char *)&rank, sizeof(rank));
+	if (f.fail() || rank < 1 || rank > rows)
+		throw exc("djb_error: Failed to read low-rank MERL header\n");
+
+	m_rank = rank;
+	u.resize(3 * rows * rank);
+	m_v.resize(3 * cols * rank);
+	f.read((char *)&u[0], sizeof(u[0]) * u.size());
+	f.read((char *)&m_v[0], sizeof(m_v[0]) * m_v.size());
+	if (f.fail())
+		throw exc("djb_error: Reading %s failed\n", path_to_file);
+	m_u.assign(u.begin(), u.end());
+}
+
+//------------------------------------------------------------------------------
+// Save compressed data
+void merl_lr::save(const char *path_to_file) const
+{
+	std::fstream f(path_to_file, std::fstream::out | std::fstream::binary
+	                           | std::fstream::trunc);
+	int32_t rank = m_rank;
+	std::vector<float> u(m_u.begin(), m_u.end());
+
+	if (!f.is_open())
+		throw exc("djb_error: Failed to open %s\n", path_to_file);
+
+	f.write((char *)&rank, sizeof(rank));
+	f.write((char *)&u[0], sizeof(u[0]) * u.size());
+	f.write((char *)&m_v[0], sizeof(m_v[0]) * m_v.size());
+	if (f.fail())
+		throw exc("djb_error: Writing %s failed\n", path_to_file);
+}
+
+size_t merl_lr::get_byte_size() const
+{
+	return sizeof(float) * m_u.size() + sizeof(uint16_t) * m_v.size();
+}
+
+//------------------------------------------------------------------------------
+// Reconstruct f_r for one cell
+float_t merl_lr::eval_cell(int c, int th, int tdpd) const
+{
+	const int rows = MERL_SAMPLING_RES_THETA_H;
+	const int cols = MERL_SAMPLING_RES_THETA_D * MERL_SAMPLING_RES_PHI_D / 2;
+	const float_t *u = &m_u[(c * rows + th) * m_rank];
+	const uint16_t *v = &m_v[(c * cols + tdpd) * m_rank];
+	float_t sum = 0;
+
+	for (int k = 0; k < m_rank; ++k)
+		sum+= u[k] * half_to_float(v[k]);
+
+	return max((float_t)0, exp(sum) - 1);
+}
+
+//------------------------------------------------------------------------------
+// look up the BRDF
+brdf::value_type merl_lr::eval(const vec3 &wi, const vec3 &wo, const void *) const
+{
+	if (wi.z > 0 && wo.z > 0) {
+		int th, td, pd;
+		merl_cell(wi, wo, &th, &td, &pd);
+		int tdpd = pd + td * MERL_SAMPLING_RES_PHI_D / 2;
+		vec3 rgb;
+
+		for (int c = 0; c < 3; ++c)
+			rgb[c] = eval_cell(c, th, tdpd);
+		rgb*= wo.z;
+
+		return brdf::value_type(&rgb[0], 3);
+	}
+
+	return zero_value();
+}
+
+//------------------------------------------------------------------------------
+// Reconstruction error against the raw table (valid cells only)
+merl_lr::error_report merl_lr::report_error(const merl &ref) const
+{
+	const int rows = MERL_SAMPLING_RES_THETA_H;
+	const int cols = MERL_SAMPLING_RES_THETA_D * MERL_SAMPLING_RES_PHI_D / 2;
+	const double scale[3] = {MERL_RED_SCALE, MERL_GREEN_SCALE, MERL_BLUE_SCALE};
+	const std::vector<double> &samples = ref.get_samples();
+	std::vector<double> partials(rows * 3 * 4, 0.0);
+	error_report report;
+
+	if ((int)samples.size() != 3 * rows * cols)
+		throw exc("djb_error: Unexpected MERL table size\n");
+
+	// per-row partial sums, reduced in order
+	parallel_for(rows, [&](int i) {
+		for (int c = 0; c < 3; ++c) {
+			double *p = &partials[(i * 3 + c) * 4];
+
+			for (int j = 0; j < cols; ++j) {
+				double x = samples[c * rows * cols + i * cols + j];
+
+				if (x < 0)
+					continue;
+				x*= scale[c];
+				double y = eval_cell(c, i, j);
+				p[0]+= sqr(x - y);
+				p[1]+= sqr(x);
+				p[2]+= sqr(log(1 + x) - log(1 + y));
+				p[3]+= 1;
+			}
+		}
+	});
+
+	for (int c = 0; c < 3; ++c) {
+		double q[4] = {0, 0, 0, 0};
+
+		for (int i = 0; i < rows; ++i)
+			for (int k = 0; k < 4; ++k)
+				q[k]+= partials[(i * 3 + c) * 4 + k];
+		report.rmse[c] = q[3] > 0 ? sqrt(q[0] / q[3]) : 0;
+		report.rel_rmse[c] = q[1] > 0 ? sqrt(q[0] / q[1]) : 0;
+		report.log_rmse[c] = q[3] > 0 ? sqrt(q[2] / q[3]) : 0;
+	}
+
+	return report;
+}
+
+// *****************************************************************************
+// Baked API implementation
+
+//------------------------------------------------------------------------------
+// Ctor: evaluate the BRDF at the centre of each cell (rows of constant theta_h
+// are evaluated in parallel)
+baked::baked(
+	const brdf &fr,
+	int res_theta_h,
+	int res_theta_d,
+	int res_phi_d,
+	const void *user_args
+):
+	m_texels(3 * res_theta_h * res_theta_d * res_phi_d, 0.f),
+	m_res_theta_h(res_theta_h),
+	m_res_theta_d(res_theta_d),
+	m_res_phi_d(res_phi_d)
+{
+	const int ch_cnt = fr.zero_value().size();
+
+	if (res_theta_h < 1 || res_theta_d < 1 || res_phi_d < 1)
+		throw exc("djb_error: Invalid table resolution\n");
+	if (ch_cnt != 1 && ch_cnt != 3)
+		throw exc("djb_error: Cannot bake a spectrum of size %i\n", ch_cnt);
+
+	parallel_for(res_theta_h, [&](int th) {
+		float_t u = (th + (float_t)0.5) / res_theta_h;
+		float_t theta_h = u * u * m_pi() / 2;
+		vec3 wh = vec3(sin(theta_h), 0, cos(theta_h));
+
+		for (int td = 0; td < res_theta_d; ++td)
+		for (int pd = 0; pd < res_phi_d; ++pd) {
+			float_t theta_d = (td + (float_t)0.5) / res_theta_d * m_pi() / 2;
+			float_t phi_d = (pd + (float_t)0.5) / res_phi_d * m_pi();
+			vec3 wd = vec3(sin(theta_d) * cos(phi_d),
+			               sin(theta_d) * sin(phi_d),
+			               cos(theta_d));
+			float *texel = &m_texels[3 * (pd + res_phi_d * (td + res_theta_d * th))];
+			vec3 wi, wo;
+
+			hd_to_io(wh, wd, &wi, &wo);
+			if (wi.z > 0 && wo.z > 0) {
+				// eval returns f_r * cos(wo)
+				brdf::value_type fr_v = fr.eval(wi, wo, user_args);
+
+				for (int c = 0; c < 3; ++c)
+					texel[c] = max((float_t)0, fr_v[ch_cnt == 1 ? 0 : c] / wo.z);
+			}
+		}
+	});
+}
+
+//------------------------------------------------------------------------------
+// GPU data
+std::vector<uint16_t> baked::get_texels_half() const
+{
+	const int cnt = m_texels.size() / 3;
+	std::vector<uint16_t> texels(4 * cnt);
+
+	for (int i = 0; i < cnt; ++i) {
+		for (int c = 0; c < 3; ++c)
+			texels[4 * i + c] = float_to_half(m_texels[3 * i + c]);
+		texels[4 * i + 3] = float_to_half(1.f);
+	}
+
+	return texels;
+}
+
+//------------------------------------------------------------------------------
+// look up the BRDF
+brdf::value_type baked::eval(const vec3 &wi, const vec3 &wo, const void *) const
+{
+	if (wi.z > 0 && wo.z > 0) {
+		vec3 wh, wd;
+
+		io_to_hd(wi, wo, &wh, &wd);
+		float_t theta_h = acos(clamp(wh.z, (float_t)-1, (float_t)1));
+		float_t theta_d = acos(clamp(wd.z, (float_t)-1, (float_t)1));
+		float_t phi_d = atan2(wd.y, wd.x);
+		if (phi_d < 0)
+			phi_d+= m_pi();
+
+		int th = sqrt(theta_h / (m_pi() / 2)) * m_res_theta_h;
+		int td = theta_d / (m_pi() / 2) * m_res_theta_d;
+		int pd = phi_d / m_pi() * m_res_phi_d;
+		th = clamp(th, 0, m_res_theta_h - 1);
+		td = clamp(td, 0, m_res_theta_d - 1);
+		pd = clamp(pd, 0, m_res_phi_d - 1);
+
+		const float *texel = &m_texels[3 * (pd + m_res_phi_d
+		                                   * (td + m_res_theta_d * th))];
+		vec3 rgb = vec3(texel[0], texel[1], texel[2]) * wo.z;
+
+		return brdf::value_type(&rgb[0], 3);
+	}
+
+	return zero_value();
+}
+
 // *****************************************************************************
 // UTIA API implementation (based on Jiri Filip's implementation)
 
@@ -2885,6 +3634,218 @@ void utia::normalize()
 		m_samples[i]*= k;
 }
 
+// *****************************************************************************
+// Evaluation plan API implementation
+
+//------------------------------------------------------------------------------
+// Ctor: precompute the lookups of each direction pair
+eval_plan::eval_plan(const std::vector<brdf::io_pair> &wiwo, int targets):
+	m_wiwo(wiwo),
+	m_cos(wiwo.size()),
+	m_targets(targets)
+{
+	const int cnt = (int)wiwo.size();
+	const int chunk = 4096;
+
+	if (targets & MERL) m_merl.resize(cnt);
+	if (targets & BAKED) m_hd.resize(cnt);
+	if (targets & UTIA) m_utia.resize(cnt);
+
+	parallel_for((cnt + chunk - 1) / chunk, [&](int j) {
+		for (int i = j * chunk; i < min(cnt, (j + 1) * chunk); ++i) {
+			const vec3 &wi = wiwo[i].first, &wo = wiwo[i].second;
+			bool valid = wi.z > 0 && wo.z > 0;
+
+			m_cos[i] = valid ? wo.z : 0;
+			if (targets & MERL) {
+				int th, td, pd;
+
+				m_merl[i] = -1;
+				if (valid) {
+					merl_cell(wi, wo, &th, &td, &pd);
+					m_merl[i] = pd + MERL_SAMPLING_RES_PHI_D / 2
+					          * (td + MERL_SAMPLING_RES_THETA_D * th);
+				}
+			}
+			if ((targets & BAKED) && valid) {
+				vec3 wh, wd;
+
+				brdf::io_to_hd(wi, wo, &wh, &wd);
+				float_t theta_h = acos(clamp(wh.z, (float_t)-1, (float_t)1));
+				float_t theta_d = acos(clamp(wd.z, (float_t)-1, (float_t)1));
+				float_t phi_d = atan2(wd.y, wd.x);
+				if (phi_d < 0)
+					phi_d+= m_pi();
+				m_hd[i] = vec3(sqrt(theta_h / (m_pi() / 2)),
+				               theta_d / (m_pi() / 2),
+				               phi_d / m_pi());
+			}
+			if ((targets & UTIA) && valid) {
+				// same interpolation as utia::eval
+				float_t r2d = 180 / m_pi();
+				float_t t[2] = {r2d * acos(wi.z), r2d * acos(wo.z)};
+				float_t p[2] = {r2d * atan2(wi.y, wi.x), r2d * atan2(wo.y, wo.x)};
+				const int nt[2] = {DJB__UTIA_NTI, DJB__UTIA_NTV};
+				const int np[2] = {DJB__UTIA_NPI, DJB__UTIA_NPV};
+				int32_t *idx[2] = {m_utia[i].row, m_utia[i].col};
+				float_t *w[2] = {m_utia[i].w_row, m_utia[i].w_col};
+
+				if (t[0] >= 90 || t[1] >= 90) {
+					m_cos[i] = 0;
+					continue;
+				}
+				for (int k = 0; k < 2; ++k) {
+					int it[2], ip[2];
+					float_t wt[2], wp[2];
+
+					while (p[k] < 0) {p[k]+= 360;}
+					while (p[k] >= 360) {p[k]-= 360;}
+					it[0] = (int)floor(t[k] / DJB__UTIA_STEP_T);
+					it[1] = it[0] + 1;
+					if (it[0] > nt[k] - 2) {
+						it[0] = nt[k] - 2;
+						it[1] = nt[k] - 1;
+					}
+					ip[0] = (int)floor(p[k] / DJB__UTIA_STEP_P);
+					ip[1] = ip[0] + 1;
+					wt[1] = t[k] - DJB__UTIA_STEP_T * it[0];
+					wt[0] = DJB__UTIA_STEP_T * it[1] - t[k];
+					wp[1] = p[k] - DJB__UTIA_STEP_P * ip[0];
+					wp[0] = DJB__UTIA_STEP_P * ip[1] - p[k];
+					if (ip[1] == np[k])
+						ip[1] = 0;
+					for (int a = 0; a < 2; ++a)
+					for (int b = 0; b < 2; ++b) {
+						idx[k][2 * a + b] = np[k] * it[a] + ip[b];
+						w[k][2 * a + b] = wt[a] * wp[b]
+						                / ((wt[0] + wt[1]) * (wp[0] + wp[1]));
+					}
+				}
+			}
+		}
+	});
+}
+
+void eval_plan::check(int target) const
+{
+	if (!(m_targets & target))
+		throw exc("djb_error: Evaluation plan was not prepared for this BRDF\n");
+}
+
+//------------------------------------------------------------------------------
+// Execution
+void eval_plan::execute(const merl &fr, std::vector<vec3> *out) const
+{
+	const int cnt = size();
+	const int chunk = 4096;
+	const int offset = MERL_SAMPLING_RES_THETA_H * MERL_SAMPLING_RES_THETA_D
+	                 * MERL_SAMPLING_RES_PHI_D / 2;
+	const std::vector<double> &samples = fr.get_samples();
+
+	check(MERL);
+	out->resize(cnt);
+	parallel_for((cnt + chunk - 1) / chunk, [&](int j) {
+		for (int i = j * chunk; i < min(cnt, (j + 1) * chunk); ++i) {
+			int idx = m_merl[i];
+			vec3 rgb = vec3(0);
+
+			if (idx >= 0) {
+				rgb = vec3(samples[idx             ] * MERL_RED_SCALE,
+				           samples[idx + offset    ] * MERL_GREEN_SCALE,
+				           samples[idx + 2 * offset] * MERL_BLUE_SCALE);
+				if (rgb.x < 0 || rgb.y < 0 || rgb.z < 0)
+					rgb = vec3(0);
+			}
+			(*out)[i] = rgb * m_cos[i];
+		}
+	});
+}
+
+void eval_plan::execute(const baked &fr, std::vector<vec3> *out) const
+{
+	const int cnt = size();
+	const int chunk = 4096;
+	const int res_th = fr.get_res_theta_h();
+	const int res_td = fr.get_res_theta_d();
+	const int res_pd = fr.get_res_phi_d();
+	const std::vector<float> &texels = fr.get_texels();
+
+	check(BAKED);
+	out->resize(cnt);
+	parallel_for((cnt + chunk - 1) / chunk, [&](int j) {
+		for (int i = j * chunk; i < min(cnt, (j + 1) * chunk); ++i) {
+			if (m_cos[i] > 0) {
+				int th = clamp((int)(m_hd[i].x * res_th), 0, res_th - 1);
+				int td = clamp((int)(m_hd[i].y * res_td), 0, res_td - 1);
+				int pd = clamp((int)(m_hd[i].z * res_pd), 0, res_pd - 1);
+				const float *texel = &texels[3 * (pd + res_pd * (td + res_td * th))];
+
+				(*out)[i] = vec3(texel[0], texel[1], texel[2]) * m_cos[i];
+			} else {
+				(*out)[i] = vec3(0);
+			}
+		}
+	});
+}
+
+void eval_plan::execute(const utia &fr, std::vector<vec3> *out) const
+{
+	const int cnt = size();
+	const int chunk = 4096;
+	const int nc = DJB__UTIA_NPV * DJB__UTIA_NTV;
+	const int nr = DJB__UTIA_NPI * DJB__UTIA_NTI;
+	const std::vector<double> &samples = fr.get_samples();
+
+	check(UTIA);
+	out->resize(cnt);
+	parallel_for((cnt + chunk - 1) / chunk, [&](int j) {
+		for (int i = j * chunk; i < min(cnt, (j + 1) * chunk); ++i) {
+			const utia_lerp &l = m_utia[i];
+			vec3 rgb = vec3(0);
+
+			if (m_cos[i] > 0) {
+				for (int isp = 0; isp < DJB__UTIA_PLANES; ++isp) {
+					const double *plane = &samples[isp * nr * nc];
+					float_t x = 0;
+
+					for (int a = 0; a < 4; ++a)
+					for (int b = 0; b < 4; ++b)
+						x+= l.w_row[a] * l.w_col[b]
+						   * (float_t)plane[nc * l.row[a] + l.col[b]];
+					if (x > (float_t)0.0375)
+						x = pow((x + (float_t)0.055) / (float_t)1.055, (float_t)2.4);
+					else
+						x/= (float_t)12.92;
+					rgb[isp] = max((float_t)0, 100 * x);
+				}
+			}
+			(*out)[i] = rgb * m_cos[i];
+		}
+	});
+}
+
+void
+eval_plan::execute(
+	const brdf &fr,
+	std::vector<vec3> *out,
+	const void *user_args
+) const {
+	const int cnt = size();
+	const int chunk = 4096;
+	const int ch_cnt = fr.zero_value().size();
+
+	out->resize(cnt);
+	parallel_for((cnt + chunk - 1) / chunk, [&](int j) {
+		for (int i = j * chunk; i < min(cnt, (j + 1) * chunk); ++i) {
+			brdf::value_type v = fr.eval(m_wiwo[i].first, m_wiwo[i].second,
+			                             user_args);
+
+			for (int c = 0; c < 3; ++c)
+				(*out)[i][c] = v[ch_cnt == 1 ? 0 : c];
+		}
+	});
+}
+
 // *************************************************************************************************
 // Shifted Gamma Distribution API implementation
 
@@ -3320,43 +4281,24 @@ vec3 npf::uberTextureLookupInt(int x) const
 	return m_uber_texture[x + 512 * m_id];
 }
 
-vec3 npf::lookupInterpolatedG1(int n, float_t theta) const
+vec3 npf::lookupInterpolatedG1(int, float_t theta) const
 {
-	float fb = theta / M_PI / 2 * 90.f;
-	return uberTextureLookupInt(clamp(fb, 0.f, 89.f)+2+90);
+	float_t fb = theta / (m_pi() / 2) * 90;
 	// find bin centers
-	float f0 = floor(fb-0.5f) + 0.5f;
-	float f1 = f0 + 1.f;
-	// find bin indexes t0 and t1
-	float t0 = floor(f0);
-	float t1 = floor(f1);
-	// ignores the first bin
-	t0 = max(1.f, t0);
-	t1 = max(2.f, t1);
-	// find theta at bin centers
-	//float theta0 = (t0+0.5f) * M_PI / 2 / 90.f;
-	//float theta1 = (t1+0.5f) * M_PI / 2 / 90.f;
-	//find the weights
-	float w0 = 1.f - (fb - f0) ;
-	float w1 = 1.f - w0 ; // 1.0 - (f1 - fb)
-	// sample
-	vec3 G1 = vec3(0);
-	vec2 uv;
-	uv.y = float(n)/256.f;
-	if (t1 > 90.f-1.f) {
-		uv.x = (t0+2.+90.f)/512.f;
-		//G1 = uberTextureLookup(uv) * w0;
-		G1 = uberTextureLookupInt(t0+2+90) * w0;
-	} else {
-		uv.x = (t0+2.+90.)/512.f;
-		vec3 g0 = uberTextureLookup(uv);
-		g0 = uberTextureLookupInt(t0+2+90);
-		uv.x = (t1+2.+90.)/512.f;
-		vec3 g1 = uberTextureLookup(uv);
-		g1 = uberTextureLookupInt(t1+2+90);
-		G1 = g0 * w0 + g1 * w1;
-	}
-	return G1;
+	float_t f0 = floor(fb - (float_t)0.5) + (float_t)0.5;
+	float_t f1 = f0 + 1;
+	// find bin indexes t0 and t1 (ignores the first bin)
+	int t0 = max(1, (int)floor(f0));
+	int t1 = max(2, (int)floor(f1));
+	// find the weights
+	float_t w0 = 1 - (fb - f0);
+	float_t w1 = 1 - w0;
+
+	if (t1 > 90 - 1)
+		return uberTextureLookupInt(t0 + 2 + 90) * w0;
+
+	return uberTextureLookupInt(t0 + 2 + 90) * w0
+	     + uberTextureLookupInt(t1 + 2 + 90) * w1;
 }
 
 
@@ -3372,69 +4314,77 @@ brdf::value_type npf::eval(const vec3 &dirIn, const vec3 &dirOut, const void *)
 		return zero_value();
 	vec3 dirNormal = vec3(0, 0, 1);
 	vec3 dirH = tmp * inversesqrt(nrm);
-	float thetaH = acos(sat(dot(dirH, dirNormal)));
-	float thetaD = acos(sat(dot(dirIn, dirH)));
-	float thetaI = acos(sat(dot(dirIn, dirNormal)));
-	float thetaO = acos(sat(dot(dirOut, dirNormal)));
-
-	// BRDF texture has a fixed size of 512x256
-	vec2 uv;
-	uv.y = float(m_id)/256.;
-
-	uv.x = 0.0/512.;
-	vec3 rhoD = uberTextureLookup(uv);
-	//if (m_first) printf("%f %f %f\n", rhoD.x, rhoD.y, rhoD.z); //OK
-
-	uv.x = 1.0/512.;
-	vec3 rhoS = uberTextureLookup(uv);
-	//if (m_first) printf("%f %f %f\n", rhoS.x, rhoS.y, rhoS.z); //OK
-
-	int iD = int(clamp(sqrt(thetaH / M_PI / 2
-	             * 90.0 * 90.0), 0.0, 89.0));
-	uv.x = float(iD+2)/512.;
-	if (m_first)
-		printf("iD: %i\n", iD);
-	vec3 D = uberTextureLookup(uv);
-	D = uberTextureLookupInt(iD+2); //OK
+	float_t thetaH = acos(sat(dot(dirH, dirNormal)));
+	float_t thetaD = acos(sat(dot(dirIn, dirH)));
+	float_t thetaI = acos(sat(dot(dirIn, dirNormal)));
+	float_t thetaO = acos(sat(dot(dirOut, dirNormal)));
+
+	// each texture row contains: rhoD rhoS D[90] G1[90] F[90]
+	vec3 rhoD = uberTextureLookupInt(0);
+	vec3 rhoS = uberTextureLookupInt(1);
+
+	float_t fD = sqrt(thetaH / (m_pi() / 2) * 90 * 90);
+	int iD = (int)clamp(fD, (float_t)0, (float_t)89);
+	vec3 D = uberTextureLookupInt(iD + 2);
 
 	vec3 G1I = lookupInterpolatedG1(m_id, thetaI);
 
 	vec3 G1O = lookupInterpolatedG1(m_id, thetaO);
 
-	auto tmp2 = thetaD / M_PI / 2 * 90.0;
-	int iF = int(clamp(tmp2, 0.0, 89.0));
-	uv.x = float(iF+2+90+90)/512.;
-	vec3 F = uberTextureLookup(uv);
-	F = uberTextureLookupInt(iF+2+90+90); //OK
+	float_t fF = thetaD / (m_pi() / 2) * 90;
+	int iF = (int)clamp(fF, (float_t)0, (float_t)89);
+	vec3 F = uberTextureLookupInt(iF + 2 + 90 + 90);
 
 	vec3 BRDF = (rhoD) + (rhoS) * D * F *
 	            (G1I / cos(thetaI)) * (G1O / cos(thetaO));
-	BRDF*= dirOut.z;
-	BRDF*= 1.0 / 16;
-
-	m_first = false;
 
-	if (fabs(dot(BRDF, BRDF)) > 9999.9999f || std::isnan(dot(BRDF, BRDF))) {
+	if (sqrt(dot(BRDF, BRDF)) >= 9999.9999f || std::isnan(dot(BRDF, BRDF))) {
 		return zero_value();
 	}
+	// same normalization as the shader (npf.glsl returns pi * f_r)
+	BRDF*= dirOut.z / m_pi();
 
 	return brdf::value_type({BRDF.x, BRDF.y, BRDF.z});
 }
 
-npf::npf(const char *uber_texture, const char *name):
-    m_uber_texture(), m_id(-1), m_first(true)
+//------------------------------------------------------------------------------
+// Load an uber texture (the number of rows is deduced from the file size)
+int npf::load(const char *uber_texture, std::vector<vec3> *texels)
 {
-	// load the uber_texture
-	FILE *pf = fopen(uber_texture, "rb");
-	if (!pf)
+	std::fstream f(uber_texture, std::fstream::in | std::fstream::binary);
+	const long row_bytes = sizeof(float) * 3 * TEXELS_PER_ROW;
+	std::vector<float> data;
+	long byte_cnt;
+
+	if (!f.is_open())
 		throw exc("djb_error: Failed to load %s\n", uber_texture);
 
-	m_uber_texture.resize(512*256);
-	fread(&m_uber_texture[0], sizeof(m_uber_texture[0]), m_uber_texture.size(), pf);
-	fclose(pf);
+	f.seekg(0, std::fstream::end);
+	byte_cnt = (long)f.tellg();
+	f.seekg(0, std::fstream::beg);
+	if (byte_cnt <= 0 || byte_cnt % row_bytes)
+		throw exc("djb_error: Invalid NPF uber texture %s\n", uber_texture);
+
+	data.resize(byte_cnt / sizeof(float));
+	f.read((char *)&data[0], byte_cnt);
+	if (f.fail())
+		throw exc("djb_error: Reading %s failed\n", uber_texture);
+
+	texels->resize(data.size() / 3);
+	for (int i = 0; i < (int)texels->size(); ++i)
+		(*texels)[i] = vec3(data[3 * i], data[3 * i + 1], data[3 * i + 2]);
+
+	return (int)(byte_cnt / row_bytes);
+}
+
+npf::npf(const char *uber_texture, const char *name):
+    m_uber_texture(), m_id(-1)
+{
+	// load the uber_texture
+	int row_cnt = load(uber_texture, &m_uber_texture);
 
 	// extract id from name
-	for (int i = 0; i < 100; ++i) {
+	for (int i = 0; i < min(100, row_cnt); ++i) {
 		if (!strcmp(s_list[i], name)) {
 			m_id = i;
 #ifndef NVERBOSE
@@ -3446,6 +4396,1315 @@ npf::npf(const char *uber_texture, const char *name):
 	if (m_id == -1) throw exc("djb_error: No NPF parameters for %s\n", name);
 }
 
+npf::npf(const char *uber_texture, int id):
+    m_uber_texture(), m_id(id)
+{
+	int row_cnt = load(uber_texture, &m_uber_texture);
+
+	if (id < 0 || id >= row_cnt)
+		throw exc("djb_error: No NPF row %i in %s\n", id, uber_texture);
+}
+
+//------------------------------------------------------------------------------
+/**
+ * Factorize a MERL BRDF into NPF terms with alternating least squares
+ *
+ * Each valid MERL bin is approximated as (in the units of the shader, i.e.,
+ * pi * f_r)
+ *     rhoD + rhoS * D(th) * F(td) * G1(ti) / cos(ti) * G1(to) / cos(to)
+ * The D and F bins of the uber texture coincide with the MERL theta_half and
+ * theta_diff bins, so each term has a closed-form update when the others are
+ * held fixed. G1 appears twice in the product, so its update is damped with a
+ * geometric mean. Residuals are weighted by cos(ti) cos(to) / (y + eps) so
+ * that the specular peak does not swamp the rest of the table. The solver
+ * runs over theta_half slices in parallel; partial sums are reduced in slice
+ * order so the result does not depend on the number of threads.
+ */
+std::vector<vec3> npf::fit(const merl &merl, int iterations)
+{
+	const int res_th = MERL_SAMPLING_RES_THETA_H;
+	const int res_td = MERL_SAMPLING_RES_THETA_D;
+	const int res_pd = MERL_SAMPLING_RES_PHI_D / 2;
+	const int res_g1 = 90;
+	const int offset = res_th * res_td * res_pd;
+	const double scale[3] = {MERL_RED_SCALE, MERL_GREEN_SCALE, MERL_BLUE_SCALE};
+	const double eps = 1e-2;
+	const double smoothness = 1e-2;
+	const std::vector<double> &samples = merl.get_samples();
+	struct sample {double y[3], k; int td, gi, go;};
+	std::vector<std::vector<sample> > slices(res_th);
+	std::vector<double> partials;
+	double rhoD[3], rhoS[3], D[3][res_th], F[3][res_td], G1[3][res_g1];
+	// pull each bin towards the mean of its neighbors; this only matters for
+	// bins with little data, e.g., at grazing angles
+	auto smooth = [&](double *num, double *den, const double *x, int b, int e) {
+		double lambda = 0;
+
+		for (int i = b; i < e; ++i)
+			lambda+= den[i];
+		lambda*= smoothness / (e - b);
+		for (int i = b; i < e; ++i) {
+			int i0 = max(b, i - 1), i1 = min(e - 1, i + 1);
+
+			num[i]+= lambda * (x[i0] + x[i1]) / 2;
+			den[i]+= lambda;
+		}
+	};
+	auto g1_bin = [&](float_t z) {
+		int bin = (int)(acos(z) / (m_pi() / 2) * res_g1);
+		return clamp(bin, 1, res_g1 - 1);
+	};
+
+	if ((int)samples.size() != 3 * offset)
+		throw exc("djb_error: Unexpected MERL table size\n");
+
+	// gather the valid samples
+	parallel_for(res_th, [&](int th) {
+		float_t u = (th + (float_t)0.5) / res_th;
+		float_t theta_h = sqr(u) * m_pi() / 2;
+		vec3 wh = vec3(sin(theta_h), 0, cos(theta_h));
+
+		for (int td = 0; td < res_td; ++td)
+		for (int pd = 0; pd < res_pd; ++pd) {
+			float_t theta_d = (td + (float_t)0.5) / res_td * m_pi() / 2;
+			float_t phi_d = (pd + (float_t)0.5) / res_pd * m_pi();
+			float_t sin_theta_d = sin(theta_d);
+			vec3 wd = vec3(sin_theta_d * cos(phi_d),
+			               sin_theta_d * sin(phi_d),
+			               cos(theta_d));
+			int idx = pd + res_pd * (td + res_td * th);
+			vec3 wi, wo;
+			sample s;
+
+			hd_to_io(wh, wd, &wi, &wo);
+			if (wi.z <= 0 || wo.z <= 0)
+				continue;
+			if (samples[idx] < 0 || samples[idx + offset] < 0
+			    || samples[idx + 2 * offset] < 0)
+				continue;
+
+			for (int c = 0; c < 3; ++c)
+				s.y[c] = m_pi() * samples[idx + c * offset] * scale[c];
+			s.k = wi.z * wo.z;
+			s.td = td;
+			s.gi = g1_bin(wi.z);
+			s.go = g1_bin(wo.z);
+			slices[th].push_back(s);
+		}
+	});
+
+	// initialize: flat terms and a diffuse guess from the tail of the table
+	for (int c = 0; c < 3; ++c) {
+		double sum = 0, cnt = 0;
+
+		for (int th = 2 * res_th / 3; th < res_th; ++th) {
+			for (int i = 0; i < (int)slices[th].size(); ++i) {
+				sum+= slices[th][i].y[c];
+				cnt+= 1;
+			}
+		}
+		rhoD[c] = cnt > 0 ? sum / cnt / 2 : 0;
+		rhoS[c] = 1;
+		for (int i = 0; i < res_th; ++i) D[c][i] = 1;
+		for (int i = 0; i < res_td; ++i) F[c][i] = 1;
+		for (int i = 0; i < res_g1; ++i) G1[c][i] = i > 0 ? 1 : 0;
+	}
+
+	for (int it = 0; it < iterations; ++it) {
+		// D: one independent problem per theta_half slice
+		parallel_for(res_th, [&](int th) {
+			for (int c = 0; c < 3; ++c) {
+				double num = 0, den = 0;
+
+				for (int i = 0; i < (int)slices[th].size(); ++i) {
+					const sample &s = slices[th][i];
+					double w = s.k / (s.y[c] + eps);
+					double t = rhoS[c] * F[c][s.td]
+					         * G1[c][s.gi] * G1[c][s.go] / s.k;
+
+					num+= w * (s.y[c] - rhoD[c]) * t;
+					den+= w * t * t;
+				}
+				D[c][th] = den > 0 ? max(0.0, num / den) : 0.0;
+			}
+		});
+
+		// F: per-slice partial sums reduced in order
+		partials.assign(res_th * 3 * res_td * 2, 0.0);
+		parallel_for(res_th, [&](int th) {
+			double *p = &partials[th * 3 * res_td * 2];
+
+			for (int i = 0; i < (int)slices[th].size(); ++i) {
+				const sample &s = slices[th][i];
+
+				for (int c = 0; c < 3; ++c) {
+					double w = s.k / (s.y[c] + eps);
+					double t = rhoS[c] * D[c][th]
+					         * G1[c][s.gi] * G1[c][s.go] / s.k;
+					double *q = &p[(c * res_td + s.td) * 2];
+
+					q[0]+= w * (s.y[c] - rhoD[c]) * t;
+					q[1]+= w * t * t;
+				}
+			}
+		});
+		for (int c = 0; c < 3; ++c) {
+			std::vector<double> num(res_td, 0.0), den(res_td, 0.0);
+
+			for (int td = 0; td < res_td; ++td)
+			for (int th = 0; th < res_th; ++th) {
+				const double *q = &partials[((th * 3 + c) * res_td + td) * 2];
+				num[td]+= q[0];
+				den[td]+= q[1];
+			}
+			smooth(&num[0], &den[0], F[c], 0, res_td);
+			for (int td = 0; td < res_td; ++td)
+				F[c][td] = den[td] > 0 ? max(0.0, num[td] / den[td]) : 0.0;
+		}
+
+		// G1: Jacobi update of both factors, damped with a geometric mean
+		partials.assign(res_th * 3 * res_g1 * 2, 0.0);
+		parallel_for(res_th, [&](int th) {
+			double *p = &partials[th * 3 * res_g1 * 2];
+
+			for (int i = 0; i < (int)slices[th].size(); ++i) {
+				const sample &s = slices[th][i];
+
+				for (int c = 0; c < 3; ++c) {
+					double w = s.k / (s.y[c] + eps);
+					double r = s.y[c] - rhoD[c];
+					double t = rhoS[c] * D[c][th] * F[c][s.td] / s.k;
+					double ti = t * G1[c][s.go];
+					double to = t * G1[c][s.gi];
+					double *qi = &p[(c * res_g1 + s.gi) * 2];
+					double *qo = &p[(c * res_g1 + s.go) * 2];
+
+					qi[0]+= w * r * ti;
+					qi[1]+= w * ti * ti;
+					qo[0]+= w * r * to;
+					qo[1]+= w * to * to;
+				}
+			}
+		});
+		for (int c = 0; c < 3; ++c) {
+			std::vector<double> num(res_g1, 0.0), den(res_g1, 0.0);
+
+			for (int g = 1; g < res_g1; ++g)
+			for (int th = 0; th < res_th; ++th) {
+				const double *q = &partials[((th * 3 + c) * res_g1 + g) * 2];
+				num[g]+= q[0];
+				den[g]+= q[1];
+			}
+			smooth(&num[0], &den[0], G1[c], 1, res_g1);
+			for (int g = 1; g < res_g1; ++g)
+				if (den[g] > 0)
+					G1[c][g] = sqrt(G1[c][g] * max(0.0, num[g] / den[g]));
+		}
+
+		// rhoD: weighted mean of the residual (rhoS is set by the gauge below)
+		partials.assign(res_th * 3 * 3, 0.0);
+		parallel_for(res_th, [&](int th) {
+			double *p = &partials[th * 3 * 3];
+
+			for (int i = 0; i < (int)slices[th].size(); ++i) {
+				const sample &s = slices[th][i];
+
+				for (int c = 0; c < 3; ++c) {
+					double w = s.k / (s.y[c] + eps);
+					double r = s.y[c] - rhoS[c] * D[c][th] * F[c][s.td]
+					         * G1[c][s.gi] * G1[c][s.go] / s.k;
+					double *q = &p[c * 3];
+
+					q[0]+= w;
+					q[1]+= w * r;
+					q[2]+= w * sqr(r - rhoD[c]);
+				}
+			}
+		});
+		for (int c = 0; c < 3; ++c) {
+			double q[3] = {0, 0, 0};
+
+			for (int th = 0; th < res_th; ++th)
+				for (int i = 0; i < 3; ++i)
+					q[i]+= partials[(th * 3 + c) * 3 + i];
+			if (q[0] > 0)
+				rhoD[c] = max(0.0, q[1] / q[0]);
+#ifndef NVERBOSE
+			if (c == 0)
+				DJB_LOG("djb_verbose: NPF iteration %i, residual = %.9f\n",
+				        it, q[0] > 0 ? q[2] / q[0] : 0.0);
+#endif
+		}
+
+		// fix the gauge: D, F and G1 peak at 1, the scale goes to rhoS
+		for (int c = 0; c < 3; ++c) {
+			double max_d = 0, max_f = 0, max_g = 0;
+
+			for (int i = 0; i < res_th; ++i) max_d = max(max_d, D[c][i]);
+			for (int i = 0; i < res_td; ++i) max_f = max(max_f, F[c][i]);
+			for (int i = 0; i < res_g1; ++i) max_g = max(max_g, G1[c][i]);
+			if (max_d > 0 && max_f > 0 && max_g > 0) {
+				for (int i = 0; i < res_th; ++i) D[c][i]/= max_d;
+				for (int i = 0; i < res_td; ++i) F[c][i]/= max_f;
+				for (int i = 0; i < res_g1; ++i) G1[c][i]/= max_g;
+				rhoS[c]*= max_d * max_f * sqr(max_g);
+			}
+		}
+	}
+
+	// store the terms following the layout of the uber texture
+	std::vector<vec3> row(TEXELS_PER_ROW, vec3(0));
+	const double floor_value = 1e-6;
+
+	for (int c = 0; c < 3; ++c) {
+		row[0][c] = rhoD[c];
+		row[1][c] = rhoS[c];
+		for (int i = 0; i < res_th; ++i)
+			row[2 + i][c] = max(floor_value, D[c][i]);
+		for (int i = 1; i < res_g1; ++i)
+			row[2 + 90 + i][c] = max(floor_value, G1[c][i]);
+		for (int i = 0; i < res_td; ++i)
+			row[2 + 90 + 90 + i][c] = max(floor_value, F[c][i]);
+	}
+
+	return row;
+}
+
+//------------------------------------------------------------------------------
+// Store a row in the first unused (all-zero) row of an uber texture, or add a
+// new row at the end; the file is created if it does not exist
+int npf::append(const char *uber_texture, const std::vector<vec3> &row)
+{
+	std::vector<vec3> texels;
+	std::vector<float> data;
+	int row_cnt = 0, id;
+
+	if ((int)row.size() != TEXELS_PER_ROW)
+		throw exc("djb_error: NPF rows must have %i texels\n", TEXELS_PER_ROW);
+
+	if (std::fstream(uber_texture, std::fstream::in).is_open())
+		row_cnt = load(uber_texture, &texels);
+
+	// find a free slot
+	for (id = 0; id < row_cnt; ++id) {
+		const vec3 *texel = &texels[id * TEXELS_PER_ROW];
+		bool used = false;
+
+		for (int i = 0; i < TEXELS_PER_ROW && !used; ++i)
+			used = texel[i].x != 0 || texel[i].y != 0 || texel[i].z != 0;
+		if (!used)
+			break;
+	}
+	if (id == row_cnt)
+		texels.resize((row_cnt + 1) * TEXELS_PER_ROW, vec3(0));
+	for (int i = 0; i < TEXELS_PER_ROW; ++i)
+		texels[id * TEXELS_PER_ROW + i] = row[i];
+
+	// write the texture back
+	data.reserve(texels.size() * 3);
+	for (int i = 0; i < (int)texels.size(); ++i)
+		for (int c = 0; c < 3; ++c)
+			data.push_back((float)texels[i][c]);
+
+	std::fstream f(uber_texture, std::fstream::out | std::fstream::binary
+	                           | std::fstream::trunc);
+	if (!f.is_open())
+		throw exc("djb_error: Failed to open %s\n", uber_texture);
+	f.write((char *)&data[0], sizeof(float) * data.size());
+	if (f.fail())
+		throw exc("djb_error: Writing %s failed\n", uber_texture);
+
+#ifndef NVERBOSE
+	DJB_LOG("djb_verbose: NPF row %i written to %s\n", id, uber_texture);
+#endif
+
+	return id;
+}
+
+// *****************************************************************************
+// LTC API implementation (see Heitz et al. 2016, "Real-Time Polygonal-Light
+// Shading with Linearly Transformed Cosines")
+
+//------------------------------------------------------------------------------
+// LTC distribution: a clamped cosine transformed by M = [X Y Z] * A, with
+// A = {m11, 0, m13; 0, m22, 0; 0, 0, 1} and Z aligned with the lobe's average
+// direction
+struct ltc_lobe {
+	vec3 x, y, z;
+	float_t m11, m22, m13;
+	mat3 m, minv;
+	float_t det_minv;
+
+	ltc_lobe(): x(1, 0, 0), y(0, 1, 0), z(0, 0, 1), m11(1), m22(1), m13(0) {
+		update();
+	}
+	void update() {
+		mat3 a = mat3(m11, 0, m13, 0, m22, 0, 0, 0, 1);
+		m = transpose(mat3(x, y, z)) * a;
+		minv = inverse(m);
+		det_minv = fabs(det(minv));
+	}
+	float_t pdf(const vec3 &w) const {
+		vec3 wo = minv * w;
+		float_t nrm_sqr = dot(wo, wo);
+		float_t nrm = sqrt(nrm_sqr);
+
+		return max((float_t)0, wo.z / nrm) / m_pi()
+		     * det_minv / (nrm_sqr * nrm);
+	}
+	vec3 sample(const vec2 &u) const {
+		vec2 d = brdf::u2_to_d2(u);
+		vec3 wo = vec3(d.x, d.y, sqrt(max((float_t)0, 1 - dot(d, d))));
+
+		return normalize(m * wo);
+	}
+};
+
+//------------------------------------------------------------------------------
+// Nelder-Mead simplex minimization (minimizes f over DIM parameters in place)
+template<int DIM, typename F>
+static float_t
+nelder_mead(float_t *x, float_t delta, float_t tolerance, int max_iter, F f)
+{
+	float_t s[DIM + 1][DIM], v[DIM + 1];
+
+	for (int i = 0; i < DIM + 1; ++i) {
+		for (int j = 0; j < DIM; ++j)
+			s[i][j] = x[j] + (i == j + 1 ? delta : 0);
+		v[i] = f(s[i]);
+	}
+
+	for (int it = 0; it < max_iter; ++it) {
+		int lo = 0, hi = 0, nh = 0;
+		float_t c[DIM], r[DIM], e[DIM], k[DIM];
+
+		// find best, worst and second worst vertices
+		for (int i = 0; i < DIM + 1; ++i) {
+			if (v[i] < v[lo]) lo = i;
+			if (v[i] > v[hi]) hi = i;
+		}
+		nh = lo;
+		for (int i = 0; i < DIM + 1; ++i)
+			if (i != hi && v[i] > v[nh]) nh = i;
+		if (fabs(v[hi] - v[lo]) <= tolerance * (fabs(v[hi]) + fabs(v[lo])) / 2)
+			break;
+
+		// centroid of all vertices but the worst
+		for (int j = 0; j < DIM; ++j) {
+			c[j] = 0;
+			for (int i = 0; i < DIM + 1; ++i)
+				if (i != hi) c[j]+= s[i][j];
+			c[j]/= DIM;
+		}
+
+		// reflection, expansion, contraction, shrink
+		for (int j = 0; j < DIM; ++j)
+			r[j] = 2 * c[j] - s[hi][j];
+		float_t vr = f(r);
+
+		if (vr < v[lo]) {
+			for (int j = 0; j < DIM; ++j)
+				e[j] = 3 * c[j] - 2 * s[hi][j];
+			float_t ve = f(e);
+
+			if (ve < vr) {
+				memcpy(s[hi], e, sizeof(e));
+				v[hi] = ve;
+			} else {
+				memcpy(s[hi], r, sizeof(r));
+				v[hi] = vr;
+			}
+		} else if (vr < v[nh]) {
+			memcpy(s[hi], r, sizeof(r));
+			v[hi] = vr;
+		} else {
+			bool outside = vr < v[hi];
+
+			for (int j = 0; j < DIM; ++j)
+				k[j] = outside ? (c[j] + r[j]) / 2 : (c[j] + s[hi][j]) / 2;
+			float_t vk = f(k);
+
+			if (vk < min(vr, v[hi])) {
+				memcpy(s[hi], k, sizeof(k));
+				v[hi] = vk;
+			} else {
+				for (int i = 0; i < DIM + 1; ++i) {
+					if (i == lo) continue;
+					for (int j = 0; j < DIM; ++j)
+						s[i][j] = (s[i][j] + s[lo][j]) / 2;
+					v[i] = f(s[i]);
+				}
+			}
+		}
+	}
+
+	int lo = 0;
+	for (int i = 1; i < DIM + 1; ++i)
+		if (v[i] < v[lo]) lo = i;
+	memcpy(x, s[lo], sizeof(float_t) * DIM);
+
+	return v[lo];
+}
+
+//------------------------------------------------------------------------------
+// Fit error: L3 distance between the BRDF and the LTC, estimated with MIS
+// over samples drawn from both distributions
+static float_t
+ltc__error(
+	const ltc_lobe &lobe,
+	const brdf &fr,
+	const vec3 &wi,
+	const void *args,
+	float_t albedo,
+	int sample_cnt
+) {
+	double error = 0;
+
+	for (int j1 = 0; j1 < sample_cnt; ++j1)
+	for (int j2 = 0; j2 < sample_cnt; ++j2) {
+		vec2 u = vec2(j1 + (float_t)0.5, j2 + (float_t)0.5) / sample_cnt;
+		vec3 wo[2];
+		float_t pdf_brdf;
+
+		wo[0] = lobe.sample(u);
+		fr.sample(u, wi, &wo[1], &pdf_brdf, args);
+
+		for (int i = 0; i < 2; ++i) {
+			float_t pdf_ltc = lobe.pdf(wo[i]);
+			float_t pdf_fr = fr.pdf(wi, wo[i], args);
+			float_t pdf_sum = pdf_ltc + pdf_fr;
+
+			if (pdf_sum > 0) {
+				double e = fabs(fr.eval(wi, wo[i], args).sum()
+				                / fr.zero_value().size()
+				                - albedo * pdf_ltc);
+				error+= e * e * e / pdf_sum;
+			}
+		}
+	}
+
+	return error / sqr(sample_cnt);
+}
+
+//------------------------------------------------------------------------------
+// Bin parameterization
+float_t ltc::get_alpha(int alpha, int res_alpha)
+{
+	if (res_alpha <= 1)
+		return 1;
+	return max((float_t)1e-3, sqr((float_t)alpha / (res_alpha - 1)));
+}
+
+float_t ltc::get_cos_theta(int theta, int res_theta)
+{
+	if (res_theta <= 1)
+		return 1;
+	float_t u = (float_t)theta / (res_theta - 1);
+
+	return max((float_t)1e-3, 1 - sqr(u));
+}
+
+//------------------------------------------------------------------------------
+// Ctor: fit the table. Rows of constant roughness are fitted in parallel;
+// each row is fitted from normal to grazing incidence, starting each bin from
+// the solution of the previous one.
+ltc::ltc(const brdf &fr, int res_theta, int res_alpha, int sample_cnt):
+	m_minv(4 * res_theta * res_alpha),
+	m_albedo(4 * res_theta * res_alpha),
+	m_res_theta(res_theta),
+	m_res_alpha(res_alpha)
+{
+	if (res_theta < 1 || res_alpha < 1 || sample_cnt < 1)
+		throw exc("djb_error: Invalid LTC table resolution\n");
+
+	parallel_for(res_alpha, [&](int a) {
+		microfacet::args args =
+			microfacet::args::isotropic(get_alpha(a, res_alpha));
+		const void *user_args = res_alpha > 1 ? &args : nullptr;
+		const int channel_cnt = (int)fr.zero_value().size();
+		ltc_lobe lobe;
+		float_t p[3] = {1, 1, 0};
+
+		for (int t = 0; t < res_theta; ++t) {
+			float_t zi = get_cos_theta(t, res_theta);
+			vec3 wi = vec3(sqrt(1 - sqr(zi)), 0, zi);
+			brdf::value_type albedo = fr.zero_value();
+			vec3 avg = vec3(0);
+			int idx = a + res_alpha * t;
+
+			// directional albedo and average direction
+			for (int j1 = 0; j1 < sample_cnt; ++j1)
+			for (int j2 = 0; j2 < sample_cnt; ++j2) {
+				vec2 u = vec2(j1 + (float_t)0.5, j2 + (float_t)0.5) / sample_cnt;
+				vec3 wo;
+				float_t pdf;
+				brdf::value_type w = fr.sample(u, wi, &wo, &pdf, user_args);
+
+				if (pdf > 0 && wo.z > 0) {
+					albedo+= w;
+					avg+= wo * (w.sum() / channel_cnt);
+				}
+			}
+			albedo/= (float_t)sqr(sample_cnt);
+			float_t mean = albedo.sum() / channel_cnt;
+
+			for (int c = 0; c < 3; ++c)
+				m_albedo[4 * idx + c] = albedo[min(c, channel_cnt - 1)];
+			m_albedo[4 * idx + 3] = mean;
+
+			// frame: Z follows the average direction in the incidence plane
+			avg.y = 0;
+			lobe.z = dot(avg, avg) > 0 ? normalize(avg) : vec3(0, 0, 1);
+			lobe.y = vec3(0, 1, 0);
+			lobe.x = cross(lobe.y, lobe.z);
+
+			if (t == 0) {
+				// isotropic lobe at normal incidence: coarse search + refine
+				auto f = [&](const float_t *q) {
+					lobe.m11 = lobe.m22 = max(q[0], (float_t)1e-7);
+					lobe.m13 = 0;
+					lobe.update();
+					return ltc__error(lobe, fr, wi, user_args, mean, sample_cnt);
+				};
+				float_t best = std::numeric_limits<float_t>::max();
+
+				for (float_t q = 1; q > 1e-3; q*= (float_t)0.5) {
+					float_t e = f(&q);
+					if (e < best) {best = e; p[0] = q;}
+				}
+				nelder_mead<1>(p, p[0] / 4, (float_t)1e-5, 100, f);
+				p[1] = p[0];
+				p[2] = 0;
+			} else {
+				auto f = [&](const float_t *q) {
+					lobe.m11 = max(q[0], (float_t)1e-7);
+					lobe.m22 = max(q[1], (float_t)1e-7);
+					lobe.m13 = q[2];
+					lobe.update();
+					return ltc__error(lobe, fr, wi, user_args, mean, sample_cnt);
+				};
+
+				nelder_mead<3>(p, (float_t)0.05, (float_t)1e-5, 100, f);
+			}
+			lobe.m11 = max(p[0], (float_t)1e-7);
+			lobe.m22 = max(p[1], (float_t)1e-7);
+			lobe.m13 = p[2];
+			lobe.update();
+
+			// store the inverse matrix normalized by its middle element
+			mat3 minv = lobe.minv;
+			float_t nrm = minv[1][1];
+			m_minv[4 * idx    ] = minv[0][0] / nrm;
+			m_minv[4 * idx + 1] = minv[2][0] / nrm;
+			m_minv[4 * idx + 2] = minv[0][2] / nrm;
+			m_minv[4 * idx + 3] = minv[2][2] / nrm;
+		}
+#ifndef NVERBOSE
+		DJB_LOG("djb_verbose: LTC row %i/%i fitted\n", a + 1, res_alpha);
+#endif
+	});
+}
+
+//------------------------------------------------------------------------------
+// Accessors
+mat3 ltc::get_minv(int theta, int alpha) const
+{
+	const float_t *m = &m_minv[4 * (alpha + m_res_alpha * theta)];
+
+	return mat3(m[0], 0, m[2],
+	            0   , 1, 0   ,
+	            m[1], 0, m[3]);
+}
+
+vec3 ltc::get_albedo(int theta, int alpha) const
+{
+	const float_t *a = &m_albedo[4 * (alpha + m_res_alpha * theta)];
+
+	return vec3(a[0], a[1], a[2]);
+}
+
+//------------------------------------------------------------------------------
+// Export
+void ltc::save(const char *path) const
+{
+	std::fstream f(path, std::fstream::out | std::fstream::binary
+	                   | std::fstream::trunc);
+	int32_t res[2] = {m_res_alpha, m_res_theta};
+	std::vector<uint16_t> data;
+
+	if (!f.is_open())
+		throw exc("djb_error: Failed to open %s\n", path);
+
+	data.reserve(m_minv.size() + m_albedo.size());
+	for (int i = 0; i < (int)m_minv.size(); ++i)
+		data.push_back(float_to_half((float)m_minv[i]));
+	for (int i = 0; i < (int)m_albedo.size(); ++i)
+		data.push_back(float_to_half((float)m_albedo[i]));
+
+	f.write((char *)res, sizeof(res));
+	f.write((char *)&data[0], sizeof(data[0]) * data.size());
+	if (f.fail())
+		throw exc("djb_error: Writing %s failed\n", path);
+}
+
+// *****************************************************************************
+// Pivot API implementation (see Dupuy et al. 2017, "A Spherical Cap
+// Preserving Parameterization for Spherical Distributions")
+
+//------------------------------------------------------------------------------
+// Spherical caps and their pivot transformation (ports of pivot.glsl)
+struct pivot_cap {
+	vec3 dir;  // direction
+	float_t z; // cos of the aperture angle
+
+	pivot_cap(const vec3 &dir, float_t z): dir(dir), z(z) {}
+};
+
+static float_t pivot__jacobian(const vec3 &wk, const vec3 &r_p)
+{
+	float_t num = 1 - dot(r_p, r_p);
+	vec3 tmp = wk - r_p;
+	float_t den = dot(tmp, tmp);
+
+	return (num * num) / (den * den);
+}
+
+static vec2 pivot__r2_to_pr2(const vec2 &r, float_t r_p)
+{
+	vec2 tmp1 = vec2(r.x - r_p, r.y);
+	vec2 tmp2 = r_p * r - vec2(1, 0);
+	float_t x = dot(tmp1, tmp2);
+	float_t y = tmp1.y * tmp2.x - tmp1.x * tmp2.y;
+
+	return vec2(x, y) / dot(tmp2, tmp2);
+}
+
+static pivot_cap pivot__cap_to_pcap(const pivot_cap &c, const vec3 &r_p)
+{
+	float_t pivot_mag = sqrt(dot(r_p, r_p));
+
+	if (pivot_mag < (float_t)0.001)
+		return pivot_cap((float_t)-1 * c.dir, c.z);
+	vec3 pivot_dir = r_p / pivot_mag;
+
+	// 2D cap dir in the basis (pivot_dir, pivot_ortho_dir)
+	float_t cos_phi = clamp(dot(c.dir, pivot_dir), (float_t)-1, (float_t)1);
+	float_t sin_phi = sqrt(1 - cos_phi * cos_phi);
+	vec3 pivot_ortho_dir = vec3(0);
+	if (fabs(cos_phi) < (float_t)0.9999)
+		pivot_ortho_dir = (c.dir - cos_phi * pivot_dir) / sin_phi;
+
+	// cap 2D end points and their transformation
+	float_t cap_sin = sqrt(max((float_t)0, 1 - c.z * c.z));
+	float_t a1 = cos_phi * c.z, a2 = sin_phi * cap_sin;
+	float_t a3 = sin_phi * c.z, a4 = cos_phi * cap_sin;
+	vec2 dir1_xf = pivot__r2_to_pr2(vec2(a1 + a2, a3 - a4), pivot_mag);
+	vec2 dir2_xf = pivot__r2_to_pr2(vec2(a1 - a2, a3 + a4), pivot_mag);
+
+	// 3D cap parameters
+	float_t area = dir1_xf.x * dir2_xf.y - dir1_xf.y * dir2_xf.x;
+	vec2 dir_xf = dir1_xf + dir2_xf;
+	dir_xf = ((area > 0 ? 1 : -1) / sqrt(dot(dir_xf, dir_xf))) * dir_xf;
+
+	return pivot_cap(dir_xf.x * pivot_dir + dir_xf.y * pivot_ortho_dir,
+	                 dot(dir_xf, dir1_xf));
+}
+
+//------------------------------------------------------------------------------
+// Solid angle of the intersection of two caps: exact, and the approximation
+// of Oat and Sander 2008 that pivot.glsl uses
+static float_t pivot__cap_solidangle(const pivot_cap &c1, const pivot_cap &c2)
+{
+	const float_t two_pi = 2 * m_pi();
+
+	// caps larger than a hemisphere in total: use their complements
+	if (c1.z + c2.z < 0) {
+		float_t s1 = two_pi * (1 - c1.z), s2 = two_pi * (1 - c2.z);
+		pivot_cap n1((float_t)-1 * c1.dir, -c1.z);
+		pivot_cap n2((float_t)-1 * c2.dir, -c2.z);
+
+		return max((float_t)0, s1 + s2 - 2 * two_pi
+		                     + pivot__cap_solidangle(n1, n2));
+	}
+
+	float_t r1 = acos(clamp(c1.z, (float_t)-1, (float_t)1));
+	float_t r2 = acos(clamp(c2.z, (float_t)-1, (float_t)1));
+	float_t cd = clamp(dot(c1.dir, c2.dir), (float_t)-1, (float_t)1);
+	float_t rd = acos(cd);
+
+	if (rd >= r1 + r2)
+		return 0;
+	if (rd <= fabs(r1 - r2))
+		return two_pi * (1 - max(c1.z, c2.z));
+
+	float_t s1 = sin(r1), s2 = sin(r2), sd = sin(rd);
+	float_t a = acos(clamp((cd - c1.z * c2.z) / (s1 * s2), (float_t)-1, (float_t)1));
+	float_t b1 = acos(clamp((c2.z - cd * c1.z) / (sd * s1), (float_t)-1, (float_t)1));
+	float_t b2 = acos(clamp((c1.z - cd * c2.z) / (sd * s2), (float_t)-1, (float_t)1));
+
+	return 2 * (m_pi() - a - b1 * c1.z - b2 * c2.z);
+}
+
+static float_t
+pivot__cap_solidangle_approx(const pivot_cap &c1, const pivot_cap &c2)
+{
+	const float_t two_pi = 2 * m_pi();
+	float_t r1 = acos(clamp(c1.z, (float_t)-1, (float_t)1));
+	float_t r2 = acos(clamp(c2.z, (float_t)-1, (float_t)1));
+	float_t rd = acos(clamp(dot(c1.dir, c2.dir), (float_t)-1, (float_t)1));
+
+	if (rd <= max(r1, r2) - min(r1, r2))
+		return two_pi - two_pi * max(c1.z, c2.z);
+	if (rd >= r1 + r2)
+		return 0;
+
+	float_t diff = fabs(r1 - r2);
+	float_t x = 1 - sat((rd - diff) / (r1 + r2 - diff));
+
+	return x * x * (3 - 2 * x) * (two_pi - two_pi * max(c1.z, c2.z));
+}
+
+//------------------------------------------------------------------------------
+// Unit-scale approximation of pivot.glsl: the solid angle of the transformed
+// cap clipped by the transformed upper hemisphere, over 4pi
+static float_t pivot__approx(const pivot_cap &c, const vec3 &r_p)
+{
+	pivot_cap c1 = pivot__cap_to_pcap(c, r_p);
+	pivot_cap c2 = pivot__cap_to_pcap(pivot_cap(vec3(0, 0, 1), 0), r_p);
+
+	return sat(pivot__cap_solidangle_approx(c1, c2) / (4 * m_pi()));
+}
+
+//------------------------------------------------------------------------------
+// Bin parameterization (roughness and theta as in the LTC table)
+float_t pivot::get_cap_cos(int cap, int res_cap)
+{
+	if (res_cap <= 1)
+		return 0;
+	float_t u = (float_t)cap / (res_cap - 1);
+
+	return 1 - max((float_t)1e-4, sqr(u));
+}
+
+//------------------------------------------------------------------------------
+// Reference integral: stratified samples of the cap and of the BRDF, combined
+// with the balance heuristic (i.e., drawn from their mixture). The control
+// variate is the distribution of the pivot clipped to the cap and the upper
+// hemisphere, whose integral is the exact solid angle of the intersection of
+// the transformed caps; its coefficient is estimated from the samples.
+float_t
+pivot::integrate(
+	const brdf &fr,
+	const vec3 &wi,
+	const vec3 &cap_dir,
+	float_t cap_cos,
+	const void *user_args,
+	int sample_cnt,
+	const vec3 &cv_pivot
+) {
+	const int channel_cnt = (int)fr.zero_value().size();
+	const double pdf_cap = 1 / (2 * m_pi() * (1 - cap_cos));
+	const double n = 2 * sqr((double)sample_cnt);
+	double sf = 0, sg = 0, sfg = 0, sgg = 0;
+	vec3 t1, t2;
+
+	// orthonormal basis around the cap direction (Frisvad)
+	if (cap_dir.z < (float_t)-0.9999999) {
+		t1 = vec3(0, -1, 0);
+		t2 = vec3(-1, 0, 0);
+	} else {
+		float_t a = 1 / (1 + cap_dir.z), b = -cap_dir.x * cap_dir.y * a;
+
+		t1 = vec3(1 - cap_dir.x * cap_dir.x * a, b, -cap_dir.x);
+		t2 = vec3(b, 1 - cap_dir.y * cap_dir.y * a, -cap_dir.y);
+	}
+
+	for (int j1 = 0; j1 < sample_cnt; ++j1)
+	for (int j2 = 0; j2 < sample_cnt; ++j2) {
+		vec2 u = vec2(j1 + (float_t)0.5, j2 + (float_t)0.5) / sample_cnt;
+		float_t z = (1 - cap_cos) * u.x + cap_cos;
+		float_t phi = 2 * m_pi() * u.y;
+		float_t r = sqrt(max((float_t)0, 1 - z * z));
+		vec3 wo[2];
+		float_t pdf_brdf;
+
+		wo[0] = r * cos(phi) * t1 + r * sin(phi) * t2 + z * cap_dir;
+		fr.sample(u, wi, &wo[1], &pdf_brdf, user_args);
+		for (int k = 0; k < 2; ++k) {
+			double f = 0, g = 0;
+
+			if ((k == 0 || pdf_brdf > 0) && wo[k].z > 0
+			&& dot(wo[k], cap_dir) >= cap_cos) {
+				double pdf = (pdf_cap + fr.pdf(wi, wo[k], user_args)) / 2;
+
+				f = fr.eval(wi, wo[k], user_args).sum() / channel_cnt / pdf;
+				g = pivot__jacobian(wo[k], cv_pivot) / (4 * m_pi()) / pdf;
+			}
+			sf+= f;
+			sg+= g;
+			sfg+= f * g;
+			sgg+= g * g;
+		}
+	}
+
+	// (skip the control variate when it is nearly constant over the samples)
+	double var = sgg / n - sqr(sg / n);
+	double beta = var > 1e-6 * sgg / n ? (sfg / n - sf * sg / sqr(n)) / var : 0;
+	pivot_cap c1 = pivot__cap_to_pcap(pivot_cap(cap_dir, cap_cos), cv_pivot);
+	pivot_cap c2 = pivot__cap_to_pcap(pivot_cap(vec3(0, 0, 1), 0), cv_pivot);
+	double g_int = pivot__cap_solidangle(c1, c2) / (4 * m_pi());
+	double est = sf / n - beta * (sg / n - g_int);
+
+	// an estimate below zero means that the coefficient is off
+	return (float_t)(est >= 0 ? est : sf / n);
+}
+
+//------------------------------------------------------------------------------
+// Ctor: fit the table. Rows of constant (roughness, theta) are fitted in
+// parallel; each row is fitted from the smallest to the largest caps (large
+// caps barely constrain the pivot), starting each bin from the solution of
+// the previous one, which also serves as control variate for the reference
+// integrals of the bin.
+pivot::pivot(
+	const brdf &fr,
+	int res_alpha,
+	int res_theta,
+	int res_cap,
+	int dir_cnt,
+	int sample_cnt
+):
+	m_params(3 * res_alpha * res_theta * res_cap),
+	m_error(res_alpha * res_theta * res_cap),
+	m_res_alpha(res_alpha),
+	m_res_theta(res_theta),
+	m_res_cap(res_cap)
+{
+	if (res_alpha < 1 || res_theta < 1 || res_cap < 1
+	|| dir_cnt < 1 || sample_cnt < 1)
+		throw exc("djb_error: Invalid pivot table resolution\n");
+
+	parallel_for(res_alpha * res_theta, [&](int row) {
+		const int a = row % res_alpha, t = row / res_alpha;
+		const int dir_res = max(1, (int)sqrt((double)dir_cnt));
+		float_t alpha = ltc::get_alpha(a, res_alpha);
+		float_t zi = ltc::get_cos_theta(t, res_theta);
+		microfacet::args args = microfacet::args::isotropic(alpha);
+		const void *user_args = res_alpha > 1 ? &args : nullptr;
+		vec3 wi = vec3(sqrt(1 - sqr(zi)), 0, zi);
+		std::vector<vec3> dirs, caps;
+		std::vector<float_t> ref, approx;
+		float_t p[2];
+
+		// cap directions drawn from the BRDF
+		for (int j1 = 0; j1 < dir_res; ++j1)
+		for (int j2 = 0; j2 < dir_res; ++j2) {
+			vec2 u = vec2(j1 + (float_t)0.5, j2 + (float_t)0.5) / dir_res;
+			vec3 wo;
+			float_t pdf;
+
+			fr.sample(u, wi, &wo, &pdf, user_args);
+			if (pdf > 0)
+				dirs.push_back(wo);
+		}
+		if (dirs.empty())
+			dirs.push_back(vec3(-wi.x, -wi.y, wi.z));
+		caps.resize(dirs.size());
+		ref.resize(dirs.size());
+		approx.resize(dirs.size());
+
+		// the pivot is parameterized by its angle to the normal and by
+		// log(1 - |pivot|), so that very sharp lobes remain reachable; it
+		// starts towards the mirror direction
+		p[0] = -acos(zi);
+		p[1] = log(max((float_t)1e-3, sqrt(alpha)));
+
+		for (int c = 0; c < res_cap; ++c) {
+			float_t zc = get_cap_cos(c, res_cap);
+			float_t p_prev[2] = {p[0], p[1]};
+			double ref_sqr = 0;
+			int idx = a + res_alpha * (t + res_theta * c);
+			auto to_pivot = [](const float_t *q) {
+				float_t r_mag = 1 - exp(q[1]);
+
+				return vec3(r_mag * sin(q[0]), 0, r_mag * cos(q[0]));
+			};
+
+			// caps overlapping the lobe: their centers lie within the
+			// aperture around the BRDF samples
+			for (int i = 0; i < (int)dirs.size(); ++i) {
+				float_t u1 = (i + (float_t)0.5) / dirs.size();
+				float_t u2 = i * (float_t)0.618034 - floor(i * (float_t)0.618034);
+				float_t z = (1 - zc) * u1 + zc, r = sqrt(max((float_t)0, 1 - z * z));
+				vec3 t1 = normalize(dot(dirs[i], wi) < (float_t)0.999
+				                    ? cross(dirs[i], wi) : vec3(0, 1, 0));
+				vec3 t2 = cross(dirs[i], t1);
+
+				caps[i] = normalize(r * cos(2 * m_pi() * u2) * t1
+				                  + r * sin(2 * m_pi() * u2) * t2 + z * dirs[i]);
+				ref[i] = integrate(fr, wi, caps[i], zc, user_args,
+				                   sample_cnt, to_pivot(p));
+				ref_sqr+= sqr((double)ref[i]);
+			}
+
+			// relative squared error, with the optimal scale (bounded, so that
+			// degenerate pivots cannot be compensated); a weak pull towards
+			// the previous bin picks a solution when the caps barely
+			// constrain the pivot
+			float_t scale = 0, error = 0;
+			auto f = [&](const float_t *q) {
+				vec3 r = to_pivot(q);
+				double sar = 0, saa = 0, e = 0;
+
+				if (q[1] > (float_t)0.69) // |pivot| > 1
+					return 2 + q[1];
+				if (fabs(q[0]) > m_pi() / 2) // pivot below the horizon
+					return 2 + (float_t)fabs(q[0]);
+				for (int i = 0; i < (int)dirs.size(); ++i) {
+					approx[i] = pivot__approx(pivot_cap(caps[i], zc), r);
+					sar+= approx[i] * (double)ref[i];
+					saa+= sqr((double)approx[i]);
+				}
+				scale = saa > 0 ? (float_t)min(2.0, max(0.0, sar / saa)) : 0;
+				for (int i = 0; i < (int)dirs.size(); ++i)
+					e+= sqr(scale * approx[i] - (double)ref[i]);
+				error = ref_sqr > 0 ? (float_t)(e / ref_sqr) : 0;
+
+				return error + (float_t)1e-4 * (sqr(q[0] - p_prev[0])
+				                              + sqr(q[1] - p_prev[1]));
+			};
+
+			nelder_mead<2>(p, (float_t)0.1, (float_t)1e-5, 200, f);
+			f(p); // scale and error of the solution
+
+			vec3 r_p = to_pivot(p);
+			m_params[3 * idx    ] = r_p.x;
+			m_params[3 * idx + 1] = r_p.z;
+			m_params[3 * idx + 2] = scale;
+			m_error[idx] = sqrt(error);
+		}
+#ifndef NVERBOSE
+		DJB_LOG("djb_verbose: pivot row %i/%i fitted\n",
+		        row + 1, res_alpha * res_theta);
+#endif
+	});
+}
+
+//------------------------------------------------------------------------------
+// Accessors
+vec3 pivot::get_params(int alpha, int theta, int cap) const
+{
+	int idx = alpha + m_res_alpha * (theta + m_res_theta * cap);
+
+	return vec3(m_params[3 * idx], m_params[3 * idx + 1],
+	            m_params[3 * idx + 2]);
+}
+
+float_t pivot::get_error(int alpha, int theta, int cap) const
+{
+	return m_error[alpha + m_res_alpha * (theta + m_res_theta * cap)];
+}
+
+//------------------------------------------------------------------------------
+// Lookup: trilinear filtering of the float16 parameters
+float_t
+pivot::eval(
+	const vec3 &wi,
+	const vec3 &cap_dir,
+	float_t cap_cos,
+	float_t alpha
+) const {
+	const int res[3] = {m_res_alpha, m_res_theta, m_res_cap};
+	float_t u[3] = {
+		sqrt(sat(alpha)),
+		sqrt(sat(1 - wi.z)),
+		sqrt(sat(1 - cap_cos))
+	};
+	int i0[3], i1[3];
+	float_t w[3];
+	vec3 params = vec3(0);
+
+	for (int k = 0; k < 3; ++k) {
+		float_t x = u[k] * (res[k] - 1);
+
+		i0[k] = min((int)x, max(0, res[k] - 2));
+		i1[k] = min(i0[k] + 1, res[k] - 1);
+		w[k] = x - i0[k];
+	}
+	for (int k = 0; k < 8; ++k) {
+		int a = k & 1 ? i1[0] : i0[0];
+		int t = k & 2 ? i1[1] : i0[1];
+		int c = k & 4 ? i1[2] : i0[2];
+		float_t wk = (k & 1 ? w[0] : 1 - w[0])
+		           * (k & 2 ? w[1] : 1 - w[1])
+		           * (k & 4 ? w[2] : 1 - w[2]);
+		vec3 q = get_params(a, t, c);
+
+		for (int j = 0; j < 3; ++j)
+			params[j]+= wk * half_to_float(float_to_half((float)q[j]));
+	}
+
+	float_t l = sqrt(sqr(wi.x) + sqr(wi.y));
+	vec2 dir = l > 0 ? vec2(wi.x, wi.y) / l : vec2(1, 0);
+	vec3 r_p = vec3(params.x * dir.x, params.x * dir.y, params.y);
+
+	return params.z * pivot__approx(pivot_cap(cap_dir, cap_cos), r_p);
+}
+
+//------------------------------------------------------------------------------
+// Export
+void pivot::save(const char *path) const
+{
+	std::fstream f(path, std::fstream::out | std::fstream::binary
+	                   | std::fstream::trunc);
+	int32_t res[3] = {m_res_alpha, m_res_theta, m_res_cap};
+	std::vector<uint16_t> data;
+
+	if (!f.is_open())
+		throw exc("djb_error: Failed to open %s\n", path);
+
+	data.reserve(m_params.size());
+	for (int i = 0; i < (int)m_params.size(); ++i)
+		data.push_back(float_to_half((float)m_params[i]));
+
+	f.write((char *)res, sizeof(res));
+	f.write((char *)&data[0], sizeof(data[0]) * data.size());
+	if (f.fail())
+		throw exc("djb_error: Writing %s failed\n", path);
+}
+
+// *****************************************************************************
+// Comparison API implementation
+
+//------------------------------------------------------------------------------
+// Channel c of a spectrum (single-channel spectra are broadcast)
+static float_t channel(const brdf::value_type &v, int c)
+{
+	return v[v.size() == 1 ? 0 : c];
+}
+
+static vec3 cosine_sample(const vec2 &u)
+{
+	vec2 d = brdf::u2_to_d2(u);
+
+	return vec3(d.x, d.y, sqrt(max((float_t)0, 1 - dot(d, d))));
+}
+
+//------------------------------------------------------------------------------
+// Compare two BRDFs. Each direction wi yields independent estimates of the
+// mean squared errors and of both albedos, which are then reduced in order.
+comparison
+compare(
+	const brdf &fr,
+	const brdf &ref,
+	int dir_cnt,
+	int sample_cnt,
+	const void *fr_args,
+	const void *ref_args
+) {
+	const int fr_size = fr.zero_value().size();
+	const int ref_size = ref.zero_value().size();
+	const int ch_cnt = max(fr_size, ref_size);
+	const int strategy_cnt = 3; // fr, ref, cosine
+	const int n = max(1, sample_cnt / strategy_cnt);
+	// per-direction results: squared error, log squared error, albedos
+	std::vector<double> slots(dir_cnt * ch_cnt * 4, 0.0);
+	comparison cmp;
+
+	if (fr_size != ref_size && min(fr_size, ref_size) != 1)
+		throw exc("djb_error: Cannot compare spectra of size %i and %i\n",
+		          fr_size, ref_size);
+	if (dir_cnt < 2)
+		throw exc("djb_error: At least two directions are required\n");
+
+	parallel_for(dir_cnt, [&](int i) {
+		vec3 wi = cosine_sample(sobol2(i, hash32(~0U), hash32(hash32(~0U))));
+		double *slot = &slots[i * ch_cnt * 4];
+
+		wi.z = max(wi.z, (float_t)1e-4);
+		wi = normalize(wi);
+		for (int s = 0; s < strategy_cnt; ++s)
+		for (int j = 0; j < n; ++j) {
+			uint32_t key = hash32(i * strategy_cnt + s);
+			vec2 u = sobol2(j, key, hash32(key));
+			vec3 wo;
+
+			if (s == 0)
+				fr.sample(u, wi, &wo, nullptr, fr_args);
+			else if (s == 1)
+				ref.sample(u, wi, &wo, nullptr, ref_args);
+			else
+				wo = cosine_sample(u);
+			if (wo.z <= 0)
+				continue;
+
+			double pdf = fr.pdf(wi, wo, fr_args)
+			           + ref.pdf(wi, wo, ref_args)
+			           + wo.z / m_pi();
+			double w = 1 / (n * pdf);
+			brdf::value_type fr_v = fr.eval(wi, wo, fr_args);
+			brdf::value_type ref_v = ref.eval(wi, wo, ref_args);
+
+			for (int c = 0; c < ch_cnt; ++c) {
+				// eval returns f_r * cos(wo)
+				double a = channel(fr_v, c), b = channel(ref_v, c);
+				double fa = max(0.0, a / wo.z), fb = max(0.0, b / wo.z);
+				double cw = w * wo.z / m_pi();
+
+				slot[c * 4    ]+= sqr(fa - fb) * cw;
+				slot[c * 4 + 1]+= sqr(log(1 + fa) - log(1 + fb)) * cw;
+				slot[c * 4 + 2]+= a * w;
+				slot[c * 4 + 3]+= b * w;
+			}
+		}
+	});
+
+	// mean and standard error of each metric over the directions wi
+	cmp.rmse.resize(ch_cnt);
+	cmp.rmse_stderr.resize(ch_cnt);
+	cmp.log_rmse.resize(ch_cnt);
+	cmp.log_rmse_stderr.resize(ch_cnt);
+	cmp.albedo_error.resize(ch_cnt);
+	cmp.albedo_error_stderr.resize(ch_cnt);
+	for (int c = 0; c < ch_cnt; ++c) {
+		double sum[3] = {0, 0, 0}, sqr_sum[3] = {0, 0, 0}, mean[3], se[3];
+		int cnt[3] = {dir_cnt, dir_cnt, 0};
+
+		for (int i = 0; i < dir_cnt; ++i) {
+			const double *slot = &slots[(i * ch_cnt + c) * 4];
+			double x[3] = {slot[0], slot[1], 0};
+
+			for (int k = 0; k < 2; ++k) {
+				sum[k]+= x[k];
+				sqr_sum[k]+= x[k] * x[k];
+			}
+			if (slot[3] > 1e-6) {
+				x[2] = fabs(slot[2] - slot[3]) / slot[3];
+				sum[2]+= x[2];
+				sqr_sum[2]+= x[2] * x[2];
+				++cnt[2];
+			}
+		}
+		for (int k = 0; k < 3; ++k) {
+			mean[k] = cnt[k] > 0 ? sum[k] / cnt[k] : 0;
+			se[k] = cnt[k] > 1
+			      ? sqrt(max(0.0, sqr_sum[k] / cnt[k] - sqr(mean[k])) / (cnt[k] - 1))
+			      : 0;
+		}
+
+		// RMSE errors follow from the MSE ones by the delta method
+		cmp.rmse[c] = sqrt(mean[0]);
+		cmp.rmse_stderr[c] = mean[0] > 0 ? se[0] / (2 * sqrt(mean[0])) : 0;
+		cmp.log_rmse[c] = sqrt(mean[1]);
+		cmp.log_rmse_stderr[c] = mean[1] > 0 ? se[1] / (2 * sqrt(mean[1])) : 0;
+		cmp.albedo_error[c] = mean[2];
+		cmp.albedo_error_stderr[c] = se[2];
+	}
+
+	return cmp;
+}
+
+// *****************************************************************************
+// Sampler API implementation
+
+//------------------------------------------------------------------------------
+// Owen scrambling of a 32-bit binary fraction (Burley's hash-based nested
+// uniform scrambling; the hash only lets bits flow toward the low bits of its
+// reversed input, so each digit is permuted based on the higher digits only)
+static uint32_t reverse_bits(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+	x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+	x = ((x >> 4) & 0x0F0F0F0FU) | ((x & 0x0F0F0F0FU) << 4);
+	x = ((x >> 8) & 0x00FF00FFU) | ((x & 0x00FF00FFU) << 8);
+
+	return (x >> 16) | (x << 16);
+}
+
+static uint32_t owen_scramble(uint32_t x, uint32_t seed)
+{
+	x = reverse_bits(x);
+	x^= x * 0x3d20adeaU;
+	x+= seed;
+	x*= (seed >> 16) | 1U;
+	x^= x * 0x05526c56U;
+	x^= x * 0x53a22864U;
+
+	return reverse_bits(x);
+}
+
+//------------------------------------------------------------------------------
+// Maps 32 random bits to [0, 1) (keeps 24 bits so that floats never round up)
+static float_t bits_to_unit(uint32_t x)
+{
+	return (float_t)((x >> 8) * 5.9604644775390625e-8);
+}
+
+sampler::sampler(int type, uint32_t seed):
+	m_type(type),
+	m_key_x(hash32(seed ^ 0x9e3779b9U)),
+	m_key_y(hash32(m_key_x))
+{
+	if (type != RANDOM && type != SOBOL && type != R2)
+		throw exc("djb_error: Invalid sampler type %i\n", type);
+}
+
+vec2 sampler::sample(uint32_t i) const
+{
+	switch (m_type) {
+	case SOBOL: {
+		uint32_t x = 0, y = 0;
+
+		for (uint32_t v1 = 1U << 31, v2 = 1U << 31; i; i>>= 1, v1>>= 1, v2^= v2 >> 1)
+			if (i & 1) {
+				x^= v1;
+				y^= v2;
+			}
+
+		return vec2(bits_to_unit(owen_scramble(x, m_key_x)),
+		            bits_to_unit(owen_scramble(y, m_key_y)));
+	}
+	case R2: {
+		// 1 / g and 1 / g^2 in 0.32 fixed point, with g the plastic number
+		// (g^3 = g + 1); the keys shift the sequence
+		uint32_t x = m_key_x + i * 3242174889U;
+		uint32_t y = m_key_y + i * 2447445414U;
+
+		return vec2(bits_to_unit(x), bits_to_unit(y));
+	}
+	default: {
+		uint32_t x = hash32(i ^ m_key_x);
+
+		return vec2(bits_to_unit(x), bits_to_unit(hash32(x ^ m_key_y)));
+	}
+	}
+}
+
+//------------------------------------------------------------------------------
+// T^2 = 1/9 - 2/n sum_i prod_k (1 - x_ik^2) / 2
+//     + 1/n^2 sum_i sum_j prod_k (1 - max(x_ik, x_jk))
+double l2_star_discrepancy(const std::vector<vec2> &u)
+{
+	int n = (int)u.size();
+	std::vector<double> rows(n);
+	double sum1 = 0, sum2 = 0;
+
+	if (n == 0)
+		return 0;
+	parallel_for(n, [&](int i) {
+		double s = 0;
+		for (int j = 0; j < n; ++j)
+			s+= (1.0 - max((double)u[i].x, (double)u[j].x))
+			  * (1.0 - max((double)u[i].y, (double)u[j].y));
+		rows[i] = s;
+	});
+	for (int i = 0; i < n; ++i) {
+		sum1+= (1.0 - sqr((double)u[i].x)) * (1.0 - sqr((double)u[i].y)) / 4;
+		sum2+= rows[i];
+	}
+
+	return sqrt(max(0.0, 1.0 / 9 - 2 * sum1 / n + sum2 / ((double)n * n)));
+}
+
 } // namespace djb
 
 #endif // DJ_BRDF_IMPLEMENTATION
@@ -6,10 +6,15 @@
 #include "GLFW/glfw3.h"
 #include "imgui.h"
 #include "imgui_impl.h"
+#include "headless.h"
+#include "recorder.h"
+#include "keyframes.h"
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <exception>
+#include <future>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -56,11 +61,13 @@ struct FramebufferManager {
     int w, h, aa, pass, samplesPerPass, samplesPerPixel;
     struct {bool progressive, reset;} flags;
     struct {int fixed;} msaa;
+    struct {int type;} sampler;
     struct {float r, g, b;} clearColor;
 } g_framebuffer = {
     VIEWER_DEFAULT_WIDTH, VIEWER_DEFAULT_HEIGHT, AA_MSAA8, 0, 1, 1,
     {true, true},
     {false},
+    {djb::sampler::SOBOL},
     {61./255., 119./255., 192./225}
 };
 
@@ -143,8 +150,22 @@ struct AppManager {
         float gamma, exposure;
     } viewer;
     struct {
-        int on, frame, capture;
+        int on, frame, capture, format;
     } recorder;
+    struct {
+        bool on;
+        int backend;
+    } headless;
+    struct {
+        Keyframes *keys;
+        int frame, frameCnt;
+        float fps;
+    } sweep;
+    struct {
+        bool on;
+        float timeout;      // max wait for events (s)
+        int frames;         // frames to draw before idling
+    } idle;
     int frame, frameLimit;
 } g_app = {
     /*dir*/    {PATH_TO_SRC_DIRECTORY "./shaders/", "./"},
@@ -153,7 +174,10 @@ struct AppManager {
                    true,
                    2.2f, 2.0f
                },
-    /*record*/ {false, 0, 0},
+    /*record*/ {false, 0, 0, RECORDER_FORMAT_PNG},
+    /*headless*/{false, HEADLESS_BACKEND_EGL},
+    /*sweep*/  {NULL, -1, 0, 60.0f},
+    /*idle*/   {true, 0.5f, 0},
     /*frame*/  0, -1
 };
 
@@ -161,7 +185,7 @@ struct AppManager {
 // OpenGL Manager
 enum { CLOCK_SPF, CLOCK_COUNT };
 enum { FRAMEBUFFER_BACK, FRAMEBUFFER_SCENE, FRAMEBUFFER_COUNT };
-enum { STREAM_SPHERES, STREAM_TRANSFORM, STREAM_RANDOM, STREAM_COUNT };
+enum { STREAM_SPHERES, STREAM_TRANSFORM, STREAM_COUNT };
 enum {
     VERTEXARRAY_EMPTY,
     VERTEXARRAY_SPHERE,
@@ -204,6 +228,7 @@ enum {
     UNIFORM_SPHERE_EXPOSURE,
     UNIFORM_SPHERE_GAMMA,
     UNIFORM_SPHERE_SAMPLES_PER_PASS,
+    UNIFORM_SPHERE_PASS,
     UNIFORM_SPHERE_MERL_SAMPLER,
     UNIFORM_SPHERE_ALPHA,
     UNIFORM_SPHERE_COLOR,
@@ -581,11 +606,12 @@ bool loadSphereProgram()
     };
     if (g_sphere.brdf.id == BRDF_MERL)
         djgp_push_string(djp, "#define BRDF_MERL 1\n");
-    djgp_push_string(djp, "#define BUFFER_BINDING_RANDOM %i\n", STREAM_RANDOM);
+    djgp_push_string(djp, "#define SAMPLER_TYPE %i\n", g_framebuffer.sampler.type);
     djgp_push_string(djp, "#define BUFFER_BINDING_TRANSFORMS %i\n", STREAM_TRANSFORM);
     djgp_push_string(djp, "#define BUFFER_BINDING_SPHERES %i\n", STREAM_SPHERES);
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "ggx.glsl"));
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "brdf_merl.glsl"));
+    djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "sampler.glsl"));
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "sphere.glsl"));
 
     if (!djgp_to_gl(djp, 450, false, true, program)) {
@@ -598,6 +624,8 @@ bool loadSphereProgram()
 
     g_gl.uniforms[UNIFORM_SPHERE_SAMPLES_PER_PASS] =
         glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_SamplesPerPass");
+    g_gl.uniforms[UNIFORM_SPHERE_PASS] =
+        glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_Pass");
     g_gl.uniforms[UNIFORM_SPHERE_MERL_SAMPLER] =
         glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_MerlSampler");
     g_gl.uniforms[UNIFORM_SPHERE_ALPHA] =
@@ -645,7 +673,6 @@ bool loadParametricProgram()
         djgp_push_string(djp, "#define SCHEME_GGX 1\n");
     }
 
-    djgp_push_string(djp, "#define BUFFER_BINDING_RANDOM %i\n", STREAM_RANDOM);
     djgp_push_string(djp, "#define BUFFER_BINDING_TRANSFORMS %i\n", STREAM_TRANSFORM);
     djgp_push_string(djp, "#define BUFFER_BINDING_SPHERE %i\n", STREAM_SPHERES);
     djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "ggx.glsl"));
@@ -948,49 +975,75 @@ bool loadBackFramebufferTexture()
     return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the MERL Assets
+ *
+ * This is the CPU side of the MERL texture: it reads the MERL file, fits
+ * the GGX roughness of the plots with a tab_r BRDF, and converts the samples
+ * to floats. It makes no GL calls, so that init() runs it on a worker thread
+ * while the programs compile. Errors are thrown.
+ */
+struct MerlAssets {
+    float ggxAlpha;
+    std::vector<float> texels;  // R32F
+};
+
+static MerlAssets loadMerlAssets()
+{
+    MerlAssets assets;
+
+    LOG("Loading {MERL-BRDF}\n");
+    djb::merl merl(g_sphere.shading.merl.files[g_sphere.shading.merl.id]);
+    djb::tab_r tab(merl, 90);
+    djb::microfacet::args args = djb::tab_r::extract_ggx_args(tab);
+    assets.ggxAlpha = args.minv[0][0];
+
+    const std::vector<double>& samples = merl.get_samples();
+    assets.texels.assign(samples.begin(), samples.end());
+
+    return assets;
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load the MERL Texture
  *
+ * This uploads the samples of the MERL assets to an R32F texture buffer.
  */
-static bool loadMerlTexture(void)
+static bool loadMerlTexture(const MerlAssets &assets)
 {
-    if (!g_sphere.shading.merl.files.empty()) {
-        try {
-        LOG("Loading {MERL-BRDF}\n");
+    g_sphere.brdf.ggxAlpha = assets.ggxAlpha;
 
-        djb::merl merl(g_sphere.shading.merl.files[g_sphere.shading.merl.id]);
-        djb::tab_r tab(merl, 90);
-        djb::microfacet::args args = djb::tab_r::extract_ggx_args(djb::tab_r(merl, 90));
-        g_sphere.brdf.ggxAlpha = args.minv[0][0];
+    if (glIsTexture(g_gl.textures[TEXTURE_MERL])) {
+        glDeleteBuffers(1, &g_gl.buffers[BUFFER_MERL]);
+        glDeleteTextures(1, &g_gl.textures[TEXTURE_MERL]);
+    }
+    glGenBuffers(1, &g_gl.buffers[BUFFER_MERL]);
+    glGenTextures(1, &g_gl.textures[TEXTURE_MERL]);
+
+    LOG("Loading {MERL-Texture}\n");
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_MERL);
+    glBindTexture(GL_TEXTURE_BUFFER, g_gl.textures[TEXTURE_MERL]);
+    glBindBuffer(GL_TEXTURE_BUFFER, g_gl.buffers[BUFFER_MERL]);
+    glBufferData(GL_TEXTURE_BUFFER,
+                 sizeof(assets.texels[0]) * assets.texels.size(),
+                 &assets.texels[0],
+                 GL_STATIC_DRAW);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, g_gl.buffers[BUFFER_MERL]);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
-        if (glIsTexture(g_gl.textures[TEXTURE_MERL])) {
-            glDeleteBuffers(1, &g_gl.buffers[BUFFER_MERL]);
-            glDeleteTextures(1, &g_gl.textures[TEXTURE_MERL]);
-        }
-        glGenBuffers(1, &g_gl.buffers[BUFFER_MERL]);
-        glGenTextures(1, &g_gl.textures[TEXTURE_MERL]);
-
-        LOG("Loading {MERL-Texture}\n");
-        glActiveTexture(GL_TEXTURE0 + TEXTURE_MERL);
-        glBindTexture(GL_TEXTURE_BUFFER, g_gl.textures[TEXTURE_MERL]);
-        glBindBuffer(GL_TEXTURE_BUFFER, g_gl.buffers[BUFFER_MERL]);
-        std::vector<float> texels;
-        const std::vector<double>& samples = merl.get_samples();
-        texels.reserve(samples.size());
-        texels.resize(0);
-        for (int i = 0; i < (int) samples.size(); ++i)
-            texels.push_back(samples[i]);
-        glBufferData(GL_TEXTURE_BUFFER,
-                     sizeof(texels[0]) * texels.size(),
-                     &texels[0],
-                     GL_STATIC_DRAW);
-        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, g_gl.buffers[BUFFER_MERL]);
-        glBindBuffer(GL_TEXTURE_BUFFER, 0);
-
-        // clean up
-        glActiveTexture(GL_TEXTURE0);
+    // clean up
+    glActiveTexture(GL_TEXTURE0);
+
+    return (glGetError() == GL_NO_ERROR);
+}
 
+static bool loadMerlTexture(void)
+{
+    if (!g_sphere.shading.merl.files.empty()) {
+        try {
+            return loadMerlTexture(loadMerlAssets());
         } catch (std::exception& e) {
             LOG("%s\n", e.what());
             return false;
@@ -1050,7 +1103,6 @@ bool loadTextures()
 
     if (v) v&= loadSceneFramebufferTexture();
     if (v) v&= loadBackFramebufferTexture();
-    if (v) v&= loadMerlTexture();
     if (v) v&= loadColormapTexture();
 
     return v;
@@ -1107,48 +1159,6 @@ bool loadSphereDataBuffers(float dt = 0)
     return (glGetError() == GL_NO_ERROR);
 }
 
-// -----------------------------------------------------------------------------
-/**
- * Load Random Buffer
- *
- * This buffer holds the random samples used by the GLSL Monte Carlo integrator.
- * It should be updated at each frame. The random samples are generated using
- * the Marsaglia pseudo-random generator.
- */
-uint32_t mrand() // Marsaglia random generator
-{
-    static uint32_t m_z = 1, m_w = 2;
-
-    m_z = 36969u * (m_z & 65535u) + (m_z >> 16u);
-    m_w = 18000u * (m_w & 65535u) + (m_w >> 16u);
-
-    return ((m_z << 16u) + m_w);
-}
-
-bool loadRandomBuffer()
-{
-    static bool first = true;
-    float buffer[256];
-    int offset = 0;
-
-    if (first) {
-        g_gl.streams[STREAM_RANDOM] = djgb_create(sizeof(buffer));
-        first = false;
-    }
-
-    for (int i = 0; i < BUFFER_SIZE(buffer); ++i) {
-        buffer[i] = (float)((double)mrand() / (double)0xFFFFFFFFu);
-        assert(buffer[i] <= 1.f && buffer[i] >= 0.f);
-    }
-
-    djgb_to_gl(g_gl.streams[STREAM_RANDOM], (const void *)buffer, &offset);
-    djgb_glbindrange(g_gl.streams[STREAM_RANDOM],
-                     GL_UNIFORM_BUFFER,
-                     STREAM_RANDOM);
-
-    return (glGetError() == GL_NO_ERROR);
-}
-
 // -----------------------------------------------------------------------------
 /**
  * Load Sphere Mesh Buffer
@@ -1238,7 +1248,6 @@ bool loadBuffers()
     bool v = true;
 
     if (v) v&= loadSphereDataBuffers();
-    if (v) v&= loadRandomBuffer();
     if (v) v&= loadSphereMeshBuffers();
     if (v) v&= loadCircleVertexBuffer();
 
@@ -1449,11 +1458,50 @@ bool loadFramebuffers()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Startup Timings
+ *
+ * The clock starts with main(); init() logs the duration of each of its
+ * phases, and render() the time to the first frame.
+ */
+static double startupClock()
+{
+    static const std::chrono::steady_clock::time_point epoch =
+        std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> dt =
+        std::chrono::steady_clock::now() - epoch;
+
+    return dt.count();
+}
+
+static double logStartupPhase(const char *name, double t0)
+{
+    double t1 = startupClock();
+
+    LOG("Note: {%s} loaded in %.1f ms\n", name, t1 - t0);
+
+    return t1;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Initialize the Demo
+ *
+ * The MERL BRDF is read and fitted on a worker thread (see loadMerlAssets)
+ * while the main thread creates the GL objects and compiles the programs;
+ * its texture is uploaded last, which is where the main thread waits.
+ */
 void init()
 {
+    std::future<MerlAssets> merl;
+    double t = startupClock();
     bool v = true;
     int i;
 
+    if (!g_sphere.shading.merl.files.empty())
+        merl = std::async(std::launch::async, &loadMerlAssets);
+
     for (i = 0; i < CLOCK_COUNT; ++i) {
         if (g_gl.clocks[i])
             djgc_release(g_gl.clocks[i]);
@@ -1461,10 +1509,31 @@ void init()
     }
 
     if (v) v&= loadTextures();
+    t = logStartupPhase("Textures", t);
     if (v) v&= loadBuffers();
+    t = logStartupPhase("Buffers", t);
     if (v) v&= loadFramebuffers();
+    t = logStartupPhase("Framebuffers", t);
     if (v) v&= loadVertexArrays();
+    t = logStartupPhase("VertexArrays", t);
     if (v) v&= loadPrograms();
+    t = logStartupPhase("Programs", t);
+
+    // the worker is joined even if a step failed
+    if (merl.valid()) {
+        try {
+            MerlAssets assets = merl.get();
+
+            if (v) v&= loadMerlTexture(assets);
+        } catch (std::exception& e) {
+            LOG("%s\n", e.what());
+            v = false;
+        } catch (...) {
+            v = false;
+        }
+        t = logStartupPhase("MERL", t);
+    }
+    if (v) configurePrograms(); // the GGX roughness comes with the MERL
 
     if (!v) throw std::exception();
 }
@@ -1473,6 +1542,11 @@ void release()
 {
     int i;
 
+    recorderShutdown();
+    if (g_app.sweep.keys) {
+        keyframesRelease(g_app.sweep.keys);
+        g_app.sweep.keys = NULL;
+    }
     for (i = 0; i < CLOCK_COUNT; ++i)
         if (g_gl.clocks[i])
             djgc_release(g_gl.clocks[i]);
@@ -1501,6 +1575,17 @@ void release()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Check whether the Scene has Reached its Sampling Rate
+ *
+ */
+bool isSceneComplete()
+{
+    return g_framebuffer.pass * g_framebuffer.samplesPerPass
+        >= g_framebuffer.samplesPerPixel;
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Render the Scene
@@ -1529,7 +1614,6 @@ void renderSceneProgressive()
         glDepthFunc(GL_LEQUAL);
         glEnable(GL_BLEND);
         glBlendFunc(GL_ONE, GL_ONE);
-        loadRandomBuffer();
     } else {
         glDepthFunc(GL_LESS);
         glDisable(GL_BLEND);
@@ -1538,6 +1622,9 @@ void renderSceneProgressive()
     // stop progressive drawing once the desired sampling rate has been reached
     if (g_framebuffer.pass * g_framebuffer.samplesPerPass
         < g_framebuffer.samplesPerPixel) {
+        glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+                           g_gl.uniforms[UNIFORM_SPHERE_PASS],
+                           g_framebuffer.pass);
 
         // draw background
         glUseProgram(g_gl.programs[PROGRAM_BACKGROUND]);
@@ -1652,7 +1739,6 @@ void renderScene()
 
         if (!passCnt) passCnt = 1;
         for (int i = 0; i < passCnt; ++i) {
-            loadRandomBuffer();
             renderSceneProgressive();
         }
     }
@@ -1709,6 +1795,10 @@ void renderViewer(double cpuDt, double gpuDt)
                 imguiSetAa();
             if (ImGui::Combo("MSAA", &g_framebuffer.msaa.fixed, "Fixed\0Random\0\0"))
                 imguiSetAa();
+            if (ImGui::Combo("Sampler", &g_framebuffer.sampler.type, "Random\0Sobol\0R2\0\0")) {
+                loadSphereProgram();
+                g_framebuffer.flags.reset = true;
+            }
             ImGui::Checkbox("Progressive", &g_framebuffer.flags.progressive);
             if (g_framebuffer.flags.progressive) {
                 ImGui::SameLine();
@@ -1736,8 +1826,14 @@ void renderViewer(double cpuDt, double gpuDt)
                 djgt_save_glcolorbuffer_png(GL_FRONT, GL_RGBA, buf);
                 ++cnt;
             }
-            if (ImGui::Button("Record"))
+            if (ImGui::Button("Record")) {
                 g_app.recorder.on = !g_app.recorder.on;
+                if (!g_app.recorder.on) {
+                    recorderShutdown();
+                    g_app.recorder.frame = 0;
+                    ++g_app.recorder.capture;
+                }
+            }
             if (g_app.recorder.on) {
                 ImGui::SameLine();
                 ImGui::Text("Recording...");
@@ -1860,14 +1956,18 @@ void renderViewer(double cpuDt, double gpuDt)
 
     // screen recording
     if (g_app.recorder.on) {
-        char name[64], path[1024];
-
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_BACK]);
-        sprintf(name, "capture_%02i_%09i",
-                g_app.recorder.capture,
-                g_app.recorder.frame);
-        strcat2(path, g_app.dir.output, name);
-        djgt_save_glcolorbuffer_bmp(GL_COLOR_ATTACHMENT0, GL_RGB, path);
+        if (!recorderIsRunning()) {
+            char name[64], path[1024];
+
+            sprintf(name, "capture_%02i_", g_app.recorder.capture);
+            strcat2(path, g_app.dir.output, name);
+            if (g_app.recorder.format == RECORDER_FORMAT_Y4M)
+                strcpy(path, "-");
+            if (!recorderInit(g_app.recorder.format,
+                              g_app.viewer.w, g_app.viewer.h, 60, path))
+                g_app.recorder.on = false;
+        }
+        recorderCapture(g_gl.framebuffers[FRAMEBUFFER_BACK]);
         ++g_app.recorder.frame;
     }
 
@@ -1909,9 +2009,127 @@ void render()
     djgc_stop(g_gl.clocks[CLOCK_SPF]);
     djgc_ticks(g_gl.clocks[CLOCK_SPF], &cpuDt, &gpuDt);
     renderViewer(cpuDt, gpuDt);
-    renderBack();
+    if (!g_app.headless.on) // there is no window to blit to
+        renderBack();
+    if (g_app.frame == 0) {
+        LOG("Note: time to first frame %.1f ms\n", startupClock());
+    }
     ++g_app.frame;
 }
+
+// -----------------------------------------------------------------------------
+/**
+ * Idle Scheduling
+ *
+ * Once the scene is complete, the main loop stops drawing and waits for
+ * events, and the window keeps showing the last frame. Input events wake
+ * the viewer for a few frames so that the HUD can respond to them.
+ */
+#define IDLE_WAKE_FRAMES 3
+void wakeViewer()
+{
+    g_app.idle.frames = IDLE_WAKE_FRAMES;
+}
+
+bool isViewerIdle()
+{
+    return g_app.idle.on && g_app.idle.frames == 0
+        && !g_framebuffer.flags.reset && isSceneComplete()
+        && !g_app.recorder.on && !g_app.sweep.keys;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Save the Composited Framebuffer to Disk
+ *
+ */
+void saveBackFramebuffer(const char *name)
+{
+    char path[1024];
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_BACK]);
+    strcat2(path, g_app.dir.output, name);
+    LOG("Note: saving %s.png\n", path);
+    djgt_save_glcolorbuffer_png(GL_COLOR_ATTACHMENT0, GL_RGBA, path);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Set the Parameters of the Sweep at Time t
+ *
+ * Tracks: merl (index), dir (thetaI phiI, in degrees), alpha (GGX) and
+ * camera (position, looking at the origin).
+ */
+void setSweepParameters(double t)
+{
+    const Keyframes *keys = g_app.sweep.keys;
+    float v[3];
+
+    if (keyframesStep(keys, "merl", t, v, 1)) {
+        int id = (int)v[0];
+        int cnt = (int)g_sphere.shading.merl.files.size();
+
+        if (id != g_sphere.shading.merl.id && id >= 0 && id < cnt) {
+            g_sphere.shading.merl.id = id;
+            loadMerlTexture();
+            loadSphereProgram();
+            loadParametricProgram();
+        }
+    }
+    if (keyframesEval(keys, "dir", t, v, 2)) {
+        g_sphere.brdf.thetaI = v[0];
+        g_sphere.brdf.phiI = v[1];
+    }
+    if (keyframesEval(keys, "alpha", t, v, 1))
+        g_sphere.brdf.ggxAlpha = v[0];
+    if (keyframesEval(keys, "camera", t, v, 3)) {
+        g_camera.pos = dja::vec3(v[0], v[1], v[2]);
+        g_camera.axis = dja::mat3::lookat(dja::vec3(0), g_camera.pos,
+                                          dja::vec3(0, 0, 1));
+    }
+    configurePrograms();
+    g_framebuffer.flags.reset = true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Advance the Keyframed Sweep
+ *
+ * Called before each render: records the current sweep frame once it is
+ * complete and sets up the next one. Returns false once the whole sweep has
+ * been recorded (always true when no sweep is loaded).
+ */
+bool updateSweep()
+{
+    if (!g_app.sweep.keys)
+        return true;
+
+    if (g_app.sweep.frame < 0) {
+        char path[1024];
+
+        if (g_app.recorder.format == RECORDER_FORMAT_Y4M)
+            strcpy(path, "-");
+        else
+            strcat2(path, g_app.dir.output, "sweep_");
+        if (!recorderInit(g_app.recorder.format,
+                          g_app.viewer.w, g_app.viewer.h,
+                          (int)g_app.sweep.fps, path))
+            return false;
+    } else if (!isSceneComplete()) {
+        return true;
+    } else {
+        recorderCapture(g_gl.framebuffers[FRAMEBUFFER_BACK]);
+    }
+
+    if (++g_app.sweep.frame == g_app.sweep.frameCnt) {
+        recorderShutdown();
+        return false;
+    }
+    setSweepParameters(g_app.sweep.frame / g_app.sweep.fps);
+
+    return true;
+}
 ////////////////////////////////////////////////////////////////////////////////
 
 // -----------------------------------------------------------------------------
@@ -1921,6 +2139,7 @@ keyboardCallback(
     int key, int scancode, int action, int modsls
 ) {
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureKeyboard)
         return;
 
@@ -1942,6 +2161,7 @@ keyboardCallback(
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 }
@@ -1953,6 +2173,7 @@ void mouseMotionCallback(GLFWwindow* window, double x, double y)
            dy = y - y0;
 
     ImGuiIO& io = ImGui::GetIO();
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 
@@ -1981,6 +2202,7 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
     ImGuiIO& io = ImGui::GetIO();
     ImGui_ImplGlfw_ScrollCallback(window, xoffset, yoffset);
+    wakeViewer();
     if (io.WantCaptureMouse)
         return;
 
@@ -1989,6 +2211,17 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
     g_framebuffer.flags.reset = true;
 }
 
+// the window content was damaged, or its focus changed: redraw
+void windowRefreshCallback(GLFWwindow* window)
+{
+    wakeViewer();
+}
+
+void windowFocusCallback(GLFWwindow* window, int focused)
+{
+    wakeViewer();
+}
+
 void usage(const char *app)
 {
     printf("%s -- OpenGL Merl Renderer\n", app);
@@ -2005,6 +2238,10 @@ void usage(const char *app)
            "  --record\n"
            "     Enables recorder\n"
            "     (disabled by default)\n\n"
+           "  --record-format png|y4m\n"
+           "     Records PNG frames to the output directory, or a y4m\n"
+           "     stream to stdout (log messages then go to stderr)\n"
+           "     (png by default)\n\n"
            "  --hidden\n"
            "     Starts the application minimized\n"
            "     (disabled by default)\n\n"
@@ -2014,14 +2251,91 @@ void usage(const char *app)
            "  --cmap\n"
            "     Specifies a colormap\n"
            "     (null by default)\n\n"
+           "  --sweep keyframes.txt\n"
+           "     Renders and records every frame of a keyframed sweep\n"
+           "     (tracks: merl, dir, alpha, camera), then exits\n"
+           "     (disabled by default)\n\n"
+           "  --sweep-fps n\n"
+           "     Frame rate of the sweep\n"
+           "     (60 by default)\n\n"
+           "  --headless egl|osmesa\n"
+           "     Renders without a window and saves the result to\n"
+           "     the output directory (runs until --frame-limit if given)\n"
+           "     (disabled by default)\n\n"
+           "  --no-idle\n"
+           "     Keeps redrawing once the image is complete\n"
+           "     (idles by default)\n\n"
            );
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Render without a Window
+ *
+ * Runs the same init()/render() code in an offscreen context until the
+ * image is complete (or the frame limit is reached), and saves the
+ * composited framebuffer to the output directory.
+ */
+int mainHeadless()
+{
+    g_app.viewer.hud = false;
+    if (!headlessInit(g_app.headless.backend,
+                      VIEWER_DEFAULT_WIDTH, VIEWER_DEFAULT_HEIGHT)) {
+        LOG("=> Failure <=\n");
+        return -1;
+    }
+
+    // Load OpenGL functions
+    LOG("Loading {OpenGL}\n");
+    if (!gladLoadGLLoader((GLADloadproc)headlessGetProcAddress)) {
+        LOG("gladLoadGLLoader failed\n");
+        headlessShutdown();
+        return -1;
+    }
+    log_debug_output();
+
+    LOG("-- Begin -- Demo (headless)\n");
+    try {
+        init();
+
+        if (g_app.sweep.keys) {
+            while (updateSweep())
+                render();
+        } else {
+            do {
+                render();
+            } while (g_app.frameLimit < 0
+                ? !isSceneComplete()
+                : g_app.frame < g_app.frameLimit);
+            saveBackFramebuffer("headless");
+        }
+
+        release();
+        headlessShutdown();
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        headlessShutdown();
+        LOG("(!) Demo Killed (!)\n");
+
+        return EXIT_FAILURE;
+    }
+    LOG("-- End -- Demo\n");
+
+    return 0;
+}
+
 // -----------------------------------------------------------------------------
 int main(int argc, const char **argv)
 {
     GLenum startVisible = GL_TRUE;
 
+    startupClock(); // starts the clock
+
+    // keep stdout for the video stream when recording y4m
+    for (int i = 1; i + 1 < argc; ++i)
+        if (!strcmp("--record-format", argv[i]) && !strcmp("y4m", argv[i + 1]))
+            recorderReserveStdout();
+
     #define PARSE_SHADING_MODE(str, enumval)               \
     else if (!strcmp("--shading-" str, argv[i])) {      \
             g_sphere.shading.mode = enumval;              \
@@ -2057,6 +2371,13 @@ int main(int argc, const char **argv)
         } else if (!strcmp("--record", argv[i])) {
             g_app.recorder.on = true;
             LOG("Note: recording enabled\n");
+        } else if (!strcmp("--record-format", argv[i]) && i + 1 < argc) {
+            g_app.recorder.format = recorderParseFormat(argv[++i]);
+            if (g_app.recorder.format < 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            LOG("Note: recording format set to %s\n", argv[i]);
         } else if (!strcmp("--no-hud", argv[i])) {
             g_app.viewer.hud = false;
             LOG("Note: HUD rendering disabled\n");
@@ -2079,6 +2400,26 @@ int main(int argc, const char **argv)
         }  else if (!strcmp("--sc", argv[i])) {
             g_sphere.brdf.ggxAlpha = atof(argv[++i]);
             LOG("Note: GGX alpha set to: %f\n", g_sphere.brdf.ggxAlpha);
+        } else if (!strcmp("--sweep", argv[i]) && i + 1 < argc) {
+            g_app.sweep.keys = keyframesLoad(argv[++i]);
+            if (!g_app.sweep.keys)
+                return EXIT_FAILURE;
+            g_app.viewer.hud = false;
+            LOG("Note: sweep set to %s\n", argv[i]);
+        } else if (!strcmp("--sweep-fps", argv[i]) && i + 1 < argc) {
+            g_app.sweep.fps = atof(argv[++i]);
+            LOG("Note: sweep fps set to %f\n", g_app.sweep.fps);
+        } else if (!strcmp("--no-idle", argv[i])) {
+            g_app.idle.on = false;
+            LOG("Note: idle mode disabled\n");
+        } else if (!strcmp("--headless", argv[i]) && i + 1 < argc) {
+            g_app.headless.backend = headlessParseBackend(argv[++i]);
+            g_app.headless.on = true;
+            if (g_app.headless.backend < 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            LOG("Note: headless rendering with %s\n", argv[i]);
         } else if (!strcmp("--color", argv[i])) {
             g_sphere.sphere.color.r = atof(argv[++i]);
             g_sphere.sphere.color.g = atof(argv[++i]);
@@ -2102,6 +2443,16 @@ int main(int argc, const char **argv)
         PARSE_SAMPLING_SCHEME("merl", SCHEME_MERL)
     }
 
+    if (g_app.sweep.keys) {
+        // (the epsilon absorbs the rounding of the key times)
+        g_app.sweep.frameCnt =
+            (int)(keyframesDuration(g_app.sweep.keys) * g_app.sweep.fps + 1e-3) + 1;
+        LOG("Note: sweep has %i frames\n", g_app.sweep.frameCnt);
+    }
+
+    if (g_app.headless.on)
+        return mainHeadless();
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -2126,6 +2477,8 @@ int main(int argc, const char **argv)
     glfwSetCursorPosCallback(window, &mouseMotionCallback);
     glfwSetMouseButtonCallback(window, &mouseButtonCallback);
     glfwSetScrollCallback(window, &mouseScrollCallback);
+    glfwSetWindowRefreshCallback(window, &windowRefreshCallback);
+    glfwSetWindowFocusCallback(window, &windowFocusCallback);
 
     // Load OpenGL functions
     LOG("Loading {OpenGL}\n");
@@ -2143,8 +2496,18 @@ int main(int argc, const char **argv)
         ImGui::StyleColorsDark();
         init();
 
-        while (!glfwWindowShouldClose(window) && (uint32_t)g_app.frame < (uint32_t)g_app.frameLimit) {
-            glfwPollEvents();
+        while (!glfwWindowShouldClose(window) && (uint32_t)g_app.frame < (uint32_t)g_app.frameLimit
+               && updateSweep()) {
+            // wait for events instead of redrawing the same frame
+            if (isViewerIdle()) {
+                glfwWaitEventsTimeout(g_app.idle.timeout);
+                if (isViewerIdle())
+                    continue;
+            } else {
+                glfwPollEvents();
+            }
+            if (g_app.idle.frames > 0)
+                --g_app.idle.frames;
 
             render();
             ++g_app.frame;
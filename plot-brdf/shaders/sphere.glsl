@@ -5,6 +5,7 @@
  *
  */
 uniform int u_SamplesPerPass;
+uniform int u_Pass;
 
 
 struct Transform {
@@ -19,17 +20,18 @@ uniform Transforms {
 	Transform u_Transform;
 };
 
-layout(std140, binding = BUFFER_BINDING_RANDOM)
-uniform Random {
-	vec4 value[64];
-} u_Random;
-
-vec4 rand(int idx) { return u_Random.value[idx]; }
-float hash(vec2 p)
+#ifdef FRAGMENT_SHADER
+// sample j of the current pass, drawn from a stream seeded by the pixel
+vec2 rand(int j)
 {
-	float h = dot(p, vec2(127.1, 311.7));
-	return fract(sin(h) * 43758.5453123);
+	uvec2 p = uvec2(gl_FragCoord.xy);
+	uint seed = sampler_hash(p.x ^ sampler_hash(p.y));
+	uint i = uint(u_Pass * u_SamplesPerPass + j);
+
+	return vec2(sampler_unit(sampler_bits(SAMPLER_TYPE, seed, i, 0)),
+	            sampler_unit(sampler_bits(SAMPLER_TYPE, seed, i, 1)));
 }
+#endif
 
 uniform float u_Exposure;
 uniform float u_Gamma;
@@ -158,8 +160,7 @@ void main(void)
  */
 #elif SHADE_DEBUG
 #if 0
-	float h = hash(gl_FragCoord.xy);
-	float u = mod(h + rand(0).x, 1.0);
+	float u = rand(0).x;
 	if (u > 0.5)
 		o_FragColor = vec4(vec3(1, 0, 1), 0.5);
 	else
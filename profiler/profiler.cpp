@@ -0,0 +1,292 @@
+#include "profiler.h"
+
+#include "glad/glad.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+#define PROFILER_FRAME_CNT 4    // frames in flight
+#define PROFILER_SCOPE_CNT 64   // scopes per frame
+
+struct ProfilerScope {
+    const char *name;
+    int depth;
+    double cpuBegin, cpuEnd;    // us, since profilerInit
+};
+
+// the scopes of a frame, and their timestamp queries (begin, end)
+struct ProfilerFrame {
+    ProfilerScope scopes[PROFILER_SCOPE_CNT];
+    GLuint queries[2 * PROFILER_SCOPE_CNT];
+    int scopeCnt;
+    bool pending;               // ended, waiting for its queries
+    double cpuRef;              // CPU time of gpuRef (us)
+    GLint64 gpuRef;             // GPU time at the beginning of the frame (ns)
+};
+
+static struct {
+    bool running, inFrame;
+    std::chrono::steady_clock::time_point epoch;
+    ProfilerFrame frames[PROFILER_FRAME_CNT];
+    int frameCnt;               // frames ended
+    int resolvedCnt;            // frames resolved (or dropped)
+    int stack[PROFILER_SCOPE_CNT];
+    int stackSize;
+    std::vector<ProfilerEntry> entries;
+    struct {
+        std::string path, events;
+        int frameCnt;           // frames left to capture
+    } trace;
+} g_profiler;
+
+static double now()
+{
+    std::chrono::duration<double, std::micro> dt =
+        std::chrono::steady_clock::now() - g_profiler.epoch;
+
+    return dt.count();
+}
+
+// -----------------------------------------------------------------------------
+// Chrome trace events
+
+static void appendTraceEvent(const char *name, int tid, double ts, double dur)
+{
+    char buf[256];
+
+    snprintf(buf, sizeof(buf),
+             ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,"
+             "\"ts\":%.3f,\"dur\":%.3f}",
+             name, tid, ts, dur);
+    g_profiler.trace.events+= buf;
+}
+
+static void writeTrace()
+{
+    FILE *pf = fopen(g_profiler.trace.path.c_str(), "w");
+
+    if (!pf) {
+        LOG("profiler_error: failed to open %s\n", g_profiler.trace.path.c_str());
+    } else {
+        fprintf(pf, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                    "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                    "\"args\":{\"name\":\"CPU\"}},\n"
+                    "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+                    "\"args\":{\"name\":\"GPU\"}}");
+        fputs(g_profiler.trace.events.c_str(), pf);
+        fprintf(pf, "\n]}\n");
+        fclose(pf);
+        LOG("Note: trace saved to %s\n", g_profiler.trace.path.c_str());
+    }
+    g_profiler.trace.events.clear();
+    g_profiler.trace.frameCnt = 0;
+}
+
+// -----------------------------------------------------------------------------
+// Readbacks
+
+// reads the queries of a frame back into the entries (and the trace)
+static void resolveFrame(ProfilerFrame *frame)
+{
+    bool capture = g_profiler.trace.frameCnt > 0;
+
+    g_profiler.entries.resize(frame->scopeCnt);
+    for (int i = 0; i < frame->scopeCnt; ++i) {
+        const ProfilerScope *scope = &frame->scopes[i];
+        ProfilerEntry *entry = &g_profiler.entries[i];
+        GLuint64 t0, t1;
+
+        glGetQueryObjectui64v(frame->queries[2 * i    ], GL_QUERY_RESULT, &t0);
+        glGetQueryObjectui64v(frame->queries[2 * i + 1], GL_QUERY_RESULT, &t1);
+        entry->name = scope->name;
+        entry->depth = scope->depth;
+        entry->cpu = (scope->cpuEnd - scope->cpuBegin) / 1e3;
+        entry->gpu = (double)(t1 - t0) / 1e6;
+
+        if (capture) {
+            // the GPU scopes are placed on the CPU timeline from the
+            // calibration done at the beginning of the frame
+            double gpuBegin = frame->cpuRef + ((GLint64)t0 - frame->gpuRef) / 1e3;
+
+            appendTraceEvent(scope->name, 1, scope->cpuBegin,
+                             scope->cpuEnd - scope->cpuBegin);
+            appendTraceEvent(scope->name, 2, gpuBegin, entry->gpu * 1e3);
+        }
+    }
+
+    if (capture && --g_profiler.trace.frameCnt == 0)
+        writeTrace();
+}
+
+// resolves the ended frames whose queries are available, in order, without
+// blocking (the GPU executes the queries of a frame in order, so the last
+// one signals the whole frame)
+static void resolveFrames()
+{
+    while (g_profiler.resolvedCnt < g_profiler.frameCnt) {
+        int id = g_profiler.resolvedCnt % PROFILER_FRAME_CNT;
+        ProfilerFrame *frame = &g_profiler.frames[id];
+        GLint available = 0;
+
+        if (frame->pending) {
+            // the frame scope is the last one closed
+            glGetQueryObjectiv(frame->queries[1],
+                               GL_QUERY_RESULT_AVAILABLE,
+                               &available);
+            if (!available)
+                return;
+            resolveFrame(frame);
+            frame->pending = false;
+        }
+        ++g_profiler.resolvedCnt;
+    }
+}
+
+// -----------------------------------------------------------------------------
+bool profilerInit()
+{
+    if (g_profiler.running)
+        profilerShutdown();
+
+    LOG("Loading {Profiler}\n");
+    g_profiler.epoch = std::chrono::steady_clock::now();
+    g_profiler.inFrame = false;
+    g_profiler.frameCnt = 0;
+    g_profiler.resolvedCnt = 0;
+    g_profiler.stackSize = 0;
+    g_profiler.entries.clear();
+    g_profiler.trace.frameCnt = 0;
+    g_profiler.trace.events.clear();
+
+    for (int i = 0; i < PROFILER_FRAME_CNT; ++i) {
+        ProfilerFrame *frame = &g_profiler.frames[i];
+
+        glGenQueries(2 * PROFILER_SCOPE_CNT, frame->queries);
+        frame->scopeCnt = 0;
+        frame->pending = false;
+    }
+    if (glGetError() != GL_NO_ERROR) {
+        LOG("profiler_error: failed to create the timestamp queries\n");
+        g_profiler.running = true;
+        profilerShutdown();
+        return false;
+    }
+    g_profiler.running = true;
+
+    return true;
+}
+
+void profilerShutdown()
+{
+    if (!g_profiler.running)
+        return;
+
+    if (g_profiler.trace.frameCnt > 0)
+        writeTrace();
+    for (int i = 0; i < PROFILER_FRAME_CNT; ++i)
+        glDeleteQueries(2 * PROFILER_SCOPE_CNT, g_profiler.frames[i].queries);
+    g_profiler.running = false;
+}
+
+// -----------------------------------------------------------------------------
+void profilerBeginFrame()
+{
+    if (!g_profiler.running || g_profiler.inFrame)
+        return;
+
+    int id = g_profiler.frameCnt % PROFILER_FRAME_CNT;
+    ProfilerFrame *frame = &g_profiler.frames[id];
+
+    resolveFrames();
+
+    // the slot is still in flight: drop its results rather than wait
+    if (frame->pending) {
+        frame->pending = false;
+        ++g_profiler.resolvedCnt;
+    }
+
+    frame->scopeCnt = 0;
+    glGetInteger64v(GL_TIMESTAMP, &frame->gpuRef);
+    frame->cpuRef = now();
+    g_profiler.inFrame = true;
+    profilerPush("Frame");
+}
+
+void profilerEndFrame()
+{
+    if (!g_profiler.running || !g_profiler.inFrame)
+        return;
+
+    ProfilerFrame *frame = &g_profiler.frames[g_profiler.frameCnt % PROFILER_FRAME_CNT];
+
+    // close the scopes left open, and the frame
+    while (g_profiler.stackSize > 0)
+        profilerPop();
+    frame->pending = true;
+    g_profiler.inFrame = false;
+    ++g_profiler.frameCnt;
+}
+
+void profilerPush(const char *name)
+{
+    if (!g_profiler.inFrame || g_profiler.stackSize == PROFILER_SCOPE_CNT)
+        return;
+
+    ProfilerFrame *frame = &g_profiler.frames[g_profiler.frameCnt % PROFILER_FRAME_CNT];
+    int id = -1; // scopes past the capacity of the frame are not recorded
+
+    if (frame->scopeCnt < PROFILER_SCOPE_CNT) {
+        ProfilerScope *scope = &frame->scopes[frame->scopeCnt];
+
+        id = frame->scopeCnt++;
+        scope->name = name;
+        scope->depth = g_profiler.stackSize;
+        scope->cpuBegin = now();
+        glQueryCounter(frame->queries[2 * id], GL_TIMESTAMP);
+    }
+    g_profiler.stack[g_profiler.stackSize++] = id;
+}
+
+void profilerPop()
+{
+    if (!g_profiler.inFrame || g_profiler.stackSize == 0)
+        return;
+
+    ProfilerFrame *frame = &g_profiler.frames[g_profiler.frameCnt % PROFILER_FRAME_CNT];
+    int id = g_profiler.stack[--g_profiler.stackSize];
+
+    if (id >= 0) {
+        glQueryCounter(frame->queries[2 * id + 1], GL_TIMESTAMP);
+        frame->scopes[id].cpuEnd = now();
+    }
+}
+
+// -----------------------------------------------------------------------------
+int profilerGetEntryCount()
+{
+    return (int)g_profiler.entries.size();
+}
+
+const ProfilerEntry *profilerGetEntries()
+{
+    return g_profiler.entries.empty() ? NULL : &g_profiler.entries[0];
+}
+
+void profilerCaptureTrace(const char *path, int frameCnt)
+{
+    if (!g_profiler.running || frameCnt <= 0)
+        return;
+
+    g_profiler.trace.path = path;
+    g_profiler.trace.events.clear();
+    g_profiler.trace.frameCnt = frameCnt;
+}
+
+bool profilerIsCapturing()
+{
+    return g_profiler.trace.frameCnt > 0;
+}
@@ -0,0 +1,47 @@
+// Hierarchical CPU/GPU frame profiler
+//
+// Scopes are nested within a frame on the render thread. Each scope records
+// its CPU time, and its GPU time through a pair of GL_TIMESTAMP queries. The
+// queries of the last few frames live in a ring and are only read back once
+// available, so the profiler never stalls the pipeline; the results of a
+// frame are typically available two or three frames later. Frames whose
+// queries are still pending when their slot is reused are dropped.
+//
+// Usage:
+//   profilerInit();
+//   ... once per frame:
+//   profilerBeginFrame();
+//   profilerPush("Scene"); ... profilerPush("LoD"); ... profilerPop(); ...
+//   profilerPop();
+//   profilerEndFrame();
+//   ... profilerGetEntries() holds the breakdown of the last resolved frame
+//   profilerShutdown();
+//
+// profilerCaptureTrace() records the next resolved frames and writes them as
+// Chrome trace events (chrome://tracing or https://ui.perfetto.dev), with
+// the CPU and GPU scopes on two threads of the same timeline.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+struct ProfilerEntry {
+    const char *name;   // the string passed to profilerPush
+    int depth;          // 0 for the frame, 1 for its scopes, etc.
+    double cpu, gpu;    // durations (ms)
+};
+
+bool profilerInit();
+void profilerShutdown();
+void profilerBeginFrame();
+void profilerEndFrame();
+// name must outlive the profiler (a string literal, typically)
+void profilerPush(const char *name);
+void profilerPop();
+// scopes of the last resolved frame, in the order they were opened
+int profilerGetEntryCount();
+const ProfilerEntry *profilerGetEntries();
+// writes the next frameCnt resolved frames to path once they are available
+void profilerCaptureTrace(const char *path, int frameCnt);
+bool profilerIsCapturing();
+
+#endif // PROFILER_H
@@ -0,0 +1,382 @@
+#include "recorder.h"
+
+#include "glad/glad.h"
+#include "stb_image_write.h"
+
+#include <cstdio>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
+#   define dup    _dup
+#   define dup2   _dup2
+#   define fdopen _fdopen
+#else
+#   include <unistd.h>
+#endif
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+// a slot is either free, waiting for its readback to complete on the GPU, or
+// being encoded by a worker
+enum { SLOT_FREE, SLOT_READBACK, SLOT_ENCODING };
+
+struct RecorderSlot {
+    GLuint buffer;
+    GLsync fence;
+    const unsigned char *data;
+    int state, frame;
+};
+
+static struct {
+    bool running;
+    int format, width, height;
+    std::string path;
+    FILE *stream;           // y4m output
+    std::vector<RecorderSlot> slots;
+    int frameCnt;           // frames captured
+    int retiredCnt;         // frames handed to the workers
+    int writtenCnt;         // y4m frames written, in order
+    std::deque<int> jobs;   // slots to encode
+    bool quit;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable cv;
+} g_recorder;
+
+// original stdout, once reserved for y4m streaming
+static int g_stdout = -1;
+
+int recorderParseFormat(const char *name)
+{
+    if (!strcmp(name, "png"))
+        return RECORDER_FORMAT_PNG;
+    if (!strcmp(name, "y4m"))
+        return RECORDER_FORMAT_Y4M;
+
+    return -1;
+}
+
+bool recorderIsRunning()
+{
+    return g_recorder.running;
+}
+
+// -----------------------------------------------------------------------------
+// Encoders (run on the worker threads)
+
+// flips the RGBA readback to RGB rows ordered from top to bottom
+static void packRgb(const unsigned char *rgba, int w, int h, unsigned char *rgb)
+{
+    for (int j = 0; j < h; ++j) {
+        const unsigned char *src = rgba + 4 * w * (h - 1 - j);
+        unsigned char *dst = rgb + 3 * w * j;
+
+        for (int i = 0; i < w; ++i) {
+            dst[3 * i    ] = src[4 * i    ];
+            dst[3 * i + 1] = src[4 * i + 1];
+            dst[3 * i + 2] = src[4 * i + 2];
+        }
+    }
+}
+
+// flips the RGBA readback to planar YUV 4:2:0 (full range BT.601)
+static void packYuv(const unsigned char *rgba, int w, int h, unsigned char *yuv)
+{
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    unsigned char *py = yuv, *pu = yuv + w * h, *pv = pu + cw * ch;
+
+    for (int j = 0; j < h; ++j) {
+        const unsigned char *src = rgba + 4 * w * (h - 1 - j);
+
+        for (int i = 0; i < w; ++i) {
+            int r = src[4 * i], g = src[4 * i + 1], b = src[4 * i + 2];
+
+            py[w * j + i] = (unsigned char)((77 * r + 150 * g + 29 * b + 128) >> 8);
+        }
+    }
+    for (int j = 0; j < ch; ++j)
+    for (int i = 0; i < cw; ++i) {
+        int r = 0, g = 0, b = 0, n = 0;
+
+        for (int y = 2 * j; y < 2 * j + 2 && y < h; ++y)
+        for (int x = 2 * i; x < 2 * i + 2 && x < w; ++x) {
+            const unsigned char *src = rgba + 4 * (w * (h - 1 - y) + x);
+
+            r+= src[0]; g+= src[1]; b+= src[2]; ++n;
+        }
+        r/= n; g/= n; b/= n;
+        pu[cw * j + i] = (unsigned char)((-43 * r - 85 * g + 128 * b + 32896) >> 8);
+        pv[cw * j + i] = (unsigned char)((128 * r - 107 * g - 21 * b + 32896) >> 8);
+    }
+}
+
+static void releaseSlot(RecorderSlot *slot)
+{
+    std::lock_guard<std::mutex> lock(g_recorder.mutex);
+
+    slot->state = SLOT_FREE;
+    g_recorder.cv.notify_all();
+}
+
+static void worker()
+{
+    int w = g_recorder.width, h = g_recorder.height;
+    std::vector<unsigned char> buffer;
+
+    for (;;) {
+        RecorderSlot *slot;
+        int frame;
+
+        {
+            std::unique_lock<std::mutex> lock(g_recorder.mutex);
+
+            g_recorder.cv.wait(lock, [] {
+                return g_recorder.quit || !g_recorder.jobs.empty();
+            });
+            if (g_recorder.jobs.empty())
+                return;
+            slot = &g_recorder.slots[g_recorder.jobs.front()];
+            frame = slot->frame;
+            g_recorder.jobs.pop_front();
+        }
+
+        if (g_recorder.format == RECORDER_FORMAT_PNG) {
+            char name[32];
+
+            buffer.resize(3 * w * h);
+            packRgb(slot->data, w, h, &buffer[0]);
+            releaseSlot(slot);
+            snprintf(name, sizeof(name), "%09i.png", frame);
+            if (!stbi_write_png((g_recorder.path + name).c_str(),
+                                w, h, 3, &buffer[0], 3 * w)) {
+                LOG("recorder_error: failed to write frame %i\n", frame);
+            }
+        } else {
+            int cw = (w + 1) / 2, ch = (h + 1) / 2;
+
+            buffer.resize(w * h + 2 * cw * ch);
+            packYuv(slot->data, w, h, &buffer[0]);
+            releaseSlot(slot);
+
+            // frames are written in capture order; the turn is taken under
+            // the lock, but the write is not, so that the other workers and
+            // the render thread (see releaseSlot and retire) don't stall on I/O
+            std::unique_lock<std::mutex> lock(g_recorder.mutex);
+            g_recorder.cv.wait(lock, [frame] {
+                return g_recorder.writtenCnt == frame;
+            });
+            lock.unlock();
+            fputs("FRAME\n", g_recorder.stream);
+            fwrite(&buffer[0], 1, buffer.size(), g_recorder.stream);
+            lock.lock();
+            ++g_recorder.writtenCnt;
+            g_recorder.cv.notify_all();
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Readbacks (run on the render thread)
+
+// hands the completed readbacks to the workers, in capture order; blocks
+// until at least minCnt frames have been handed over
+static void retire(int minCnt)
+{
+    while (g_recorder.retiredCnt < g_recorder.frameCnt) {
+        int slotCnt = (int)g_recorder.slots.size();
+        int id = g_recorder.retiredCnt % slotCnt;
+        RecorderSlot *slot = &g_recorder.slots[id];
+        bool block = g_recorder.retiredCnt < minCnt;
+        GLuint64 timeout = block ? 1000000000u : 0u;
+        GLenum status = glClientWaitSync(slot->fence,
+                                         GL_SYNC_FLUSH_COMMANDS_BIT,
+                                         timeout);
+
+        if (status == GL_WAIT_FAILED) {
+            LOG("recorder_error: glClientWaitSync failed\n");
+            return;
+        } else if (status == GL_TIMEOUT_EXPIRED) {
+            if (block) // keep waiting: the frame must not be lost
+                continue;
+            return;
+        }
+        glDeleteSync(slot->fence);
+        slot->fence = 0;
+
+        std::lock_guard<std::mutex> lock(g_recorder.mutex);
+        slot->state = SLOT_ENCODING;
+        g_recorder.jobs.push_back(id);
+        g_recorder.cv.notify_all();
+        ++g_recorder.retiredCnt;
+    }
+}
+
+void recorderCapture(unsigned int framebuffer)
+{
+    if (!g_recorder.running)
+        return;
+
+    int slotCnt = (int)g_recorder.slots.size();
+    RecorderSlot *slot = &g_recorder.slots[g_recorder.frameCnt % slotCnt];
+
+    retire(0);
+
+    // the ring is full: wait for the readback, then for the encoder
+    if (slot->fence)
+        retire(slot->frame + 1);
+    {
+        std::unique_lock<std::mutex> lock(g_recorder.mutex);
+
+        g_recorder.cv.wait(lock, [slot] {
+            return slot->state == SLOT_FREE;
+        });
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, g_recorder.width, g_recorder.height,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->frame = g_recorder.frameCnt++;
+    slot->state = SLOT_READBACK;
+}
+
+// -----------------------------------------------------------------------------
+void recorderReserveStdout()
+{
+    if (g_stdout >= 0)
+        return;
+    fflush(stdout);
+    g_stdout = dup(1);
+    dup2(2, 1); // logs go to stderr from now on
+#ifdef _WIN32
+    _setmode(g_stdout, _O_BINARY);
+#endif
+}
+
+static bool openStream(const char *path)
+{
+    if (!strcmp(path, "-")) {
+        recorderReserveStdout();
+        g_recorder.stream = fdopen(dup(g_stdout), "wb");
+    } else {
+        g_recorder.stream = fopen(path, "wb");
+    }
+    if (!g_recorder.stream) {
+        LOG("recorder_error: failed to open %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+static void closeStream()
+{
+    if (!g_recorder.stream)
+        return;
+    fclose(g_recorder.stream);
+    g_recorder.stream = NULL;
+}
+
+bool recorderInit(int format, int width, int height, int fps, const char *path)
+{
+    int workerCnt = (int)std::thread::hardware_concurrency() - 1;
+    GLsizeiptr size = 4 * (GLsizeiptr)width * height;
+    GLbitfield flags = GL_MAP_READ_BIT
+                     | GL_MAP_PERSISTENT_BIT
+                     | GL_MAP_COHERENT_BIT;
+
+    if (g_recorder.running)
+        recorderShutdown();
+    if (workerCnt < 1) workerCnt = 1;
+
+    LOG("Loading {Recorder}\n");
+    g_recorder.format = format;
+    g_recorder.width = width;
+    g_recorder.height = height;
+    g_recorder.path = path;
+    g_recorder.stream = NULL;
+    g_recorder.frameCnt = 0;
+    g_recorder.retiredCnt = 0;
+    g_recorder.writtenCnt = 0;
+    g_recorder.jobs.clear();
+    g_recorder.quit = false;
+
+    if (format == RECORDER_FORMAT_Y4M) {
+        if (!openStream(path))
+            return false;
+        fprintf(g_recorder.stream,
+                "YUV4MPEG2 W%i H%i F%i:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+                width, height, fps);
+    }
+
+    // one buffer per worker, plus a few frames in flight on the GPU
+    g_recorder.slots.resize(workerCnt + 3);
+    for (int i = 0; i < (int)g_recorder.slots.size(); ++i) {
+        RecorderSlot *slot = &g_recorder.slots[i];
+
+        glGenBuffers(1, &slot->buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+        glBufferStorage(GL_PIXEL_PACK_BUFFER, size, NULL, flags);
+        slot->data = (const unsigned char *)
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+        slot->fence = 0;
+        slot->state = SLOT_FREE;
+        slot->frame = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (glGetError() != GL_NO_ERROR) {
+        LOG("recorder_error: failed to map the pixel-pack buffers\n");
+        g_recorder.running = true;
+        recorderShutdown();
+        return false;
+    }
+
+    for (int i = 0; i < workerCnt; ++i)
+        g_recorder.workers.push_back(std::thread(worker));
+    g_recorder.running = true;
+
+    return true;
+}
+
+void recorderShutdown()
+{
+    if (!g_recorder.running)
+        return;
+
+    retire(g_recorder.frameCnt);
+    {
+        std::lock_guard<std::mutex> lock(g_recorder.mutex);
+        g_recorder.quit = true;
+        g_recorder.cv.notify_all();
+    }
+    for (int i = 0; i < (int)g_recorder.workers.size(); ++i)
+        g_recorder.workers[i].join();
+    g_recorder.workers.clear();
+
+    for (int i = 0; i < (int)g_recorder.slots.size(); ++i) {
+        RecorderSlot *slot = &g_recorder.slots[i];
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+        if (slot->data)
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glDeleteBuffers(1, &slot->buffer);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    g_recorder.slots.clear();
+    closeStream();
+    LOG("Note: recorded %i frames\n", g_recorder.frameCnt);
+    g_recorder.running = false;
+}
+
@@ -0,0 +1,41 @@
+// Asynchronous frame recorder
+//
+// Captures the first color attachment of a framebuffer without stalling the
+// render loop: each capture is a glReadPixels into one of a ring of
+// persistently mapped pixel-pack buffers, followed by a fence. Frames whose
+// fence has signaled are handed to a pool of worker threads that either
+// encode them to PNG (through stb_image_write, whose implementation is
+// expected in the application) or convert them to YUV 4:2:0 and stream them
+// as y4m, e.g., to stdout for piping into an encoder. The render thread only
+// blocks when all buffers are still being encoded.
+//
+// Usage:
+//   recorderInit(RECORDER_FORMAT_PNG, w, h, 60, "path/capture_00_");
+//   ... once per frame: recorderCapture(framebuffer);
+//   recorderShutdown(); // flushes pending frames
+//
+// When streaming y4m to stdout ("-"), the original stdout is kept for the
+// stream and file descriptor 1 is redirected to stderr, so that log messages
+// do not corrupt it; call recorderReserveStdout() at startup to redirect the
+// messages printed before the recording starts as well.
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+enum { RECORDER_FORMAT_PNG, RECORDER_FORMAT_Y4M };
+
+// returns the format named "png" or "y4m", -1 otherwise
+int recorderParseFormat(const char *name);
+// starts a recording; for PNG, path is a prefix to which the frame number and
+// extension are appended, for y4m it is the output file ("-" for stdout)
+bool recorderInit(int format, int width, int height, int fps, const char *path);
+bool recorderIsRunning();
+// queues a capture of the color attachment 0 of a framebuffer (0 for the
+// window backbuffer)
+void recorderCapture(unsigned int framebuffer);
+// waits for all queued frames to be written
+void recorderShutdown();
+void recorderReserveStdout();
+
+#endif // RECORDER_H
+
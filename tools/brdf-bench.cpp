@@ -0,0 +1,441 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// BRDF Benchmark Tool
+//
+// Measures the single-threaded eval, sample and pdf throughput of the BRDFs
+// of dj_brdf.h, as well as their construction time and the peak heap memory
+// of their construction. Results are written as JSON and can be
+// compared against a previous run to catch performance regressions.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <new>
+#include <chrono>
+#include <exception>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#define DJ_BRDF_IMPLEMENTATION 1
+#include "dj_brdf.h"
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark Data
+//
+////////////////////////////////////////////////////////////////////////////////
+enum {METRIC_HIGHER_IS_BETTER, METRIC_LOWER_IS_BETTER};
+struct Result {
+    std::string brdf, metric, unit;
+    double value;
+    int order;
+};
+
+struct BenchManager {
+    std::vector<Result> results;
+    std::vector<djb::brdf::io_pair> wiwo;
+    std::vector<djb::vec2> u;
+    double minTime;     // minimum duration of a throughput measurement (s)
+    double sink;        // keeps the compiler from discarding evaluations
+} g_bench = {
+    {}, {}, {}, 0.25, 0.0
+};
+
+// -----------------------------------------------------------------------------
+static double now()
+{
+    using namespace std::chrono;
+
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// -----------------------------------------------------------------------------
+// Heap accounting: the global operator new and delete keep track of the
+// bytes in use and of their high-water mark, on all threads (the fits of
+// dj_brdf run in parallel). Each block is prefixed with its size.
+static std::atomic<long long> g_heapBytes(0), g_heapPeak(0);
+static const size_t HEAP_HEADER = sizeof(std::max_align_t);
+
+void *operator new(size_t size)
+{
+    char *p = (char *)malloc(size + HEAP_HEADER);
+
+    if (!p)
+        throw std::bad_alloc();
+    *(size_t *)p = size;
+
+    long long bytes = g_heapBytes+= (long long)size;
+    long long peak = g_heapPeak;
+    while (bytes > peak && !g_heapPeak.compare_exchange_weak(peak, bytes));
+
+    return p + HEAP_HEADER;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (ptr) {
+        char *p = (char *)ptr - HEAP_HEADER;
+
+        g_heapBytes-= (long long)*(size_t *)p;
+        free(p);
+    }
+}
+
+// -----------------------------------------------------------------------------
+static void
+pushResult(const char *brdf, const char *metric, double value,
+           const char *unit, int order)
+{
+    Result r = {brdf, metric, unit, value, order};
+
+    g_bench.results.push_back(r);
+    LOG("   %-8s %-16s %12.3f %s\n", brdf, metric, value, unit);
+}
+
+// -----------------------------------------------------------------------------
+// Generate the (fixed) set of directions and random numbers
+static void loadInputs(int cnt)
+{
+    uint32_t state = 0x9e3779b9u;
+    auto rnd = [&]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+    auto hemisphere = [&]() {
+        float u1 = rnd(), u2 = rnd();
+        float r = sqrt(u1), phi = 2 * 3.14159265f * u2;
+
+        return djb::vec3(r * cos(phi), r * sin(phi), sqrt(1 - u1));
+    };
+
+    g_bench.wiwo.resize(cnt);
+    g_bench.u.resize(cnt);
+    for (int i = 0; i < cnt; ++i) {
+        g_bench.wiwo[i].first = hemisphere();
+        g_bench.wiwo[i].second = hemisphere();
+        g_bench.u[i] = djb::vec2(rnd(), rnd());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// Run f over the inputs until minTime is reached; returns Mcalls/s
+template <typename F>
+static double throughput(const F &f)
+{
+    const int cnt = (int)g_bench.wiwo.size();
+    double start = now(), elapsed;
+    long calls = 0;
+
+    do {
+        for (int i = 0; i < cnt; ++i)
+            f(i);
+        calls+= cnt;
+        elapsed = now() - start;
+    } while (elapsed < g_bench.minTime);
+
+    return calls / elapsed * 1e-6;
+}
+
+static void benchBrdf(const char *name, const djb::brdf &brdf,
+                      const void *args = nullptr)
+{
+    double eval = throughput([&](int i) {
+        const djb::brdf::io_pair &p = g_bench.wiwo[i];
+        g_bench.sink+= brdf.eval(p.first, p.second, args)[0];
+    });
+    double sample = throughput([&](int i) {
+        djb::vec3 wo;
+        g_bench.sink+= brdf.sample(g_bench.u[i], g_bench.wiwo[i].first,
+                                   &wo, nullptr, args)[0];
+    });
+    double pdf = throughput([&](int i) {
+        const djb::brdf::io_pair &p = g_bench.wiwo[i];
+        g_bench.sink+= brdf.pdf(p.first, p.second, args);
+    });
+
+    pushResult(name, "eval", eval, "Mcalls/s", METRIC_HIGHER_IS_BETTER);
+    pushResult(name, "sample", sample, "Mcalls/s", METRIC_HIGHER_IS_BETTER);
+    pushResult(name, "pdf", pdf, "Mcalls/s", METRIC_HIGHER_IS_BETTER);
+}
+
+// -----------------------------------------------------------------------------
+// Construct a BRDF, recording its construction time (best of up to 5 runs
+// within minTime) and its peak memory, i.e., the high-water mark of the heap
+// during its construction, temporaries included, above what was in use
+// before (the previous instance is released first)
+template <typename T, typename F>
+static std::unique_ptr<T> construct(const char *name, const F &f)
+{
+    std::unique_ptr<T> brdf;
+    double ms = 1e30, total = 0;
+    long long peak = 0;
+
+    for (int i = 0; i < 5 && (i == 0 || total < g_bench.minTime); ++i) {
+        brdf.reset();
+
+        long long bytes0 = g_heapBytes;
+        g_heapPeak = bytes0;
+        double start = now();
+
+        brdf.reset(f());
+        double dt = now() - start;
+        ms = std::min(ms, dt * 1e3);
+        total+= dt;
+        peak = std::max(peak, g_heapPeak - bytes0);
+    }
+
+    pushResult(name, "construct", ms, "ms", METRIC_LOWER_IS_BETTER);
+    pushResult(name, "memory", peak / 1048576.0, "MiB", METRIC_LOWER_IS_BETTER);
+
+    return brdf;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// JSON Output and Baseline Comparison
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+static bool writeJson(const char *path)
+{
+    FILE *pf = fopen(path, "w");
+
+    if (!pf) {
+        LOG("djb_error: Failed to open %s\n", path);
+        return false;
+    }
+    fprintf(pf, "{\n");
+    fprintf(pf, "  \"version\": 1,\n");
+    fprintf(pf, "  \"threads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(pf, "  \"results\": [\n");
+    for (int i = 0; i < (int)g_bench.results.size(); ++i) {
+        const Result &r = g_bench.results[i];
+
+        fprintf(pf, "    {\"brdf\": \"%s\", \"metric\": \"%s\", "
+                    "\"value\": %.6g, \"unit\": \"%s\", \"lower_is_better\": %s}%s\n",
+                r.brdf.c_str(), r.metric.c_str(), r.value, r.unit.c_str(),
+                r.order == METRIC_LOWER_IS_BETTER ? "true" : "false",
+                i + 1 < (int)g_bench.results.size() ? "," : "");
+    }
+    fprintf(pf, "  ]\n");
+    fprintf(pf, "}\n");
+    fclose(pf);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Compare against a file written by writeJson; returns the number of metrics
+// that regressed or cannot be compared (missing from the baseline, or with a
+// baseline of zero), or -1 if the file cannot be read or holds no results
+static int compareBaseline(const char *path, double tolerance)
+{
+    FILE *pf = fopen(path, "r");
+    std::vector<Result> baseline;
+    char line[512];
+    int failures = 0;
+
+    if (!pf) {
+        LOG("djb_error: Failed to open %s\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), pf)) {
+        char brdf[64], metric[64];
+        double value;
+
+        if (sscanf(line, " {\"brdf\": \"%63[^\"]\", \"metric\": \"%63[^\"]\", "
+                         "\"value\": %lf", brdf, metric, &value) == 3) {
+            Result r = {brdf, metric, "", value, 0};
+
+            baseline.push_back(r);
+        }
+    }
+    fclose(pf);
+
+    if (baseline.empty()) {
+        LOG("djb_error: No results in %s\n", path);
+        return -1;
+    }
+
+    LOG("Comparing against {%s} (tolerance %.0f%%)\n", path, tolerance * 100);
+    for (int i = 0; i < (int)g_bench.results.size(); ++i) {
+        const Result &r = g_bench.results[i];
+        const Result *base = NULL;
+
+        for (int j = 0; j < (int)baseline.size() && !base; ++j)
+            if (baseline[j].brdf == r.brdf && baseline[j].metric == r.metric)
+                base = &baseline[j];
+
+        if (!base || base->value <= 0) {
+            LOG("   %-8s %-16s %12s -> %12.3f            <= INCOMPARABLE\n",
+                r.brdf.c_str(), r.metric.c_str(), base ? "0" : "missing",
+                r.value);
+            ++failures;
+            continue;
+        }
+
+        double ratio = r.value / base->value;
+        bool regression = r.order == METRIC_HIGHER_IS_BETTER
+                        ? ratio < 1 - tolerance
+                        : ratio > 1 + tolerance;
+
+        LOG("   %-8s %-16s %12.3f -> %12.3f (%+6.1f%%)%s\n",
+            r.brdf.c_str(), r.metric.c_str(), base->value, r.value,
+            (ratio - 1) * 100, regression ? "  <= REGRESSION" : "");
+        failures+= regression;
+    }
+
+    return failures;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Main
+//
+////////////////////////////////////////////////////////////////////////////////
+void usage(const char *app)
+{
+    printf("%s -- dj_brdf benchmarks\n", app);
+    printf("usage: %s --merl file [--utia file] [--npf file] "
+           "[--output path.json] [--baseline path.json] [--tolerance t] "
+           "[--min-time seconds] [--size n]\n", app);
+    printf("  --merl      MERL BRDF (also used to build tab, tab_r, and "
+           "to look up sgd, abc and npf by name)\n");
+    printf("  --baseline  compare with a previous output; the exit code is "
+           "nonzero if a metric regresses by more than the tolerance "
+           "(default 0.1), or is missing or zero in the baseline\n");
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, const char **argv)
+{
+    const char *merlFile = NULL, *utiaFile = NULL, *npfFile = NULL;
+    const char *output = "brdf-bench.json", *baseline = NULL;
+    double tolerance = 0.1;
+    int size = 4096;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--merl", argv[i]) && i + 1 < argc) {
+            merlFile = argv[++i];
+        } else if (!strcmp("--utia", argv[i]) && i + 1 < argc) {
+            utiaFile = argv[++i];
+        } else if (!strcmp("--npf", argv[i]) && i + 1 < argc) {
+            npfFile = argv[++i];
+        } else if (!strcmp("--output", argv[i]) && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!strcmp("--baseline", argv[i]) && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (!strcmp("--tolerance", argv[i]) && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (!strcmp("--min-time", argv[i]) && i + 1 < argc) {
+            g_bench.minTime = atof(argv[++i]);
+        } else if (!strcmp("--size", argv[i]) && i + 1 < argc) {
+            size = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!merlFile || size <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // name of the material (used by sgd, abc and npf)
+    std::string name = merlFile;
+    size_t s = name.find_last_of("/\\");
+    if (s != std::string::npos) name = name.substr(s + 1);
+    name = name.substr(0, name.find_last_of('.'));
+
+    loadInputs(size);
+    try {
+        djb::microfacet::args args = djb::microfacet::args::isotropic(0.3);
+
+        LOG("Benchmarking {analytic}\n");
+        benchBrdf("ggx", djb::ggx(), &args);
+        benchBrdf("beckmann", djb::beckmann(), &args);
+
+        LOG("Benchmarking {merl}\n");
+        std::unique_ptr<djb::merl> merl = construct<djb::merl>("merl", [&]() {
+            return new djb::merl(merlFile);
+        });
+        benchBrdf("merl", *merl);
+
+        LOG("Benchmarking {tab_r}\n");
+        std::unique_ptr<djb::tab_r> tabr = construct<djb::tab_r>("tab_r", [&]() {
+            return new djb::tab_r(*merl, 90);
+        });
+        benchBrdf("tab_r", *tabr);
+
+        LOG("Benchmarking {tab}\n");
+        std::unique_ptr<djb::tab> tab = construct<djb::tab>("tab", [&]() {
+            return new djb::tab(*merl);
+        });
+        benchBrdf("tab", *tab);
+
+        if (utiaFile) {
+            LOG("Benchmarking {utia}\n");
+            std::unique_ptr<djb::utia> utia = construct<djb::utia>("utia", [&]() {
+                return new djb::utia(utiaFile);
+            });
+            benchBrdf("utia", *utia);
+        }
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        LOG("=> Failure <=\n");
+
+        return EXIT_FAILURE;
+    }
+
+    // parametric fits are only available for the materials of the MERL database
+    try {
+        LOG("Benchmarking {sgd}\n");
+        benchBrdf("sgd", djb::sgd(name.c_str()));
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+    }
+    try {
+        LOG("Benchmarking {abc}\n");
+        benchBrdf("abc", djb::abc(name.c_str()));
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+    }
+    if (npfFile) {
+        try {
+            LOG("Benchmarking {npf}\n");
+            benchBrdf("npf", djb::npf(npfFile, name.c_str()));
+        } catch (std::exception& e) {
+            LOG("%s", e.what());
+        }
+    }
+    LOG("(checksum %g)\n", g_bench.sink);
+
+    if (!writeJson(output))
+        return EXIT_FAILURE;
+    LOG("Results written to {%s}\n", output);
+
+    if (baseline) {
+        int regressions = compareBaseline(baseline, tolerance);
+
+        if (regressions < 0) {
+            LOG("=> Failure <=\n");
+            return EXIT_FAILURE;
+        } else if (regressions > 0) {
+            LOG("=> %i regressed or incomparable metric(s) <=\n", regressions);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
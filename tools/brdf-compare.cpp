@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// BRDF Comparison Tool
+//
+// Compares a model against each MERL BRDF given on the command line and
+// prints the RMSE, log-RMSE and relative albedo error with their standard
+// errors (see djb::compare).
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+
+#define DJ_BRDF_IMPLEMENTATION 1
+#include "dj_brdf.h"
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+void usage(const char *app)
+{
+    printf("%s -- BRDF comparison\n", app);
+    printf("usage: %s [--ggx | --beckmann | --tab | --lr rank | --npf] "
+           "[--directions n] [--samples n] merl1 merl2 ...\n", app);
+    printf("  --ggx, --beckmann  microfacet BRDF extracted from the MERL data\n");
+    printf("  --tab              tabulated microfacet BRDF of the MERL data\n");
+    printf("  --lr               low-rank MERL approximation of given rank\n");
+    printf("  --npf              NPF fit of the MERL data\n");
+}
+
+enum {MODEL_GGX, MODEL_BECKMANN, MODEL_TAB, MODEL_LR, MODEL_NPF};
+
+static void logMetric(const char *name,
+                      const djb::brdf::value_type &x,
+                      const djb::brdf::value_type &se)
+{
+    LOG("   %-12s", name);
+    for (int i = 0; i < (int)x.size(); ++i) {
+        LOG(" %.6f (+/- %.6f)", x[i], se[i]);
+    }
+    LOG("\n");
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, const char **argv)
+{
+    int model = MODEL_GGX, rank = 6;
+    int dirCnt = 256, sampleCnt = 256;
+    int cnt = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--ggx", argv[i])) {
+            model = MODEL_GGX;
+        } else if (!strcmp("--beckmann", argv[i])) {
+            model = MODEL_BECKMANN;
+        } else if (!strcmp("--tab", argv[i])) {
+            model = MODEL_TAB;
+        } else if (!strcmp("--npf", argv[i])) {
+            model = MODEL_NPF;
+        } else if (!strcmp("--lr", argv[i]) && i + 1 < argc) {
+            model = MODEL_LR;
+            rank = atoi(argv[++i]);
+        } else if (!strcmp("--directions", argv[i]) && i + 1 < argc) {
+            dirCnt = atoi(argv[++i]);
+        } else if (!strcmp("--samples", argv[i]) && i + 1 < argc) {
+            sampleCnt = atoi(argv[++i]);
+        } else if (!strncmp("-", argv[i], 1)) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--lr", argv[i])
+            || !strcmp("--directions", argv[i])
+            || !strcmp("--samples", argv[i])) {
+            ++i;
+            continue;
+        } else if (!strncmp("-", argv[i], 1)) {
+            continue;
+        }
+
+        try {
+            LOG("Comparing {%s}\n", argv[i]);
+            djb::merl merl(argv[i]);
+            std::unique_ptr<djb::brdf> brdf;
+            djb::microfacet::args args;
+            const void *userArgs = nullptr;
+
+            switch (model) {
+            case MODEL_GGX:
+                args = djb::tab_r::extract_ggx_args(djb::tab_r(merl, 90));
+                brdf.reset(new djb::ggx());
+                userArgs = &args;
+                break;
+            case MODEL_BECKMANN:
+                args = djb::tab_r::extract_beckmann_args(djb::tab_r(merl, 90));
+                brdf.reset(new djb::beckmann());
+                userArgs = &args;
+                break;
+            case MODEL_TAB:
+                brdf.reset(new djb::tab_r(merl, 90));
+                break;
+            case MODEL_LR:
+                brdf.reset(new djb::merl_lr(merl, rank));
+                break;
+            case MODEL_NPF: {
+                const char *tmp = "brdf-compare.npf.tmp";
+                remove(tmp);
+                djb::npf::append(tmp, djb::npf::fit(merl));
+                brdf.reset(new djb::npf(tmp, 0));
+                remove(tmp);
+            } break;
+            }
+
+            djb::comparison cmp = djb::compare(*brdf, merl, dirCnt, sampleCnt,
+                                               userArgs);
+            logMetric("RMSE", cmp.rmse, cmp.rmse_stderr);
+            logMetric("log-RMSE", cmp.log_rmse, cmp.log_rmse_stderr);
+            logMetric("albedo", cmp.albedo_error, cmp.albedo_error_stderr);
+            ++cnt;
+        } catch (std::exception& e) {
+            LOG("%s", e.what());
+            LOG("=> Failure <=\n");
+        }
+    }
+    if (cnt == 0)
+        usage(argv[0]);
+
+    return cnt > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,478 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Envmap Sampling Validation Tool
+//
+// Draws directions with the envmap importance sampling tables of envmap.h
+// (which the sphere shader of demo-merl uses for its light samples) and
+// checks that their histogram matches the density of the tables, that the
+// density returned with each sample agrees with envmapPdf, and that
+// envmapPdf integrates to one over the sphere. By default a synthetic
+// envmap is used (a sky, a small and bright sun, and a black ground);
+// an HDR file can be given instead.
+//
+// The tool also validates the SH projection of envmap.h: projecting each
+// basis function must give the corresponding unit coefficient, and the
+// closed form diffuse shading is compared with a brute-force integration.
+// The time to project a 4096x2048 envmap (the benchmark target) is
+// reported.
+//
+// Last, the cubemap conversion is checked: the faces of a smooth envmap
+// must hold the radiance of their direction (which checks their
+// orientation), and the last level of the mip chain must preserve the
+// integral of the envmap.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "envmap.h"
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+static const double PI = 3.14159265358979323846;
+
+void usage(const char *app)
+{
+    printf("%s -- validation of the envmap importance sampling tables\n", app);
+    printf("usage: %s [--envmap file.hdr] [--samples n] [--bins nu nv] [--threads n] "
+           "[--sh-bench w h]\n", app);
+}
+
+// -----------------------------------------------------------------------------
+// synthetic envmap, first row at the nadir (as uploaded to OpenGL)
+std::vector<float> syntheticEnvmap(int w, int h)
+{
+    std::vector<float> rgb(3 * w * h);
+
+    for (int j = 0; j < h; ++j)
+    for (int i = 0; i < w; ++i) {
+        float *t = &rgb[3 * (j * w + i)];
+        float v = (j + 0.5f) / h, u = (i + 0.5f) / w;
+        float sun = (fabs(u - 0.3f) < 0.01f && fabs(v - 0.8f) < 0.02f) ? 5e3f : 0.0f;
+
+        t[0] = v < 0.4f ? 0.0f : 0.3f * v + sun;
+        t[1] = v < 0.4f ? 0.0f : 0.5f * v + sun;
+        t[2] = v < 0.4f ? 0.0f : 1.0f * v + sun;
+    }
+
+    return rgb;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Chi-Square Test of the Sample Histogram
+ *
+ * The expected probability of each (u, v) bin is the integral of the
+ * piecewise constant density of the tables over the bin; bins with fewer
+ * than 5 expected samples are pooled into a single one. Returns the
+ * statistic divided by the degrees of freedom.
+ */
+double
+chiSquare(const EnvmapSampler *s, const std::vector<double> &histogram,
+          int nu, int nv, double sampleCnt, int *dof)
+{
+    int w = envmapSamplerWidth(s), h = envmapSamplerHeight(s);
+    const float *pdf = envmapTexelPdf(s);
+    std::vector<double> expected(nu * nv, 0.0);
+
+    for (int j = 0; j < h; ++j)
+    for (int i = 0; i < w; ++i) {
+        double p = pdf[j * w + i] / ((double)w * h);
+        double u0 = (double)i / w, u1 = (i + 1.0) / w;
+        double v0 = (double)j / h, v1 = (j + 1.0) / h;
+
+        // spread the texel over the bins it overlaps
+        for (int y = (int)(v0 * nv); y < nv && y < v1 * nv; ++y)
+        for (int x = (int)(u0 * nu); x < nu && x < u1 * nu; ++x) {
+            double du = std::min(u1, (x + 1.0) / nu) - std::max(u0, (double)x / nu);
+            double dv = std::min(v1, (y + 1.0) / nv) - std::max(v0, (double)y / nv);
+
+            if (du > 0.0 && dv > 0.0)
+                expected[y * nu + x]+= p * du * dv * w * h;
+        }
+    }
+
+    double chi2 = 0.0, poolExpected = 0.0, poolObserved = 0.0;
+    (*dof) = -1;
+    for (int k = 0; k < nu * nv; ++k) {
+        double e = expected[k] * sampleCnt, o = histogram[k];
+
+        if (e < 5.0) {
+            poolExpected+= e;
+            poolObserved+= o;
+        } else {
+            chi2+= (o - e) * (o - e) / e;
+            ++(*dof);
+        }
+    }
+    if (poolExpected >= 5.0) {
+        chi2+= (poolObserved - poolExpected) * (poolObserved - poolExpected)
+             / poolExpected;
+        ++(*dof);
+    } else if (poolObserved > 0.0 && poolExpected == 0.0) {
+        return HUGE_VAL; // samples where the density is zero
+    }
+
+    return chi2 / std::max(1, *dof);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * SH Projection of the Basis
+ *
+ * Projects envmaps holding each basis function in turn and returns the
+ * largest deviation from the expected unit coefficient, which checks the
+ * solid angle weights and the orthonormality of the polynomials.
+ */
+double shBasisError(int w, int h, int threadCnt)
+{
+    const int order = 4, coeffCnt = (order + 1) * (order + 1);
+    std::vector<float> Y(coeffCnt * w * h), rgb(3 * w * h);
+    std::vector<float> coeffs(3 * coeffCnt);
+    double error = 0.0;
+
+    for (int j = 0; j < h; ++j)
+    for (int i = 0; i < w; ++i) {
+        double phi = ((i + 0.5) / w - 0.5) * 2.0 * PI;
+        double theta = (1.0 - (j + 0.5) / h) * PI;
+        float dir[3] = {
+            (float)(sin(theta) * sin(phi)),
+            (float)(sin(theta) * cos(phi)),
+            (float)cos(theta)
+        };
+
+        envmapShBasis(order, dir, &Y[coeffCnt * (j * w + i)]);
+    }
+
+    for (int k = 0; k < coeffCnt; ++k) {
+        for (int n = 0; n < w * h; ++n)
+            rgb[3 * n] = rgb[3 * n + 1] = rgb[3 * n + 2] = Y[coeffCnt * n + k];
+        envmapProjectSh(&rgb[0], w, h, order, threadCnt, &coeffs[0]);
+        for (int l = 0; l < 3 * coeffCnt; ++l) {
+            double expected = (l / 3 == k) ? 1.0 : 0.0;
+
+            error = std::max(error, fabs(coeffs[l] - expected));
+        }
+    }
+
+    return error;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * SH Diffuse Shading Error
+ *
+ * Relative error (in luminance) of the closed form radiance reflected by a
+ * white Lambertian surface, compared with a sum over all texels, for a
+ * set of normals. This is the truncation error of the SH, which decreases
+ * with the order but can remain large for very bright and small sources.
+ */
+double
+shDiffuseError(const std::vector<float> &texels, int w, int h, int order,
+               int threadCnt)
+{
+    std::vector<float> coeffs(3 * 25);
+    double error = 0.0, maxValue = 0.0;
+    const int normalCnt = 64;
+
+    envmapProjectSh(&texels[0], w, h, order, threadCnt, &coeffs[0]);
+    envmapShConvolveCosine(order, &coeffs[0]);
+    for (int n = 0; n < normalCnt; ++n) {
+        // normals on a Fibonacci spiral
+        float z = 1.0f - (2.0f * n + 1.0f) / normalCnt;
+        float r = sqrt(std::max(0.0f, 1.0f - z * z));
+        float phi = 2.399963f * n;
+        float nrm[3] = {r * cosf(phi), r * sinf(phi), z}, rgb[3];
+        double sum = 0.0;
+
+        for (int j = 0; j < h; ++j) {
+            double theta = (1.0 - (j + 0.5) / h) * PI;
+            double solidAngle = 2.0 * PI / w
+                              * (cos(PI * (1.0 - (j + 1.0) / h))
+                               - cos(PI * (1.0 - (double)j / h)));
+
+            for (int i = 0; i < w; ++i) {
+                double phi = ((i + 0.5) / w - 0.5) * 2.0 * PI;
+                double c = sin(theta) * sin(phi) * nrm[0]
+                         + sin(theta) * cos(phi) * nrm[1]
+                         + cos(theta) * nrm[2];
+                const float *t = &texels[3 * (j * w + i)];
+                double y = 0.2126 * t[0] + 0.7152 * t[1] + 0.0722 * t[2];
+
+                if (c > 0.0)
+                    sum+= y * c * solidAngle / PI;
+            }
+        }
+        envmapShEval(order, &coeffs[0], nrm, rgb);
+        double y = 0.2126 * rgb[0] + 0.7152 * rgb[1] + 0.0722 * rgb[2];
+
+        error = std::max(error, fabs(y - sum));
+        maxValue = std::max(maxValue, sum);
+    }
+
+    return maxValue > 0.0 ? error / maxValue : 0.0;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Cubemap Orientation
+ *
+ * Converts an envmap whose radiance is dir + 1 and returns the largest
+ * difference between the texels and the radiance of their direction.
+ */
+double cubemapDirectionError(int w, int h, int size, int threadCnt)
+{
+    std::vector<float> rgb(3 * w * h);
+    double error = 0.0;
+
+    for (int j = 0; j < h; ++j)
+    for (int i = 0; i < w; ++i) {
+        double phi = ((i + 0.5) / w - 0.5) * 2.0 * PI;
+        double theta = (1.0 - (j + 0.5) / h) * PI;
+        float *t = &rgb[3 * (j * w + i)];
+
+        t[0] = (float)(sin(theta) * sin(phi) + 1.0);
+        t[1] = (float)(sin(theta) * cos(phi) + 1.0);
+        t[2] = (float)(cos(theta) + 1.0);
+    }
+
+    EnvmapCubemap *cm = envmapCreateCubemap(&rgb[0], w, h, size, threadCnt, NULL);
+    for (int face = 0; face < 6; ++face) {
+        const float *texels = envmapCubemapFace(cm, 0, face, &size);
+
+        for (int j = 0; j < size; ++j)
+        for (int i = 0; i < size; ++i) {
+            // OpenGL cube map face selection, inverted
+            float a = 2.0f * (i + 0.5f) / size - 1.0f;
+            float b = 2.0f * (j + 0.5f) / size - 1.0f;
+            float d[6][3] = {
+                { 1.0f,    -b,    -a}, {-1.0f,    -b,     a},
+                {    a,  1.0f,     b}, {    a, -1.0f,    -b},
+                {    a,    -b,  1.0f}, {   -a,    -b, -1.0f}
+            };
+            float nrm = sqrt(1.0f + a * a + b * b);
+
+            for (int c = 0; c < 3; ++c) {
+                double expected = d[face][c] / nrm + 1.0;
+
+                error = std::max(error, fabs(texels[3 * (j * size + i) + c] - expected));
+            }
+        }
+    }
+    envmapReleaseCubemap(cm);
+
+    return error;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Cubemap Integral
+ *
+ * Relative difference (in luminance) between the integral of the envmap
+ * and that of the last level of its cubemap, whose faces have one texel.
+ */
+double
+cubemapIntegralError(const std::vector<float> &texels, int w, int h,
+                     int threadCnt)
+{
+    EnvmapCubemap *cm = envmapCreateCubemap(&texels[0], w, h, w / 4, threadCnt, NULL);
+    int last = envmapCubemapLevelCount(cm) - 1, size;
+    double expected = 0.0, actual = 0.0;
+
+    for (int j = 0; j < h; ++j) {
+        double solidAngle = 2.0 * PI / w
+                          * (cos(PI * (1.0 - (j + 1.0) / h))
+                           - cos(PI * (1.0 - (double)j / h)));
+
+        for (int i = 0; i < w; ++i) {
+            const float *t = &texels[3 * (j * w + i)];
+
+            expected+= (0.2126 * t[0] + 0.7152 * t[1] + 0.0722 * t[2]) * solidAngle;
+        }
+    }
+    for (int face = 0; face < 6; ++face) {
+        const float *t = envmapCubemapFace(cm, last, face, &size);
+
+        actual+= (0.2126 * t[0] + 0.7152 * t[1] + 0.0722 * t[2]) * 4.0 * PI / 6.0;
+    }
+    envmapReleaseCubemap(cm);
+
+    return fabs(actual - expected) / expected;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, const char **argv)
+{
+    const char *path = NULL;
+    int sampleCnt = 1 << 22, nu = 64, nv = 32;
+    int threadCnt = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<float> texels;
+    int w = 512, h = 256;
+    int benchWidth = 4096, benchHeight = 2048;
+    bool ok = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--envmap", argv[i]) && i + 1 < argc) {
+            path = argv[++i];
+        } else if (!strcmp("--samples", argv[i]) && i + 1 < argc) {
+            sampleCnt = atoi(argv[++i]);
+        } else if (!strcmp("--bins", argv[i]) && i + 2 < argc) {
+            nu = atoi(argv[++i]);
+            nv = atoi(argv[++i]);
+        } else if (!strcmp("--threads", argv[i]) && i + 1 < argc) {
+            threadCnt = atoi(argv[++i]);
+        } else if (!strcmp("--sh-bench", argv[i]) && i + 2 < argc) {
+            benchWidth = atoi(argv[++i]);
+            benchHeight = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (sampleCnt < 1 || nu < 1 || nv < 1 || benchWidth < 1 || benchHeight < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (path) {
+        int c;
+        stbi_set_flip_vertically_on_load(1);
+        float *data = stbi_loadf(path, &w, &h, &c, 3);
+
+        if (!data) {
+            LOG("envmap-check_error: failed to load %s\n", path);
+            return EXIT_FAILURE;
+        }
+        texels.assign(data, data + 3 * w * h);
+        stbi_image_free(data);
+    } else {
+        texels = syntheticEnvmap(w, h);
+    }
+
+    EnvmapSampler *s = envmapCreateSampler(&texels[0], w, h, threadCnt);
+    if (!s)
+        return EXIT_FAILURE;
+
+    // histogram of the samples and consistency of their density
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> U(0.0f, 1.0f);
+    std::vector<double> histogram(nu * nv, 0.0);
+    int mismatchCnt = 0, invalidCnt = 0;
+
+    for (int n = 0; n < sampleCnt; ++n) {
+        float dir[3], pdf;
+
+        envmapSample(s, U(gen), U(gen), dir, &pdf);
+        float len = sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+        if (!(pdf > 0.0f) || fabs(len - 1.0f) > 1e-4f) {
+            ++invalidCnt;
+            continue;
+        }
+        if (fabs(envmapPdf(s, dir) - pdf) > 1e-3f * pdf)
+            ++mismatchCnt;
+
+        double u = atan2((double)dir[0], (double)dir[1]) / PI * 0.5 + 0.5;
+        double v = 1.0 - acos(std::max(-1.0, std::min(1.0, (double)dir[2]))) / PI;
+        int x = std::min(nu - 1, (int)(u * nu));
+        int y = std::min(nv - 1, (int)(v * nv));
+        histogram[y * nu + x]+= 1.0;
+    }
+
+    // integral of the density over the sphere (uniform directions)
+    double sum = 0.0, sum2 = 0.0;
+    for (int n = 0; n < sampleCnt; ++n) {
+        float z = 2.0f * U(gen) - 1.0f, phi = 2.0f * (float)PI * U(gen);
+        float r = sqrt(std::max(0.0f, 1.0f - z * z));
+        float dir[3] = {r * cosf(phi), r * sinf(phi), z};
+        double f = envmapPdf(s, dir) * 4.0 * PI;
+
+        sum+= f;
+        sum2+= f * f;
+    }
+    double mean = sum / sampleCnt;
+    double stderr_ = sqrt(std::max(0.0, sum2 / sampleCnt - mean * mean) / sampleCnt);
+
+    int dof;
+    double chi2 = chiSquare(s, histogram, nu, nv, sampleCnt, &dof);
+
+    LOG("envmap            %ix%i\n", w, h);
+    LOG("samples           %i\n", sampleCnt);
+    LOG("invalid samples   %i\n", invalidCnt);
+    LOG("pdf mismatches    %i\n", mismatchCnt);
+    LOG("chi2 / dof        %.4f (%i dof)\n", chi2, dof);
+    LOG("integral of pdf   %.4f +- %.4f\n", mean, stderr_);
+
+    // the normalized statistic has a standard deviation of sqrt(2 / dof)
+    if (invalidCnt > 0) {
+        LOG("samples with a null density or a non-unit direction\n");
+        ok = false;
+    }
+    if (mismatchCnt > sampleCnt / 10000) {
+        LOG("sample densities disagree with envmapPdf\n");
+        ok = false;
+    }
+    if (chi2 > 1.0 + 5.0 * sqrt(2.0 / std::max(1, dof))) {
+        LOG("histogram does not match the density\n");
+        ok = false;
+    }
+    if (fabs(mean - 1.0) > 5.0 * stderr_ + 1e-3) {
+        LOG("density does not integrate to one\n");
+        ok = false;
+    }
+    envmapReleaseSampler(s);
+
+    // SH projection
+    double basisError = shBasisError(128, 64, threadCnt);
+    LOG("sh basis error    %.2e\n", basisError);
+    for (int order = 2; order <= 4; ++order) {
+        double error = shDiffuseError(texels, w, h, order, threadCnt);
+
+        LOG("sh diffuse error  %.4f (order %i)\n", error, order);
+    }
+    if (basisError > 1e-3) {
+        LOG("SH projection of the basis is not the identity\n");
+        ok = false;
+    }
+
+    std::vector<float> bench = syntheticEnvmap(benchWidth, benchHeight);
+    std::vector<float> coeffs(3 * 25);
+    std::chrono::high_resolution_clock::time_point t0 =
+        std::chrono::high_resolution_clock::now();
+    envmapProjectSh(&bench[0], benchWidth, benchHeight, 4, threadCnt, &coeffs[0]);
+    std::chrono::high_resolution_clock::time_point t1 =
+        std::chrono::high_resolution_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    LOG("sh projection     %.1f ms for %ix%i (order 4, %i threads, %.1f Mtexels/s)\n",
+        ms, benchWidth, benchHeight, threadCnt,
+        (double)benchWidth * benchHeight / ms * 1e-3);
+
+
+    // cubemaps
+    double directionError = cubemapDirectionError(512, 256, 64, threadCnt);
+    double integralError = cubemapIntegralError(texels, w, h, threadCnt);
+    LOG("cubemap error     %.2e\n", directionError);
+    LOG("cubemap integral  %.4f (relative error)\n", integralError);
+    if (directionError > 1e-2) {
+        LOG("cubemap faces do not match the envmap directions\n");
+        ok = false;
+    }
+    if (integralError > 1e-2) {
+        LOG("cubemap does not preserve the integral of the envmap\n");
+        ok = false;
+    }
+
+    LOG("=> %s <=\n", ok ? "Success" : "Failure");
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
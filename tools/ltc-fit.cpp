@@ -0,0 +1,98 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// LTC Fitting Tool
+//
+// Fits Linearly Transformed Cosines to a BRDF for each (theta, roughness) bin
+// and exports the inverse matrices and directional albedo as float16 tables
+// (see djb::ltc::save for the file layout).
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+
+#define DJ_BRDF_IMPLEMENTATION 1
+#include "dj_brdf.h"
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+void usage(const char *app)
+{
+    printf("%s -- LTC table fitting\n", app);
+    printf("usage: %s --output path_to_table "
+           "[--ggx | --beckmann | --merl file | --tab file] "
+           "[--res-theta n] [--res-alpha n] [--samples n]\n", app);
+    printf("  --merl fits the measured data (single roughness, so --res-alpha "
+           "does not apply)\n");
+    printf("  --tab  fits the microfacet NDF extracted from a MERL file; the "
+           "roughness axis scales the measured NDF\n");
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, const char **argv)
+{
+    const char *output = NULL;
+    int resTheta = 64, resAlpha = 64, samples = 32;
+    bool resAlphaSet = false, measured = false;
+    std::unique_ptr<djb::merl> merl;
+    std::unique_ptr<djb::brdf> brdf(new djb::ggx());
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            if (!strcmp("--output", argv[i]) && i + 1 < argc) {
+                output = argv[++i];
+            } else if (!strcmp("--res-theta", argv[i]) && i + 1 < argc) {
+                resTheta = atoi(argv[++i]);
+            } else if (!strcmp("--res-alpha", argv[i]) && i + 1 < argc) {
+                resAlpha = atoi(argv[++i]);
+                resAlphaSet = true;
+            } else if (!strcmp("--samples", argv[i]) && i + 1 < argc) {
+                samples = atoi(argv[++i]);
+            } else if (!strcmp("--ggx", argv[i])) {
+                brdf.reset(new djb::ggx());
+                measured = false;
+            } else if (!strcmp("--beckmann", argv[i])) {
+                brdf.reset(new djb::beckmann());
+                measured = false;
+            } else if (!strcmp("--merl", argv[i]) && i + 1 < argc) {
+                brdf.reset(new djb::merl(argv[++i]));
+                measured = true;
+            } else if (!strcmp("--tab", argv[i]) && i + 1 < argc) {
+                merl.reset(new djb::merl(argv[++i]));
+                brdf.reset(new djb::tab_r(*merl, 90));
+                measured = false;
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        if (!output) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        // the measured data has a single roughness
+        if (measured) {
+            if (resAlphaSet && resAlpha != 1) {
+                LOG("ltc-fit_error: --res-alpha does not apply to --merl\n");
+                return EXIT_FAILURE;
+            }
+            resAlpha = 1;
+        }
+
+        LOG("Fitting {LTC-%ix%i}\n", resAlpha, resTheta);
+        djb::ltc ltc(*brdf, resTheta, resAlpha, samples);
+
+        LOG("Writing {%s}\n", output);
+        ltc.save(output);
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        LOG("=> Failure <=\n");
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,597 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MERL Sphere Reference Renderer
+//
+// Renders the scene of demo-merl (a unit sphere lit by an HDR environment map
+// and shaded with a MERL, NPF or diffuse BRDF) on the CPU, to produce
+// ground-truth images on machines without a GPU and to validate the GLSL
+// integrator. The camera, the envmap lookup and the tone mapping follow the
+// demo (sphere.glsl, background.glsl and viewer.glsl).
+//
+// Each camera sample combines a BRDF sample and an envmap sample (drawn from
+// the tables of envmap.h, as on the GPU) with multiple importance sampling
+// (power heuristic). The image is split into tiles that are distributed over
+// the threads; a thread that runs out of tiles steals from the others.
+// Camera rays are intersected with the sphere four at a time with SSE.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#   define MERL_RENDER_SSE 1
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#define DJ_BRDF_IMPLEMENTATION 1
+#include "dj_brdf.h"
+
+#include "envmap.h"
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+static const float PI = 3.14159265358979f;
+
+////////////////////////////////////////////////////////////////////////////////
+// Render Settings
+//
+////////////////////////////////////////////////////////////////////////////////
+struct RenderManager {
+    int width, height, samplesPerPixel, tileSize, threadCnt;
+    struct {float x, y, z;} cameraPos;   // looks at the origin, z up
+    float fovy;                          // vertical field of view (degrees)
+    float exposure, gamma;               // see viewer.glsl
+    int sampler;
+    const char *output;
+} g_render = {
+    640, 400, 64, 32, 0,
+    {3.0f, 0.0f, 1.2f},
+    55.0f,
+    2.0f, 2.2f,
+    djb::sampler::SOBOL,
+    "render"
+};
+
+// -----------------------------------------------------------------------------
+// Lambertian BRDF with unit albedo (the "diffuse" mode of sphere.glsl)
+class lambert : public djb::brdf_rgb {
+public:
+    djb::brdf::value_type
+    eval(const djb::vec3 &wi, const djb::vec3 &wo, const void * = NULL) const
+    {
+        if (wi.z > 0 && wo.z > 0)
+            return djb::brdf::value_type(wo.z / PI, 3);
+
+        return zero_value();
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Environment Map
+//
+////////////////////////////////////////////////////////////////////////////////
+struct Envmap {
+    int w, h;
+    std::vector<float> texels;  // RGB, first row at the nadir (as on the GPU)
+    EnvmapSampler *sampler;     // importance sampling tables (see envmap.h)
+
+    Envmap(): w(0), h(0), sampler(NULL) {}
+    ~Envmap() {if (sampler) envmapReleaseSampler(sampler);}
+};
+
+static void loadEnvmap(const char *path, Envmap *env)
+{
+    int c;
+
+    stbi_set_flip_vertically_on_load(1);
+    float *data = stbi_loadf(path, &env->w, &env->h, &c, 3);
+
+    if (!data)
+        throw djb::exc("merl-render_error: failed to load %s\n", path);
+    env->texels.assign(data, data + 3 * env->w * env->h);
+    stbi_image_free(data);
+
+    env->sampler = envmapCreateSampler(&env->texels[0], env->w, env->h,
+                                       g_render.threadCnt);
+    if (!env->sampler)
+        throw djb::exc("merl-render_error: failed to build the envmap tables\n");
+}
+
+// bilinear lookup with repeat wrapping, as the GPU does (see evalEnvmap)
+static void evalEnvmap(const Envmap &env, const djb::vec3 &d, float *rgb)
+{
+    double z = std::max(-1.0, std::min(1.0, (double)d.z));
+    float u = (float)atan2(d.x, d.y) / PI * 0.5f + 0.5f;
+    float v = 1.0f - (float)acos(z) / PI;
+    float x = u * env.w - 0.5f, y = v * env.h - 0.5f;
+    int x0 = (int)floor(x), y0 = (int)floor(y);
+    float fx = x - x0, fy = y - y0;
+
+    rgb[0] = rgb[1] = rgb[2] = 0.0f;
+    for (int k = 0; k < 4; ++k) {
+        int i = ((x0 + (k & 1)) % env.w + env.w) % env.w;
+        int j = ((y0 + (k >> 1)) % env.h + env.h) % env.h;
+        float wx = (k & 1) ? fx : 1.0f - fx;
+        float wy = (k >> 1) ? fy : 1.0f - fy;
+        const float *t = &env.texels[3 * (j * env.w + i)];
+
+        rgb[0]+= wx * wy * t[0];
+        rgb[1]+= wx * wy * t[1];
+        rgb[2]+= wx * wy * t[2];
+    }
+}
+
+// solid angle density of the envmap samples
+static float pdfEnvmap(const Envmap &env, const djb::vec3 &d)
+{
+    float dir[3] = {(float)d.x, (float)d.y, (float)d.z};
+
+    return envmapPdf(env.sampler, dir);
+}
+
+static djb::vec3 sampleEnvmap(const Envmap &env, const djb::vec2 &u, float *pdf)
+{
+    float dir[3];
+
+    envmapSample(env.sampler, (float)u.x, (float)u.y, dir, pdf);
+
+    return djb::vec3(dir[0], dir[1], dir[2]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Ray-Sphere Intersection
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+/**
+ * Intersect Four Rays with the Unit Sphere
+ *
+ * The rays share their origin o and have unit directions; t is set to the
+ * distance of the first hit, or to a negative value on a miss.
+ */
+static void
+intersectSphere4(const float o[3],
+                 const float dx[4], const float dy[4], const float dz[4],
+                 float t[4])
+{
+    float c = o[0] * o[0] + o[1] * o[1] + o[2] * o[2] - 1.0f;
+#if MERL_RENDER_SSE
+    __m128 b = _mm_add_ps(_mm_add_ps(
+                   _mm_mul_ps(_mm_set1_ps(o[0]), _mm_loadu_ps(dx)),
+                   _mm_mul_ps(_mm_set1_ps(o[1]), _mm_loadu_ps(dy))),
+                   _mm_mul_ps(_mm_set1_ps(o[2]), _mm_loadu_ps(dz)));
+    __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_set1_ps(c));
+    __m128 hit = _mm_cmpge_ps(disc, _mm_setzero_ps());
+    __m128 d = _mm_sqrt_ps(_mm_max_ps(disc, _mm_setzero_ps()));
+    __m128 t0 = _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), b), d);
+    __m128 t1 = _mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), b), d);
+    // nearest positive root
+    __m128 tn = _mm_or_ps(
+        _mm_and_ps(_mm_cmpgt_ps(t0, _mm_setzero_ps()), t0),
+        _mm_andnot_ps(_mm_cmpgt_ps(t0, _mm_setzero_ps()), t1));
+
+    _mm_storeu_ps(t, _mm_or_ps(_mm_and_ps(hit, tn),
+                               _mm_andnot_ps(hit, _mm_set1_ps(-1.0f))));
+#else
+    for (int k = 0; k < 4; ++k) {
+        float b = o[0] * dx[k] + o[1] * dy[k] + o[2] * dz[k];
+        float disc = b * b - c;
+
+        if (disc >= 0.0f) {
+            float t0 = -b - sqrt(disc);
+
+            t[k] = t0 > 0.0f ? t0 : -b + sqrt(disc);
+        } else {
+            t[k] = -1.0f;
+        }
+    }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Shading
+//
+////////////////////////////////////////////////////////////////////////////////
+struct Scene {
+    Envmap envmap;
+    std::unique_ptr<djb::brdf> brdf;      // evaluated BRDF
+    std::unique_ptr<djb::brdf> sampling;  // BRDF used for importance sampling
+};
+
+// orthonormal basis around a unit normal (Duff et al. 2017)
+static void basis(const djb::vec3 &n, djb::vec3 *t1, djb::vec3 *t2)
+{
+    double s = n.z >= 0.0 ? 1.0 : -1.0;
+    double a = -1.0 / (s + n.z), b = n.x * n.y * a;
+
+    (*t1) = djb::vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+    (*t2) = djb::vec3(b, s + n.y * n.y * a, -n.y);
+}
+
+static djb::vec3
+toWorld(const djb::vec3 &w, const djb::vec3 &t1, const djb::vec3 &t2,
+        const djb::vec3 &n)
+{
+    return t1 * w.x + t2 * w.y + n * w.z;
+}
+
+static djb::vec3
+toLocal(const djb::vec3 &w, const djb::vec3 &t1, const djb::vec3 &t2,
+        const djb::vec3 &n)
+{
+    return djb::vec3(djb::dot(w, t1), djb::dot(w, t2), djb::dot(w, n));
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Radiance Leaving the Sphere at p towards -d
+ *
+ * One BRDF sample and one envmap sample, combined with the power heuristic.
+ */
+static void
+shade(const Scene &scene, const djb::vec3 &p, const djb::vec3 &d,
+      const djb::vec2 &u1, const djb::vec2 &u2, float *rgb)
+{
+    djb::vec3 n = djb::normalize(p), t1, t2;
+
+    basis(n, &t1, &t2);
+    djb::vec3 wo = toLocal(djb::vec3(-d.x, -d.y, -d.z), t1, t2, n);
+
+    rgb[0] = rgb[1] = rgb[2] = 0.0f;
+    if (wo.z <= 0.0)
+        return;
+
+    // BRDF sample
+    {
+        djb::vec3 wi;
+        djb::float_t pdfBrdf;
+
+        scene.sampling->sample(u1, wo, &wi, &pdfBrdf);
+        if (pdfBrdf > 0 && wi.z > 0) {
+            djb::brdf::value_type fr = scene.brdf->eval(wo, wi);
+            djb::vec3 wiWorld = djb::normalize(toWorld(wi, t1, t2, n));
+            float Li[3], pdfEnv = pdfEnvmap(scene.envmap, wiWorld);
+            float w = (float)(pdfBrdf * pdfBrdf
+                    / (pdfBrdf * pdfBrdf + pdfEnv * pdfEnv));
+
+            evalEnvmap(scene.envmap, wiWorld, Li);
+            for (int c = 0; c < 3; ++c)
+                rgb[c]+= Li[c] * (float)(fr[c % fr.size()] / pdfBrdf) * w;
+        }
+    }
+
+    // envmap sample
+    {
+        float pdfEnv;
+        djb::vec3 wiWorld = sampleEnvmap(scene.envmap, u2, &pdfEnv);
+        djb::vec3 wi = toLocal(wiWorld, t1, t2, n);
+
+        if (pdfEnv > 0.0f && wi.z > 0) {
+            djb::brdf::value_type fr = scene.brdf->eval(wo, wi);
+            float pdfBrdf = (float)scene.sampling->pdf(wo, wi);
+            float Li[3];
+            float w = pdfEnv * pdfEnv / (pdfBrdf * pdfBrdf + pdfEnv * pdfEnv);
+
+            evalEnvmap(scene.envmap, wiWorld, Li);
+            for (int c = 0; c < 3; ++c)
+                rgb[c]+= Li[c] * (float)fr[c % fr.size()] / pdfEnv * w;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tile Scheduling
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+/**
+ * Work-Stealing Tile Queues
+ *
+ * Each thread starts with a contiguous range of tiles, which it consumes
+ * from the front; once empty, it steals from the back of the range with the
+ * most remaining tiles. Tiles are coarse, so each range is simply guarded
+ * by a mutex.
+ */
+struct TileQueue {
+    std::mutex mutex;
+    int begin, end;
+};
+
+static int popTile(std::vector<TileQueue> &queues, int self, int *steals)
+{
+    {
+        std::lock_guard<std::mutex> lock(queues[self].mutex);
+
+        if (queues[self].begin < queues[self].end)
+            return queues[self].begin++;
+    }
+    for (;;) {
+        int victim = -1, remaining = 0;
+
+        for (int i = 0; i < (int)queues.size(); ++i) {
+            std::lock_guard<std::mutex> lock(queues[i].mutex);
+            int cnt = queues[i].end - queues[i].begin;
+
+            if (cnt > remaining) {
+                remaining = cnt;
+                victim = i;
+            }
+        }
+        if (victim < 0)
+            return -1;
+
+        std::lock_guard<std::mutex> lock(queues[victim].mutex);
+        if (queues[victim].begin < queues[victim].end) {
+            ++(*steals);
+            return --queues[victim].end;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Render a Tile
+ *
+ * Pixels are processed in groups of four along the rows so that their
+ * camera rays can be intersected together. The samples of a pixel come from
+ * three djb::sampler streams seeded by the pixel coordinates (pixel
+ * position, BRDF sample and envmap sample).
+ */
+static void
+renderTile(const Scene &scene, int tile, float *image)
+{
+    const int w = g_render.width, h = g_render.height, s = g_render.tileSize;
+    const int tilesPerRow = (w + s - 1) / s;
+    const int x0 = (tile % tilesPerRow) * s, y0 = (tile / tilesPerRow) * s;
+    const int x1 = std::min(w, x0 + s), y1 = std::min(h, y0 + s);
+    const float o[3] = {
+        g_render.cameraPos.x, g_render.cameraPos.y, g_render.cameraPos.z
+    };
+    djb::vec3 pos(o[0], o[1], o[2]);
+    djb::vec3 fwd = djb::normalize(djb::vec3(-o[0], -o[1], -o[2]));
+    djb::vec3 right = djb::normalize(djb::cross(fwd, djb::vec3(0, 0, 1)));
+    djb::vec3 up = djb::cross(right, fwd);
+    float tanY = tan(g_render.fovy * PI / 360.0f);
+    float tanX = tanY * w / h;
+
+    for (int y = y0; y < y1; ++y)
+    for (int x = x0; x < x1; x+= 4) {
+        int cnt = std::min(4, x1 - x);
+        float sum[4][3] = {{0}};
+        std::vector<djb::sampler> streams;
+
+        for (int k = 0; k < cnt; ++k) {
+            uint32_t seed = djb::sampler(djb::sampler::RANDOM, y * w + x + k)
+                          .sample(0).x * 4294967295.0;
+
+            for (int dim = 0; dim < 3; ++dim)
+                streams.push_back(djb::sampler(g_render.sampler, seed + dim));
+        }
+
+        for (int i = 0; i < g_render.samplesPerPixel; ++i) {
+            float dx[4], dy[4], dz[4], t[4];
+
+            // camera rays (unused lanes duplicate the last pixel)
+            for (int k = 0; k < 4; ++k) {
+                int kk = std::min(k, cnt - 1);
+                djb::vec2 u = streams[3 * kk].sample(i);
+                float sx = (2.0f * (x + kk + (float)u.x) / w - 1.0f) * tanX;
+                float sy = (1.0f - 2.0f * (y + (float)u.y) / h) * tanY;
+                djb::vec3 d = djb::normalize(fwd + right * sx + up * sy);
+
+                dx[k] = (float)d.x; dy[k] = (float)d.y; dz[k] = (float)d.z;
+            }
+            intersectSphere4(o, dx, dy, dz, t);
+
+            for (int k = 0; k < cnt; ++k) {
+                djb::vec3 d(dx[k], dy[k], dz[k]);
+                float rgb[3];
+
+                if (t[k] > 0.0f) {
+                    shade(scene, pos + d * t[k], d,
+                          streams[3 * k + 1].sample(i),
+                          streams[3 * k + 2].sample(i), rgb);
+                } else {
+                    evalEnvmap(scene.envmap, d, rgb);
+                }
+                for (int c = 0; c < 3; ++c)
+                    sum[k][c]+= rgb[c];
+            }
+        }
+
+        for (int k = 0; k < cnt; ++k)
+        for (int c = 0; c < 3; ++c)
+            image[3 * (y * w + x + k) + c] = sum[k][c] / g_render.samplesPerPixel;
+    }
+}
+
+// -----------------------------------------------------------------------------
+static double now()
+{
+    using namespace std::chrono;
+
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void render(const Scene &scene, std::vector<float> *image)
+{
+    const int s = g_render.tileSize;
+    const int tileCnt = ((g_render.width + s - 1) / s)
+                      * ((g_render.height + s - 1) / s);
+    const int threadCnt = g_render.threadCnt;
+    std::vector<TileQueue> queues(threadCnt);
+    std::vector<std::thread> threads;
+    std::vector<int> steals(threadCnt, 0);
+    double start = now();
+
+    image->assign(3 * g_render.width * g_render.height, 0.0f);
+    for (int i = 0; i < threadCnt; ++i) {
+        queues[i].begin = tileCnt * i / threadCnt;
+        queues[i].end = tileCnt * (i + 1) / threadCnt;
+    }
+    for (int i = 0; i < threadCnt; ++i) {
+        threads.push_back(std::thread([&, i] {
+            int tile;
+
+            while ((tile = popTile(queues, i, &steals[i])) >= 0)
+                renderTile(scene, tile, &(*image)[0]);
+        }));
+    }
+    for (int i = 0; i < threadCnt; ++i)
+        threads[i].join();
+
+    double dt = now() - start;
+    double sampleCnt = (double)g_render.width * g_render.height
+                     * g_render.samplesPerPixel;
+    int stealCnt = 0;
+
+    for (int i = 0; i < threadCnt; ++i)
+        stealCnt+= steals[i];
+    LOG("Note: %i tiles on %i threads (%i stolen) in %.3fs\n",
+        tileCnt, threadCnt, stealCnt, dt);
+    LOG("Note: %.3f Msamples/s\n", sampleCnt / dt * 1e-6);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Write the Radiance (HDR) and the Tone Mapped Image (PNG)
+ *
+ * The tone mapping matches viewer.glsl: exposure, then gamma.
+ */
+static void save(const std::vector<float> &image)
+{
+    const int w = g_render.width, h = g_render.height;
+    std::vector<unsigned char> ldr(3 * w * h);
+    std::string hdrPath = std::string(g_render.output) + ".hdr";
+    std::string pngPath = std::string(g_render.output) + ".png";
+    float scale = exp2(g_render.exposure);
+
+    for (int i = 0; i < 3 * w * h; ++i) {
+        float c = pow(image[i] * scale, 1.0f / g_render.gamma);
+
+        ldr[i] = (unsigned char)(std::min(1.0f, c) * 255.0f + 0.5f);
+    }
+    if (!stbi_write_hdr(hdrPath.c_str(), w, h, 3, &image[0]))
+        throw djb::exc("merl-render_error: failed to write %s\n", hdrPath.c_str());
+    if (!stbi_write_png(pngPath.c_str(), w, h, 3, &ldr[0], 3 * w))
+        throw djb::exc("merl-render_error: failed to write %s\n", pngPath.c_str());
+    LOG("Note: wrote %s and %s\n", hdrPath.c_str(), pngPath.c_str());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void usage(const char *app)
+{
+    printf("%s -- CPU reference renderer for the demo-merl scene\n", app);
+    printf("usage: %s --envmap file.hdr [--merl file | --npf uber.bin name | --diffuse]\n"
+           "       [--size w h] [--spp n] [--tile n] [--threads n]\n"
+           "       [--camera x y z] [--fovy deg] [--exposure e] [--gamma g]\n"
+           "       [--sampler random|sobol|r2] [--output name]\n", app);
+}
+
+int main(int argc, const char **argv)
+{
+    const char *envmap = NULL, *merl = NULL, *npf = NULL, *npfName = NULL;
+    Scene scene;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--envmap", argv[i]) && i + 1 < argc) {
+            envmap = argv[++i];
+        } else if (!strcmp("--merl", argv[i]) && i + 1 < argc) {
+            merl = argv[++i];
+        } else if (!strcmp("--npf", argv[i]) && i + 2 < argc) {
+            npf = argv[++i];
+            npfName = argv[++i];
+        } else if (!strcmp("--diffuse", argv[i])) {
+            merl = npf = NULL;
+        } else if (!strcmp("--size", argv[i]) && i + 2 < argc) {
+            g_render.width = atoi(argv[++i]);
+            g_render.height = atoi(argv[++i]);
+        } else if (!strcmp("--spp", argv[i]) && i + 1 < argc) {
+            g_render.samplesPerPixel = atoi(argv[++i]);
+        } else if (!strcmp("--tile", argv[i]) && i + 1 < argc) {
+            g_render.tileSize = atoi(argv[++i]);
+        } else if (!strcmp("--threads", argv[i]) && i + 1 < argc) {
+            g_render.threadCnt = atoi(argv[++i]);
+        } else if (!strcmp("--camera", argv[i]) && i + 3 < argc) {
+            g_render.cameraPos.x = atof(argv[++i]);
+            g_render.cameraPos.y = atof(argv[++i]);
+            g_render.cameraPos.z = atof(argv[++i]);
+        } else if (!strcmp("--fovy", argv[i]) && i + 1 < argc) {
+            g_render.fovy = atof(argv[++i]);
+        } else if (!strcmp("--exposure", argv[i]) && i + 1 < argc) {
+            g_render.exposure = atof(argv[++i]);
+        } else if (!strcmp("--gamma", argv[i]) && i + 1 < argc) {
+            g_render.gamma = atof(argv[++i]);
+        } else if (!strcmp("--sampler", argv[i]) && i + 1 < argc) {
+            const char *name = argv[++i];
+
+            if (!strcmp("random", name))
+                g_render.sampler = djb::sampler::RANDOM;
+            else if (!strcmp("r2", name))
+                g_render.sampler = djb::sampler::R2;
+            else
+                g_render.sampler = djb::sampler::SOBOL;
+        } else if (!strcmp("--output", argv[i]) && i + 1 < argc) {
+            g_render.output = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!envmap || g_render.width < 1 || g_render.height < 1
+    || g_render.samplesPerPixel < 1 || g_render.tileSize < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (g_render.threadCnt < 1)
+        g_render.threadCnt = std::max(1, (int)std::thread::hardware_concurrency());
+
+    try {
+        LOG("Loading {Envmap}\n");
+        loadEnvmap(envmap, &scene.envmap);
+
+        LOG("Loading {BRDF}\n");
+        if (merl) {
+            djb::merl *fr = new djb::merl(merl);
+
+            scene.brdf.reset(fr);
+            scene.sampling.reset(new djb::tab_r(*fr, 90));
+        } else if (npf) {
+            djb::npf *fr = new djb::npf(npf, npfName);
+
+            scene.brdf.reset(fr);
+            scene.sampling.reset(new djb::tab_r(*fr, 90));
+        } else {
+            scene.brdf.reset(new lambert());
+            scene.sampling.reset(new lambert());
+        }
+
+        std::vector<float> image;
+        LOG("Rendering {%ix%i, %i spp}\n",
+            g_render.width, g_render.height, g_render.samplesPerPixel);
+        render(scene, &image);
+        save(image);
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// NPF Fitting Tool
+//
+// Factorizes MERL BRDFs into the NPF terms (rhoD, rhoS, D, G1, F) and stores
+// them as rows of the uber texture that is loaded by demo-merl. Each row takes
+// 512 RGB texels, so a single texture can hold thousands of materials.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+
+#define DJ_BRDF_IMPLEMENTATION 1
+#include "dj_brdf.h"
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+void usage(const char *app)
+{
+    printf("%s -- NPF uber texture builder\n", app);
+    printf("usage: %s --output path_to_uber_texture [--iterations n] "
+           "merl1 merl2 ...\n", app);
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, const char **argv)
+{
+    const char *output = NULL;
+    int iterations = 32;
+    int cnt = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--output", argv[i]) && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!strcmp("--iterations", argv[i]) && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (!strncmp("-", argv[i], 1)) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!output) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--output", argv[i]) || !strcmp("--iterations", argv[i])) {
+            ++i;
+            continue;
+        }
+
+        try {
+            LOG("Fitting {%s}\n", argv[i]);
+            djb::merl merl(argv[i]);
+            std::vector<djb::vec3> row = djb::npf::fit(merl, iterations);
+            int id = djb::npf::append(output, row);
+
+            LOG("=> NPF row %i\n", id);
+            ++cnt;
+        } catch (std::exception& e) {
+            LOG("%s", e.what());
+            LOG("=> Failure <=\n");
+        }
+    }
+    LOG("%i material(s) written to %s\n", cnt, output);
+
+    return cnt > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
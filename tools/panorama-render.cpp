@@ -0,0 +1,564 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Fisheye / Perspective Panorama Renderer
+//
+// Renders an HDR envmap through the cameras of demo-fisheye on the CPU, to
+// produce wide-angle reference frames from HDR captures in batch. The
+// stereographic mapping (inv and proj) and the perspective alternative are
+// those of demo-fisheye/shaders/background.glsl, and the camera follows the
+// CameraManager of the demo (a field of view, a position and a target).
+//
+// The image is split into tiles that the threads pull from a shared counter.
+// Within a tile, the envmap coordinates of the directions of four pixels
+// are computed at once with SSE (atan2 is replaced by a polynomial accurate
+// to 1e-5 radians, i.e., a hundredth of a texel of an 8K envmap); the texels
+// are then filtered bilinearly or with a Catmull-Rom kernel.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#   define PANORAMA_RENDER_SSE 1
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+static const float PI = 3.14159265358979f;
+
+////////////////////////////////////////////////////////////////////////////////
+// Render Settings
+//
+////////////////////////////////////////////////////////////////////////////////
+enum {FILTER_BILINEAR, FILTER_CUBIC};
+
+// -----------------------------------------------------------------------------
+// Camera Manager (see demo-fisheye)
+struct CameraManager {
+    float fovy;                          // vertical field of view (degrees)
+    struct {float x, y, z;} pos, target; // looks at the target, z up
+    bool fisheye;
+} g_camera = {
+    55.0f,
+    {3.0f, 0.0f, 1.2f}, {0.0f, 0.0f, 0.0f},
+    true
+};
+
+// -----------------------------------------------------------------------------
+// Render Manager
+struct RenderManager {
+    int width, height, supersampling, tileSize, threadCnt;
+    int filter;
+    float exposure, gamma;               // see viewer.glsl
+    const char *output;
+} g_render = {
+    1680, 1050, 1, 32, 0,
+    FILTER_BILINEAR,
+    2.0f, 2.2f,
+    "panorama"
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Environment Map
+//
+////////////////////////////////////////////////////////////////////////////////
+struct Envmap {
+    int w, h;
+    std::vector<float> texels;  // RGB, first row at the nadir (as on the GPU)
+};
+
+static void loadEnvmap(const char *path, Envmap *env)
+{
+    int c;
+
+    stbi_set_flip_vertically_on_load(1);
+    float *data = stbi_loadf(path, &env->w, &env->h, &c, 3);
+
+    if (!data) {
+        std::string msg = std::string("panorama-render_error: failed to load ")
+                        + path + "\n";
+
+        throw std::runtime_error(msg);
+    }
+    env->texels.assign(data, data + 3 * env->w * env->h);
+    stbi_image_free(data);
+}
+
+// repeat along the longitude, clamp along the latitude
+static inline int wrapX(const Envmap &env, int i)
+{
+    i%= env.w;
+
+    return i < 0 ? i + env.w : i;
+}
+
+static inline int clampY(const Envmap &env, int j)
+{
+    return std::max(0, std::min(env.h - 1, j));
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Filter the Envmap at Texel Coordinates (x, y)
+ *
+ * The coordinates are those of the texel centers, i.e., u * w - 0.5. The
+ * cubic filter is the Catmull-Rom spline, whose negative lobes are clamped
+ * so that the radiance never becomes negative around bright sources.
+ */
+static void filterBilinear(const Envmap &env, float x, float y, float *rgb)
+{
+    int x0 = (int)floor(x), y0 = (int)floor(y);
+    float fx = x - x0, fy = y - y0;
+    int i[2] = {wrapX(env, x0), wrapX(env, x0 + 1)};
+    int j[2] = {clampY(env, y0), clampY(env, y0 + 1)};
+
+    rgb[0] = rgb[1] = rgb[2] = 0.0f;
+    for (int k = 0; k < 4; ++k) {
+        float wx = (k & 1) ? fx : 1.0f - fx;
+        float wy = (k >> 1) ? fy : 1.0f - fy;
+        const float *t = &env.texels[3 * (j[k >> 1] * env.w + i[k & 1])];
+
+        rgb[0]+= wx * wy * t[0];
+        rgb[1]+= wx * wy * t[1];
+        rgb[2]+= wx * wy * t[2];
+    }
+}
+
+static void catmullRom(float t, float w[4])
+{
+    float t2 = t * t, t3 = t2 * t;
+
+    w[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+    w[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+    w[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+    w[3] = 0.5f * (t3 - t2);
+}
+
+static void filterCubic(const Envmap &env, float x, float y, float *rgb)
+{
+    int x0 = (int)floor(x), y0 = (int)floor(y);
+    float wx[4], wy[4];
+    int i[4], j[4];
+
+    catmullRom(x - x0, wx);
+    catmullRom(y - y0, wy);
+    for (int k = 0; k < 4; ++k) {
+        i[k] = wrapX(env, x0 + k - 1);
+        j[k] = clampY(env, y0 + k - 1);
+    }
+    rgb[0] = rgb[1] = rgb[2] = 0.0f;
+    for (int v = 0; v < 4; ++v)
+    for (int u = 0; u < 4; ++u) {
+        float w = wx[u] * wy[v];
+        const float *t = &env.texels[3 * (j[v] * env.w + i[u])];
+
+        rgb[0]+= w * t[0];
+        rgb[1]+= w * t[1];
+        rgb[2]+= w * t[2];
+    }
+    rgb[0] = std::max(0.0f, rgb[0]);
+    rgb[1] = std::max(0.0f, rgb[1]);
+    rgb[2] = std::max(0.0f, rgb[2]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Camera Mapping
+//
+////////////////////////////////////////////////////////////////////////////////
+struct Frame {
+    float fwd[3], right[3], up[3];
+    float tanX, tanY;
+};
+
+static void normalize(float v[3])
+{
+    float nrm = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+    v[0]/= nrm; v[1]/= nrm; v[2]/= nrm;
+}
+
+static void cross(const float a[3], const float b[3], float c[3])
+{
+    c[0] = a[1] * b[2] - a[2] * b[1];
+    c[1] = a[2] * b[0] - a[0] * b[2];
+    c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Build the Camera Frame
+ *
+ * As in background.glsl, the screen coordinates span tan(fovy / 2) times
+ * the aspect ratio; the perspective mapping doubles them so that both
+ * mappings agree at the center of the image.
+ */
+static Frame cameraFrame()
+{
+    const float zUp[3] = {0.0f, 0.0f, 1.0f};
+    Frame f;
+
+    f.fwd[0] = g_camera.target.x - g_camera.pos.x;
+    f.fwd[1] = g_camera.target.y - g_camera.pos.y;
+    f.fwd[2] = g_camera.target.z - g_camera.pos.z;
+    normalize(f.fwd);
+    cross(f.fwd, zUp, f.right);
+    if (f.right[0] * f.right[0] + f.right[1] * f.right[1] < 1e-12f)
+        throw std::runtime_error("panorama-render_error: the camera looks along z\n");
+    normalize(f.right);
+    cross(f.right, f.fwd, f.up);
+    f.tanY = tan(g_camera.fovy * PI / 360.0f);
+    f.tanX = f.tanY * g_render.width / g_render.height;
+
+    return f;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Map Screen Coordinates to a Camera Direction
+ *
+ * The fisheye mapping is proj(x) = 2 inv(x + e0) - e0, with inv(x) = x / |x|^2,
+ * applied to the point (0, sx, sy); its result has unit length. The
+ * perspective mapping normalizes (1, 2 sx, 2 sy). Components are expressed
+ * in the (forward, right, up) basis of the camera.
+ */
+static void cameraDir(float sx, float sy, float w[3])
+{
+    if (g_camera.fisheye) {
+        float nrm = 1.0f / (1.0f + sx * sx + sy * sy);
+
+        w[0] = 2.0f * nrm - 1.0f;
+        w[1] = 2.0f * sx * nrm;
+        w[2] = 2.0f * sy * nrm;
+    } else {
+        float nrm = 1.0f / sqrt(1.0f + 4.0f * (sx * sx + sy * sy));
+
+        w[0] = nrm;
+        w[1] = 2.0f * sx * nrm;
+        w[2] = 2.0f * sy * nrm;
+    }
+}
+
+#if PANORAMA_RENDER_SSE
+// -----------------------------------------------------------------------------
+/**
+ * Four-Wide atan2
+ *
+ * The arctangent of the ratio of the smallest to the largest magnitude is
+ * approximated with the polynomial 4.4.49 of Abramowitz and Stegun (absolute
+ * error below 1e-5), and the octant is restored with masks.
+ */
+static __m128 atan2_4(__m128 y, __m128 x)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 ax = _mm_andnot_ps(signMask, x), ay = _mm_andnot_ps(signMask, y);
+    __m128 mn = _mm_min_ps(ax, ay), mx = _mm_max_ps(ax, ay);
+    __m128 a = _mm_div_ps(mn, _mm_max_ps(mx, _mm_set1_ps(1e-30f)));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 p = _mm_set1_ps(0.0208351f);
+
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.0851330f));
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(0.1801410f));
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.3302995f));
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(0.9998660f));
+    p = _mm_mul_ps(p, a);
+
+    __m128 swap = _mm_cmpgt_ps(ay, ax);
+    p = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps(PI / 2.0f), p)),
+                  _mm_andnot_ps(swap, p));
+    __m128 neg = _mm_cmplt_ps(x, _mm_setzero_ps());
+    p = _mm_or_ps(_mm_and_ps(neg, _mm_sub_ps(_mm_set1_ps(PI), p)),
+                  _mm_andnot_ps(neg, p));
+
+    return _mm_or_ps(p, _mm_and_ps(signMask, y));
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Envmap Texel Coordinates of Four Camera Directions
+ *
+ * w holds the camera-space components (forward, right, up) of each lane;
+ * the world direction d gives u = atan2(d.x, d.y) / 2pi + 1/2 and
+ * v = 1 - acos(d.z) / pi (see evalEnvmap in background.glsl), and
+ * acos(d.z) is computed as atan2(|d.xy|, d.z).
+ */
+static void
+envmapCoords4(const Envmap &env, const Frame &f,
+              __m128 w0, __m128 w1, __m128 w2, float *x, float *y)
+{
+    __m128 d[3];
+
+    for (int c = 0; c < 3; ++c)
+        d[c] = _mm_add_ps(_mm_add_ps(
+                   _mm_mul_ps(_mm_set1_ps(f.fwd[c]), w0),
+                   _mm_mul_ps(_mm_set1_ps(f.right[c]), w1)),
+                   _mm_mul_ps(_mm_set1_ps(f.up[c]), w2));
+
+    __m128 rxy = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]),
+                                        _mm_mul_ps(d[1], d[1])));
+    __m128 phi = atan2_4(d[0], d[1]);
+    __m128 theta = atan2_4(rxy, d[2]);
+    __m128 u = _mm_add_ps(_mm_mul_ps(phi, _mm_set1_ps(0.5f / PI)),
+                          _mm_set1_ps(0.5f));
+    __m128 v = _mm_sub_ps(_mm_set1_ps(1.0f),
+                          _mm_mul_ps(theta, _mm_set1_ps(1.0f / PI)));
+
+    _mm_storeu_ps(x, _mm_sub_ps(_mm_mul_ps(u, _mm_set1_ps((float)env.w)),
+                                _mm_set1_ps(0.5f)));
+    _mm_storeu_ps(y, _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps((float)env.h)),
+                                _mm_set1_ps(0.5f)));
+}
+#else
+static void
+envmapCoords(const Envmap &env, const Frame &f, const float w[3],
+             float *x, float *y)
+{
+    float d[3];
+
+    for (int c = 0; c < 3; ++c)
+        d[c] = f.fwd[c] * w[0] + f.right[c] * w[1] + f.up[c] * w[2];
+
+    float u = atan2(d[0], d[1]) / PI * 0.5f + 0.5f;
+    float v = 1.0f - atan2(sqrt(d[0] * d[0] + d[1] * d[1]), d[2]) / PI;
+
+    (*x) = u * env.w - 0.5f;
+    (*y) = v * env.h - 0.5f;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Rendering
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+/**
+ * Render a Tile
+ *
+ * Each pixel averages n x n stratified subpixels (n is the supersampling
+ * factor); the subpixels of four neighboring pixels along a row are mapped
+ * to the envmap together.
+ */
+static void
+renderTile(const Envmap &env, const Frame &f, int tile, float *image)
+{
+    const int w = g_render.width, h = g_render.height, s = g_render.tileSize;
+    const int n = g_render.supersampling;
+    const int tilesPerRow = (w + s - 1) / s;
+    const int x0 = (tile % tilesPerRow) * s, y0 = (tile / tilesPerRow) * s;
+    const int x1 = std::min(w, x0 + s), y1 = std::min(h, y0 + s);
+    const float scale = 1.0f / (n * n);
+    void (*filter)(const Envmap &, float, float, float *) =
+        g_render.filter == FILTER_CUBIC ? &filterCubic : &filterBilinear;
+
+    for (int y = y0; y < y1; ++y)
+    for (int x = x0; x < x1; x+= 4) {
+        int cnt = std::min(4, x1 - x);
+        float sum[4][3] = {{0}};
+
+        for (int j = 0; j < n; ++j)
+        for (int i = 0; i < n; ++i) {
+            float sy = (1.0f - 2.0f * (y + (j + 0.5f) / n) / h) * f.tanY;
+            float tx[4], ty[4];
+
+            float w0[4], w1[4], w2[4];
+
+            // unused lanes duplicate the last pixel
+            for (int k = 0; k < 4; ++k) {
+                int kk = std::min(k, cnt - 1);
+                float sx = (2.0f * (x + kk + (i + 0.5f) / n) / w - 1.0f) * f.tanX;
+                float dir[3];
+
+                cameraDir(sx, sy, dir);
+                w0[k] = dir[0]; w1[k] = dir[1]; w2[k] = dir[2];
+            }
+#if PANORAMA_RENDER_SSE
+            envmapCoords4(env, f, _mm_loadu_ps(w0), _mm_loadu_ps(w1),
+                          _mm_loadu_ps(w2), tx, ty);
+#else
+            for (int k = 0; k < cnt; ++k) {
+                float dir[3] = {w0[k], w1[k], w2[k]};
+
+                envmapCoords(env, f, dir, &tx[k], &ty[k]);
+            }
+#endif
+            for (int k = 0; k < cnt; ++k) {
+                float rgb[3];
+
+                (*filter)(env, tx[k], ty[k], rgb);
+                sum[k][0]+= rgb[0];
+                sum[k][1]+= rgb[1];
+                sum[k][2]+= rgb[2];
+            }
+        }
+
+        for (int k = 0; k < cnt; ++k)
+        for (int c = 0; c < 3; ++c)
+            image[3 * (y * w + x + k) + c] = sum[k][c] * scale;
+    }
+}
+
+// -----------------------------------------------------------------------------
+static double now()
+{
+    using namespace std::chrono;
+
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void render(const Envmap &env, std::vector<float> *image)
+{
+    const int s = g_render.tileSize;
+    const int tileCnt = ((g_render.width + s - 1) / s)
+                      * ((g_render.height + s - 1) / s);
+    const Frame f = cameraFrame();
+    std::atomic<int> next(0);
+    std::vector<std::thread> threads;
+    double start = now();
+
+    image->assign(3 * g_render.width * g_render.height, 0.0f);
+    for (int i = 0; i < g_render.threadCnt; ++i) {
+        threads.push_back(std::thread([&] {
+            int tile;
+
+            while ((tile = next++) < tileCnt)
+                renderTile(env, f, tile, &(*image)[0]);
+        }));
+    }
+    for (int i = 0; i < (int)threads.size(); ++i)
+        threads[i].join();
+
+    double dt = now() - start;
+    double pixelCnt = (double)g_render.width * g_render.height;
+
+    LOG("Note: %i tiles on %i threads in %.3fs\n",
+        tileCnt, g_render.threadCnt, dt);
+    LOG("Note: %.3f Mpixels/s (%i subpixels per pixel)\n",
+        pixelCnt / dt * 1e-6, g_render.supersampling * g_render.supersampling);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Write the Radiance (HDR) and the Tone Mapped Image (PNG)
+ *
+ * The tone mapping matches viewer.glsl: exposure, then gamma.
+ */
+static void save(const std::vector<float> &image)
+{
+    const int w = g_render.width, h = g_render.height;
+    std::vector<unsigned char> ldr(3 * w * h);
+    std::string hdrPath = std::string(g_render.output) + ".hdr";
+    std::string pngPath = std::string(g_render.output) + ".png";
+    float scale = exp2(g_render.exposure);
+
+    for (int i = 0; i < 3 * w * h; ++i) {
+        float c = pow(image[i] * scale, 1.0f / g_render.gamma);
+
+        ldr[i] = (unsigned char)(std::min(1.0f, c) * 255.0f + 0.5f);
+    }
+    if (!stbi_write_hdr(hdrPath.c_str(), w, h, 3, &image[0]))
+        throw std::runtime_error("panorama-render_error: failed to write "
+                                 + hdrPath + "\n");
+    if (!stbi_write_png(pngPath.c_str(), w, h, 3, &ldr[0], 3 * w))
+        throw std::runtime_error("panorama-render_error: failed to write "
+                                 + pngPath + "\n");
+    LOG("Note: wrote %s and %s\n", hdrPath.c_str(), pngPath.c_str());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void usage(const char *app)
+{
+    printf("%s -- CPU renderer for the cameras of demo-fisheye\n", app);
+    printf("usage: %s --envmap file.hdr [--perspective] [--cubic]\n"
+           "       [--size w h] [--supersampling n] [--tile n] [--threads n]\n"
+           "       [--camera x y z] [--target x y z] [--fovy deg]\n"
+           "       [--exposure e] [--gamma g] [--output name]\n", app);
+}
+
+int main(int argc, const char **argv)
+{
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--envmap", argv[i]) && i + 1 < argc) {
+            path = argv[++i];
+        } else if (!strcmp("--perspective", argv[i])) {
+            g_camera.fisheye = false;
+        } else if (!strcmp("--fisheye", argv[i])) {
+            g_camera.fisheye = true;
+        } else if (!strcmp("--cubic", argv[i])) {
+            g_render.filter = FILTER_CUBIC;
+        } else if (!strcmp("--bilinear", argv[i])) {
+            g_render.filter = FILTER_BILINEAR;
+        } else if (!strcmp("--size", argv[i]) && i + 2 < argc) {
+            g_render.width = atoi(argv[++i]);
+            g_render.height = atoi(argv[++i]);
+        } else if (!strcmp("--supersampling", argv[i]) && i + 1 < argc) {
+            g_render.supersampling = atoi(argv[++i]);
+        } else if (!strcmp("--tile", argv[i]) && i + 1 < argc) {
+            g_render.tileSize = atoi(argv[++i]);
+        } else if (!strcmp("--threads", argv[i]) && i + 1 < argc) {
+            g_render.threadCnt = atoi(argv[++i]);
+        } else if (!strcmp("--camera", argv[i]) && i + 3 < argc) {
+            g_camera.pos.x = atof(argv[++i]);
+            g_camera.pos.y = atof(argv[++i]);
+            g_camera.pos.z = atof(argv[++i]);
+        } else if (!strcmp("--target", argv[i]) && i + 3 < argc) {
+            g_camera.target.x = atof(argv[++i]);
+            g_camera.target.y = atof(argv[++i]);
+            g_camera.target.z = atof(argv[++i]);
+        } else if (!strcmp("--fovy", argv[i]) && i + 1 < argc) {
+            g_camera.fovy = atof(argv[++i]);
+        } else if (!strcmp("--exposure", argv[i]) && i + 1 < argc) {
+            g_render.exposure = atof(argv[++i]);
+        } else if (!strcmp("--gamma", argv[i]) && i + 1 < argc) {
+            g_render.gamma = atof(argv[++i]);
+        } else if (!strcmp("--output", argv[i]) && i + 1 < argc) {
+            g_render.output = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!path || g_render.width < 1 || g_render.height < 1
+    || g_render.supersampling < 1 || g_render.tileSize < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (g_render.threadCnt < 1)
+        g_render.threadCnt = std::max(1, (int)std::thread::hardware_concurrency());
+
+    try {
+        Envmap env;
+        std::vector<float> image;
+
+        LOG("Loading {Envmap}\n");
+        loadEnvmap(path, &env);
+
+        LOG("Rendering {%ix%i, %s, %s}\n",
+            g_render.width, g_render.height,
+            g_camera.fisheye ? "fisheye" : "perspective",
+            g_render.filter == FILTER_CUBIC ? "cubic" : "bilinear");
+        render(env, &image);
+        save(image);
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Pivot Fitting Tool
+//
+// Fits the pivots of the GGX sphere light approximation of pivot.glsl for
+// each (roughness, theta, cap size) bin and exports them as a float16 3D
+// table (see djb::pivot::save for the file layout), which the
+// GGXSphereLightingPivotTable shader looks up with a single fetch. The fit is
+// then compared against reference integrals at random configurations.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <exception>
+
+#define DJ_BRDF_IMPLEMENTATION 1
+#include "dj_brdf.h"
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+static const float PI = 3.14159265358979f;
+
+void usage(const char *app)
+{
+    printf("%s -- pivot table fitting for GGX sphere lights\n", app);
+    printf("usage: %s --output path_to_table "
+           "[--res-alpha n] [--res-theta n] [--res-cap n] "
+           "[--directions n] [--samples n] [--check n]\n", app);
+    printf("  --samples is the number of cap samples per dimension of the "
+           "reference integrals\n");
+    printf("  --check is the number of random configurations of the "
+           "comparison (0 disables it)\n");
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Compare the Table against Reference Integrals
+ *
+ * Configurations are drawn off the grid: the roughness, theta and aperture
+ * are uniform in the table coordinates, and the cap is centered on a
+ * direction sampled from the BRDF. The table is looked up exactly as on the
+ * GPU (float16, trilinear), and the references use four times as many
+ * samples per dimension as the fit. Errors are reported relative to the
+ * RMS of the reference, per roughness range, next to the residual of the fit
+ * at the grid nodes.
+ */
+static void
+check(const djb::ggx &fr, const djb::pivot &table, int configCnt, int sampleCnt)
+{
+    const float ranges[] = {0.0f, 0.1f, 0.3f, 0.6f, 1.0f};
+    const int rangeCnt = 4;
+    double err[rangeCnt] = {0}, ref[rangeCnt] = {0};
+    int cnt[rangeCnt] = {0};
+    double fitErr = 0;
+    djb::sampler rng(djb::sampler::RANDOM, 42);
+
+    for (int i = 0; i < configCnt; ++i) {
+        djb::vec2 u1 = rng.sample(2 * i), u2 = rng.sample(2 * i + 1);
+        float alpha = std::max(1e-3f, (float)(u1.x * u1.x));
+        float zi = std::max(1e-3f, (float)(1.0 - u1.y * u1.y));
+        float zc = 1.0f - std::max(1e-4f, (float)(u2.x * u2.x));
+        djb::microfacet::args args = djb::microfacet::args::isotropic(alpha);
+        djb::vec3 wi(sqrt(1.0f - zi * zi), 0, zi), wo;
+        djb::float_t pdf;
+
+        // rotate the configuration around the normal
+        float phi = 2.0f * PI * (float)u2.y;
+        wi = djb::vec3(wi.x * cos(phi), wi.x * sin(phi), wi.z);
+        fr.sample(djb::sampler(djb::sampler::RANDOM, i).sample(0),
+                  wi, &wo, &pdf, &args);
+        if (!(pdf > 0))
+            continue;
+
+        double r = djb::pivot::integrate(fr, wi, wo, zc, &args, 4 * sampleCnt);
+        double a = table.eval(wi, wo, zc, alpha);
+        int k = 0;
+
+        while (k < rangeCnt - 1 && alpha >= ranges[k + 1] * ranges[k + 1])
+            ++k;
+        err[k]+= (a - r) * (a - r);
+        ref[k]+= r * r;
+        ++cnt[k];
+    }
+
+    for (int a = 0; a < table.get_res_alpha(); ++a)
+    for (int t = 0; t < table.get_res_theta(); ++t)
+    for (int c = 0; c < table.get_res_cap(); ++c)
+        fitErr+= table.get_error(a, t, c);
+    fitErr/= table.get_res_alpha() * table.get_res_theta() * table.get_res_cap();
+
+    LOG("Comparison {%i configurations}\n", configCnt);
+    for (int k = 0; k < rangeCnt; ++k) {
+        if (cnt[k] == 0)
+            continue;
+        LOG("  sqrt(alpha) in [%.1f, %.1f): relative RMSE %.4f (%i configurations)\n",
+            ranges[k], ranges[k + 1],
+            ref[k] > 0 ? sqrt(err[k] / ref[k]) : 0.0, cnt[k]);
+    }
+    LOG("  mean relative RMSE of the fit at the nodes: %.4f\n", fitErr);
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, const char **argv)
+{
+    const char *output = NULL;
+    int resAlpha = 16, resTheta = 16, resCap = 16;
+    int dirCnt = 64, sampleCnt = 16, checkCnt = 1024;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            if (!strcmp("--output", argv[i]) && i + 1 < argc) {
+                output = argv[++i];
+            } else if (!strcmp("--res-alpha", argv[i]) && i + 1 < argc) {
+                resAlpha = atoi(argv[++i]);
+            } else if (!strcmp("--res-theta", argv[i]) && i + 1 < argc) {
+                resTheta = atoi(argv[++i]);
+            } else if (!strcmp("--res-cap", argv[i]) && i + 1 < argc) {
+                resCap = atoi(argv[++i]);
+            } else if (!strcmp("--directions", argv[i]) && i + 1 < argc) {
+                dirCnt = atoi(argv[++i]);
+            } else if (!strcmp("--samples", argv[i]) && i + 1 < argc) {
+                sampleCnt = atoi(argv[++i]);
+            } else if (!strcmp("--check", argv[i]) && i + 1 < argc) {
+                checkCnt = atoi(argv[++i]);
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        if (!output) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        djb::ggx fr;
+
+        LOG("Fitting {Pivot-%ix%ix%i}\n", resAlpha, resTheta, resCap);
+        djb::pivot table(fr, resAlpha, resTheta, resCap, dirCnt, sampleCnt);
+
+        LOG("Writing {%s}\n", output);
+        table.save(output);
+
+        if (checkCnt > 0)
+            check(fr, table, checkCnt, sampleCnt);
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        LOG("=> Failure <=\n");
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
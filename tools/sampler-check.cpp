@@ -0,0 +1,179 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Sampler Validation Tool
+//
+// Measures the L2-star discrepancy of the sample streams of djb::sampler for
+// increasing prefix lengths, averaged over several seeds, and checks that the
+// low-discrepancy streams beat white noise and converge faster than it. Also
+// checks that the GLSL implementation of the streams (sampler.glsl, compiled
+// here as C++) produces the same sequences bit for bit.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <exception>
+
+#define DJ_BRDF_IMPLEMENTATION 1
+#include "dj_brdf.h"
+
+typedef uint32_t uint;
+#include "../demo-merl/shaders/sampler.glsl"
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+#define BUFFER_SIZE(x)    ((int)(sizeof(x)/sizeof(x[0])))
+
+void usage(const char *app)
+{
+    printf("%s -- discrepancy of the djb::sampler streams\n", app);
+    printf("usage: %s [--max-count n] [--seeds n]\n", app);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Mean discrepancy over the seeds for sample counts 16, 32, ..., maxCnt
+ *
+ * The prefixes are taken from the same stream, as the progressive renderers
+ * do when they accumulate passes.
+ */
+std::vector<double>
+discrepancies(int type, int maxCnt, int seedCnt, bool *inRange)
+{
+    std::vector<double> d;
+
+    for (int n = 16; n <= maxCnt; n*= 2) {
+        double sum = 0.0;
+
+        for (int seed = 0; seed < seedCnt; ++seed) {
+            djb::sampler s(type, seed);
+            std::vector<djb::vec2> u(n);
+
+            for (int i = 0; i < n; ++i) {
+                u[i] = s.sample(i);
+                if (u[i].x < 0 || u[i].x >= 1 || u[i].y < 0 || u[i].y >= 1)
+                    *inRange = false;
+            }
+            sum+= djb::l2_star_discrepancy(u);
+        }
+        d.push_back(sum / seedCnt);
+    }
+
+    return d;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Compare the GLSL streams with djb::sampler for the seeds of a few pixels
+ *
+ * The seeds are derived from the pixel coordinates as in sphere.glsl.
+ */
+bool bitExact(int type, int cnt)
+{
+    const uint pixels[][2] = {{0, 0}, {1, 0}, {0, 1}, {511, 287}, {1919, 1079}};
+
+    for (int k = 0; k < BUFFER_SIZE(pixels); ++k) {
+        uint seed = sampler_hash(pixels[k][0] ^ sampler_hash(pixels[k][1]));
+        djb::sampler s(type, seed);
+
+        for (int i = 0; i < cnt; ++i) {
+            djb::vec2 u = s.sample(i);
+            float x = sampler_unit(sampler_bits(type, seed, i, 0));
+            float y = sampler_unit(sampler_bits(type, seed, i, 1));
+
+            if (x != (float)u.x || y != (float)u.y) {
+                LOG("pixel {%u %u} sample %i: {%.9f %.9f} != {%.9f %.9f}\n",
+                    pixels[k][0], pixels[k][1], i, x, y, u.x, u.y);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Least-squares slope of log(discrepancy) against log(n)
+ */
+double convergenceRate(const std::vector<double> &d)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int n = (int)d.size();
+
+    for (int i = 0; i < n; ++i) {
+        double x = log(16.0 * (1 << i)), y = log(d[i]);
+
+        sx+= x; sy+= y; sxx+= x * x; sxy+= x * y;
+    }
+
+    return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, const char **argv)
+{
+    const char *names[] = {"random", "sobol", "r2"};
+    const int types[] = {
+        djb::sampler::RANDOM, djb::sampler::SOBOL, djb::sampler::R2
+    };
+    std::vector<double> d[3];
+    double rate[3];
+    int maxCnt = 4096, seedCnt = 8;
+    bool ok = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp("--max-count", argv[i]) && i + 1 < argc) {
+            maxCnt = atoi(argv[++i]);
+        } else if (!strcmp("--seeds", argv[i]) && i + 1 < argc) {
+            seedCnt = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (maxCnt < 32 || seedCnt < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        for (int i = 0; i < 3; ++i) {
+            bool inRange = true;
+
+            d[i] = discrepancies(types[i], maxCnt, seedCnt, &inRange);
+            rate[i] = convergenceRate(d[i]);
+            if (!inRange) {
+                LOG("%s: samples out of [0, 1)\n", names[i]);
+                ok = false;
+            }
+            if (!bitExact(types[i], maxCnt)) {
+                LOG("%s: GLSL and C++ streams differ\n", names[i]);
+                ok = false;
+            }
+        }
+    } catch (std::exception& e) {
+        LOG("%s", e.what());
+        return EXIT_FAILURE;
+    }
+
+    LOG("%8s %12s %12s %12s\n", "n", names[0], names[1], names[2]);
+    for (int j = 0; j < (int)d[0].size(); ++j) {
+        LOG("%8i %12.6f %12.6f %12.6f\n",
+            16 << j, d[0][j], d[1][j], d[2][j]);
+    }
+    LOG("%8s %12.3f %12.3f %12.3f\n", "rate", rate[0], rate[1], rate[2]);
+
+    // white noise converges in n^-1/2, low-discrepancy streams in ~n^-1
+    for (int i = 1; i < 3; ++i) {
+        if (d[i].back() >= d[0].back() || rate[i] > rate[0] - 0.25) {
+            LOG("%s: no better than white noise\n", names[i]);
+            ok = false;
+        }
+    }
+    LOG("=> %s <=\n", ok ? "Success" : "Failure");
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+